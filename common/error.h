@@ -165,6 +165,15 @@ namespace pdo {
                 ) : Error(PDO_ERR_SYSTEM_BUSY, msg) {}
         }; // class SystemBusyError
 
+        // XXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXX
+        class SessionError : public Error
+        {
+        public:
+            explicit SessionError(
+                const std::string& msg
+                ) : Error(PDO_ERR_SESSION, msg) {}
+        }; // class SessionError
+
         // XXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXX
         class UnknownError : public Error
         {
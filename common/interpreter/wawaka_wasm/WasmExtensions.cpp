@@ -198,7 +198,13 @@ static NativeSymbol native_symbols[] =
     /* Persistent store operations from WasmStateExtensions.h */
     EXPORT_WASM_API_WITH_SIG2(key_value_set,"(i*~*~)i"),
     EXPORT_WASM_API_WITH_SIG2(key_value_get,"(i*~ii)i"),
+    EXPORT_WASM_API_WITH_SIG2(key_value_get_size,"(i*~)i"),
+    EXPORT_WASM_API_WITH_SIG2(key_value_read_into,"(i*~*~i)i"),
     EXPORT_WASM_API_WITH_SIG2(privileged_key_value_get,"(*~ii)i"),
+    EXPORT_WASM_API_WITH_SIG2(key_value_iterate,"(i*~*~iiii)i"),
+    EXPORT_WASM_API_WITH_SIG2(key_value_get_many,"(i*~ii)i"),
+    EXPORT_WASM_API_WITH_SIG2(key_value_set_many,"(i*~)i"),
+    EXPORT_WASM_API_WITH_SIG2(key_value_delete_many,"(i*~)i"),
 
     EXPORT_WASM_API_WITH_SIG2(key_value_create,"(*~)i"),
     EXPORT_WASM_API_WITH_SIG2(key_value_open,"(*~*~)i"),
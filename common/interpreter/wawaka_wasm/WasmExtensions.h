@@ -43,12 +43,53 @@ bool key_value_get(
     uint8_t** val_buffer_pointer,
     size_t* val_length_pointer);
 
+int key_value_get_size(
+    const size_t handle,
+    const uint8_t* key_buffer,
+    const size_t key_buffer_length);
+
+int key_value_read_into(
+    const size_t handle,
+    const uint8_t* key_buffer,
+    const size_t key_buffer_length,
+    uint8_t* val_buffer,
+    const size_t val_buffer_length,
+    const size_t offset);
+
 bool privileged_key_value_get(
     const uint8_t* key_buffer,
     const size_t key_buffer_length,
     uint8_t** val_buffer_pointer,
     size_t* val_length_pointer);
 
+int key_value_iterate(
+    const size_t handle,
+    const uint8_t* prefix_buffer,
+    const size_t prefix_buffer_length,
+    const uint8_t* start_buffer,
+    const size_t start_buffer_length,
+    const bool inclusive,
+    const size_t limit,
+    uint8_t** result_buffer_pointer,
+    size_t* result_length_pointer);
+
+int key_value_get_many(
+    const size_t handle,
+    const uint8_t* keys_buffer,
+    const size_t keys_buffer_length,
+    uint8_t** vals_buffer_pointer,
+    size_t* vals_length_pointer);
+
+bool key_value_set_many(
+    const size_t handle,
+    const uint8_t* pairs_buffer,
+    const size_t pairs_buffer_length);
+
+bool key_value_delete_many(
+    const size_t handle,
+    const uint8_t* keys_buffer,
+    const size_t keys_buffer_length);
+
 int key_value_create(
     const uint8_t* aes_key_buffer,
     const size_t aes_key_buffer_length);
@@ -0,0 +1,271 @@
+/* Copyright 2024 Intel Corporation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <string.h>
+#include <algorithm>
+#include <vector>
+
+#include "error.h"
+#include "log.h"
+#include "types.h"
+
+#include "WasmInstanceSnapshot.h"
+
+namespace pe = pdo::error;
+
+// WASM_INSTANCE_SNAPSHOT is only defined by the build when the WAMR
+// release matches the one whose instance layout this file was written
+// against; with any other release snapshots are refused and the module
+// cache falls back to creating a fresh instance for every invocation
+#ifndef WASM_INSTANCE_SNAPSHOT
+
+// XXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXX
+WasmInstanceSnapshot::WasmInstanceSnapshot(wasm_module_inst_t module_inst)
+{
+    pe::ThrowIf<pe::RuntimeError>(true, "instance snapshots are not supported with this WAMR release");
+}
+
+// XXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXX
+bool WasmInstanceSnapshot::restore(wasm_module_inst_t module_inst) const
+{
+    return false;
+}
+
+#else
+
+extern "C" {
+#include "wasm_runtime.h"
+#include "mem_alloc.h"
+}
+
+// granularity used to skip the (mostly zero) pages of linear memory
+#define SNAPSHOT_PAGE_SIZE 4096
+
+// XXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXX
+static WASMMemoryInstance* get_memory(WASMModuleInstance* inst)
+{
+    if (inst->memory_count == 0)
+        return NULL;
+
+    return inst->memories[0];
+}
+
+// XXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXX
+// The version check in the build cannot tell patched or differently
+// configured runtimes apart; compare the private structures with what
+// the public API reports for the same instance, so that an instance
+// whose layout does not match is never captured or reset
+// XXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXX
+static bool layout_matches(WASMModuleInstance* inst)
+{
+    wasm_module_inst_t module_inst = (wasm_module_inst_t)inst;
+    WASMMemoryInstance* memory = get_memory(inst);
+
+    uint32_t app_start = 0, app_end = 0;
+    bool has_memory = wasm_runtime_get_app_addr_range(module_inst, 0, &app_start, &app_end);
+    if (memory == NULL || memory->memory_data_size == 0)
+        return ! has_memory;
+
+    if (! has_memory || app_start != 0 || app_end != memory->memory_data_size)
+        return false;
+    if (wasm_runtime_addr_app_to_native(module_inst, 0) != memory->memory_data)
+        return false;
+    if (memory->memory_data_end != memory->memory_data + memory->memory_data_size)
+        return false;
+
+    // the app heap, if any, lies within linear memory
+    if (memory->heap_data < memory->memory_data || memory->heap_data > memory->heap_data_end ||
+        memory->heap_data_end > memory->memory_data_end)
+        return false;
+
+    return true;
+}
+
+// XXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXX
+static bool is_zero(const uint8_t* data, size_t size)
+{
+    for (size_t i = 0; i < size; i++)
+        if (data[i] != 0)
+            return false;
+
+    return true;
+}
+
+// XXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXX
+// data.drop and elem.drop record dropped segments in per-instance
+// bitmaps; a fresh instance starts with every segment available
+// XXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXX
+#if WASM_ENABLE_BULK_MEMORY != 0 || WASM_ENABLE_REF_TYPES != 0
+static size_t bitmap_size(const bh_bitmap* bitmap)
+{
+    if (bitmap == NULL)
+        return 0;
+
+    return (bitmap->end_index - bitmap->begin_index + 7) / 8;
+}
+
+static void save_bitmap(const bh_bitmap* bitmap, ByteArray& image)
+{
+    image.assign(bitmap_size(bitmap), 0);
+    if (image.size() > 0)
+        memcpy(image.data(), bitmap->map, image.size());
+}
+
+static bool restore_bitmap(bh_bitmap* bitmap, const ByteArray& image)
+{
+    if (bitmap_size(bitmap) != image.size())
+        return false;
+
+    if (image.size() > 0)
+        memcpy(bitmap->map, image.data(), image.size());
+
+    return true;
+}
+#endif
+
+// XXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXX
+WasmInstanceSnapshot::WasmInstanceSnapshot(wasm_module_inst_t module_inst)
+{
+    WASMModuleInstance* inst = (WASMModuleInstance*)module_inst;
+    pe::ThrowIf<pe::RuntimeError>(
+        inst->module_type != Wasm_Module_Bytecode, "instance snapshots require the wasm interpreter");
+    pe::ThrowIf<pe::RuntimeError>(
+        inst->memory_count > 1, "instance snapshots support a single linear memory");
+    pe::ThrowIf<pe::RuntimeError>(
+        ! layout_matches(inst), "wasm instance layout does not match this WAMR build");
+
+    WASMMemoryInstance* memory = get_memory(inst);
+    if (memory != NULL)
+    {
+        page_count_ = memory->cur_page_count;
+        memory_data_size_ = memory->memory_data_size;
+
+        for (uint32_t offset = 0; offset < memory_data_size_; offset += SNAPSHOT_PAGE_SIZE)
+        {
+            uint32_t length = std::min((uint32_t)SNAPSHOT_PAGE_SIZE, memory_data_size_ - offset);
+            const uint8_t* page = memory->memory_data + offset;
+            if (is_zero(page, length))
+                continue;
+
+            page_index_.push_back(offset / SNAPSHOT_PAGE_SIZE);
+            pages_.insert(pages_.end(), page, page + length);
+        }
+    }
+
+    globals_.assign(inst->global_data, inst->global_data + inst->global_data_size);
+
+    for (uint32_t i = 0; i < inst->table_count; i++)
+    {
+        WASMTableInstance* table = inst->tables[i];
+        const uint8_t* data = (const uint8_t*)table;
+        size_t length = offsetof(WASMTableInstance, elems) + table->max_size * sizeof(table->elems[0]);
+        tables_.push_back(ByteArray(data, data + length));
+    }
+
+#if WASM_ENABLE_BULK_MEMORY != 0
+    save_bitmap(inst->e->common.data_dropped, data_dropped_);
+#endif
+#if WASM_ENABLE_REF_TYPES != 0
+    save_bitmap(inst->e->common.elem_dropped, elem_dropped_);
+#endif
+}
+
+// XXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXX
+bool WasmInstanceSnapshot::restore(wasm_module_inst_t module_inst) const
+{
+    WASMModuleInstance* inst = (WASMModuleInstance*)module_inst;
+    if (! layout_matches(inst))
+        return false;
+
+    WASMMemoryInstance* memory = get_memory(inst);
+
+    // memory.grow may have moved or resized linear memory and the
+    // runtime has no way to shrink it back, give up on the instance
+    if (memory != NULL)
+    {
+        if (memory->cur_page_count != page_count_ || memory->memory_data_size != memory_data_size_)
+            return false;
+    }
+
+    if (inst->global_data_size != globals_.size() || inst->table_count != tables_.size())
+        return false;
+
+#if WASM_ENABLE_BULK_MEMORY != 0
+    if (! restore_bitmap(inst->e->common.data_dropped, data_dropped_))
+        return false;
+#endif
+#if WASM_ENABLE_REF_TYPES != 0
+    if (! restore_bitmap(inst->e->common.elem_dropped, elem_dropped_))
+        return false;
+#endif
+
+    // the app heap allocator keeps its bookkeeping outside of linear
+    // memory; it is rebuilt over the restored heap region below the
+    // same way it is when the instance is created
+    if (memory != NULL && memory->heap_handle != NULL)
+        mem_allocator_destroy(memory->heap_handle);
+
+    if (memory != NULL)
+    {
+        size_t next = 0;
+        for (uint32_t offset = 0, page = 0; offset < memory_data_size_; offset += SNAPSHOT_PAGE_SIZE, page++)
+        {
+            uint32_t length = std::min((uint32_t)SNAPSHOT_PAGE_SIZE, memory_data_size_ - offset);
+            uint8_t* target = memory->memory_data + offset;
+            if (next < page_index_.size() && page_index_[next] == page)
+            {
+                memcpy(target, pages_.data() + next * SNAPSHOT_PAGE_SIZE, length);
+                next++;
+            }
+            else
+            {
+                memset(target, 0, length);
+            }
+        }
+    }
+
+    memcpy(inst->global_data, globals_.data(), globals_.size());
+
+    for (uint32_t i = 0; i < inst->table_count; i++)
+        memcpy((uint8_t*)inst->tables[i], tables_[i].data(), tables_[i].size());
+
+    if (memory != NULL && memory->heap_handle != NULL)
+    {
+        uint32_t heap_size = (uint32_t)(memory->heap_data_end - memory->heap_data);
+        void* heap_handle = mem_allocator_create_with_struct_and_pool(
+            memory->heap_handle, mem_allocator_get_heap_struct_size(), memory->heap_data, heap_size);
+        if (heap_handle == NULL)
+        {
+            SAFE_LOG(PDO_LOG_ERROR, "failed to reinitialize the application heap");
+            return false;
+        }
+    }
+
+    wasm_runtime_clear_exception(module_inst);
+    return true;
+}
+
+#endif // WASM_INSTANCE_SNAPSHOT
+
+// XXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXX
+size_t WasmInstanceSnapshot::size(void) const
+{
+    size_t size = pages_.size() + globals_.size() + page_index_.size() * sizeof(uint32_t);
+    size += data_dropped_.size() + elem_dropped_.size();
+    for (auto t = tables_.begin(); t != tables_.end(); t++)
+        size += t->size();
+
+    return size;
+}
@@ -0,0 +1,66 @@
+/* Copyright 2024 Intel Corporation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <stdint.h>
+#include <vector>
+
+#include "types.h"
+
+extern "C" {
+#include "wasm_export.h"
+}
+
+// XXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXX
+// WasmInstanceSnapshot
+//
+// Image of a module instance taken immediately after instantiation,
+// before any contract code has run. Restoring the image into an instance
+// of the same module returns linear memory, globals, tables, dropped
+// data/elem segments and the app heap to exactly the state a fresh call to wasm_runtime_instantiate
+// would produce, so a reset instance behaves identically to a new one.
+//
+// Only the non-zero pages of linear memory are kept in the image.
+// ----------------------------------------------------------------
+// Relies on the layout of WASMModuleInstance from the WAMR
+// interpreter; AOT module instances are not supported. The build only
+// enables snapshots (WASM_INSTANCE_SNAPSHOT) for the WAMR release this
+// layout was checked against, otherwise the constructor throws. The
+// constructor also throws when the instance structures disagree with
+// the public runtime API, and the module is then not pooled.
+// XXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXX
+class WasmInstanceSnapshot
+{
+private:
+    uint32_t page_count_ = 0;
+    uint32_t memory_data_size_ = 0;
+    std::vector<uint32_t> page_index_;
+    ByteArray pages_;
+    ByteArray globals_;
+    std::vector<ByteArray> tables_;
+    ByteArray data_dropped_;
+    ByteArray elem_dropped_;
+
+public:
+    WasmInstanceSnapshot(wasm_module_inst_t module_inst);
+
+    // Restore the image into an instance of the same module; returns
+    // false if the instance cannot be reset (for example, because the
+    // contract grew linear memory) and must be discarded
+    bool restore(wasm_module_inst_t module_inst) const;
+
+    size_t size(void) const;
+};
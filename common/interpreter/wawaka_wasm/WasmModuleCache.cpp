@@ -0,0 +1,242 @@
+/* Copyright 2024 Intel Corporation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <string>
+#include <map>
+
+#include "packages/base64/base64.h"
+
+#include "error.h"
+#include "log.h"
+#include "types.h"
+
+#include "WasmModuleCache.h"
+
+namespace pe = pdo::error;
+
+// The memory used by a loaded module is not reported by the runtime;
+// the loader keeps tables and (for the fast interpreter) a translated
+// copy of the code in the runtime pool, so we charge each entry twice
+// the size of the binary
+#define MODULE_FOOTPRINT_FACTOR 2
+
+// XXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXX
+WasmModuleCache::~WasmModuleCache(void)
+{
+    clear();
+}
+
+// XXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXX
+void WasmModuleCache::drop_instance(const pooled_instance_t& instance)
+{
+    if (instance.exec_env != NULL)
+        wasm_runtime_destroy_exec_env(instance.exec_env);
+    if (instance.module_inst != NULL)
+        wasm_runtime_deinstantiate(instance.module_inst);
+}
+
+// XXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXX
+void WasmModuleCache::drop_entry(std::map<std::string, module_cache_entry_t>::iterator entry)
+{
+    // instances must be released before the module is unloaded
+    for (auto i = entry->second.instances.begin(); i != entry->second.instances.end(); i++)
+        drop_instance(*i);
+    entry->second.instances.clear();
+
+    if (entry->second.module != NULL)
+        wasm_runtime_unload(entry->second.module);
+
+    footprint_ -= entry->second.footprint;
+    module_cache_.erase(entry);
+}
+
+// XXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXX
+bool WasmModuleCache::evict(wasm_module_t keep)
+{
+    auto victim = module_cache_.end();
+    for (auto it = module_cache_.begin(); it != module_cache_.end(); it++)
+    {
+        if (it->second.module == keep)
+            continue;
+        if (victim == module_cache_.end() || it->second.clock < victim->second.clock)
+            victim = it;
+    }
+
+    if (victim == module_cache_.end())
+        return false;
+
+    SAFE_LOG(PDO_LOG_DEBUG, "evict wasm module from cache");
+    drop_entry(victim);
+    evictions_++;
+    return true;
+}
+
+// XXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXX
+void WasmModuleCache::replacement_policy_LRU(wasm_module_t keep)
+{
+    // the module that is about to be instantiated is never evicted,
+    // even if it alone exceeds the budget
+    while (module_cache_.size() > max_entries_ || footprint_ > max_footprint_)
+    {
+        if (! evict(keep))
+            break;
+    }
+}
+
+// XXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXX
+wasm_module_t WasmModuleCache::load(
+    const std::string& code_hash,
+    const std::string& code)
+{
+    auto it = module_cache_.find(code_hash);
+    if (it != module_cache_.end())
+    {
+        hits_++;
+        it->second.clock = ++cache_clock_;
+        return it->second.module;
+    }
+
+    misses_++;
+
+    module_cache_entry_t entry;
+    entry.binary_code = Base64EncodedStringToByteArray(code);
+    entry.footprint = MODULE_FOOTPRINT_FACTOR * entry.binary_code.size();
+    entry.clock = ++cache_clock_;
+    entry.poolable = true;
+
+    char error_buf[128];
+    entry.module = wasm_runtime_load(
+        (uint8*)entry.binary_code.data(), entry.binary_code.size(), error_buf, sizeof(error_buf));
+
+    // the footprint is an estimate; if the pool is exhausted, drop
+    // everything else in the cache and try again before giving up
+    if (entry.module == NULL && (evict_instance() || evict()))
+    {
+        while (evict())
+            ;
+        entry.module = wasm_runtime_load(
+            (uint8*)entry.binary_code.data(), entry.binary_code.size(), error_buf, sizeof(error_buf));
+    }
+
+    if (entry.module == NULL)
+        SAFE_LOG(PDO_LOG_CRITICAL, "load failed with error <%s>", error_buf);
+
+    pe::ThrowIfNull(entry.module, "module load failed");
+
+    // the ByteArray moves with the entry, the underlying buffer
+    // referenced by the module does not change
+    wasm_module_t module = entry.module;
+    footprint_ += entry.footprint;
+    module_cache_.emplace(code_hash, std::move(entry));
+
+    replacement_policy_LRU(module);
+
+    SAFE_LOG(PDO_LOG_DEBUG, "wasm module cache: %zu entries, %zu bytes, %lu hits, %lu misses, %lu evictions",
+             module_cache_.size(), footprint_, hits_, misses_, evictions_);
+
+    return module;
+}
+
+// XXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXX
+bool WasmModuleCache::acquire_instance(
+    const std::string& code_hash,
+    wasm_module_inst_t& module_inst,
+    wasm_exec_env_t& exec_env)
+{
+    auto it = module_cache_.find(code_hash);
+    if (it == module_cache_.end() || it->second.instances.empty())
+    {
+        instance_misses_++;
+        return false;
+    }
+
+    instance_hits_++;
+    module_inst = it->second.instances.back().module_inst;
+    exec_env = it->second.instances.back().exec_env;
+    it->second.instances.pop_back();
+
+    return true;
+}
+
+// XXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXX
+void WasmModuleCache::snapshot_instance(
+    const std::string& code_hash,
+    wasm_module_inst_t module_inst)
+{
+    auto it = module_cache_.find(code_hash);
+    if (it == module_cache_.end() || it->second.snapshot || ! it->second.poolable)
+        return;
+
+    // modules whose instances cannot be captured are simply not pooled
+    try
+    {
+        it->second.snapshot = std::make_shared<WasmInstanceSnapshot>(module_inst);
+        SAFE_LOG(PDO_LOG_DEBUG, "wasm instance snapshot: %zu bytes", it->second.snapshot->size());
+    }
+    catch (pe::RuntimeError& e)
+    {
+        SAFE_LOG(PDO_LOG_INFO, "instance pool disabled for module; %s", e.what());
+        it->second.poolable = false;
+    }
+}
+
+// XXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXX
+void WasmModuleCache::release_instance(
+    const std::string& code_hash,
+    wasm_module_inst_t module_inst,
+    wasm_exec_env_t exec_env,
+    bool reusable)
+{
+    pooled_instance_t instance = { module_inst, exec_env };
+
+    auto it = module_cache_.find(code_hash);
+    if (reusable && it != module_cache_.end() && it->second.snapshot &&
+        it->second.instances.size() < INSTANCE_POOL_MAX_SIZE &&
+        it->second.snapshot->restore(module_inst))
+    {
+        it->second.instances.push_back(instance);
+        return;
+    }
+
+    instance_discards_++;
+    drop_instance(instance);
+}
+
+// XXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXX
+bool WasmModuleCache::evict_instance(void)
+{
+    auto victim = module_cache_.end();
+    for (auto it = module_cache_.begin(); it != module_cache_.end(); it++)
+    {
+        if (it->second.instances.empty())
+            continue;
+        if (victim == module_cache_.end() || it->second.clock < victim->second.clock)
+            victim = it;
+    }
+
+    if (victim == module_cache_.end())
+        return false;
+
+    drop_instance(victim->second.instances.back());
+    victim->second.instances.pop_back();
+    return true;
+}
+
+// XXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXX
+void WasmModuleCache::clear(void)
+{
+    while (! module_cache_.empty())
+        drop_entry(module_cache_.begin());
+}
@@ -0,0 +1,149 @@
+/* Copyright 2024 Intel Corporation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <stdint.h>
+#include <memory>
+#include <string>
+#include <map>
+#include <vector>
+
+#include "types.h"
+#include "WasmInstanceSnapshot.h"
+
+extern "C" {
+#include "wasm_export.h"
+}
+
+// MODULE_CACHE_SIZE and MODULE_CACHE_MAX_ENTRIES are normally defined
+// through gcc definitions with the rest of the memory configuration;
+// MODULE_CACHE_SIZE is the number of bytes of the runtime memory pool
+// reserved for loaded modules
+#ifndef MODULE_CACHE_SIZE
+#define MODULE_CACHE_SIZE (1 << 20)
+#endif
+
+#ifndef MODULE_CACHE_MAX_ENTRIES
+#define MODULE_CACHE_MAX_ENTRIES 16
+#endif
+
+// number of idle instances kept for each cached module
+#ifndef INSTANCE_POOL_MAX_SIZE
+#define INSTANCE_POOL_MAX_SIZE 1
+#endif
+
+// XXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXX
+// WasmModuleCache
+//
+// Loaded wasm modules keyed by the hash of the contract code. Parsing
+// and validating a module is independent of the contract state so the
+// result can be reused across invocations on the same interpreter;
+// only the module instance must be created for each request. Entries
+// are evicted least recently used first whenever the number of entries
+// or the estimated memory footprint exceeds the configured budget.
+//
+// Each entry also holds a small pool of idle module instances together
+// with their execution environments. An instance is returned to the pool
+// after it has been reset to the snapshot taken when the first instance
+// of the module was created. Idle instances share the runtime pool with
+// the active instance and are released first when memory is short.
+// XXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXX
+class WasmModuleCache
+{
+private:
+    struct pooled_instance_t
+    {
+        wasm_module_inst_t module_inst;
+        wasm_exec_env_t exec_env;
+    };
+
+    struct module_cache_entry_t
+    {
+        wasm_module_t module;
+        ByteArray binary_code;  // WAMR may reference the buffer for the life of the module
+        size_t footprint;
+        uint64_t clock;
+        bool poolable;
+        std::shared_ptr<WasmInstanceSnapshot> snapshot;
+        std::vector<pooled_instance_t> instances;
+    };
+
+    std::map<std::string, module_cache_entry_t> module_cache_;
+
+    size_t max_entries_;
+    size_t max_footprint_;
+    size_t footprint_ = 0;
+    uint64_t cache_clock_ = 0;
+
+    void drop_entry(std::map<std::string, module_cache_entry_t>::iterator entry);
+    void drop_instance(const pooled_instance_t& instance);
+    void replacement_policy_LRU(wasm_module_t keep);
+
+public:
+    uint64_t hits_ = 0;
+    uint64_t misses_ = 0;
+    uint64_t evictions_ = 0;
+    uint64_t instance_hits_ = 0;
+    uint64_t instance_misses_ = 0;
+    uint64_t instance_discards_ = 0;
+
+    WasmModuleCache(
+        size_t max_entries = MODULE_CACHE_MAX_ENTRIES,
+        size_t max_footprint = MODULE_CACHE_SIZE) :
+        max_entries_(max_entries), max_footprint_(max_footprint) {}
+
+    ~WasmModuleCache(void);
+
+    // Return the loaded module for the code hash, loading the base64
+    // encoded code on a miss; throws if the module cannot be loaded
+    wasm_module_t load(
+        const std::string& code_hash,
+        const std::string& code);
+
+    // Evict the least recently used module that is not the given module,
+    // returns false if there was nothing to evict
+    bool evict(wasm_module_t keep = NULL);
+
+    // Take an idle, reset instance of the module from the pool; returns
+    // false if the caller must create a new instance
+    bool acquire_instance(
+        const std::string& code_hash,
+        wasm_module_inst_t& module_inst,
+        wasm_exec_env_t& exec_env);
+
+    // Record the post-instantiation image of the module the first time
+    // an instance is created; must be called before the instance runs
+    void snapshot_instance(
+        const std::string& code_hash,
+        wasm_module_inst_t module_inst);
+
+    // Reset the instance and return it to the pool, or destroy it if it
+    // cannot be reused or the pool is full
+    void release_instance(
+        const std::string& code_hash,
+        wasm_module_inst_t module_inst,
+        wasm_exec_env_t exec_env,
+        bool reusable);
+
+    // Destroy one idle instance to free runtime memory, least recently
+    // used module first; returns false if there were none
+    bool evict_instance(void);
+
+    void clear(void);
+
+    size_t size(void) const { return module_cache_.size(); }
+    size_t footprint(void) const { return footprint_; }
+};
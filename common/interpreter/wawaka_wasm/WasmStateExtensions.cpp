@@ -64,6 +64,42 @@ static pstate::Basic_KV_Plus* fetch_state_from_handle(
     return state;
 }
 
+/* ----------------------------------------------------------------- *
+ * NAME: pack_byte_array
+ *
+ * Batched operations pass arrays of byte arrays in a single buffer,
+ * each item is its length (4 bytes) followed by its bytes.
+ * ----------------------------------------------------------------- */
+static void pack_byte_array(ByteArray& packed, const ByteArray& item)
+{
+    uint32_t length = item.size();
+    packed.insert(packed.end(), (uint8_t*)&length, (uint8_t*)&length + sizeof(length));
+    packed.insert(packed.end(), item.begin(), item.end());
+}
+
+/* ----------------------------------------------------------------- *
+ * NAME: unpack_byte_arrays
+ * ----------------------------------------------------------------- */
+static bool unpack_byte_arrays(const uint8_t* buffer, const size_t buffer_length, std::vector<ByteArray>& items)
+{
+    size_t offset = 0;
+    while (offset < buffer_length)
+    {
+        uint32_t length;
+        if (buffer_length - offset < sizeof(length))
+            return false;
+        memcpy(&length, buffer + offset, sizeof(length));
+        offset += sizeof(length);
+
+        if (buffer_length - offset < length)
+            return false;
+        items.emplace_back(buffer + offset, buffer + offset + length);
+        offset += length;
+    }
+
+    return true;
+}
+
 /* ----------------------------------------------------------------- *
  * NAME: _key_value_set_wrapper
  * ----------------------------------------------------------------- */
@@ -146,6 +182,83 @@ extern "C" bool key_value_get_wrapper(
     }
 }
 
+/* ----------------------------------------------------------------- *
+ * NAME: _key_value_get_size_wrapper
+ *
+ * Returns the size of the value of a key, 0 if the key has no value
+ * and -1 on failure; with key_value_read_into, a contract reads a
+ * value into its own buffer with a single copy.
+ * ----------------------------------------------------------------- */
+extern "C" int32 key_value_get_size_wrapper(
+    wasm_exec_env_t exec_env,
+    const int32 kv_store_handle,
+    const uint8_t* key_buffer,
+    const int32 key_buffer_length) // size_t
+{
+    wasm_module_inst_t module_inst = wasm_runtime_get_module_inst(exec_env);
+    try {
+        pstate::Basic_KV_Plus* state = fetch_state_from_handle(module_inst, kv_store_handle);
+        if (state == NULL)
+            return -1;
+
+        if (key_buffer == NULL)
+            return -1;
+
+        ByteArray ba_key(key_buffer, key_buffer + key_buffer_length);
+        size_t size = state->UnprivilegedGetSize(ba_key);
+        if (size > INT32_MAX)
+            return -1;
+
+        return size;
+    }
+    catch (pdo::error::Error& e) {
+        SAFE_LOG(PDO_LOG_ERROR, "failure in %s; %s", __FUNCTION__, e.what());
+        return -1;
+    }
+    catch (...) {
+        SAFE_LOG(PDO_LOG_ERROR, "unexpected failure in %s", __FUNCTION__);
+        return -1;
+    }
+}
+
+/* ----------------------------------------------------------------- *
+ * NAME: _key_value_read_into_wrapper
+ *
+ * Copies the value of a key, from an offset on, into a buffer of the
+ * contract; the buffer has been checked to lie in the module memory.
+ * Returns the number of bytes copied, or -1 on failure.
+ * ----------------------------------------------------------------- */
+extern "C" int32 key_value_read_into_wrapper(
+    wasm_exec_env_t exec_env,
+    const int32 kv_store_handle,
+    const uint8_t* key_buffer,
+    const int32 key_buffer_length, // size_t
+    uint8_t* val_buffer,
+    const int32 val_buffer_length, // size_t
+    const int32 offset) // size_t
+{
+    wasm_module_inst_t module_inst = wasm_runtime_get_module_inst(exec_env);
+    try {
+        pstate::Basic_KV_Plus* state = fetch_state_from_handle(module_inst, kv_store_handle);
+        if (state == NULL)
+            return -1;
+
+        if (key_buffer == NULL || val_buffer == NULL || val_buffer_length < 0 || offset < 0)
+            return -1;
+
+        ByteArray ba_key(key_buffer, key_buffer + key_buffer_length);
+        return state->UnprivilegedGetInto(ba_key, val_buffer, val_buffer_length, offset);
+    }
+    catch (pdo::error::Error& e) {
+        SAFE_LOG(PDO_LOG_ERROR, "failure in %s; %s", __FUNCTION__, e.what());
+        return -1;
+    }
+    catch (...) {
+        SAFE_LOG(PDO_LOG_ERROR, "unexpected failure in %s", __FUNCTION__);
+        return -1;
+    }
+}
+
 /* ----------------------------------------------------------------- *
  * NAME: _privilege_key_value_get_wrapper
  * ----------------------------------------------------------------- */
@@ -188,6 +301,206 @@ extern "C" bool privileged_key_value_get_wrapper(
     }
 }
 
+/* ----------------------------------------------------------------- *
+ * NAME: _key_value_iterate_wrapper
+ *
+ * Returns, in key order, up to limit key/value pairs of the store
+ * whose key starts with the prefix and follows the start key (or is
+ * equal to it if inclusive is set). The keys and values of the pairs
+ * are packed in a single buffer. Returns the number of pairs, or
+ * -1 on failure; fewer pairs than limit means that the iteration is
+ * complete, otherwise the next call starts from the last key returned.
+ * ----------------------------------------------------------------- */
+extern "C" int32 key_value_iterate_wrapper(
+    wasm_exec_env_t exec_env,
+    const int32 kv_store_handle,
+    const uint8_t* prefix_buffer,
+    const int32 prefix_buffer_length, // size_t
+    const uint8_t* start_buffer,
+    const int32 start_buffer_length, // size_t
+    const int32 inclusive, // bool
+    const int32 limit, // size_t
+    int32 result_buffer_pointer_offset, // uint8_t**
+    int32 result_length_pointer_offset) // size_t*
+{
+    wasm_module_inst_t module_inst = wasm_runtime_get_module_inst(exec_env);
+    try {
+        pstate::Basic_KV_Plus* state = fetch_state_from_handle(module_inst, kv_store_handle);
+        if (state == NULL)
+            return -1;
+
+        if (prefix_buffer == NULL || start_buffer == NULL || limit < 0)
+            return -1;
+
+        ByteArray ba_prefix(prefix_buffer, prefix_buffer + prefix_buffer_length);
+        ByteArray ba_start(start_buffer, start_buffer + start_buffer_length);
+
+        pstate::KeyValueArray pairs;
+        state->UnprivilegedScan(ba_prefix, ba_start, inclusive != 0, limit, pairs);
+        if (pairs.size() == 0)
+            return 0;
+
+        ByteArray result;
+        for (const auto& pair : pairs)
+        {
+            pack_byte_array(result, pair.first);
+            pack_byte_array(result, pair.second);
+        }
+
+        if (! save_buffer(module_inst, result, result_buffer_pointer_offset, result_length_pointer_offset))
+            return -1;
+
+        return pairs.size();
+    }
+    catch (pdo::error::Error& e) {
+        SAFE_LOG(PDO_LOG_ERROR, "failure in %s; %s", __FUNCTION__, e.what());
+        return -1;
+    }
+    catch (...) {
+        SAFE_LOG(PDO_LOG_ERROR, "unexpected failure in %s", __FUNCTION__);
+        return -1;
+    }
+}
+
+/* ----------------------------------------------------------------- *
+ * NAME: _key_value_get_many_wrapper
+ *
+ * Gets the values of a packed array of keys with a single lookup in
+ * the store, and returns them packed in the order of the keys (empty
+ * for missing keys). Returns the number of keys found, or -1 on
+ * failure.
+ * ----------------------------------------------------------------- */
+extern "C" int32 key_value_get_many_wrapper(
+    wasm_exec_env_t exec_env,
+    const int32 kv_store_handle,
+    const uint8_t* keys_buffer,
+    const int32 keys_buffer_length, // size_t
+    int32 vals_buffer_pointer_offset, // uint8_t**
+    int32 vals_length_pointer_offset) // size_t*
+{
+    wasm_module_inst_t module_inst = wasm_runtime_get_module_inst(exec_env);
+    try {
+        pstate::Basic_KV_Plus* state = fetch_state_from_handle(module_inst, kv_store_handle);
+        if (state == NULL)
+            return -1;
+
+        if (keys_buffer == NULL)
+            return -1;
+
+        std::vector<ByteArray> keys;
+        if (! unpack_byte_arrays(keys_buffer, keys_buffer_length, keys) || keys.size() == 0)
+            return -1;
+
+        std::vector<ByteArray> vals;
+        state->UnprivilegedGetMany(keys, vals);
+
+        int32 found = 0;
+        ByteArray result;
+        for (const ByteArray& val : vals)
+        {
+            pack_byte_array(result, val);
+            if (val.size() > 0)
+                found++;
+        }
+
+        if (! save_buffer(module_inst, result, vals_buffer_pointer_offset, vals_length_pointer_offset))
+            return -1;
+
+        return found;
+    }
+    catch (pdo::error::Error& e) {
+        SAFE_LOG(PDO_LOG_ERROR, "failure in %s; %s", __FUNCTION__, e.what());
+        return -1;
+    }
+    catch (...) {
+        SAFE_LOG(PDO_LOG_ERROR, "unexpected failure in %s", __FUNCTION__);
+        return -1;
+    }
+}
+
+/* ----------------------------------------------------------------- *
+ * NAME: _key_value_set_many_wrapper
+ *
+ * Sets the pairs of a packed array of alternating keys and values.
+ * ----------------------------------------------------------------- */
+extern "C" bool key_value_set_many_wrapper(
+    wasm_exec_env_t exec_env,
+    const int32 kv_store_handle,
+    const uint8_t* pairs_buffer,
+    const int32 pairs_buffer_length) // size_t
+{
+    wasm_module_inst_t module_inst = wasm_runtime_get_module_inst(exec_env);
+    try {
+        pstate::Basic_KV_Plus* state = fetch_state_from_handle(module_inst, kv_store_handle);
+        if (state == NULL)
+            return false;
+
+        if (pairs_buffer == NULL)
+            return false;
+
+        std::vector<ByteArray> items;
+        if (! unpack_byte_arrays(pairs_buffer, pairs_buffer_length, items) || items.size() % 2 != 0)
+            return false;
+
+        pstate::KeyValueArray pairs;
+        pairs.reserve(items.size() / 2);
+        for (size_t i = 0; i < items.size(); i += 2)
+        {
+            pairs.emplace_back();
+            pairs.back().first.swap(items[i]);
+            pairs.back().second.swap(items[i + 1]);
+        }
+
+        state->UnprivilegedPutMany(pairs);
+        return true;
+    }
+    catch (pdo::error::Error& e) {
+        SAFE_LOG(PDO_LOG_ERROR, "failure in %s; %s", __FUNCTION__, e.what());
+        return false;
+    }
+    catch (...) {
+        SAFE_LOG(PDO_LOG_ERROR, "unexpected failure in %s", __FUNCTION__);
+        return false;
+    }
+}
+
+/* ----------------------------------------------------------------- *
+ * NAME: _key_value_delete_many_wrapper
+ *
+ * Deletes the keys of a packed array of keys.
+ * ----------------------------------------------------------------- */
+extern "C" bool key_value_delete_many_wrapper(
+    wasm_exec_env_t exec_env,
+    const int32 kv_store_handle,
+    const uint8_t* keys_buffer,
+    const int32 keys_buffer_length) // size_t
+{
+    wasm_module_inst_t module_inst = wasm_runtime_get_module_inst(exec_env);
+    try {
+        pstate::Basic_KV_Plus* state = fetch_state_from_handle(module_inst, kv_store_handle);
+        if (state == NULL)
+            return false;
+
+        if (keys_buffer == NULL)
+            return false;
+
+        std::vector<ByteArray> keys;
+        if (! unpack_byte_arrays(keys_buffer, keys_buffer_length, keys))
+            return false;
+
+        state->UnprivilegedDeleteMany(keys);
+        return true;
+    }
+    catch (pdo::error::Error& e) {
+        SAFE_LOG(PDO_LOG_ERROR, "failure in %s; %s", __FUNCTION__, e.what());
+        return false;
+    }
+    catch (...) {
+        SAFE_LOG(PDO_LOG_ERROR, "unexpected failure in %s", __FUNCTION__);
+        return false;
+    }
+}
+
 /* ----------------------------------------------------------------- *
  * NAME: _key_value_create_wrapper
  * ----------------------------------------------------------------- */
@@ -221,7 +534,9 @@ extern "C" int32 key_value_create_wrapper(
             return -1;
         }
 
-        pstate::Interpreter_KV* state = new pstate::Interpreter_KV(ba_encryption_key);
+        // the caches of all the stores share the budget of the contract state
+        pstate::Interpreter_KV* state = new pstate::Interpreter_KV(
+            ba_encryption_key, CACHE_SIZE, kv_store_pool[0]->GetCacheBudget());
         if (state == NULL)
         {
             SAFE_LOG(PDO_LOG_ERROR, "state was not initialized (get)");
@@ -281,7 +596,9 @@ extern "C" int32 key_value_open_wrapper(
             return -1;
         }
 
-        pstate::Interpreter_KV* state = new pstate::Interpreter_KV(ba_id_hash, ba_encryption_key);
+        // the caches of all the stores share the budget of the contract state
+        pstate::Interpreter_KV* state = new pstate::Interpreter_KV(
+            ba_id_hash, ba_encryption_key, CACHE_SIZE, kv_store_pool[0]->GetCacheBudget());
         if (state == NULL)
         {
             SAFE_LOG(PDO_LOG_ERROR, "state was not initialized (get)");
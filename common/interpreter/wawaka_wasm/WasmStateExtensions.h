@@ -36,6 +36,21 @@ extern "C" bool key_value_get_wrapper(
     int32 val_buffer_pointer_offset,  /* uint8_t** */
     int32 val_length_pointer_offset); /* size_t* */
 
+extern "C" int32 key_value_get_size_wrapper(
+    wasm_exec_env_t exec_env,
+    const int32 kv_store_handle,
+    const uint8_t* key_buffer,
+    const int32 key_buffer_length);
+
+extern "C" int32 key_value_read_into_wrapper(
+    wasm_exec_env_t exec_env,
+    const int32 kv_store_handle,
+    const uint8_t* key_buffer,
+    const int32 key_buffer_length,
+    uint8_t* val_buffer,
+    const int32 val_buffer_length,
+    const int32 offset);
+
 extern "C" bool privileged_key_value_get_wrapper(
     wasm_exec_env_t exec_env,
     const uint8_t* key_buffer,
@@ -43,6 +58,38 @@ extern "C" bool privileged_key_value_get_wrapper(
     int32 val_buffer_pointer_offset,  /* uint8_t** */
     int32 val_length_pointer_offset); /* size_t* */
 
+extern "C" int32 key_value_iterate_wrapper(
+    wasm_exec_env_t exec_env,
+    const int32 kv_store_handle,
+    const uint8_t* prefix_buffer,
+    const int32 prefix_buffer_length,
+    const uint8_t* start_buffer,
+    const int32 start_buffer_length,
+    const int32 inclusive,
+    const int32 limit,
+    int32 result_buffer_pointer_offset,  /* uint8_t** */
+    int32 result_length_pointer_offset); /* size_t* */
+
+extern "C" int32 key_value_get_many_wrapper(
+    wasm_exec_env_t exec_env,
+    const int32 kv_store_handle,
+    const uint8_t* keys_buffer,
+    const int32 keys_buffer_length,
+    int32 vals_buffer_pointer_offset,  /* uint8_t** */
+    int32 vals_length_pointer_offset); /* size_t* */
+
+extern "C" bool key_value_set_many_wrapper(
+    wasm_exec_env_t exec_env,
+    const int32 kv_store_handle,
+    const uint8_t* pairs_buffer,
+    const int32 pairs_buffer_length);
+
+extern "C" bool key_value_delete_many_wrapper(
+    wasm_exec_env_t exec_env,
+    const int32 kv_store_handle,
+    const uint8_t* keys_buffer,
+    const int32 keys_buffer_length);
+
 extern "C" int key_value_create_wrapper(
     wasm_exec_env_t exec_env,
     const uint8_t* key_buffer,
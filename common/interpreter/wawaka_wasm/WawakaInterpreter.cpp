@@ -140,17 +140,21 @@ const char* WawakaInterpreter::report_interpreter_error(
 
 // XXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXX
 void WawakaInterpreter::load_contract_code(
-    const std::string& code)
+    const pc::ContractCode& inContractCode)
 {
     char error_buf[128];
-    binary_code_ = Base64EncodedStringToByteArray(code);
 
+    // the module is owned by the cache, only the instance and
+    // the execution environment are created for each request
     SAFE_LOG(PDO_LOG_DEBUG, "initialize the wasm interpreter");
-    wasm_module = wasm_runtime_load((uint8*)binary_code_.data(), binary_code_.size(), error_buf, sizeof(error_buf));
-    if (wasm_module == NULL)
-        SAFE_LOG(PDO_LOG_CRITICAL, "load failed with error <%s>", error_buf);
+    code_hash_ = inContractCode.CodeHash;
+    wasm_module = module_cache_.load(code_hash_, inContractCode.Code);
 
-    pe::ThrowIfNull(wasm_module, "module load failed");
+    // an idle instance from the pool has already been reset to
+    // the state of a freshly created instance
+    instance_reusable_ = false;
+    if (module_cache_.acquire_instance(code_hash_, wasm_module_inst, wasm_exec_env))
+        return;
 
     /* exec_envs in WAMR maintain the corresponding module's stack.
        So we can pass a dummy stack size here, since we're explictly
@@ -158,8 +162,21 @@ void WawakaInterpreter::load_contract_code(
     */
     // HEAP_SIZE defined through gcc definitions
     wasm_module_inst = wasm_runtime_instantiate(wasm_module, 0, HEAP_SIZE, error_buf, sizeof(error_buf));
+
+    // cached modules and idle instances share the pool with the
+    // instance, release them if that is what it takes to instantiate
+    // this one
+    while (wasm_module_inst == NULL && (module_cache_.evict_instance() || module_cache_.evict(wasm_module)))
+        wasm_module_inst = wasm_runtime_instantiate(wasm_module, 0, HEAP_SIZE, error_buf, sizeof(error_buf));
+
+    if (wasm_module_inst == NULL)
+        SAFE_LOG(PDO_LOG_CRITICAL, "instantiate failed with error <%s>", error_buf);
+
     pe::ThrowIfNull(wasm_module_inst, "failed to instantiate the module");
 
+    // the snapshot must be taken before any contract code runs
+    module_cache_.snapshot_instance(code_hash_, wasm_module_inst);
+
     /* this is where we set the module's stack size */
     // STACK_SIZE defined through gcc definitions
     wasm_exec_env = wasm_runtime_create_exec_env(wasm_module_inst, STACK_SIZE);
@@ -197,6 +214,7 @@ int32 WawakaInterpreter::initialize_contract(
            !wasm_runtime_call_wasm(wasm_exec_env,
                                    wasm_func, 1, argv),
            "execution failed for some reason");
+        instance_reusable_ = true;
 
         SAFE_LOG(PDO_LOG_DEBUG, "RESULT=%u", argv[0]);
         result = argv[0];
@@ -254,6 +272,7 @@ int32 WawakaInterpreter::evaluate_function(
            !wasm_runtime_call_wasm(wasm_exec_env,
                                    wasm_func, 2, argv),
            "execution failed for some reason");
+        instance_reusable_ = true;
 
         SAFE_LOG(PDO_LOG_DEBUG, "RESULT=%u", argv[0]);
         result = argv[0];
@@ -276,35 +295,35 @@ int32 WawakaInterpreter::evaluate_function(
 // XXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXX
 void WawakaInterpreter::Finalize(void)
 {
-    // Clear the code buffer
-    binary_code_.clear();
-
-    // Destroy the environment
-    if (wasm_exec_env != NULL)
-    {
-        wasm_runtime_destroy_exec_env(wasm_exec_env);
-        wasm_exec_env = NULL;
-    }
-
+    // Return the instance and its environment to the pool; an
+    // instance is only reused if the contract ran to completion
     if (wasm_module_inst != NULL)
     {
-        wasm_runtime_deinstantiate(wasm_module_inst);
+        module_cache_.release_instance(code_hash_, wasm_module_inst, wasm_exec_env, instance_reusable_);
         wasm_module_inst = NULL;
+        wasm_exec_env = NULL;
     }
-
-    if (wasm_module != NULL)
+    else if (wasm_exec_env != NULL)
     {
-        wasm_runtime_unload(wasm_module);
-        wasm_module = NULL;
+        wasm_runtime_destroy_exec_env(wasm_exec_env);
+        wasm_exec_env = NULL;
     }
 
-    wasm_runtime_destroy();
+    // the module stays loaded in the module cache, the runtime
+    // is kept for the life of the interpreter so that cached
+    // modules remain valid across requests
+    wasm_module = NULL;
+    instance_reusable_ = false;
 }
 
 // XXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXX
 WawakaInterpreter::~WawakaInterpreter(void)
 {
     Finalize();
+
+    module_cache_.clear();
+    if (runtime_initialized_)
+        wasm_runtime_destroy();
 }
 
 // XXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXX
@@ -313,6 +332,9 @@ void WawakaInterpreter::Initialize(void)
     RuntimeInitArgs init_args;
     bool result;
 
+    if (runtime_initialized_)
+        return;
+
     SAFE_LOG(PDO_LOG_DEBUG, "initialize wasm interpreter");
 
     os_set_print_function(wasm_printer);
@@ -328,6 +350,8 @@ void WawakaInterpreter::Initialize(void)
 
     bool registered = RegisterNativeFunctions();
     pe::ThrowIf<pe::RuntimeError>(! registered, "failed to register native functions");
+
+    runtime_initialized_ = true;
 }
 
 // XXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXX
@@ -349,7 +373,7 @@ void WawakaInterpreter::create_initial_contract_state(
     initialStateHash.assign(initialStateHash.size(), 0); // this is probably not necessary
 
     // load the contract code
-    load_contract_code(inContractCode.Code);
+    load_contract_code(inContractCode);
 
     // this doesn't really set thread local data since it is
     // not supported for sgx, it does however attach the data
@@ -400,7 +424,7 @@ void WawakaInterpreter::send_message_to_contract(
     // initialize the extensions library with the current state
 
     // load the contract code
-    load_contract_code(inContractCode.Code);
+    load_contract_code(inContractCode);
 
     // set up the key value store information
     kv_store_pool[0] = &inoutContractState;
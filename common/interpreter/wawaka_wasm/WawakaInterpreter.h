@@ -20,6 +20,7 @@
 
 #include "basic_kv.h"
 #include "ContractInterpreter.h"
+#include "WasmModuleCache.h"
 
 extern "C" {
 #include "wasm_export.h"
@@ -36,12 +37,16 @@ class WawakaInterpreter : public pc::ContractInterpreter
 private:
     std::string error_msg_;
 
-    // RUNTIME_MEM_POOL_SIZE defined through gcc definitions
-    char global_mem_pool_buf[RUNTIME_MEM_POOL_SIZE] = { 0 };
+    // RUNTIME_MEM_POOL_SIZE defined through gcc definitions, the pool
+    // is extended to hold the modules kept in the module cache
+    char global_mem_pool_buf[RUNTIME_MEM_POOL_SIZE + MODULE_CACHE_SIZE] = { 0 };
+    bool runtime_initialized_ = false;
     wasm_module_t wasm_module = NULL;
     wasm_module_inst_t wasm_module_inst = NULL;
     wasm_exec_env_t wasm_exec_env = NULL;
-    ByteArray binary_code_;
+    WasmModuleCache module_cache_;
+    std::string code_hash_;
+    bool instance_reusable_ = false;
     pdo::state::Basic_KV_Plus* kv_store_pool[KV_STORE_POOL_MAX_SIZE] = { 0 };
 
     void parse_response_string(
@@ -55,7 +60,7 @@ private:
         const char* error);
 
     void load_contract_code(
-        const std::string& code);
+        const pc::ContractCode& inContractCode);
 
     int32 initialize_contract(
         const std::string& env);
@@ -15,6 +15,8 @@
 
 #pragma once
 
+#include <vector>
+
 #include "pdo_error.h"
 #include "types.h"
 
@@ -116,6 +118,68 @@ namespace pdo
             const size_t inValueSize
             );
 
+        /**
+         * Gets a sequence of blocks from the block store in one transaction
+         * Primary expected use: ocall
+         *
+         * Blocks are copied back to back into outValue in the order of the
+         * ids until the next block does not fit; the caller can request the
+         * remaining blocks with a larger buffer or in another call.
+         *
+         * @param inIds            concatenated ids
+         * @param inIdsSize        length of inIds
+         * @param inIdSizes        length of each id in inIds
+         * @param inCount          number of ids
+         * @param outValue         [output] buffer where blocks are copied
+         * @param inValueSize      length of caller's outValue buffer
+         * @param outValueSizes    [output] size of each block copied, and of
+         *                         the first block that did not fit
+         * @param outFetchedCount  [output] number of blocks copied
+         *
+         * @return
+         *  PDO_SUCCESS  outValue contains the first outFetchedCount blocks
+         *  else         failed, a block is missing or the store failed
+         */
+        pdo_err_t BlockStoreGetMany(
+            const uint8_t* inIds,
+            const size_t inIdsSize,
+            const size_t* inIdSizes,
+            const size_t inCount,
+            uint8_t* outValue,
+            const size_t inValueSize,
+            size_t* outValueSizes,
+            size_t* outFetchedCount
+            );
+
+        /**
+         * Puts a sequence of blocks into the block store in one transaction
+         * for each shard that the blocks are routed to
+         * Primary expected use: ocall
+         *
+         * @param inIds          concatenated ids
+         * @param inIdsSize      length of inIds
+         * @param inIdSizes      length of each id in inIds
+         * @param inCount        number of ids and blocks
+         * @param inValue        concatenated blocks
+         * @param inValueSize    length of inValue
+         * @param inValueSizes   length of each block in inValue
+         *
+         * @return
+         *  PDO_SUCCESS  all id->value pairs stored
+         *  else         failed, the blocks of some shards may be stored;
+         *               blocks are addressed by content so the put can
+         *               be repeated
+         */
+        pdo_err_t BlockStorePutMany(
+            const uint8_t* inIds,
+            const size_t inIdsSize,
+            const size_t* inIdSizes,
+            const size_t inCount,
+            const uint8_t* inValue,
+            const size_t inValueSize,
+            const size_t* inValueSizes
+            );
+
         /**
          * Gets the size of a block in the block store
          * Primary expected use: python / untrusted side
@@ -186,5 +250,37 @@ namespace pdo
             const ByteArray& inValue
             );
 
+        /**
+         * Gets a sequence of blocks from the block store
+         * Primary expected use: state flush and prefetch
+         *
+         * @param inIds      ids of the blocks
+         * @param outValues  [output] block data, in the order of the ids
+         *
+         * @return
+         *  PDO_SUCCESS   outValues contains the requested blocks
+         *  else          failed, outValues undefined
+         */
+        pdo_err_t BlockStoreGetMany(
+            const std::vector<ByteArray>& inIds,
+            std::vector<ByteArray>& outValues
+            );
+
+        /**
+         * Puts a sequence of blocks into the block store
+         * Primary expected use: state flush
+         *
+         * @param inIds     ids of the blocks
+         * @param inValues  block data to write, in the order of the ids
+         *
+         * @return
+         *  PDO_SUCCESS  all id->value pairs stored
+         *  else         failed
+         */
+        pdo_err_t BlockStorePutMany(
+            const std::vector<ByteArray>& inIds,
+            const std::vector<ByteArray>& inValues
+            );
+
     } /* contract */
 } /* pdo */
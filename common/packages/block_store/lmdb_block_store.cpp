@@ -42,77 +42,315 @@
  */
 #define DEFAULT_BLOCK_STORE_SIZE (1ULL << 40)
 
+/*
+ * Maximum number of concurrent read transactions on a shard; each
+ * read transaction, including the ones that threads keep between
+ * reads, holds one reader slot in the shard
+ */
+#define MAXIMUM_BLOCK_STORE_READERS 512
+
+/*
+ * Maximum number of read transactions that threads keep between reads
+ * on a shard, see SafeReadTransaction; the remaining reader slots are
+ * left for the reads of the other threads
+ */
+#define MAXIMUM_BLOCK_STORE_CACHED_READERS (MAXIMUM_BLOCK_STORE_READERS / 2)
+
+/*
+ * Maximum number of shards, that is independent LMDB environments,
+ * that the blocks can be spread over
+ */
+#define MAXIMUM_BLOCK_STORE_SHARDS 64
+
 /* -----------------------------------------------------------------
  * CLASS: SafeThreadLock
  *
- * This class initializes the lock for serializing  and wraps transactions to
- * ensure that the resources are released when the object is deallocated.
+ * This class takes a lock and releases it when the object is
+ * deallocated. LMDB allows any number of readers to run concurrently
+ * with a single writer, so read transactions do not take a lock.
  * ----------------------------------------------------------------- */
 
-/* Lock to protect access to the database */
+/* Lock to serialize opening, closing and rebalancing the store */
 static pthread_mutex_t lmdb_block_store_lock = PTHREAD_MUTEX_INITIALIZER;
 
 class SafeThreadLock
 {
+private:
+    pthread_mutex_t& lock_;
+
 public:
-    SafeThreadLock(void)
+    SafeThreadLock(pthread_mutex_t& lock) : lock_(lock)
     {
-        pthread_mutex_lock(&lmdb_block_store_lock);
+        pthread_mutex_lock(&lock_);
     }
 
     ~SafeThreadLock(void)
     {
-        pthread_mutex_unlock(&lmdb_block_store_lock);
+        pthread_mutex_unlock(&lock_);
     }
 };
 
 /* -----------------------------------------------------------------
- * CLASS: SafeTransaction
- *
- * This class initializes the lmdb database and wraps transactions to
- * ensure that the resources are released when the object is deallocated.
+ * Group commit requests, see group_commit below
  * ----------------------------------------------------------------- */
+typedef struct
+{
+    const uint8_t* id_;
+    size_t id_size_;
+    const uint8_t* value_;
+    size_t value_size_;
+} block_write_t;
+
+typedef struct
+{
+    std::vector<block_write_t> blocks_;
+    pdo_err_t result_;
+    bool done_;
+} put_request_t;
 
-/* Lightning database environment used to store data */
+/* -----------------------------------------------------------------
+ * CLASS: BlockStoreShard
+ *
+ * The blocks are spread over one or more shards. Each shard is a
+ * Lightning database environment in its own file with its own writer,
+ * so writes to different shards proceed in parallel. The database
+ * handles are opened once when the shard is opened and are shared by
+ * all transactions on the shard.
+ *
+ * The expiration database is an index of the blocks ordered by their
+ * expiration time; its keys are the big-endian expiration time
+ * followed by the block id, its values are empty. The store database
+ * of the first shard records the number of shards.
+ *
+ * Shards are never deallocated; a shard that is no longer used keeps
+ * its (closed) state until the store opens it again.
+ * ----------------------------------------------------------------- */
 #define BLOCK_DB_NAME "block_data"
 #define META_DB_NAME "meta_data"
+#define EXPIRATION_DB_NAME "expiration_data"
+#define STORE_DB_NAME "store_data"
 
-static MDB_env* lmdb_block_store_env;
-
-class SafeTransaction
+class BlockStoreShard
 {
 public:
+    MDB_env* env_ = NULL;
     MDB_dbi dbi_ = 0;
     MDB_dbi meta_dbi_ = 0;
-    MDB_txn* txn_ = NULL;
+    MDB_dbi expiration_dbi_ = 0;
+    MDB_dbi store_dbi_ = 0;
+
+    // serializes the write transactions on the shard and protects
+    // the set of read transactions
+    pthread_mutex_t lock_;
+
+    // read transactions of all threads, see SafeReadTransaction
+    std::atomic<uint64_t> generation_;
+    std::set<MDB_txn*> readers_;
+
+    // reads in progress and the close that waits for them to end,
+    // see close_shards
+    std::atomic<unsigned> active_readers_;
+    std::atomic<bool> closing_;
+    pthread_cond_t readers_cond_;
+
+    // puts waiting for the next group commit, see group_commit
+    pthread_mutex_t queue_lock_;
+    pthread_cond_t queue_cond_;
+    std::vector<put_request_t*> queue_;
+    bool committing_ = false;
+
+    // position of the scan that adds blocks missing from the
+    // expiration index, protected by the shard lock
+    std::string index_position_;
+    bool index_complete_ = false;
+
+    // position of the scan that moves blocks to the shard they are
+    // routed to, protected by the block store lock
+    std::string rebalance_position_;
+    bool rebalance_complete_ = false;
+
+    BlockStoreShard(void) : generation_(0), active_readers_(0), closing_(false)
+    {
+        pthread_mutex_init(&lock_, NULL);
+        pthread_cond_init(&readers_cond_, NULL);
+        pthread_mutex_init(&queue_lock_, NULL);
+        pthread_cond_init(&queue_cond_, NULL);
+    }
+};
 
-    SafeTransaction(unsigned int txn_flags = 0, unsigned int dbi_flags = 0) {
-        int ret;
-        ret = mdb_txn_begin(lmdb_block_store_env, NULL, txn_flags, &txn_);
-        if (ret == MDB_SUCCESS)
+static BlockStoreShard lmdb_block_store_shards[MAXIMUM_BLOCK_STORE_SHARDS];
+
+/* number of shards with an open environment, protected by the block store lock */
+static unsigned lmdb_block_store_open_shards = 0;
+
+static std::string lmdb_block_store_path;
+static bool lmdb_block_store_sync_on_commit = false;
+
+/* -----------------------------------------------------------------
+ * Routing
+ *
+ * A block is routed to a shard by the first two bytes of its id, the
+ * ids are hashes so the blocks are spread evenly. When the number of
+ * shards changes, the previous shard count is kept until every block
+ * has been moved to the shard that it is routed to; in the meantime
+ * a block is looked up in the shard of the previous routing and then
+ * in the shard of the current routing, and new blocks are written to
+ * the shard of the current routing. A shard count of zero means that
+ * the store is not open, a previous shard count of zero means that no
+ * blocks are being moved.
+ *
+ * Readers and writers register with the routing epoch while they use
+ * a routing; before blocks are moved to a new routing, the store waits
+ * for the readers and writers of the previous epoch so that no block
+ * is looked up or written with a stale routing. The last user of an
+ * epoch that is no longer current wakes the threads that wait for it.
+ * ----------------------------------------------------------------- */
+static std::atomic<unsigned> lmdb_block_store_shard_count(0);
+static std::atomic<unsigned> lmdb_block_store_previous_shard_count(0);
+static std::atomic<uint64_t> lmdb_block_store_routing_epoch(0);
+static std::atomic<int64_t> lmdb_block_store_routing_users[2];
+
+static pthread_mutex_t lmdb_block_store_routing_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t lmdb_block_store_routing_cond = PTHREAD_COND_INITIALIZER;
+
+static unsigned route_block(
+    const uint8_t* inId,
+    const size_t inIdSize,
+    const unsigned inShardCount)
+{
+    unsigned prefix = 0;
+    for (size_t i = 0; i < 2 && i < inIdSize; i++)
+        prefix = (prefix << 8) | inId[i];
+
+    return prefix % inShardCount;
+}
+
+static void leave_routing(const uint64_t inEpoch)
+{
+    if (--lmdb_block_store_routing_users[inEpoch & 1] == 0 && inEpoch != lmdb_block_store_routing_epoch)
+    {
+        SafeThreadLock rlock(lmdb_block_store_routing_lock);
+        pthread_cond_broadcast(&lmdb_block_store_routing_cond);
+    }
+}
+
+// wait until no reader or writer uses the routing of inEpoch, which
+// must not be the current epoch
+static void wait_for_routing(const uint64_t inEpoch)
+{
+    SafeThreadLock rlock(lmdb_block_store_routing_lock);
+    while (lmdb_block_store_routing_users[inEpoch & 1] > 0)
+        pthread_cond_wait(&lmdb_block_store_routing_cond, &lmdb_block_store_routing_lock);
+}
+
+class ShardRouting
+{
+private:
+    uint64_t epoch_;
+
+public:
+    unsigned shard_count_;
+    unsigned previous_shard_count_;
+
+    ShardRouting(void)
+    {
+        while (true)
         {
-            ret = mdb_dbi_open(txn_, BLOCK_DB_NAME, dbi_flags, &dbi_);
-            if (ret == MDB_SUCCESS)
-            {
-                ret = mdb_dbi_open(txn_, META_DB_NAME, dbi_flags, &meta_dbi_);
-                if (ret == MDB_SUCCESS)
-                    return;
-                else
-                    SAFE_LOG(PDO_LOG_ERROR, "Failed to open metadata database: %d", ret);
-            }
-            else
-                SAFE_LOG(PDO_LOG_ERROR, "Failed to open main database: %d", ret);
+            epoch_ = lmdb_block_store_routing_epoch;
+            lmdb_block_store_routing_users[epoch_ & 1]++;
+            if (epoch_ == lmdb_block_store_routing_epoch)
+                break;
+            leave_routing(epoch_);
         }
-        else
-            SAFE_LOG(PDO_LOG_ERROR, "LMDB transaction begin failed: %d", ret);
 
-        if (txn_ != NULL)
+        shard_count_ = lmdb_block_store_shard_count;
+        previous_shard_count_ = lmdb_block_store_previous_shard_count;
+    }
+
+    ~ShardRouting(void)
+    {
+        leave_routing(epoch_);
+    }
+
+    bool open(void) const
+    {
+        return shard_count_ != 0;
+    }
+
+    unsigned shard(const uint8_t* inId, const size_t inIdSize) const
+    {
+        return route_block(inId, inIdSize, shard_count_);
+    }
+
+    unsigned previous_shard(const uint8_t* inId, const size_t inIdSize) const
+    {
+        if (previous_shard_count_ == 0)
+            return shard(inId, inIdSize);
+        return route_block(inId, inIdSize, previous_shard_count_);
+    }
+};
+
+// XXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXX
+// Switch to a new routing; must be called with the block store lock
+// held. The readers and writers of the previous epoch may still be
+// running when this returns, BlockStoreRebalance waits for them before
+// it moves blocks. The new epoch shares its counter with the epoch
+// before the previous one, whose users are normally long gone since
+// the blocks of that change were moved after they left
+// XXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXX
+static void start_routing(const unsigned inShardCount, const unsigned inPreviousShardCount)
+{
+    wait_for_routing(lmdb_block_store_routing_epoch + 1);
+
+    for (unsigned s = 0; s < lmdb_block_store_open_shards; s++)
+    {
+        lmdb_block_store_shards[s].rebalance_position_.clear();
+        lmdb_block_store_shards[s].rebalance_complete_ = false;
+    }
+
+    lmdb_block_store_previous_shard_count = inPreviousShardCount;
+    lmdb_block_store_shard_count = inShardCount;
+
+    lmdb_block_store_routing_epoch++;
+}
+
+/* -----------------------------------------------------------------
+ * CLASS: SafeTransaction
+ *
+ * This class wraps write transactions to ensure that the resources
+ * are released when the object is deallocated. The lock of the shard
+ * is held for the lifetime of the transaction.
+ * ----------------------------------------------------------------- */
+class SafeTransaction
+{
+private:
+    SafeThreadLock slock_;
+
+public:
+    MDB_dbi dbi_;
+    MDB_dbi meta_dbi_;
+    MDB_dbi expiration_dbi_;
+    MDB_dbi store_dbi_;
+    MDB_txn* txn_ = NULL;
+
+    SafeTransaction(BlockStoreShard& shard) :
+        slock_(shard.lock_),
+        dbi_(shard.dbi_),
+        meta_dbi_(shard.meta_dbi_),
+        expiration_dbi_(shard.expiration_dbi_),
+        store_dbi_(shard.store_dbi_)
+    {
+        pdo::error::ThrowIfNull(shard.env_, "block store is not open");
+        pdo::error::ThrowIf<pdo::error::ValueError>(
+            shard.closing_, "block store is not open");
+
+        int ret = mdb_txn_begin(shard.env_, NULL, 0, &txn_);
+        if (ret != MDB_SUCCESS)
         {
-            mdb_txn_abort(txn_);
+            SAFE_LOG(PDO_LOG_ERROR, "LMDB transaction begin failed: %d", ret);
             txn_ = NULL;
+            throw pdo::error::SystemError("failed to open LMDB transaction");
         }
-
-        throw pdo::error::SystemError("failed to open LMDB transaction");
     }
 
     ~SafeTransaction(void) {
@@ -131,26 +369,238 @@ public:
 
     void commit(void) {
         pdo::error::ThrowIfNull(txn_, "duplicate commit of LMDB transaction");
-        mdb_txn_commit(txn_);
+        int ret = mdb_txn_commit(txn_);
+        txn_ = NULL;
+        pdo::error::ThrowIf<pdo::error::SystemError>(
+            ret != MDB_SUCCESS, "failed to commit LMDB transaction");
+    }
+};
+
+/* -----------------------------------------------------------------
+ * CLASS: SafeShardTransactions
+ *
+ * Write transactions on several shards, used when a change must be
+ * made in all of the shards or in none. Every thread that holds the
+ * locks of more than one shard takes them through this class, in the
+ * order of the shard index, so that two such threads cannot deadlock.
+ * The transactions that are not committed are aborted when the object
+ * is deallocated.
+ * ----------------------------------------------------------------- */
+class SafeShardTransactions
+{
+private:
+    std::map<unsigned, SafeTransaction*> transactions_;
+
+    SafeShardTransactions(const SafeShardTransactions&);
+    SafeShardTransactions& operator=(const SafeShardTransactions&);
+
+public:
+    SafeShardTransactions(const std::set<unsigned>& inShards)
+    {
+        try
+        {
+            for (std::set<unsigned>::const_iterator s = inShards.begin(); s != inShards.end(); s++)
+                transactions_[*s] = new SafeTransaction(lmdb_block_store_shards[*s]);
+        }
+        catch (...)
+        {
+            release();
+            throw;
+        }
+    }
+
+    ~SafeShardTransactions(void) {
+        release();
+    }
+
+    SafeTransaction& operator[](const unsigned inShard) {
+        return *transactions_.at(inShard);
+    }
+
+    // commit the transactions in the order of the shard index; LMDB
+    // commits fail only when the disk fails or is full, in which case
+    // the shards committed before the failure keep their changes
+    void commit(void) {
+        for (std::map<unsigned, SafeTransaction*>::iterator t = transactions_.begin(); t != transactions_.end(); t++)
+        {
+            if (t->second->txn_ != NULL)
+                t->second->commit();
+        }
+    }
+
+    // abort the transactions in reverse order to release the locks in
+    // the reverse of the order in which they were taken
+    void release(void) {
+        for (std::map<unsigned, SafeTransaction*>::reverse_iterator t = transactions_.rbegin(); t != transactions_.rend(); t++)
+            delete t->second;
+        transactions_.clear();
+    }
+};
+
+/* -----------------------------------------------------------------
+ * CLASS: SafeReadTransaction
+ *
+ * This class wraps read-only transactions on a shard. The environments
+ * are opened with MDB_NOTLS so that read transactions are not bound to
+ * the reader slot of the thread that created them; each thread keeps
+ * one read transaction per shard that is reset when a read completes
+ * and renewed for the next read, which avoids allocating a transaction
+ * and a reader slot for every operation. A reset transaction keeps its
+ * reader slot, so at most MAXIMUM_BLOCK_STORE_CACHED_READERS threads
+ * keep a transaction on a shard; the reads of other threads begin and
+ * end a transaction of their own.
+ *
+ * The read transactions of all threads are registered with the shard
+ * so that they can be released when the store is closed; a thread
+ * notices that the store was closed or reopened through the generation
+ * counter of the shard. A read is counted while it is in progress and
+ * closing the store waits until no read is in progress, so only the
+ * transactions that are reset are released.
+ * ----------------------------------------------------------------- */
+class ReaderSlot
+{
+public:
+    BlockStoreShard* shard_ = NULL;
+    MDB_txn* txn_ = NULL;
+    uint64_t generation_ = 0;
+    bool active_ = false;
+
+    ~ReaderSlot(void) {
+        if (shard_ == NULL)
+            return;
+
+        SafeThreadLock slock(shard_->lock_);
+        if (txn_ != NULL && generation_ == shard_->generation_)
+        {
+            shard_->readers_.erase(txn_);
+            mdb_txn_abort(txn_);
+        }
+    }
+};
+
+static thread_local ReaderSlot lmdb_block_store_reader[MAXIMUM_BLOCK_STORE_SHARDS];
+
+class SafeReadTransaction
+{
+private:
+    BlockStoreShard& shard_;
+    ReaderSlot& reader_;
+
+    // set when the transaction belongs to this object rather than
+    // to the thread, that is when reads are nested or when the shard
+    // keeps as many transactions between reads as it allows
+    bool owned_ = false;
+
+    // end the read counted by the constructor and wake a close that
+    // waits for it
+    void release(void) {
+        if (--shard_.active_readers_ == 0 && shard_.closing_)
+        {
+            SafeThreadLock slock(shard_.lock_);
+            pthread_cond_broadcast(&shard_.readers_cond_);
+        }
+    }
+
+public:
+    MDB_dbi dbi_;
+    MDB_dbi meta_dbi_;
+    MDB_txn* txn_ = NULL;
+
+    SafeReadTransaction(BlockStoreShard& shard) :
+        shard_(shard),
+        reader_(lmdb_block_store_reader[&shard - lmdb_block_store_shards]),
+        dbi_(shard.dbi_),
+        meta_dbi_(shard.meta_dbi_)
+    {
+        // count the read before looking at the environment, a close
+        // that has started is seen here and a close that starts later
+        // waits for the read to end
+        shard.active_readers_++;
+        if (shard.closing_ || shard.env_ == NULL)
+        {
+            release();
+            throw pdo::error::ValueError("block store is not open");
+        }
+
+        int ret;
+
+        if (reader_.active_)
+        {
+            owned_ = true;
+            ret = mdb_txn_begin(shard.env_, NULL, MDB_RDONLY, &txn_);
+        }
+        else if (reader_.txn_ != NULL && reader_.generation_ == shard.generation_)
+        {
+            ret = mdb_txn_renew(reader_.txn_);
+            if (ret == MDB_SUCCESS)
+                txn_ = reader_.txn_;
+        }
+        else
+        {
+            // the transaction from an earlier generation was released
+            // when the store was closed
+            reader_.txn_ = NULL;
+
+            SafeThreadLock slock(shard.lock_);
+            owned_ = (shard.readers_.size() >= MAXIMUM_BLOCK_STORE_CACHED_READERS);
+            ret = mdb_txn_begin(shard.env_, NULL, MDB_RDONLY, &txn_);
+            if (ret == MDB_SUCCESS && ! owned_)
+            {
+                shard.readers_.insert(txn_);
+                reader_.shard_ = &shard;
+                reader_.txn_ = txn_;
+                reader_.generation_ = shard.generation_;
+            }
+        }
+
+        if (ret != MDB_SUCCESS)
+        {
+            SAFE_LOG(PDO_LOG_ERROR, "LMDB read transaction begin failed: %d", ret);
+            txn_ = NULL;
+            release();
+            throw pdo::error::SystemError("failed to open LMDB transaction");
+        }
+
+        if (! owned_)
+            reader_.active_ = true;
+    }
+
+    ~SafeReadTransaction(void) {
+        if (txn_ != NULL)
+            commit();
+    }
+
+    // end the snapshot; the transaction is kept for the next read
+    void commit(void) {
+        pdo::error::ThrowIfNull(txn_, "duplicate commit of LMDB transaction");
+        if (owned_)
+            mdb_txn_abort(txn_);
+        else
+        {
+            mdb_txn_reset(txn_);
+            reader_.active_ = false;
+        }
         txn_ = NULL;
+        release();
     }
 };
 
 // XXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXX
-static pdo_err_t get_data(
+// Find the data in the memory map; the view is valid for the life of
+// the transaction
+// XXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXX
+static pdo_err_t get_data_view(
     MDB_dbi dbi,
     MDB_txn* txn,
     const uint8_t* inId,
     const size_t inIdSize,
-    uint8_t* outValue,
-    const size_t inValueSize)
+    MDB_val& outData)
 {
     MDB_val lmdb_id;
     lmdb_id.mv_size = inIdSize;
     lmdb_id.mv_data = (void*)inId;
 
-    MDB_val lmdb_data;
-    int ret = mdb_get(txn, dbi, &lmdb_id, &lmdb_data);
+    int ret = mdb_get(txn, dbi, &lmdb_id, &outData);
     if (ret == MDB_NOTFOUND)
     {
         SAFE_LOG(PDO_LOG_DEBUG, "data not found");
@@ -163,6 +613,22 @@ static pdo_err_t get_data(
         return PDO_ERR_SYSTEM;
     }
 
+    return PDO_SUCCESS;
+}
+
+static pdo_err_t get_data(
+    MDB_dbi dbi,
+    MDB_txn* txn,
+    const uint8_t* inId,
+    const size_t inIdSize,
+    uint8_t* outValue,
+    const size_t inValueSize)
+{
+    MDB_val lmdb_data;
+    pdo_err_t result = get_data_view(dbi, txn, inId, inIdSize, lmdb_data);
+    if (result != PDO_SUCCESS)
+        return result;
+
     if (inValueSize < lmdb_data.mv_size)
     {
         SAFE_LOG(PDO_LOG_ERROR, "insufficient space allocated for data block");
@@ -226,106 +692,1029 @@ static pdo_err_t put_metadata(
 }
 
 // XXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXX
-void pdo::lmdb_block_store::BlockStoreOpen(const std::string& db_path)
-{
-    SafeThreadLock slock;
-
-    int ret;
-
-    ret = mdb_env_create(&lmdb_block_store_env);
-    pdo::error::ThrowIf<pdo::error::SystemError>(ret != 0, "Failed to create LMDB environment");
-
-    ret = mdb_env_set_mapsize(lmdb_block_store_env, DEFAULT_BLOCK_STORE_SIZE);
-    pdo::error::ThrowIf<pdo::error::SystemError>(ret != 0, "Failed to set LMDB default size");
-
-    ret = mdb_env_set_maxdbs(lmdb_block_store_env, 2);
-    pdo::error::ThrowIf<pdo::error::SystemError>(ret != 0, "Failed to set LMDB database count");
+// The expiration index orders blocks by expiration time so that the
+// expired blocks can be found without a scan of the metadata
+// XXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXX
+#define EXPIRATION_TIME_SIZE sizeof(uint64_t)
 
-    /*
-     * MDB_NOSUBDIR avoids creating an additional directory for the database
-     * MDB_WRITEMAP | MDB_NOMETASYNC should substantially improve LMDB's performance
-     * This risks possibly losing at most the last transaction if the system crashes
-     * before it is written to disk.
-     */
-    unsigned int flags = MDB_NOSUBDIR | MDB_WRITEMAP | MDB_NOMETASYNC | MDB_MAPASYNC;
-    ret = mdb_env_open(lmdb_block_store_env, db_path.c_str(), flags, 0664);
-    pdo::error::ThrowIf<pdo::error::SystemError>(ret != 0, "Failed to open LMDB database");
+static ByteArray expiration_key(
+    const uint64_t expiration_time,
+    const uint8_t* inId,
+    const size_t inIdSize)
+{
+    ByteArray key(EXPIRATION_TIME_SIZE + inIdSize);
+    for (size_t i = 0; i < EXPIRATION_TIME_SIZE; i++)
+        key[i] = (expiration_time >> (8 * (EXPIRATION_TIME_SIZE - 1 - i))) & 0xff;
 
-    // Ensure that the databases are created
-    SafeTransaction stxn(0, MDB_CREATE);
-    stxn.commit();
+    std::copy(inId, inId + inIdSize, key.begin() + EXPIRATION_TIME_SIZE);
+    return key;
 }
 
-// XXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXX
-void pdo::lmdb_block_store::BlockStoreClose()
+static uint64_t expiration_time_from_key(const MDB_val& key)
 {
-    if (lmdb_block_store_env != NULL)
-        mdb_env_close(lmdb_block_store_env);
+    const uint8_t* data = (const uint8_t*)key.mv_data;
+    uint64_t expiration_time = 0;
+    for (size_t i = 0; i < EXPIRATION_TIME_SIZE && i < key.mv_size; i++)
+        expiration_time = (expiration_time << 8) | data[i];
+
+    return expiration_time;
 }
 
-// XXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXX
-pdo_err_t pdo::block_store::BlockStoreHead(
+static pdo_err_t put_expiration(
+    SafeTransaction& stxn,
     const uint8_t* inId,
     const size_t inIdSize,
-    bool* outIsPresent,
-    size_t* outValueSize
-)
+    const uint64_t expiration_time)
 {
-    *outValueSize = 0;
-
-    pdo::block_store::BlockMetaData metadata;
-    pdo_err_t result = pdo::block_store::BlockStoreHead(inId, inIdSize, outIsPresent, &metadata);
-    if (result == PDO_SUCCESS)
-        *outValueSize = metadata.block_size_;
-
-    return result;
+    ByteArray key = expiration_key(expiration_time, inId, inIdSize);
+    return put_data(stxn.expiration_dbi_, stxn.txn_, key.data(), key.size(), NULL, 0);
 }
 
-// XXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXX
-pdo_err_t pdo::block_store::BlockStoreHead(
+// an entry that does not exist is not an error, blocks written by
+// earlier versions of the store are not in the index
+static pdo_err_t delete_expiration(
+    SafeTransaction& stxn,
     const uint8_t* inId,
     const size_t inIdSize,
-    bool* outIsPresent,
-    pdo::block_store::BlockMetaData *outMetadata
-)
+    const uint64_t expiration_time)
 {
-#if BLOCK_STORE_DEBUG
-    {
-        std::string idStr = BinaryToHexString(inId, inIdSize);
-        SAFE_LOG(PDO_LOG_DEBUG, "BlockStoreHead: '%s'", idStr.c_str());
-    }
-#endif
-
-    *outIsPresent = false;
+    ByteArray key = expiration_key(expiration_time, inId, inIdSize);
 
-    SafeTransaction stxn(MDB_RDONLY);
+    MDB_val lmdb_key;
+    lmdb_key.mv_size = key.size();
+    lmdb_key.mv_data = (void*)key.data();
 
-    if (stxn.txn_ == NULL)
+    int ret = mdb_del(stxn.txn_, stxn.expiration_dbi_, &lmdb_key, NULL);
+    if (ret != MDB_SUCCESS && ret != MDB_NOTFOUND)
+    {
+        SAFE_LOG(PDO_LOG_ERROR, "failed to remove block from the expiration index; %d", ret);
         return PDO_ERR_SYSTEM;
+    }
+
+    return PDO_SUCCESS;
+}
+
+static pdo_err_t delete_data(
+    MDB_dbi dbi,
+    MDB_txn* txn,
+    const uint8_t* inId,
+    const size_t inIdSize)
+{
+    MDB_val lmdb_id;
+    lmdb_id.mv_size = inIdSize;
+    lmdb_id.mv_data = (void*)inId;
+
+    int ret = mdb_del(txn, dbi, &lmdb_id, NULL);
+    if (ret != MDB_SUCCESS && ret != MDB_NOTFOUND)
+    {
+        SAFE_LOG(PDO_LOG_ERROR, "Failed to delete from LMDB database : %d", ret);
+        return PDO_ERR_SYSTEM;
+    }
+
+    return PDO_SUCCESS;
+}
+
+// XXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXX
+// Write the block and its metadata as part of a larger transaction;
+// blocks are addressed by their content so a block that is already
+// present is not written again, only its expiration time is extended
+// XXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXX
+static pdo_err_t put_block(
+    SafeTransaction& stxn,
+    const uint8_t* inId,
+    const size_t inIdSize,
+    const uint8_t* inValue,
+    const size_t inValueSize,
+    const struct timeval& now)
+{
+    pdo_err_t result;
+    pdo::block_store::BlockMetaData metadata;
+
+    result = get_metadata(stxn.meta_dbi_, stxn.txn_, inId, inIdSize, &metadata);
+    if (result == PDO_SUCCESS && metadata.block_size_ == inValueSize)
+    {
+        uint64_t expiration_time = now.tv_sec + MINIMUM_EXPIRATION_TIME;
+        if (expiration_time <= metadata.expiration_time_)
+            return PDO_SUCCESS;
+
+        result = delete_expiration(stxn, inId, inIdSize, metadata.expiration_time_);
+        if (result != PDO_SUCCESS)
+            return result;
+
+        metadata.expiration_time_ = expiration_time;
+        result = put_metadata(stxn.meta_dbi_, stxn.txn_, inId, inIdSize, &metadata);
+        if (result != PDO_SUCCESS)
+        {
+            SAFE_LOG(PDO_LOG_ERROR, "failed to extend block expiration; %d", result);
+            return result;
+        }
+
+        return put_expiration(stxn, inId, inIdSize, expiration_time);
+    }
+
+    result = put_data(stxn.dbi_, stxn.txn_, inId, inIdSize, inValue, inValueSize);
+    if (result != PDO_SUCCESS)
+    {
+        SAFE_LOG(PDO_LOG_ERROR, "failed to write block data; %d", result);
+        return result;
+    }
+
+    // update the last access time
+    metadata.block_size_ = inValueSize;
+    metadata.create_time_ = now.tv_sec;
+    metadata.expiration_time_ = now.tv_sec + MINIMUM_EXPIRATION_TIME;
+    metadata.tag_ = 0;
+    result = put_metadata(stxn.meta_dbi_, stxn.txn_, inId, inIdSize, &metadata);
+    if (result != PDO_SUCCESS)
+    {
+        SAFE_LOG(PDO_LOG_ERROR, "failed to save block meta data; %d", result);
+        return result;
+    }
+
+    return put_expiration(stxn, inId, inIdSize, metadata.expiration_time_);
+}
+
+// XXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXX
+// Copy a block that is moved from another shard; if the block is
+// already in this shard, the later expiration time is kept
+// XXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXX
+static pdo_err_t copy_block(
+    SafeTransaction& stxn,
+    const ByteArray& inId,
+    const ByteArray& inValue,
+    const pdo::block_store::BlockMetaData& inMetadata)
+{
+    pdo_err_t result;
+    pdo::block_store::BlockMetaData metadata;
+
+    result = get_metadata(stxn.meta_dbi_, stxn.txn_, inId.data(), inId.size(), &metadata);
+    if (result == PDO_SUCCESS && metadata.block_size_ == inValue.size())
+    {
+        if (metadata.expiration_time_ < inMetadata.expiration_time_)
+        {
+            result = delete_expiration(stxn, inId.data(), inId.size(), metadata.expiration_time_);
+            if (result == PDO_SUCCESS)
+                result = put_expiration(stxn, inId.data(), inId.size(), inMetadata.expiration_time_);
+            if (result != PDO_SUCCESS)
+                return result;
+
+            metadata.expiration_time_ = inMetadata.expiration_time_;
+        }
+
+        if (metadata.tag_ == 0)
+            metadata.tag_ = inMetadata.tag_;
+
+        return put_metadata(stxn.meta_dbi_, stxn.txn_, inId.data(), inId.size(), &metadata);
+    }
+
+    if (result != PDO_SUCCESS && result != PDO_ERR_NOTFOUND)
+        return result;
+
+    result = put_data(stxn.dbi_, stxn.txn_, inId.data(), inId.size(), inValue.data(), inValue.size());
+    if (result == PDO_SUCCESS)
+        result = put_metadata(stxn.meta_dbi_, stxn.txn_, inId.data(), inId.size(), &inMetadata);
+    if (result == PDO_SUCCESS)
+        result = put_expiration(stxn, inId.data(), inId.size(), inMetadata.expiration_time_);
+
+    return result;
+}
+
+/* -----------------------------------------------------------------
+ * CLASS: ShardedReadTransaction
+ *
+ * A read transaction over all of the shards; the read transaction on
+ * a shard begins when the first block is looked up in the shard, so
+ * reads that touch one shard cost the same as with a single shard.
+ *
+ * While blocks are moved between shards, a block is looked up in the
+ * shard it was routed to first. A block is copied to its new shard
+ * before it is removed from the old one, so a block that is not in
+ * the old shard is found in the new shard provided that the snapshot
+ * of the new shard was taken after the snapshot of the old shard.
+ * ----------------------------------------------------------------- */
+class ShardedReadTransaction
+{
+private:
+    ShardRouting routing_;
+    SafeReadTransaction* transactions_[MAXIMUM_BLOCK_STORE_SHARDS];
+    uint64_t sequence_[MAXIMUM_BLOCK_STORE_SHARDS];
+    uint64_t next_sequence_ = 0;
+    std::vector<SafeReadTransaction*> retries_;
+
+    SafeReadTransaction& transaction(const unsigned inShard)
+    {
+        if (transactions_[inShard] == NULL)
+        {
+            transactions_[inShard] = new SafeReadTransaction(lmdb_block_store_shards[inShard]);
+            sequence_[inShard] = next_sequence_++;
+        }
+
+        return *transactions_[inShard];
+    }
+
+    static pdo_err_t lookup(
+        SafeReadTransaction& stxn,
+        const bool inMetadata,
+        const uint8_t* inId,
+        const size_t inIdSize,
+        MDB_val& outData)
+    {
+        return get_data_view(inMetadata ? stxn.meta_dbi_ : stxn.dbi_, stxn.txn_, inId, inIdSize, outData);
+    }
+
+public:
+    ShardedReadTransaction(void)
+    {
+        pdo::error::ThrowIf<pdo::error::RuntimeError>(! routing_.open(), "block store is not open");
+
+        for (size_t s = 0; s < MAXIMUM_BLOCK_STORE_SHARDS; s++)
+            transactions_[s] = NULL;
+    }
+
+    ~ShardedReadTransaction(void)
+    {
+        commit();
+    }
+
+    // find the block data, or the block metadata, in the shard that
+    // holds the block; the view is valid for the life of the transaction
+    pdo_err_t find(
+        const bool inMetadata,
+        const uint8_t* inId,
+        const size_t inIdSize,
+        MDB_val& outData)
+    {
+        const unsigned shard = routing_.shard(inId, inIdSize);
+        const unsigned previous_shard = routing_.previous_shard(inId, inIdSize);
+        if (shard == previous_shard)
+            return lookup(transaction(shard), inMetadata, inId, inIdSize, outData);
+
+        pdo_err_t result = lookup(transaction(previous_shard), inMetadata, inId, inIdSize, outData);
+        if (result != PDO_ERR_NOTFOUND)
+            return result;
+
+        SafeReadTransaction& stxn = transaction(shard);
+        if (sequence_[shard] > sequence_[previous_shard])
+            return lookup(stxn, inMetadata, inId, inIdSize, outData);
+
+        // the snapshot of the new shard is older than the snapshot of
+        // the old shard, take a new snapshot that is kept as long as
+        // the views that it returns
+        retries_.push_back(new SafeReadTransaction(lmdb_block_store_shards[shard]));
+        return lookup(*retries_.back(), inMetadata, inId, inIdSize, outData);
+    }
+
+    void commit(void)
+    {
+        for (size_t i = 0; i < retries_.size(); i++)
+            delete retries_[i];
+        retries_.clear();
+
+        for (size_t s = 0; s < MAXIMUM_BLOCK_STORE_SHARDS; s++)
+        {
+            delete transactions_[s];
+            transactions_[s] = NULL;
+        }
+    }
+};
+
+/* -----------------------------------------------------------------
+ * Group commit
+ *
+ * Puts from concurrent callers are queued and committed together in
+ * one write transaction on the shard. The first caller that finds no
+ * commit in progress becomes the leader: it takes every queued request,
+ * writes them in a single transaction and wakes the callers that it
+ * committed for. Callers that arrive while a commit is in progress
+ * wait and are picked up by the next leader. The blocks of a single
+ * request are committed atomically; if the batch transaction fails,
+ * each request is retried in its own transaction so that one failing
+ * request does not fail the others.
+ * ----------------------------------------------------------------- */
+
+// XXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXX
+static pdo_err_t commit_requests(
+    BlockStoreShard& shard,
+    std::vector<put_request_t*>::iterator first,
+    std::vector<put_request_t*>::iterator last)
+{
+    pdo_err_t result;
+
+    try
+    {
+        SafeTransaction stxn(shard);
+
+        struct timeval now;
+        gettimeofday(&now, NULL);
+
+        for (std::vector<put_request_t*>::iterator request = first; request != last; request++)
+        {
+            std::vector<block_write_t>& blocks = (*request)->blocks_;
+            for (size_t i = 0; i < blocks.size(); i++)
+            {
+                // the transaction is aborted if any of the puts fails
+                result = put_block(stxn,
+                    blocks[i].id_, blocks[i].id_size_, blocks[i].value_, blocks[i].value_size_, now);
+                if (result != PDO_SUCCESS)
+                    return result;
+            }
+        }
+
+        stxn.commit();
+    }
+    catch (pdo::error::Error& e)
+    {
+        SAFE_LOG(PDO_LOG_ERROR, "failed to commit block store writes; %s", e.what());
+        return PDO_ERR_SYSTEM;
+    }
+
+    return PDO_SUCCESS;
+}
+
+// XXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXX
+static pdo_err_t group_commit(BlockStoreShard& shard, put_request_t& request)
+{
+    request.result_ = PDO_SUCCESS;
+    request.done_ = false;
+
+    pthread_mutex_lock(&shard.queue_lock_);
+    shard.queue_.push_back(&request);
+
+    while (shard.committing_ && ! request.done_)
+        pthread_cond_wait(&shard.queue_cond_, &shard.queue_lock_);
+
+    if (request.done_)
+    {
+        pthread_mutex_unlock(&shard.queue_lock_);
+        return request.result_;
+    }
+
+    // this caller is the leader for the requests queued so far
+    std::vector<put_request_t*> batch;
+    batch.swap(shard.queue_);
+    shard.committing_ = true;
+    pthread_mutex_unlock(&shard.queue_lock_);
+
+    pdo_err_t result = commit_requests(shard, batch.begin(), batch.end());
+    for (size_t i = 0; i < batch.size(); i++)
+    {
+        if (result == PDO_SUCCESS || batch.size() == 1)
+            batch[i]->result_ = result;
+        else
+            batch[i]->result_ = commit_requests(shard, batch.begin() + i, batch.begin() + i + 1);
+    }
+
+    pthread_mutex_lock(&shard.queue_lock_);
+    for (size_t i = 0; i < batch.size(); i++)
+        batch[i]->done_ = true;
+    shard.committing_ = false;
+    pthread_cond_broadcast(&shard.queue_cond_);
+    pthread_mutex_unlock(&shard.queue_lock_);
+
+    return request.result_;
+}
+
+// XXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXX
+// Route the blocks to their shards and commit them together or not at
+// all. Blocks that are routed to a single shard go through the group
+// commit of the shard; blocks that are routed to several shards are
+// written in a transaction on each of the shards, and the transactions
+// are committed once every block has been written.
+// XXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXX
+static pdo_err_t put_blocks(const std::vector<block_write_t>& blocks)
+{
+    ShardRouting routing;
+    if (! routing.open())
+    {
+        SAFE_LOG(PDO_LOG_ERROR, "block store is not open");
+        return PDO_ERR_SYSTEM;
+    }
+
+    std::set<unsigned> shards;
+    for (size_t i = 0; i < blocks.size(); i++)
+        shards.insert(routing.shard(blocks[i].id_, blocks[i].id_size_));
+
+    if (shards.size() <= 1)
+    {
+        put_request_t request;
+        request.blocks_ = blocks;
+        return group_commit(lmdb_block_store_shards[shards.empty() ? 0 : *shards.begin()], request);
+    }
+
+    try
+    {
+        SafeShardTransactions stxns(shards);
+
+        struct timeval now;
+        gettimeofday(&now, NULL);
+
+        for (size_t i = 0; i < blocks.size(); i++)
+        {
+            // the transactions are aborted if any of the puts fails
+            SafeTransaction& stxn = stxns[routing.shard(blocks[i].id_, blocks[i].id_size_)];
+            pdo_err_t result = put_block(stxn,
+                blocks[i].id_, blocks[i].id_size_, blocks[i].value_, blocks[i].value_size_, now);
+            if (result != PDO_SUCCESS)
+                return result;
+        }
+
+        stxns.commit();
+    }
+    catch (pdo::error::Error& e)
+    {
+        SAFE_LOG(PDO_LOG_ERROR, "failed to commit block store writes; %s", e.what());
+        return PDO_ERR_SYSTEM;
+    }
+
+    return PDO_SUCCESS;
+}
+
+/* -----------------------------------------------------------------
+ * Shards
+ *
+ * The first shard is stored in the file named by the caller so that a
+ * store with a single shard is unchanged, shard i is stored in the
+ * file with the suffix ".i". The shards are opened with the block
+ * store lock held.
+ * ----------------------------------------------------------------- */
+#define SHARD_COUNT_KEY "shard_count"
+#define PREVIOUS_SHARD_COUNT_KEY "previous_shard_count"
+
+static void open_shard(const unsigned inShard)
+{
+    BlockStoreShard& shard = lmdb_block_store_shards[inShard];
+
+    std::string shard_path = lmdb_block_store_path;
+    if (inShard > 0)
+        shard_path += "." + std::to_string(inShard);
+
+    int ret;
+    MDB_env* env;
+
+    ret = mdb_env_create(&env);
+    pdo::error::ThrowIf<pdo::error::SystemError>(ret != 0, "Failed to create LMDB environment");
+
+    ret = mdb_env_set_mapsize(env, DEFAULT_BLOCK_STORE_SIZE);
+    pdo::error::ThrowIf<pdo::error::SystemError>(ret != 0, "Failed to set LMDB default size");
+
+    ret = mdb_env_set_maxdbs(env, 4);
+    pdo::error::ThrowIf<pdo::error::SystemError>(ret != 0, "Failed to set LMDB database count");
+
+    ret = mdb_env_set_maxreaders(env, MAXIMUM_BLOCK_STORE_READERS);
+    pdo::error::ThrowIf<pdo::error::SystemError>(ret != 0, "Failed to set LMDB reader count");
+
+    /*
+     * MDB_NOSUBDIR avoids creating an additional directory for the database
+     * MDB_WRITEMAP | MDB_NOMETASYNC should substantially improve LMDB's performance
+     * This risks possibly losing at most the last transaction if the system crashes
+     * before it is written to disk. When sync_on_commit is set, every commit
+     * (that is every group of concurrent puts) is flushed to disk instead.
+     * MDB_NOTLS allows read transactions to be reset and renewed rather
+     * than tying a reader slot to the thread that created it.
+     */
+    unsigned int flags = MDB_NOSUBDIR | MDB_WRITEMAP | MDB_NOTLS;
+    if (! lmdb_block_store_sync_on_commit)
+        flags |= MDB_NOMETASYNC | MDB_MAPASYNC;
+    ret = mdb_env_open(env, shard_path.c_str(), flags, 0664);
+    pdo::error::ThrowIf<pdo::error::SystemError>(ret != 0, "Failed to open LMDB database");
+
+    // Ensure that the databases are created, the handles remain valid
+    // until the environment is closed
+    MDB_txn* txn;
+    ret = mdb_txn_begin(env, NULL, 0, &txn);
+    pdo::error::ThrowIf<pdo::error::SystemError>(ret != 0, "Failed to begin LMDB transaction");
+
+    ret = mdb_dbi_open(txn, BLOCK_DB_NAME, MDB_CREATE, &shard.dbi_);
+    if (ret == MDB_SUCCESS)
+        ret = mdb_dbi_open(txn, META_DB_NAME, MDB_CREATE, &shard.meta_dbi_);
+    if (ret == MDB_SUCCESS)
+        ret = mdb_dbi_open(txn, EXPIRATION_DB_NAME, MDB_CREATE, &shard.expiration_dbi_);
+    if (ret == MDB_SUCCESS)
+        ret = mdb_dbi_open(txn, STORE_DB_NAME, MDB_CREATE, &shard.store_dbi_);
+    if (ret != MDB_SUCCESS)
+    {
+        mdb_txn_abort(txn);
+        mdb_env_close(env);
+        throw pdo::error::SystemError("Failed to open LMDB databases");
+    }
+
+    ret = mdb_txn_commit(txn);
+    pdo::error::ThrowIf<pdo::error::SystemError>(ret != 0, "Failed to create LMDB databases");
+
+    shard.env_ = env;
+
+    // blocks written before the expiration index existed are added to
+    // the index by the garbage collector
+    shard.index_position_.clear();
+    shard.index_complete_ = false;
+
+    shard.rebalance_position_.clear();
+    shard.rebalance_complete_ = false;
+}
+
+static void open_shards(const unsigned inShardCount)
+{
+    while (lmdb_block_store_open_shards < inShardCount)
+    {
+        open_shard(lmdb_block_store_open_shards);
+        lmdb_block_store_open_shards++;
+    }
+}
+
+static void close_shards(void)
+{
+    for (unsigned s = 0; s < lmdb_block_store_open_shards; s++)
+    {
+        BlockStoreShard& shard = lmdb_block_store_shards[s];
+        SafeThreadLock slock(shard.lock_);
+
+        // wait for the reads in progress to end, new reads and writes
+        // fail while the store is closing; a thread that closes the
+        // store must not hold a read transaction itself
+        shard.closing_ = true;
+        while (shard.active_readers_ > 0)
+            pthread_cond_wait(&shard.readers_cond_, &shard.lock_);
+
+        // release the read transactions of all threads, all of them
+        // are reset; the threads begin new transactions if the store
+        // is opened again
+        for (std::set<MDB_txn*>::iterator txn = shard.readers_.begin(); txn != shard.readers_.end(); txn++)
+            mdb_txn_abort(*txn);
+        shard.readers_.clear();
+        shard.generation_++;
+
+        mdb_env_close(shard.env_);
+        shard.env_ = NULL;
+        shard.closing_ = false;
+    }
+
+    lmdb_block_store_open_shards = 0;
+}
+
+// XXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXX
+// The shard counts are saved in the first shard so that a move that
+// is interrupted continues when the store is opened again
+// XXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXX
+static void load_shard_counts(unsigned& outShardCount, unsigned& outPreviousShardCount)
+{
+    SafeTransaction stxn(lmdb_block_store_shards[0]);
+
+    uint32_t count;
+    const std::string key(SHARD_COUNT_KEY);
+    const std::string previous_key(PREVIOUS_SHARD_COUNT_KEY);
+
+    outShardCount = 1;
+    if (get_data(stxn.store_dbi_, stxn.txn_,
+            (const uint8_t*)key.data(), key.size(), (uint8_t*)&count, sizeof(count)) == PDO_SUCCESS)
+        outShardCount = count;
+
+    outPreviousShardCount = 0;
+    if (get_data(stxn.store_dbi_, stxn.txn_,
+            (const uint8_t*)previous_key.data(), previous_key.size(), (uint8_t*)&count, sizeof(count)) == PDO_SUCCESS)
+        outPreviousShardCount = count;
+
+    pdo::error::ThrowIf<pdo::error::RuntimeError>(
+        outShardCount == 0 || outShardCount > MAXIMUM_BLOCK_STORE_SHARDS
+        || outPreviousShardCount > MAXIMUM_BLOCK_STORE_SHARDS,
+        "invalid block store shard count");
+
+    stxn.abort();
+}
+
+static void save_shard_counts(const unsigned inShardCount, const unsigned inPreviousShardCount)
+{
+    SafeTransaction stxn(lmdb_block_store_shards[0]);
+
+    uint32_t count;
+    const std::string key(SHARD_COUNT_KEY);
+    const std::string previous_key(PREVIOUS_SHARD_COUNT_KEY);
+    pdo_err_t result;
+
+    count = inShardCount;
+    result = put_data(stxn.store_dbi_, stxn.txn_,
+        (const uint8_t*)key.data(), key.size(), (const uint8_t*)&count, sizeof(count));
+    pdo::error::ThrowIf<pdo::error::SystemError>(result != PDO_SUCCESS, "failed to save block store shard count");
+
+    count = inPreviousShardCount;
+    result = put_data(stxn.store_dbi_, stxn.txn_,
+        (const uint8_t*)previous_key.data(), previous_key.size(), (const uint8_t*)&count, sizeof(count));
+    pdo::error::ThrowIf<pdo::error::SystemError>(result != PDO_SUCCESS, "failed to save block store shard count");
+
+    stxn.commit();
+}
+
+// XXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXX
+void pdo::lmdb_block_store::BlockStoreOpen(
+    const std::string& db_path,
+    bool sync_on_commit,
+    size_t shard_count)
+{
+    SafeThreadLock slock(lmdb_block_store_lock);
+
+    pdo::error::ThrowIf<pdo::error::RuntimeError>(
+        lmdb_block_store_open_shards != 0, "block store is already open");
+    pdo::error::ThrowIf<pdo::error::ValueError>(
+        shard_count > MAXIMUM_BLOCK_STORE_SHARDS, "invalid block store shard count");
+
+    lmdb_block_store_path = db_path;
+    lmdb_block_store_sync_on_commit = sync_on_commit;
+
+    try
+    {
+        unsigned current_count, previous_count;
+
+        open_shards(1);
+        load_shard_counts(current_count, previous_count);
+        open_shards(std::max(current_count, previous_count));
+
+        if (shard_count == 0 || shard_count == current_count)
+        {
+            start_routing(current_count, previous_count);
+            return;
+        }
+
+        pdo::error::ThrowIf<pdo::error::RuntimeError>(
+            previous_count != 0, "block store shards are being rebalanced");
+
+        open_shards(shard_count);
+        save_shard_counts(shard_count, current_count);
+        start_routing(shard_count, current_count);
+    }
+    catch (...)
+    {
+        lmdb_block_store_shard_count = 0;
+        lmdb_block_store_previous_shard_count = 0;
+        close_shards();
+        throw;
+    }
+}
+
+// XXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXX
+void pdo::lmdb_block_store::BlockStoreClose()
+{
+    SafeThreadLock slock(lmdb_block_store_lock);
+
+    if (lmdb_block_store_open_shards == 0)
+        return;
+
+    lmdb_block_store_shard_count = 0;
+    lmdb_block_store_previous_shard_count = 0;
+    close_shards();
+}
+
+// XXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXX
+size_t pdo::lmdb_block_store::BlockStoreShardCount(void)
+{
+    return lmdb_block_store_shard_count;
+}
+
+// XXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXX
+void pdo::lmdb_block_store::BlockStoreReshard(const size_t inShardCount)
+{
+    SafeThreadLock slock(lmdb_block_store_lock);
+
+    const unsigned current_count = lmdb_block_store_shard_count;
+    pdo::error::ThrowIf<pdo::error::RuntimeError>(
+        current_count == 0, "block store is not open");
+    pdo::error::ThrowIf<pdo::error::ValueError>(
+        inShardCount == 0 || inShardCount > MAXIMUM_BLOCK_STORE_SHARDS, "invalid block store shard count");
+    pdo::error::ThrowIf<pdo::error::RuntimeError>(
+        lmdb_block_store_previous_shard_count != 0, "block store shards are being rebalanced");
+
+    if (inShardCount == current_count)
+        return;
+
+    open_shards(inShardCount);
+    save_shard_counts(inShardCount, current_count);
+    start_routing(inShardCount, current_count);
+}
+
+// XXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXX
+// Move up to inBatchSize blocks out of a shard, continuing from the
+// position where the previous step ended. The source shard and the
+// shards that blocks may move to stay locked until the blocks are
+// removed from the source, so a concurrent change to the metadata of a
+// block is either copied or made in the new shard. The locks are taken
+// in the order of the shard index, as puts to several shards take them.
+// XXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXX
+typedef struct
+{
+    ByteArray id_;
+    ByteArray value_;
+    pdo::block_store::BlockMetaData metadata_;
+} moved_block_t;
+
+static pdo_err_t rebalance_shard(
+    const unsigned inShard,
+    const unsigned inShardCount,
+    const size_t inBatchSize,
+    size_t* outMovedCount)
+{
+    BlockStoreShard& shard = lmdb_block_store_shards[inShard];
+
+    std::set<unsigned> shards;
+    shards.insert(inShard);
+    for (unsigned s = 0; s < inShardCount; s++)
+        shards.insert(s);
+
+    SafeShardTransactions stxns(shards);
+    SafeTransaction& stxn = stxns[inShard];
+
+    MDB_cursor* cursor;
+    int ret = mdb_cursor_open(stxn.txn_, stxn.meta_dbi_, &cursor);
+    if (ret != MDB_SUCCESS)
+    {
+        SAFE_LOG(PDO_LOG_ERROR, "failed to open metadata cursor; %d", ret);
+        return PDO_ERR_SYSTEM;
+    }
+
+    MDB_val key, data;
+    if (shard.rebalance_position_.empty())
+        ret = mdb_cursor_get(cursor, &key, &data, MDB_FIRST);
+    else
+    {
+        key.mv_size = shard.rebalance_position_.size();
+        key.mv_data = (void*)shard.rebalance_position_.data();
+        ret = mdb_cursor_get(cursor, &key, &data, MDB_SET_RANGE);
+    }
+
+    // copy the blocks before writing, writes may invalidate the pages
+    // that the cursor refers to
+    std::map<unsigned, std::vector<moved_block_t>> moves;
+    size_t examined = 0;
+    pdo_err_t result = PDO_SUCCESS;
+    while (ret == MDB_SUCCESS && examined < inBatchSize)
+    {
+        const uint8_t* id = (const uint8_t*)key.mv_data;
+        const unsigned destination = route_block(id, key.mv_size, inShardCount);
+        if (destination != inShard)
+        {
+            moved_block_t block;
+            block.id_.assign(id, id + key.mv_size);
+            Zero(&block.metadata_, sizeof(block.metadata_));
+            memcpy_s(&block.metadata_, sizeof(block.metadata_), data.mv_data, std::min(data.mv_size, sizeof(block.metadata_)));
+
+            MDB_val lmdb_data;
+            result = get_data_view(stxn.dbi_, stxn.txn_, id, key.mv_size, lmdb_data);
+            if (result != PDO_SUCCESS)
+                break;
+
+            const uint8_t* value = (const uint8_t*)lmdb_data.mv_data;
+            block.value_.assign(value, value + lmdb_data.mv_size);
+            moves[destination].push_back(block);
+        }
+
+        examined++;
+        ret = mdb_cursor_get(cursor, &key, &data, MDB_NEXT);
+    }
+
+    std::string position;
+    bool complete = (ret != MDB_SUCCESS);
+    if (! complete)
+        position.assign((const char*)key.mv_data, key.mv_size);
+
+    mdb_cursor_close(cursor);
+
+    if (result != PDO_SUCCESS)
+    {
+        SAFE_LOG(PDO_LOG_ERROR, "failed to read block data; %d", result);
+        return result;
+    }
+
+    // the destinations commit before the source; a failure after a
+    // destination commits leaves the block in both shards, copying it
+    // again on the next step is harmless
+    size_t moved = 0;
+    std::map<unsigned, std::vector<moved_block_t>>::iterator move;
+    for (move = moves.begin(); move != moves.end(); move++)
+    {
+        SafeTransaction& dtxn = stxns[move->first];
+        for (size_t i = 0; i < move->second.size(); i++)
+        {
+            const moved_block_t& block = move->second[i];
+            result = copy_block(dtxn, block.id_, block.value_, block.metadata_);
+            if (result != PDO_SUCCESS)
+                return result;
+        }
+    }
+
+    for (move = moves.begin(); move != moves.end(); move++)
+        stxns[move->first].commit();
+
+    for (move = moves.begin(); move != moves.end(); move++)
+    {
+        for (size_t i = 0; i < move->second.size(); i++)
+        {
+            const moved_block_t& block = move->second[i];
+            result = delete_data(stxn.dbi_, stxn.txn_, block.id_.data(), block.id_.size());
+            if (result == PDO_SUCCESS)
+                result = delete_data(stxn.meta_dbi_, stxn.txn_, block.id_.data(), block.id_.size());
+            if (result == PDO_SUCCESS)
+                result = delete_expiration(stxn, block.id_.data(), block.id_.size(), block.metadata_.expiration_time_);
+            if (result != PDO_SUCCESS)
+                return result;
+        }
+        moved += move->second.size();
+    }
+
+    stxn.commit();
+
+    shard.rebalance_position_ = position;
+    shard.rebalance_complete_ = complete;
+    *outMovedCount += moved;
+
+    return PDO_SUCCESS;
+}
+
+// XXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXX
+pdo_err_t pdo::lmdb_block_store::BlockStoreRebalance(
+    const size_t inBatchSize,
+    size_t* outMovedCount,
+    bool* outComplete)
+{
+    *outMovedCount = 0;
+    *outComplete = false;
+
+    if (inBatchSize == 0)
+        return PDO_ERR_VALUE;
+
+    try
+    {
+        // blocks are moved only when no reader or writer uses the
+        // routing from before the change; wait for them without the
+        // block store lock so that they do not hold up other changes
+        uint64_t epoch = lmdb_block_store_routing_epoch;
+        if (lmdb_block_store_previous_shard_count != 0)
+            wait_for_routing(epoch - 1);
+
+        SafeThreadLock slock(lmdb_block_store_lock);
+
+        const unsigned shard_count = lmdb_block_store_shard_count;
+        if (shard_count == 0)
+        {
+            SAFE_LOG(PDO_LOG_ERROR, "block store is not open");
+            return PDO_ERR_SYSTEM;
+        }
+
+        if (lmdb_block_store_previous_shard_count == 0)
+        {
+            *outComplete = true;
+            return PDO_SUCCESS;
+        }
+
+        // the store was reopened while waiting, the next step waits
+        // for the readers and writers of the new epoch
+        if (epoch != lmdb_block_store_routing_epoch)
+            return PDO_SUCCESS;
+
+        // one step of the scan of the first shard that is not done
+        unsigned s = 0;
+        while (s < lmdb_block_store_open_shards && lmdb_block_store_shards[s].rebalance_complete_)
+            s++;
+
+        if (s < lmdb_block_store_open_shards)
+        {
+            pdo_err_t result = rebalance_shard(s, shard_count, inBatchSize, outMovedCount);
+            if (result != PDO_SUCCESS)
+                return result;
+        }
+
+        while (s < lmdb_block_store_open_shards && lmdb_block_store_shards[s].rebalance_complete_)
+            s++;
+
+        // every block is in the shard it is routed to, readers that
+        // begin now look in a single shard
+        if (s == lmdb_block_store_open_shards)
+        {
+            save_shard_counts(shard_count, 0);
+            lmdb_block_store_previous_shard_count = 0;
+            *outComplete = true;
+        }
+    }
+    catch (pdo::error::Error& e)
+    {
+        SAFE_LOG(PDO_LOG_ERROR, "failed to rebalance block store; %s", e.what());
+        return PDO_ERR_SYSTEM;
+    }
+
+    return PDO_SUCCESS;
+}
+
+// XXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXX
+pdo_err_t pdo::block_store::BlockStoreHead(
+    const uint8_t* inId,
+    const size_t inIdSize,
+    bool* outIsPresent,
+    size_t* outValueSize
+)
+{
+    *outValueSize = 0;
+
+    pdo::block_store::BlockMetaData metadata;
+    pdo_err_t result = pdo::block_store::BlockStoreHead(inId, inIdSize, outIsPresent, &metadata);
+    if (result == PDO_SUCCESS)
+        *outValueSize = metadata.block_size_;
+
+    return result;
+}
+
+// XXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXX
+pdo_err_t pdo::block_store::BlockStoreHead(
+    const uint8_t* inId,
+    const size_t inIdSize,
+    bool* outIsPresent,
+    pdo::block_store::BlockMetaData *outMetadata
+)
+{
+#if BLOCK_STORE_DEBUG
+    {
+        std::string idStr = BinaryToHexString(inId, inIdSize);
+        SAFE_LOG(PDO_LOG_DEBUG, "BlockStoreHead: '%s'", idStr.c_str());
+    }
+#endif
+
+    *outIsPresent = false;
+    Zero(outMetadata, sizeof(pdo::block_store::BlockMetaData));
+
+    ShardedReadTransaction stxn;
+
+    MDB_val lmdb_data;
+    pdo_err_t result = stxn.find(true, inId, inIdSize, lmdb_data);
+    if (result == PDO_ERR_NOTFOUND)
+        return PDO_SUCCESS;
+
+    if (result != PDO_SUCCESS)
+        return result;
+
+    memcpy_s(outMetadata, sizeof(pdo::block_store::BlockMetaData),
+        lmdb_data.mv_data, std::min(lmdb_data.mv_size, sizeof(pdo::block_store::BlockMetaData)));
+    *outIsPresent = true;
+
+#if BLOCK_STORE_DEBUG
+    {
+        std::string idStr = BinaryToHexString(inId, inIdSize);
+        SAFE_LOG(PDO_LOG_DEBUG, "Block store found id: '%s' -> '%zu'", idStr.c_str(), outMetadata->block_size_);
+    }
+#endif
+
+    return PDO_SUCCESS;
+}
+
+// XXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXX
+class pdo::lmdb_block_store::ReadTransaction::Transaction : public ShardedReadTransaction
+{
+};
+
+pdo::lmdb_block_store::ReadTransaction::ReadTransaction(void)
+{
+    transaction_ = new pdo::lmdb_block_store::ReadTransaction::Transaction();
+}
+
+pdo::lmdb_block_store::ReadTransaction::~ReadTransaction(void)
+{
+    delete transaction_;
+}
 
-    pdo_err_t result = get_metadata(stxn.meta_dbi_, stxn.txn_, inId, inIdSize, outMetadata);
-    if (result == PDO_ERR_NOTFOUND)
+// XXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXX
+pdo_err_t pdo::lmdb_block_store::ReadTransaction::Get(
+    const uint8_t* inId,
+    const size_t inIdSize,
+    pdo::lmdb_block_store::BlockView& outView)
+{
+#if BLOCK_STORE_DEBUG
     {
-        stxn.commit();
-        return PDO_SUCCESS;
+        std::string idStr = BinaryToHexString(inId, inIdSize);
+        SAFE_LOG(PDO_LOG_DEBUG, "BlockStoreGet: '%s'", idStr.c_str());
     }
+#endif
 
+    MDB_val lmdb_data;
+    pdo_err_t result = transaction_->find(false, inId, inIdSize, lmdb_data);
     if (result != PDO_SUCCESS)
         return result;
 
-    *outIsPresent = true;
+    outView.data_ = (const uint8_t*)lmdb_data.mv_data;
+    outView.size_ = lmdb_data.mv_size;
 
 #if BLOCK_STORE_DEBUG
     {
         std::string idStr = BinaryToHexString(inId, inIdSize);
-        SAFE_LOG(PDO_LOG_DEBUG, "Block store found id: '%s' -> '%zu'", idStr.c_str(), outMetadata->block_size_);
+        std::string valueStr = BinaryToHexString(outView.data_, outView.size_);
+        SAFE_LOG(PDO_LOG_DEBUG, "Block store found id: '%s' -> '%s'", idStr.c_str(), valueStr.c_str());
     }
 #endif
 
-    stxn.commit();
     return PDO_SUCCESS;
 }
 
+// XXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXX
+pdo_err_t pdo::lmdb_block_store::ReadTransaction::Get(
+    const ByteArray& inId,
+    pdo::lmdb_block_store::BlockView& outView)
+{
+    return Get(inId.data(), inId.size(), outView);
+}
+
 // XXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXX
 pdo_err_t pdo::block_store::BlockStoreGet(
     const uint8_t* inId,
@@ -333,52 +1722,23 @@ pdo_err_t pdo::block_store::BlockStoreGet(
     uint8_t* outValue,
     const size_t inValueSize)
 {
-    pdo_err_t result;
-
-#if BLOCK_STORE_DEBUG
-    {
-        std::string idStr = BinaryToHexString(inId, inIdSize);
-        SAFE_LOG(PDO_LOG_DEBUG, "BlockStoreGet: '%s'", idStr.c_str());
-    }
-#endif
-
-    SafeTransaction stxn(MDB_RDONLY);
-
-    if (stxn.txn_ == NULL)
-        return PDO_ERR_SYSTEM;
+    pdo::lmdb_block_store::ReadTransaction transaction;
+    pdo::lmdb_block_store::BlockView view;
 
-    // Get the block metadata, we can check the size first and then will
-    // use it later to update the access time
-    pdo::block_store::BlockMetaData metadata;
-    result = get_metadata(stxn.meta_dbi_, stxn.txn_, inId, inIdSize, &metadata);
+    pdo_err_t result = transaction.Get(inId, inIdSize, view);
     if (result != PDO_SUCCESS)
     {
-        SAFE_LOG(PDO_LOG_ERROR, "failed to retreive block metadata; %d", result);
+        SAFE_LOG(PDO_LOG_ERROR, "failed to retreive block data; %d", result);
         return result;
     }
 
-    if (inValueSize < metadata.block_size_)
+    if (inValueSize < view.size_)
     {
         SAFE_LOG(PDO_LOG_ERROR, "insufficient space allocated for block data");
         return PDO_ERR_VALUE;
     }
 
-    result = get_data(stxn.dbi_, stxn.txn_, inId, inIdSize, outValue, inValueSize);
-    if (result != PDO_SUCCESS)
-    {
-        SAFE_LOG(PDO_LOG_ERROR, "failed to retreive block data; %d", result);
-        return result;
-    }
-
-#if BLOCK_STORE_DEBUG
-    {
-        std::string idStr = BinaryToHexString(inId, inIdSize);
-        std::string valueStr = BinaryToHexString((uint8_t*)lmdb_data.mv_data, lmdb_data.mv_size);
-        SAFE_LOG(PDO_LOG_DEBUG, "Block store found id: '%s' -> '%s'", idStr.c_str(), valueStr.c_str());
-    }
-#endif
-
-    stxn.commit();
+    memcpy_s(outValue, inValueSize, view.data_, view.size_);
     return PDO_SUCCESS;
 }
 
@@ -399,34 +1759,12 @@ pdo_err_t pdo::block_store::BlockStorePut(
     }
 #endif
 
-    SafeTransaction stxn(0);
-
-    if (stxn.txn_ == NULL)
-        return PDO_ERR_SYSTEM;
-
-    result = put_data(stxn.dbi_, stxn.txn_, inId, inIdSize, inValue, inValueSize);
-    if (result != PDO_SUCCESS)
-    {
-        SAFE_LOG(PDO_LOG_ERROR, "failed to write block data; %d", result);
-        return result;
-    }
-
-    // update the last access time
-    struct timeval now;
-    gettimeofday(&now, NULL);
-
-    pdo::block_store::BlockMetaData metadata;
+    std::vector<block_write_t> blocks;
+    blocks.push_back({inId, inIdSize, inValue, inValueSize});
 
-    metadata.block_size_ = inValueSize;
-    metadata.create_time_ = now.tv_sec;
-    metadata.expiration_time_ = now.tv_sec + MINIMUM_EXPIRATION_TIME;
-    metadata.tag_ = 0;
-    result = put_metadata(stxn.meta_dbi_, stxn.txn_, inId, inIdSize, &metadata);
+    result = put_blocks(blocks);
     if (result != PDO_SUCCESS)
-    {
-        SAFE_LOG(PDO_LOG_ERROR, "failed to save block meta data; %d", result);
         return result;
-    }
 
 #if BLOCK_STORE_DEBUG
     {
@@ -436,10 +1774,95 @@ pdo_err_t pdo::block_store::BlockStorePut(
     }
 #endif
 
+    return PDO_SUCCESS;
+}
+
+// XXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXX
+pdo_err_t pdo::block_store::BlockStoreGetMany(
+    const uint8_t* inIds,
+    const size_t inIdsSize,
+    const size_t* inIdSizes,
+    const size_t inCount,
+    uint8_t* outValue,
+    const size_t inValueSize,
+    size_t* outValueSizes,
+    size_t* outFetchedCount)
+{
+    pdo_err_t result;
+
+    *outFetchedCount = 0;
+
+    ShardedReadTransaction stxn;
+
+    size_t id_offset = 0;
+    size_t value_offset = 0;
+    for (size_t i = 0; i < inCount; i++)
+    {
+        if (inIdsSize - id_offset < inIdSizes[i])
+        {
+            SAFE_LOG(PDO_LOG_ERROR, "malformed block id list");
+            return PDO_ERR_VALUE;
+        }
+
+        const uint8_t* id = inIds + id_offset;
+        id_offset += inIdSizes[i];
+
+        MDB_val lmdb_data;
+        result = stxn.find(false, id, inIdSizes[i], lmdb_data);
+        if (result != PDO_SUCCESS)
+        {
+            SAFE_LOG(PDO_LOG_ERROR, "failed to retreive block data; %d", result);
+            return result;
+        }
+
+        // report the size of the block that does not fit so the
+        // caller can make room for it
+        outValueSizes[i] = lmdb_data.mv_size;
+        if (inValueSize - value_offset < lmdb_data.mv_size)
+            break;
+
+        memcpy_s(outValue + value_offset, inValueSize - value_offset, lmdb_data.mv_data, lmdb_data.mv_size);
+
+        value_offset += lmdb_data.mv_size;
+        *outFetchedCount = i + 1;
+    }
+
     stxn.commit();
     return PDO_SUCCESS;
 }
 
+// XXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXX
+pdo_err_t pdo::block_store::BlockStorePutMany(
+    const uint8_t* inIds,
+    const size_t inIdsSize,
+    const size_t* inIdSizes,
+    const size_t inCount,
+    const uint8_t* inValue,
+    const size_t inValueSize,
+    const size_t* inValueSizes)
+{
+    std::vector<block_write_t> blocks;
+
+    size_t id_offset = 0;
+    size_t value_offset = 0;
+    for (size_t i = 0; i < inCount; i++)
+    {
+        if (inIdsSize - id_offset < inIdSizes[i] || inValueSize - value_offset < inValueSizes[i])
+        {
+            SAFE_LOG(PDO_LOG_ERROR, "malformed block list");
+            return PDO_ERR_VALUE;
+        }
+
+        blocks.push_back({inIds + id_offset, inIdSizes[i], inValue + value_offset, inValueSizes[i]});
+
+        id_offset += inIdSizes[i];
+        value_offset += inValueSizes[i];
+    }
+
+    // the blocks of each shard are committed together or not at all
+    return put_blocks(blocks);
+}
+
 // XXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXX
 pdo_err_t pdo::block_store::BlockStoreHead(
     const ByteArray& inId,
@@ -466,39 +1889,385 @@ pdo_err_t pdo::block_store::BlockStoreGet(
     ByteArray& outValue
 )
 {
-    pdo_err_t result = PDO_SUCCESS;
+    // Size and copy the block in a single transaction
+    pdo::lmdb_block_store::ReadTransaction transaction;
+    pdo::lmdb_block_store::BlockView view;
+
+    pdo_err_t result = transaction.Get(inId, view);
+    if (result == PDO_ERR_NOTFOUND)
+        return PDO_ERR_VALUE;
 
-    // Get the size of the state block
-    bool isPresent;
-    size_t value_size;
-    result = BlockStoreHead(inId.data(), inId.size(), &isPresent, &value_size);
     if (result != PDO_SUCCESS)
-    {
         return result;
+
+    outValue.assign(view.data_, view.data_ + view.size_);
+    return PDO_SUCCESS;
+}
+
+// XXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXX
+pdo_err_t pdo::block_store::BlockStorePut(
+    const ByteArray& inId,
+    const ByteArray& inValue
+)
+{
+    return BlockStorePut(inId.data(), inId.size(), inValue.data(), inValue.size());
+}
+
+// XXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXX
+pdo_err_t pdo::block_store::BlockStoreGetMany(
+    const std::vector<ByteArray>& inIds,
+    std::vector<ByteArray>& outValues
+)
+{
+    pdo_err_t result;
+
+    outValues.resize(inIds.size());
+
+    ShardedReadTransaction stxn;
+
+    for (size_t i = 0; i < inIds.size(); i++)
+    {
+        MDB_val lmdb_data;
+        result = stxn.find(false, inIds[i].data(), inIds[i].size(), lmdb_data);
+        if (result != PDO_SUCCESS)
+        {
+            SAFE_LOG(PDO_LOG_ERROR, "failed to retreive block data; %d", result);
+            return result;
+        }
+
+        const uint8_t* data = (const uint8_t*)lmdb_data.mv_data;
+        outValues[i].assign(data, data + lmdb_data.mv_size);
+    }
+
+    stxn.commit();
+    return PDO_SUCCESS;
+}
+
+// XXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXX
+pdo_err_t pdo::block_store::BlockStorePutMany(
+    const std::vector<ByteArray>& inIds,
+    const std::vector<ByteArray>& inValues
+)
+{
+    if (inIds.size() != inValues.size())
+        return PDO_ERR_VALUE;
+
+    std::vector<block_write_t> blocks;
+    for (size_t i = 0; i < inIds.size(); i++)
+        blocks.push_back({inIds[i].data(), inIds[i].size(), inValues[i].data(), inValues[i].size()});
+
+    return put_blocks(blocks);
+}
+
+// XXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXX
+// Add up to inBatchSize blocks that are missing from the expiration
+// index, continuing from the position where the previous step ended;
+// the position where the next step starts is returned rather than
+// saved, the caller saves it when the transaction commits
+// XXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXX
+static pdo_err_t index_unindexed_blocks(
+    BlockStoreShard& shard,
+    SafeTransaction& stxn,
+    const size_t inBatchSize,
+    std::string& outPosition,
+    bool& outComplete)
+{
+    outPosition = shard.index_position_;
+    outComplete = shard.index_complete_;
+    if (outComplete)
+        return PDO_SUCCESS;
+
+    MDB_cursor* cursor;
+    int ret = mdb_cursor_open(stxn.txn_, stxn.meta_dbi_, &cursor);
+    if (ret != MDB_SUCCESS)
+    {
+        SAFE_LOG(PDO_LOG_ERROR, "failed to open metadata cursor; %d", ret);
+        return PDO_ERR_SYSTEM;
+    }
+
+    MDB_val key, data;
+    if (shard.index_position_.empty())
+        ret = mdb_cursor_get(cursor, &key, &data, MDB_FIRST);
+    else
+    {
+        key.mv_size = shard.index_position_.size();
+        key.mv_data = (void*)shard.index_position_.data();
+        ret = mdb_cursor_get(cursor, &key, &data, MDB_SET_RANGE);
+    }
+
+    // copy the entries before writing, writes may invalidate the
+    // pages that the cursor refers to
+    std::vector<std::pair<ByteArray, uint64_t>> entries;
+    while (ret == MDB_SUCCESS && entries.size() < inBatchSize)
+    {
+        const uint8_t* id = (const uint8_t*)key.mv_data;
+        pdo::block_store::BlockMetaData metadata;
+        memcpy_s(&metadata, sizeof(metadata), data.mv_data, std::min(data.mv_size, sizeof(metadata)));
+        entries.push_back(std::make_pair(ByteArray(id, id + key.mv_size), metadata.expiration_time_));
+
+        ret = mdb_cursor_get(cursor, &key, &data, MDB_NEXT);
+    }
+
+    if (ret == MDB_SUCCESS)
+        outPosition.assign((const char*)key.mv_data, key.mv_size);
+    else
+        outComplete = true;
+
+    mdb_cursor_close(cursor);
+
+    for (size_t i = 0; i < entries.size(); i++)
+    {
+        pdo_err_t result = put_expiration(stxn, entries[i].first.data(), entries[i].first.size(), entries[i].second);
+        if (result != PDO_SUCCESS)
+            return result;
+    }
+
+    return PDO_SUCCESS;
+}
+
+// XXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXX
+static pdo_err_t expire_shard_blocks(
+    BlockStoreShard& shard,
+    const uint64_t inCurrentTime,
+    const size_t inBatchSize,
+    const uint64_t inLiveTag,
+    size_t* outExpiredCount,
+    bool* outComplete)
+{
+    *outComplete = false;
+
+    try
+    {
+        SafeTransaction stxn(shard);
+
+        std::string index_position;
+        bool index_complete;
+        pdo_err_t result = index_unindexed_blocks(shard, stxn, inBatchSize, index_position, index_complete);
+        if (result != PDO_SUCCESS)
+            return result;
+
+        // collect the oldest entries of the index that have expired
+        MDB_cursor* cursor;
+        int ret = mdb_cursor_open(stxn.txn_, stxn.expiration_dbi_, &cursor);
+        if (ret != MDB_SUCCESS)
+        {
+            SAFE_LOG(PDO_LOG_ERROR, "failed to open expiration cursor; %d", ret);
+            return PDO_ERR_SYSTEM;
+        }
+
+        std::vector<ByteArray> keys;
+        size_t expired = 0;
+        MDB_val key, data;
+        ret = mdb_cursor_get(cursor, &key, &data, MDB_FIRST);
+        while (ret == MDB_SUCCESS && keys.size() < inBatchSize && expiration_time_from_key(key) < inCurrentTime)
+        {
+            const uint8_t* k = (const uint8_t*)key.mv_data;
+            keys.push_back(ByteArray(k, k + key.mv_size));
+            ret = mdb_cursor_get(cursor, &key, &data, MDB_NEXT);
+        }
+
+        bool more = (ret == MDB_SUCCESS && expiration_time_from_key(key) < inCurrentTime);
+        mdb_cursor_close(cursor);
+
+        for (size_t i = 0; i < keys.size(); i++)
+        {
+            const uint8_t* id = keys[i].data() + EXPIRATION_TIME_SIZE;
+            const size_t id_size = keys[i].size() - EXPIRATION_TIME_SIZE;
+            MDB_val index_key;
+            index_key.mv_size = keys[i].size();
+            index_key.mv_data = (void*)keys[i].data();
+            const uint64_t expiration_time = expiration_time_from_key(index_key);
+
+            result = delete_expiration(stxn, id, id_size, expiration_time);
+            if (result != PDO_SUCCESS)
+                return result;
+
+            // the block may have been removed or extended by a writer
+            // that does not maintain the index, the entry is stale
+            pdo::block_store::BlockMetaData metadata;
+            result = get_metadata(stxn.meta_dbi_, stxn.txn_, id, id_size, &metadata);
+            if (result == PDO_ERR_NOTFOUND)
+                continue;
+            if (result != PDO_SUCCESS)
+                return result;
+
+            if (metadata.expiration_time_ != expiration_time)
+            {
+                result = put_expiration(stxn, id, id_size, metadata.expiration_time_);
+                if (result != PDO_SUCCESS)
+                    return result;
+                continue;
+            }
+
+            // blocks that are reachable from a live state are kept
+            if (inLiveTag != 0 && metadata.tag_ == inLiveTag)
+            {
+                metadata.expiration_time_ = inCurrentTime + MINIMUM_EXPIRATION_TIME;
+                result = put_metadata(stxn.meta_dbi_, stxn.txn_, id, id_size, &metadata);
+                if (result == PDO_SUCCESS)
+                    result = put_expiration(stxn, id, id_size, metadata.expiration_time_);
+                if (result != PDO_SUCCESS)
+                    return result;
+                continue;
+            }
+
+            result = delete_data(stxn.dbi_, stxn.txn_, id, id_size);
+            if (result == PDO_SUCCESS)
+                result = delete_data(stxn.meta_dbi_, stxn.txn_, id, id_size);
+            if (result != PDO_SUCCESS)
+                return result;
+
+            expired++;
+        }
+
+        stxn.commit();
+
+        // the shard lock is held until the transaction is released, so
+        // no other step reads the position in between
+        shard.index_position_ = index_position;
+        shard.index_complete_ = index_complete;
+        *outExpiredCount += expired;
+        *outComplete = (! more) && index_complete;
     }
-    else if (!isPresent)
+    catch (pdo::error::Error& e)
     {
+        SAFE_LOG(PDO_LOG_ERROR, "failed to expire blocks; %s", e.what());
+        return PDO_ERR_SYSTEM;
+    }
+
+    return PDO_SUCCESS;
+}
+
+// XXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXX
+// Each shard has its own expiration index, a step expires up to
+// inBatchSize blocks in each of the shards
+// XXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXX
+pdo_err_t pdo::lmdb_block_store::BlockStoreExpireBlocks(
+    const uint64_t inCurrentTime,
+    const size_t inBatchSize,
+    const uint64_t inLiveTag,
+    size_t* outExpiredCount,
+    bool* outComplete)
+{
+    *outExpiredCount = 0;
+    *outComplete = false;
+
+    if (inBatchSize == 0)
         return PDO_ERR_VALUE;
+
+    SafeThreadLock slock(lmdb_block_store_lock);
+
+    if (lmdb_block_store_open_shards == 0)
+    {
+        SAFE_LOG(PDO_LOG_ERROR, "block store is not open");
+        return PDO_ERR_SYSTEM;
     }
 
-    // Resize the output array
-    outValue.resize(value_size);
+    bool complete = true;
+    for (unsigned s = 0; s < lmdb_block_store_open_shards; s++)
+    {
+        bool shard_complete;
+        pdo_err_t result = expire_shard_blocks(lmdb_block_store_shards[s],
+            inCurrentTime, inBatchSize, inLiveTag, outExpiredCount, &shard_complete);
+        if (result != PDO_SUCCESS)
+            return result;
+
+        complete = complete && shard_complete;
+    }
 
-    // Fetch the state from the block storage
-    result = BlockStoreGet(inId.data(), inId.size(), &outValue[0], value_size);
-    if (result != PDO_SUCCESS)
+    *outComplete = complete;
+    return PDO_SUCCESS;
+}
+
+// XXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXX
+static pdo_err_t tag_shard_blocks(
+    BlockStoreShard& shard,
+    const std::vector<const ByteArray*>& inIds,
+    const uint64_t inTag,
+    size_t* outTaggedCount)
+{
+    try
     {
-        return result;
+        SafeTransaction stxn(shard);
+
+        for (size_t i = 0; i < inIds.size(); i++)
+        {
+            const ByteArray& id = *inIds[i];
+
+            pdo::block_store::BlockMetaData metadata;
+            pdo_err_t result = get_metadata(stxn.meta_dbi_, stxn.txn_, id.data(), id.size(), &metadata);
+            if (result == PDO_ERR_NOTFOUND)
+                continue;
+            if (result != PDO_SUCCESS)
+                return result;
+
+            if (metadata.tag_ == inTag)
+                continue;
+
+            metadata.tag_ = inTag;
+            result = put_metadata(stxn.meta_dbi_, stxn.txn_, id.data(), id.size(), &metadata);
+            if (result != PDO_SUCCESS)
+                return result;
+
+            (*outTaggedCount)++;
+        }
+
+        stxn.commit();
+    }
+    catch (pdo::error::Error& e)
+    {
+        SAFE_LOG(PDO_LOG_ERROR, "failed to tag blocks; %s", e.what());
+        return PDO_ERR_SYSTEM;
     }
 
-    return result;
+    return PDO_SUCCESS;
 }
 
 // XXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXX
-pdo_err_t pdo::block_store::BlockStorePut(
-    const ByteArray& inId,
-    const ByteArray& inValue
-)
+// While blocks are moved between shards, the blocks are tagged in the
+// shard they are moved from before the shard they are moved to; a
+// block that is moved in between carries its tag or is tagged in the
+// shard it was moved to
+// XXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXX
+pdo_err_t pdo::lmdb_block_store::BlockStoreTagBlocks(
+    const std::vector<ByteArray>& inIds,
+    const uint64_t inTag,
+    size_t* outTaggedCount)
 {
-    return BlockStorePut(inId.data(), inId.size(), inValue.data(), inValue.size());
+    *outTaggedCount = 0;
+
+    ShardRouting routing;
+    if (! routing.open())
+    {
+        SAFE_LOG(PDO_LOG_ERROR, "block store is not open");
+        return PDO_ERR_SYSTEM;
+    }
+
+    std::map<unsigned, std::vector<const ByteArray*>> previous_ids;
+    std::map<unsigned, std::vector<const ByteArray*>> ids;
+    for (size_t i = 0; i < inIds.size(); i++)
+    {
+        const unsigned shard = routing.shard(inIds[i].data(), inIds[i].size());
+        const unsigned previous_shard = routing.previous_shard(inIds[i].data(), inIds[i].size());
+        if (previous_shard != shard)
+            previous_ids[previous_shard].push_back(&inIds[i]);
+        ids[shard].push_back(&inIds[i]);
+    }
+
+    std::map<unsigned, std::vector<const ByteArray*>>::iterator group;
+    for (group = previous_ids.begin(); group != previous_ids.end(); group++)
+    {
+        pdo_err_t result = tag_shard_blocks(lmdb_block_store_shards[group->first], group->second, inTag, outTaggedCount);
+        if (result != PDO_SUCCESS)
+            return result;
+    }
+
+    for (group = ids.begin(); group != ids.end(); group++)
+    {
+        pdo_err_t result = tag_shard_blocks(lmdb_block_store_shards[group->first], group->second, inTag, outTaggedCount);
+        if (result != PDO_SUCCESS)
+            return result;
+    }
+
+    return PDO_SUCCESS;
 }
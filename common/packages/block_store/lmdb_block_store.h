@@ -35,15 +35,175 @@ namespace pdo
          *   The path to the LMDB (lightning memory mapped database) which provides
          *   the back-end to this block store implementation
          *
+         * @param sync_on_commit
+         *   Flush each commit to disk before the puts it contains return; by
+         *   default the map is written back asynchronously
+         *
+         * @param shard_count
+         *   Number of shards to spread the blocks over; each shard is an
+         *   LMDB environment in its own file (db_path for the first shard,
+         *   db_path.N for shard N) with its own writer. 0 keeps the number
+         *   of shards the store was last used with; another number starts
+         *   moving the blocks as BlockStoreReshard does
+         *
          * @return
          *  Success (return PDO_SUCCESS) - Block store ready to use
          *  Failure (return nonzero) - Block store is unusable
          */
-        void BlockStoreOpen(const std::string& db_path);
+        void BlockStoreOpen(const std::string& db_path, bool sync_on_commit = false, size_t shard_count = 0);
 
         /**
-         * Close the block store and flush the data to disk
+         * Close the block store and flush the data to disk; waits for
+         * the reads in progress on other threads to end, so it must not
+         * be called while the calling thread holds a ReadTransaction
          */
         void BlockStoreClose();
+
+        /**
+         * Number of shards that new blocks are written to, 0 if the
+         * store is not open
+         */
+        size_t BlockStoreShardCount(void);
+
+        /**
+         * Change the number of shards. New blocks are written to the
+         * shards of the new routing immediately; existing blocks are
+         * moved by BlockStoreRebalance and remain readable while they are
+         * moved. Must not be called while the calling thread holds a
+         * ReadTransaction.
+         *
+         * @param inShardCount      new number of shards
+         *
+         * Throws if the store is not open or the blocks of an earlier
+         * change are still being moved
+         */
+        void BlockStoreReshard(const size_t inShardCount);
+
+        /**
+         * Move blocks to the shard they are routed to after the number of
+         * shards changed. Each call examines at most inBatchSize blocks of
+         * one shard, callers repeat the call until outComplete is set.
+         * The first step after a change waits until no reader or writer
+         * uses the routing from before the change, so it must not be
+         * called while the calling thread holds a ReadTransaction.
+         * Readers are never blocked; writers wait for the step to finish.
+         *
+         * @param inBatchSize       maximum number of blocks examined
+         * @param outMovedCount     [output] number of blocks moved
+         * @param outComplete       [output] true if every block is in the
+         *                          shard it is routed to
+         *
+         * @return
+         *  PDO_SUCCESS  the step was committed
+         *  else         failed, the step can be repeated
+         */
+        pdo_err_t BlockStoreRebalance(
+            const size_t inBatchSize,
+            size_t* outMovedCount,
+            bool* outComplete
+            );
+
+        /**
+         * Delete the blocks whose expiration time has passed. Blocks are
+         * found through an index ordered by expiration time; each call
+         * examines at most inBatchSize blocks of each shard in one write
+         * transaction so that other writers are not held up, callers
+         * repeat the call until outComplete is set. Readers are never
+         * blocked.
+         *
+         * @param inCurrentTime     seconds since epoch
+         * @param inBatchSize       maximum number of blocks examined
+         * @param inLiveTag         expired blocks tagged with inLiveTag are
+         *                          kept and their expiration is extended,
+         *                          0 keeps no blocks
+         * @param outExpiredCount   [output] number of blocks deleted
+         * @param outComplete       [output] true if no expired blocks remain
+         *
+         * @return
+         *  PDO_SUCCESS  the batch was committed
+         *  else         failed, no blocks were deleted
+         */
+        pdo_err_t BlockStoreExpireBlocks(
+            const uint64_t inCurrentTime,
+            const size_t inBatchSize,
+            const uint64_t inLiveTag,
+            size_t* outExpiredCount,
+            bool* outComplete
+            );
+
+        /**
+         * Set the tag of a list of blocks, used to mark the blocks that
+         * are reachable from live states before expiring blocks; blocks
+         * that are not in the store are skipped
+         *
+         * @param inIds             list of block ids
+         * @param inTag             tag saved in the metadata of the blocks
+         * @param outTaggedCount    [output] number of blocks whose tag changed
+         *
+         * @return
+         *  PDO_SUCCESS  the tags were committed
+         *  else         failed, no tags were changed
+         */
+        pdo_err_t BlockStoreTagBlocks(
+            const std::vector<ByteArray>& inIds,
+            const uint64_t inTag,
+            size_t* outTaggedCount
+            );
+
+        /**
+         * A read-only view of a block in the memory map of the block
+         * store. The view is valid until the read transaction that
+         * returned it is destroyed and must not be written through.
+         */
+        typedef struct
+        {
+            const uint8_t* data_;
+            size_t size_;
+        } BlockView;
+
+        /**
+         * A read transaction on the block store. Blocks fetched through the
+         * transaction are not copied out of the memory map, so a caller can
+         * copy a block once, directly into its final destination. The
+         * transaction sees the store as it was when the transaction began;
+         * it must be destroyed by the thread that created it.
+         * Primary expected use: ocall and python bindings
+         */
+        class ReadTransaction
+        {
+        private:
+            class Transaction;
+            Transaction* transaction_;
+
+            ReadTransaction(const ReadTransaction&);
+            ReadTransaction& operator=(const ReadTransaction&);
+
+        public:
+            ReadTransaction(void);
+            ~ReadTransaction(void);
+
+            /**
+             * Gets a view of a block
+             *
+             * @param inId          pointer to id byte array
+             * @param inIdSize      length of inId
+             * @param outView       [output] view of the block data
+             *
+             * @return
+             *  PDO_SUCCESS         outView refers to the block data
+             *  PDO_ERR_NOTFOUND    the block is not in the store
+             *  else                failed, outView is not modified
+             */
+            pdo_err_t Get(
+                const uint8_t* inId,
+                const size_t inIdSize,
+                BlockView& outView
+                );
+
+            pdo_err_t Get(
+                const ByteArray& inId,
+                BlockView& outView
+                );
+        };
     } /* contract */
 } /* pdo */
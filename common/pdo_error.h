@@ -35,7 +35,13 @@ typedef enum {
                                   a PDO_ERR_SYSTEM for reporting.
                                 */
     PDO_ERR_CRYPTO = -11,
-    PDO_ERR_NOTFOUND = -12
+    PDO_ERR_NOTFOUND = -12,
+    PDO_ERR_SESSION = -13      /*
+                                  The session id in a request is unknown
+                                  to the enclave or has expired. The
+                                  request was not processed and may be
+                                  resent with the encrypted session key.
+                                */
 } pdo_err_t;
 
 typedef enum {
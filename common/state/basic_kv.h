@@ -21,6 +21,11 @@ namespace pdo
 {
 namespace state
 {
+    class cache_budget;
+
+    // key/value pairs in key order, as returned by a scan
+    typedef std::vector<std::pair<ByteArray, ByteArray>> KeyValueArray;
+
     class Basic_KV
     {
     protected:
@@ -44,6 +49,29 @@ namespace state
         virtual ByteArray UnprivilegedGet(const ByteArray& key) = 0;
         virtual void UnprivilegedPut(const ByteArray& key, const ByteArray& value) = 0;
         virtual void UnprivilegedDelete(const ByteArray& key) = 0;
+
+        // unprivileged reads of a value straight into a buffer, the size
+        // is 0 for a missing key
+        virtual size_t UnprivilegedGetSize(const ByteArray& key) const = 0;
+        virtual size_t UnprivilegedGetInto(const ByteArray& key, uint8_t* buffer, size_t size, size_t offset) const = 0;
+
+        // batched unprivileged operations, a get returns the values in the
+        // order of the keys (empty for missing keys)
+        virtual void UnprivilegedGetMany(const std::vector<ByteArray>& keys, std::vector<ByteArray>& values) const = 0;
+        virtual void UnprivilegedPutMany(const KeyValueArray& pairs) = 0;
+        virtual void UnprivilegedDeleteMany(const std::vector<ByteArray>& keys) = 0;
+
+        // return, in key order, up to limit pairs whose key starts with
+        // prefix and follows start (or is equal to start if inclusive);
+        // fewer than limit pairs means that the scan reached the end
+        virtual void PrivilegedScan(const ByteArray& prefix, const ByteArray& start,
+            bool inclusive, size_t limit, KeyValueArray& out) const = 0;
+        virtual void UnprivilegedScan(const ByteArray& prefix, const ByteArray& start,
+            bool inclusive, size_t limit, KeyValueArray& out) const = 0;
+
+        // memory budget of the state cache, shared with the other stores
+        // opened while this one is in use; NULL if there is none
+        virtual cache_budget* GetCacheBudget(void) const { return NULL; }
     };
 }
 }
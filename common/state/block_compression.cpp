@@ -0,0 +1,184 @@
+/* Copyright 2024 Intel Corporation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <string.h>
+#include <algorithm>
+#include <vector>
+
+#include "state.h"
+
+namespace pstate = pdo::state;
+
+#define LZ_MIN_MATCH 4
+#define LZ_MAX_OFFSET 65535
+#define LZ_LAST_LITERALS 5     // the last bytes are always literals
+#define LZ_MATCH_LIMIT 12      // no match starts in the last bytes
+#define LZ_HASH_LOG 12
+#define LZ_NO_POSITION 0xFFFFFFFF
+
+static uint32_t read32(const uint8_t* p)
+{
+    uint32_t v;
+    memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+static uint32_t hash32(uint32_t v)
+{
+    return (v * 2654435761U) >> (32 - LZ_HASH_LOG);
+}
+
+static void write_length(ByteArray& out, size_t length)
+{
+    while (length >= 255)
+    {
+        out.push_back(255);
+        length -= 255;
+    }
+    out.push_back(length);
+}
+
+static void write_literals(ByteArray& out, const uint8_t* literals, size_t literal_length)
+{
+    out.insert(out.end(), literals, literals + literal_length);
+}
+
+bool pstate::block_compressor::compress(const uint8_t* in, size_t size, ByteArray& out)
+{
+    out.clear();
+    out.reserve(size);
+
+    if (table_.empty())
+        table_.resize(1 << LZ_HASH_LOG);
+    std::fill(table_.begin(), table_.end(), LZ_NO_POSITION);
+    uint32_t* table = table_.data();
+    size_t anchor = 0;
+    size_t pos = 0;
+
+    if (size > LZ_MATCH_LIMIT)
+    {
+        while (pos < size - LZ_MATCH_LIMIT)
+        {
+            uint32_t sequence = read32(in + pos);
+            uint32_t h = hash32(sequence);
+            uint32_t candidate = table[h];
+            table[h] = pos;
+
+            if (candidate == LZ_NO_POSITION || pos - candidate > LZ_MAX_OFFSET || read32(in + candidate) != sequence)
+            {
+                pos++;
+                continue;
+            }
+
+            // extend the match forward, then backward over the pending literals
+            size_t match_length = LZ_MIN_MATCH;
+            while (pos + match_length < size - LZ_LAST_LITERALS && in[candidate + match_length] == in[pos + match_length])
+                match_length++;
+            while (pos > anchor && candidate > 0 && in[pos - 1] == in[candidate - 1])
+            {
+                pos--;
+                candidate--;
+                match_length++;
+            }
+
+            size_t literal_length = pos - anchor;
+            size_t extra_match_length = match_length - LZ_MIN_MATCH;
+            out.push_back(((literal_length < 15 ? literal_length : 15) << 4) |
+                (extra_match_length < 15 ? extra_match_length : 15));
+            if (literal_length >= 15)
+                write_length(out, literal_length - 15);
+            write_literals(out, in + anchor, literal_length);
+
+            size_t offset = pos - candidate;
+            out.push_back(offset & 0xFF);
+            out.push_back(offset >> 8);
+            if (extra_match_length >= 15)
+                write_length(out, extra_match_length - 15);
+
+            pos += match_length;
+            anchor = pos;
+
+            // give up as soon as the output is not shorter
+            if (out.size() >= size)
+                return false;
+        }
+    }
+
+    size_t literal_length = size - anchor;
+    out.push_back((literal_length < 15 ? literal_length : 15) << 4);
+    if (literal_length >= 15)
+        write_length(out, literal_length - 15);
+    write_literals(out, in + anchor, literal_length);
+
+    return out.size() < size;
+}
+
+static size_t read_length(const uint8_t* in, size_t size, size_t& pos)
+{
+    size_t length = 0;
+    uint8_t b;
+    do
+    {
+        pdo::error::ThrowIf<pdo::error::ValueError>(pos >= size, "compressed block, truncated length");
+        b = in[pos++];
+        length += b;
+    } while (b == 255);
+    return length;
+}
+
+void pstate::decompress_block(const uint8_t* in, size_t size, size_t raw_size, ByteArray& out)
+{
+    out.resize(raw_size);
+    size_t ip = 0;
+    size_t op = 0;
+
+    while (ip < size)
+    {
+        uint8_t token = in[ip++];
+
+        size_t literal_length = token >> 4;
+        if (literal_length == 15)
+            literal_length += read_length(in, size, ip);
+        pdo::error::ThrowIf<pdo::error::ValueError>(
+            literal_length > size - ip || literal_length > raw_size - op, "compressed block, invalid literal length");
+        memcpy(out.data() + op, in + ip, literal_length);
+        ip += literal_length;
+        op += literal_length;
+
+        // the last sequence has no match
+        if (ip == size)
+            break;
+
+        pdo::error::ThrowIf<pdo::error::ValueError>(size - ip < 2, "compressed block, truncated offset");
+        size_t offset = in[ip] | (in[ip + 1] << 8);
+        ip += 2;
+        pdo::error::ThrowIf<pdo::error::ValueError>(offset == 0 || offset > op, "compressed block, invalid offset");
+
+        size_t match_length = token & 15;
+        if (match_length == 15)
+            match_length += read_length(in, size, ip);
+        match_length += LZ_MIN_MATCH;
+        pdo::error::ThrowIf<pdo::error::ValueError>(match_length > raw_size - op, "compressed block, invalid match length");
+
+        // the match may overlap the bytes it produces
+        uint8_t* dst = out.data() + op;
+        const uint8_t* src = dst - offset;
+        for (size_t i = 0; i < match_length; i++)
+            dst[i] = src[i];
+        op += match_length;
+    }
+
+    pdo::error::ThrowIf<pdo::error::ValueError>(op != raw_size, "compressed block, invalid size");
+}
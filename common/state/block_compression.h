@@ -0,0 +1,54 @@
+/* Copyright 2024 Intel Corporation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <vector>
+
+namespace pdo
+{
+namespace state
+{
+    // XXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXX
+    // block compression
+    //
+    // A self-contained LZ77 compressor that writes the LZ4 block format:
+    // a sequence is a token (literal length and match length, 4 bits
+    // each), the extra bytes of the literal length, the literals, a 2 byte
+    // offset and the extra bytes of the match length; the last sequence
+    // has only literals. It has no dependency, so it runs in the enclave,
+    // and it favors speed over ratio as it is applied to every data node
+    // written. The hash table of the compressor is allocated on the first
+    // compression and reused for the following ones, so a compressor is
+    // kept for the life of a state rather than made for every block.
+    // XXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXX
+    class block_compressor
+    {
+    private:
+        std::vector<uint32_t> table_;
+
+    public:
+        // compress size bytes into out; returns false (and out is not
+        // usable) if the compressed data is not shorter than the input
+        bool compress(const uint8_t* in, size_t size, ByteArray& out);
+    };
+
+    // decompress size bytes into out, which must hold exactly raw_size
+    // bytes once decompressed; throws on invalid data
+    void decompress_block(const uint8_t* in, size_t size, size_t raw_size, ByteArray& out);
+}
+}
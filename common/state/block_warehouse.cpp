@@ -13,24 +13,293 @@
  * limitations under the License.
  */
 
+#include <string.h>
+
 #include "state.h"
 
 namespace pstate = pdo::state;
 
+// XXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXX
+// Root block (all integers are 32 bit little endian):
+//     magic | version | block count | depth | id count | ids | hmac
+// Index block:
+//     magic | level | id count | ids
+// XXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXX
+#define BLOCK_INDEX_MAGIC_LENGTH 4
+#define ROOT_BLOCK_HEADER_LENGTH (BLOCK_INDEX_MAGIC_LENGTH + 4 * sizeof(uint32_t))
+#define ROOT_BLOCK_HMAC_LENGTH SHA256_DIGEST_LENGTH
+#define INDEX_BLOCK_HEADER_LENGTH (BLOCK_INDEX_MAGIC_LENGTH + 2 * sizeof(uint32_t))
+
+static void append_magic(ByteArray& block, const char* magic)
+{
+    block.insert(block.end(), magic, magic + BLOCK_INDEX_MAGIC_LENGTH);
+}
+
+static bool has_magic(const ByteArray& block, const char* magic)
+{
+    return block.size() >= BLOCK_INDEX_MAGIC_LENGTH
+        && memcmp(block.data(), magic, BLOCK_INDEX_MAGIC_LENGTH) == 0;
+}
+
+static void append_uint32(ByteArray& block, uint32_t value)
+{
+    for (unsigned int i = 0; i < sizeof(uint32_t); i++)
+        block.push_back((value >> (8 * i)) & 0xff);
+}
+
+static uint32_t read_uint32(const ByteArray& block, size_t offset)
+{
+    uint32_t value = 0;
+    for (unsigned int i = 0; i < sizeof(uint32_t); i++)
+        value |= ((uint32_t)block[offset + i]) << (8 * i);
+    return value;
+}
+
+static void append_ids(ByteArray& block, const pstate::StateBlockIdArray& ids)
+{
+    for (unsigned int i = 0; i < ids.size(); i++)
+        block.insert(block.end(), ids[i].begin(), ids[i].end());
+}
+
+static void read_ids(const ByteArray& block, size_t offset, uint32_t count, pstate::StateBlockIdArray& ids)
+{
+    ids.resize(count);
+    for (unsigned int i = 0; i < count; i++)
+    {
+        ByteArray::const_iterator first = block.begin() + offset + i * STATE_BLOCK_ID_LENGTH;
+        ids[i].assign(first, first + STATE_BLOCK_ID_LENGTH);
+    }
+}
+
+// number of data block ids covered by each id of a node at the given level
+static uint64_t index_child_span(unsigned int level)
+{
+    uint64_t span = 1;
+    for (unsigned int l = 0; l < level; l++)
+        span *= STATE_BLOCK_INDEX_FANOUT;
+    return span;
+}
+
+// number of ids in a node of a complete tree over count data block ids
+static unsigned int index_node_size(unsigned int level, unsigned int index, uint64_t count)
+{
+    uint64_t span = index_child_span(level);
+    uint64_t first = (uint64_t)index * span * STATE_BLOCK_INDEX_FANOUT;
+    if (count <= first)
+        return 0;
+
+    uint64_t children = (count - first + span - 1) / span;
+    return children < STATE_BLOCK_INDEX_FANOUT ? children : STATE_BLOCK_INDEX_FANOUT;
+}
+
+pdo::state::block_warehouse::block_warehouse(const ByteArray& state_encryption_key)
+    : state_encryption_key_(state_encryption_key)
+{
+    reset();
+}
+
+void pdo::state::block_warehouse::reset(void)
+{
+    nodes_.clear();
+    count_ = 0;
+    stored_count_ = 0;
+    depth_ = 0;
+    nodes_[index_position_t(0, 0)] = {{}, true};
+}
+
+pstate::block_warehouse::index_node_t& pdo::state::block_warehouse::get_node(
+    unsigned int level, unsigned int index, bool append)
+{
+    std::map<index_position_t, index_node_t>::iterator it = nodes_.find(index_position_t(level, index));
+    if (it != nodes_.end())
+        return it->second;
+
+    // the root is always present, any other node is reached from its parent
+    pdo::error::ThrowIf<pdo::error::RuntimeError>(level >= depth_, "missing block index node");
+    index_node_t& parent = get_node(level + 1, index / STATE_BLOCK_INDEX_FANOUT, append);
+    unsigned int slot = index % STATE_BLOCK_INDEX_FANOUT;
+
+    if (append && slot == parent.ids.size())
+    {
+        // new node, its id is set when it is written
+        parent.ids.push_back(StateBlockId(STATE_BLOCK_ID_LENGTH, 0));
+        parent.dirty = true;
+        index_node_t& node = nodes_[index_position_t(level, index)];
+        node.dirty = true;
+        return node;
+    }
+
+    pdo::error::ThrowIf<pdo::error::RuntimeError>(
+        slot >= parent.ids.size(), "block index out of range");
+
+    StateBlock block;
+    state_status_t ret = sebio_fetch(parent.ids[slot], SEBIO_NO_CRYPTO, block);
+    pdo::error::ThrowIf<pdo::error::ValueError>(
+        ret != STATE_SUCCESS, "block index fetch, sebio returned an error");
+
+    // the block id is its hash (checked by sebio), so only the layout is verified here
+    pdo::error::ThrowIf<pdo::error::ValueError>(
+        block.size() < INDEX_BLOCK_HEADER_LENGTH || ! has_magic(block, STATE_INDEX_BLOCK_MAGIC),
+        "invalid block index block");
+    uint32_t block_level = read_uint32(block, BLOCK_INDEX_MAGIC_LENGTH);
+    uint32_t id_count = read_uint32(block, BLOCK_INDEX_MAGIC_LENGTH + sizeof(uint32_t));
+    pdo::error::ThrowIf<pdo::error::ValueError>(
+        block_level != level
+        || id_count != index_node_size(level, index, stored_count_)
+        || block.size() != INDEX_BLOCK_HEADER_LENGTH + (size_t)id_count * STATE_BLOCK_ID_LENGTH,
+        "invalid block index block");
+
+    index_node_t& node = nodes_[index_position_t(level, index)];
+    read_ids(block, INDEX_BLOCK_HEADER_LENGTH, id_count, node.ids);
+    node.dirty = false;
+    loaded_index_blocks_ ++;
+    return node;
+}
+
+void pdo::state::block_warehouse::grow(void)
+{
+    pdo::error::ThrowIf<pdo::error::RuntimeError>(
+        depth_ + 1 > STATE_BLOCK_INDEX_MAX_DEPTH, "block index is full");
+
+    // the current root becomes an index block under a new root
+    nodes_.at(index_position_t(depth_, 0)).dirty = true;
+    depth_ ++;
+    nodes_[index_position_t(depth_, 0)] = {{StateBlockId(STATE_BLOCK_ID_LENGTH, 0)}, true};
+}
+
+void pdo::state::block_warehouse::shrink(void)
+{
+    // a root with a single child is replaced by the child
+    while (depth_ > 0 && nodes_.at(index_position_t(depth_, 0)).ids.size() <= 1)
+    {
+        get_node(depth_ - 1, 0);
+        nodes_.erase(index_position_t(depth_, 0));
+        depth_ --;
+    }
+}
+
+void pdo::state::block_warehouse::write_index_blocks(void)
+{
+    // write the modified nodes one level at a time, each level updates
+    // the ids in its parents so that they are written with the next level
+    for (unsigned int level = 0; level < depth_; level++)
+    {
+        std::vector<unsigned int> indexes;
+        std::vector<StateBlock> blocks;
+        std::map<index_position_t, index_node_t>::iterator it;
+        for (it = nodes_.lower_bound(index_position_t(level, 0));
+             it != nodes_.end() && it->first.first == level; it++)
+        {
+            if (! it->second.dirty)
+                continue;
+
+            StateBlock block;
+            append_magic(block, STATE_INDEX_BLOCK_MAGIC);
+            append_uint32(block, level);
+            append_uint32(block, it->second.ids.size());
+            append_ids(block, it->second.ids);
+            indexes.push_back(it->first.second);
+            blocks.push_back(std::move(block));
+        }
+
+        if (blocks.empty())
+            continue;
+
+        std::vector<ByteArray> new_ids;
+        state_status_t ret = sebio_evict_many(blocks, SEBIO_NO_CRYPTO, new_ids);
+        pdo::error::ThrowIf<pdo::error::ValueError>(
+            ret != STATE_SUCCESS, "block index unload, sebio returned an error");
+
+        for (unsigned int i = 0; i < indexes.size(); i++)
+        {
+            nodes_.at(index_position_t(level, indexes[i])).dirty = false;
+            index_node_t& parent = nodes_.at(index_position_t(level + 1, indexes[i] / STATE_BLOCK_INDEX_FANOUT));
+            parent.ids[indexes[i] % STATE_BLOCK_INDEX_FANOUT] = new_ids[i];
+            parent.dirty = true;
+        }
+        written_index_blocks_ += blocks.size();
+    }
+}
+
 void pdo::state::block_warehouse::serialize_block_ids(pdo::state::StateNode& node)
 {
-    node.ClearChildren();
-    for (unsigned int i = 0; i < blockIds_.size(); i++)
+    try
     {
-        node.AppendChildId(blockIds_[i]);
+        shrink();
+        write_index_blocks();
+
+        index_node_t& root = nodes_.at(index_position_t(depth_, 0));
+        StateBlock& block = node.GetBlock();
+        block.clear();
+        append_magic(block, STATE_ROOT_BLOCK_MAGIC);
+        append_uint32(block, STATE_FORMAT_VERSION);
+        append_uint32(block, count_);
+        append_uint32(block, depth_);
+        append_uint32(block, root.ids.size());
+        append_ids(block, root.ids);
+
+        ByteArray block_ids_hmac = pdo::crypto::ComputeMessageHMAC(state_encryption_key_, block);
+        block.insert(block.end(), block_ids_hmac.begin(), block_ids_hmac.end());
+
+        root.dirty = false;
+        stored_count_ = count_;
+    }
+    catch (const std::exception& e)
+    {
+        SAFE_LOG_EXCEPTION("block_warehouse::serialize_block_ids");
+        throw;
     }
-    node.BlockifyChildren(state_encryption_key_);
 }
 
 void pdo::state::block_warehouse::deserialize_block_ids(pdo::state::StateNode& node)
 {
-    node.UnBlockifyChildren(state_encryption_key_);
-    blockIds_ = node.GetChildrenBlocks();
+    const StateBlock& block = node.GetBlock();
+
+    if (! has_magic(block, STATE_ROOT_BLOCK_MAGIC))
+    {
+        // version 1 root block, the json list of all the block ids
+        node.UnBlockifyChildren(state_encryption_key_);
+        StateBlockIdArray ids = node.GetChildrenBlocks();
+        node.ClearChildren();
+
+        // build the index in memory, it is written entirely on the next update
+        reset();
+        for (unsigned int i = 0; i < ids.size(); i++)
+            add_block_id(ids[i]);
+        return;
+    }
+
+    pdo::error::ThrowIf<pdo::error::ValueError>(
+        block.size() < ROOT_BLOCK_HEADER_LENGTH + ROOT_BLOCK_HMAC_LENGTH, "invalid state root block");
+
+    // verify authenticator
+    ByteArray body(block.begin(), block.end() - ROOT_BLOCK_HMAC_LENGTH);
+    ByteArray expected_block_ids_hmac(block.end() - ROOT_BLOCK_HMAC_LENGTH, block.end());
+    ByteArray block_ids_hmac = pdo::crypto::ComputeMessageHMAC(state_encryption_key_, body);
+    pdo::error::ThrowIf<pdo::error::RuntimeError>(
+        expected_block_ids_hmac != block_ids_hmac, "invalid block-ids authenticator");
+
+    size_t offset = BLOCK_INDEX_MAGIC_LENGTH;
+    uint32_t version = read_uint32(body, offset);
+    uint32_t count = read_uint32(body, offset += sizeof(uint32_t));
+    uint32_t depth = read_uint32(body, offset += sizeof(uint32_t));
+    uint32_t id_count = read_uint32(body, offset += sizeof(uint32_t));
+    pdo::error::ThrowIf<pdo::error::ValueError>(
+        version != STATE_FORMAT_VERSION, "unsupported state format version");
+    pdo::error::ThrowIf<pdo::error::ValueError>(
+        depth > STATE_BLOCK_INDEX_MAX_DEPTH
+        || id_count != index_node_size(depth, 0, count)
+        || body.size() != ROOT_BLOCK_HEADER_LENGTH + (size_t)id_count * STATE_BLOCK_ID_LENGTH,
+        "invalid state root block");
+
+    reset();
+    count_ = count;
+    stored_count_ = count;
+    depth_ = depth;
+    nodes_.clear();
+    index_node_t& root = nodes_[index_position_t(depth_, 0)];
+    read_ids(body, ROOT_BLOCK_HEADER_LENGTH, id_count, root.ids);
+    root.dirty = false;
 }
 
 void pdo::state::block_warehouse::update_datablock_id(
@@ -38,9 +307,12 @@ void pdo::state::block_warehouse::update_datablock_id(
 {
     pdo::error::ThrowIf<pdo::error::RuntimeError>(
         newId.size() != STATE_BLOCK_ID_LENGTH, "bad block id");
+    pdo::error::ThrowIf<pdo::error::RuntimeError>(
+        data_block_num >= count_, "block num out of range");
 
-    unsigned int index = data_block_num;
-    blockIds_[index] = newId;
+    index_node_t& leaf = get_node(0, data_block_num / STATE_BLOCK_INDEX_FANOUT);
+    leaf.ids[data_block_num % STATE_BLOCK_INDEX_FANOUT] = newId;
+    leaf.dirty = true;
 }
 
 void pdo::state::block_warehouse::add_block_id(pstate::StateBlockId& id)
@@ -50,7 +322,13 @@ void pdo::state::block_warehouse::add_block_id(pstate::StateBlockId& id)
 
     try
     {
-        blockIds_.push_back(id);
+        if (count_ == index_child_span(depth_ + 1))
+            grow();
+
+        index_node_t& leaf = get_node(0, count_ / STATE_BLOCK_INDEX_FANOUT, true);
+        leaf.ids.push_back(id);
+        leaf.dirty = true;
+        count_ ++;
     }
     catch (const std::exception& e)
     {
@@ -59,34 +337,48 @@ void pdo::state::block_warehouse::add_block_id(pstate::StateBlockId& id)
     }
 }
 
-void pdo::state::block_warehouse::remove_empty_block_ids()
+void pdo::state::block_warehouse::remove_block_id_from_datablock_num(unsigned int data_block_num)
 {
-    StateBlockId emptyId(STATE_BLOCK_ID_LENGTH, 0);
-    unsigned int i = 0;
-    while (i < blockIds_.size())
+    pdo::error::ThrowIf<pdo::error::RuntimeError>(
+        count_ == 0 || data_block_num != count_ - 1, "only the last block id can be removed");
+
+    unsigned int level = 0;
+    unsigned int index = data_block_num / STATE_BLOCK_INDEX_FANOUT;
+    index_node_t* node = &get_node(level, index);
+    node->ids.pop_back();
+    node->dirty = true;
+    count_ --;
+
+    // drop the index nodes left empty
+    while (level < depth_ && node->ids.empty())
     {
-        if (blockIds_[i] == emptyId)
-        {
-            blockIds_.erase(blockIds_.begin() + i);
-        }
-        else
-            i++;
+        index_node_t& parent = get_node(level + 1, index / STATE_BLOCK_INDEX_FANOUT);
+        nodes_.erase(index_position_t(level, index));
+        parent.ids.pop_back();
+        parent.dirty = true;
+        level ++;
+        index /= STATE_BLOCK_INDEX_FANOUT;
+        node = &parent;
     }
 }
 
-void pdo::state::block_warehouse::remove_block_id_from_datablock_num(unsigned int data_block_num)
-{
-    unsigned int index = data_block_num;
-    blockIds_.erase(blockIds_.begin() + index);
-}
-
 void pdo::state::block_warehouse::get_datablock_id_from_datablock_num(
     unsigned int data_block_num, pdo::state::StateBlockId& outId)
 {
     // CONVENTION:  the data blocks are put in sequential order in the list,
     //              where the last block is the last appended data block
-    unsigned int index = data_block_num;
-    outId = blockIds_[index];
+    pdo::error::ThrowIf<pdo::error::RuntimeError>(
+        data_block_num >= count_, "block num out of range");
+
+    index_node_t& leaf = get_node(0, data_block_num / STATE_BLOCK_INDEX_FANOUT);
+    outId = leaf.ids[data_block_num % STATE_BLOCK_INDEX_FANOUT];
+}
+
+void pdo::state::block_warehouse::get_datablock_ids(pdo::state::StateBlockIdArray& outIds)
+{
+    outIds.resize(count_);
+    for (unsigned int n = 0; n < count_; n++)
+        get_datablock_id_from_datablock_num(n, outIds[n]);
 }
 
 unsigned int pdo::state::block_warehouse::get_root_block_num()
@@ -96,6 +388,5 @@ unsigned int pdo::state::block_warehouse::get_root_block_num()
 
 unsigned int pdo::state::block_warehouse::get_last_block_num()
 {
-    return blockIds_.size() - 1;
+    return count_ - 1;
 }
-
@@ -15,22 +15,72 @@
 
 #pragma once
 
+#include <map>
+
+// Number of block ids in each block of the block-id index
+#ifndef STATE_BLOCK_INDEX_FANOUT
+#define STATE_BLOCK_INDEX_FANOUT 256
+#endif
+
+#define STATE_BLOCK_INDEX_MAX_DEPTH 4
+#define STATE_FORMAT_VERSION 2
+#define STATE_ROOT_BLOCK_MAGIC "PDOS"
+#define STATE_INDEX_BLOCK_MAGIC "PDOI"
+
 namespace pdo
 {
 namespace state
 {
+    // XXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXX
+    // block_warehouse
+    //
+    // The ordered list of the ids of the data blocks of a state. The list
+    // is stored as a tree of index blocks with a fixed fanout: the leaves
+    // (level 0) hold data block ids, the blocks at level l hold the ids of
+    // blocks at level l-1, and the root block holds the ids of the top
+    // level together with an HMAC computed with the state key. Index
+    // blocks are not encrypted and are addressed by their hash like any
+    // other block, so the root authenticates the whole tree.
+    //
+    // Index blocks are fetched only when one of their ids is needed, and
+    // only the blocks on the path of a modified id are written back. A
+    // state with up to STATE_BLOCK_INDEX_FANOUT blocks keeps all of its ids
+    // in the root block.
+    //
+    // States whose root block is the JSON list of version 1 are read and
+    // converted to the current format when they are written.
+    // XXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXX
     class block_warehouse
     {
     private:
-        pdo::state::StateBlockIdArray blockIds_ = {};
+        struct index_node_t
+        {
+            pdo::state::StateBlockIdArray ids;
+            bool dirty;
+        };
+
+        // index nodes that have been loaded or created, keyed by level and
+        // position in the level; the root is at level depth_
+        typedef std::pair<unsigned int, unsigned int> index_position_t;
+        std::map<index_position_t, index_node_t> nodes_;
+
+        unsigned int count_ = 0;
+        unsigned int stored_count_ = 0;
+        unsigned int depth_ = 0;
+
+        index_node_t& get_node(unsigned int level, unsigned int index, bool append = false);
+        void reset(void);
+        void grow(void);
+        void shrink(void);
+        void write_index_blocks(void);
 
     public:
         const ByteArray state_encryption_key_;
 
-        block_warehouse(const ByteArray& state_encryption_key)
-            : state_encryption_key_(state_encryption_key)
-        {
-        }
+        unsigned int loaded_index_blocks_ = 0;
+        unsigned int written_index_blocks_ = 0;
+
+        block_warehouse(const ByteArray& state_encryption_key);
 
         void serialize_block_ids(pdo::state::StateNode& node);
         void deserialize_block_ids(pdo::state::StateNode& node);
@@ -39,13 +89,15 @@ namespace state
 
         void add_block_id(pdo::state::StateBlockId& id);
 
-        void remove_empty_block_ids();
+        // only the last block id can be removed
         void remove_block_id_from_datablock_num(unsigned int data_block_num);
 
         void get_datablock_id_from_datablock_num(
             unsigned int data_block_num, pdo::state::StateBlockId& outId);
+        void get_datablock_ids(pdo::state::StateBlockIdArray& outIds);
         unsigned int get_root_block_num();
         unsigned int get_last_block_num();
+        unsigned int get_index_depth() const { return depth_; }
     };
 }
 }
@@ -13,36 +13,83 @@
  * limitations under the License.
  */
 
+#include <algorithm>
+
 #include "state.h"
 
 namespace pstate = pdo::state;
 
-#define BLOCK_CACHE_MAX_ITEMS (CACHE_SIZE / FIXED_DATA_NODE_BYTE_SIZE)
+#define BLOCK_CACHE_NO_ENTRY ((uint32_t)-1)
+
+#define BLOCK_CACHE_QUEUE_RECENT 0
+#define BLOCK_CACHE_QUEUE_FREQUENT 1
+
+// each slot is charged to the budget for the size of its data node
+#define BLOCK_CACHE_SLOT_BYTES FIXED_DATA_NODE_BYTE_SIZE
 
 #if (FIXED_DATA_NODE_BYTE_SIZE < (1 << 11) || CACHE_SIZE < (1 << 15))
 #error "use at least 2KB data node size and 32KB cache size"
 #endif
 
-pstate::cache_slots::cache_slots() : data_nodes_(BLOCK_CACHE_MAX_ITEMS, data_node(0))
+bool pstate::cache_budget::reserve(size_t bytes, bool force)
+{
+    if (!force && bytes > available())
+        return false;
+
+    used_ += bytes;
+    return true;
+}
+
+void pstate::cache_budget::release(size_t bytes)
+{
+    pdo::error::ThrowIf<pdo::error::RuntimeError>(
+        bytes > used_, "cache budget, releasing more than reserved");
+    used_ -= bytes;
+}
+
+pstate::cache_slots::cache_slots(unsigned int max_slots, cache_budget* budget)
+    : max_slots_(max_slots), budget_(budget), reserved_(0)
 {
-    for (unsigned int i = 0; i < data_nodes_.size(); i++)
+}
+
+pstate::cache_slots::~cache_slots()
+{
+    if (budget_ != NULL)
+        budget_->release(reserved_);
+}
+
+bool pstate::cache_slots::grow()
+{
+    if (data_nodes_.size() >= max_slots_)
+        return false;
+
+    // the first few slots are granted even if the budget is exhausted
+    if (budget_ != NULL)
     {
-        try
-        {
-            dn_queue_.push(&(data_nodes_[i]));
-        }
-        catch (const std::exception& e)
-        {
-            SAFE_LOG_EXCEPTION("cache_slots init error");
-            throw;
-        }
+        bool force = data_nodes_.size() < STATE_CACHE_MIN_ITEMS;
+        if (!budget_->reserve(BLOCK_CACHE_SLOT_BYTES, force))
+            return false;
+        reserved_ += BLOCK_CACHE_SLOT_BYTES;
+    }
+
+    try
+    {
+        data_nodes_.emplace_back(0);
+        dn_queue_.push(&(data_nodes_.back()));
     }
+    catch (const std::exception& e)
+    {
+        SAFE_LOG_EXCEPTION("cache_slots grow error");
+        throw;
+    }
+
+    return true;
 }
 
 pstate::data_node* pstate::cache_slots::allocate()
 {
     pdo::error::ThrowIf<pdo::error::RuntimeError>(
-        dn_queue_.empty(), "cache full -- cannot allocate additional cache slots, queue empty");
+        dn_queue_.empty() && !grow(), "cache full -- cannot allocate additional cache slots, queue empty");
     data_node* d = dn_queue_.front();
     dn_queue_.pop();
 
@@ -68,56 +115,279 @@ void pstate::cache_slots::release(data_node** dn)
 
 unsigned int pstate::cache_slots::available_slots()
 {
-    return dn_queue_.size();
+    // free slots, plus the ones that can still be created
+    unsigned int growable = max_slots_ - data_nodes_.size();
+    if (budget_ != NULL)
+    {
+        unsigned int affordable = budget_->available() / BLOCK_CACHE_SLOT_BYTES;
+        if (data_nodes_.size() < STATE_CACHE_MIN_ITEMS)
+            affordable = std::max(affordable, (unsigned int)(STATE_CACHE_MIN_ITEMS - data_nodes_.size()));
+        growable = std::min(growable, affordable);
+    }
+
+    return dn_queue_.size() + growable;
+}
+
+pstate::Cache::Cache(block_warehouse& bw, size_t cache_size, cache_budget* budget, state_cache_policy_e policy)
+    : block_warehouse_(bw),
+      synced_entries_(0),
+      policy_(policy),
+      budget_(budget),
+      max_items_(cache_size / FIXED_DATA_NODE_BYTE_SIZE),
+      slots_(cache_size / FIXED_DATA_NODE_BYTE_SIZE, budget)
+{
+    pdo::error::ThrowIf<pdo::error::ValueError>(
+        max_items_ < STATE_CACHE_MIN_ITEMS, "cache size too small");
+
+    // the hash index has at least twice as many buckets as entries,
+    // entries are added as slots are allocated
+    uint32_t index_size = 1;
+    while (index_size < 2 * max_items_)
+        index_size <<= 1;
+    index_.assign(index_size, BLOCK_CACHE_NO_ENTRY);
+    index_mask_ = index_size - 1;
+
+    for (unsigned int q = 0; q < 2; q++)
+        queues_[q] = { BLOCK_CACHE_NO_ENTRY, BLOCK_CACHE_NO_ENTRY, 0 };
+}
+
+// XXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXX
+// hash index, linear probing with backward shift deletion
+// XXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXX
+uint32_t pstate::Cache::index_home(unsigned int block_num) const
+{
+    // block numbers are dense, fibonacci hashing spreads them out
+    return ((uint32_t)block_num * 2654435769u) & index_mask_;
+}
+
+uint32_t pstate::Cache::find_entry(unsigned int block_num) const
+{
+    for (uint32_t i = index_home(block_num); index_[i] != BLOCK_CACHE_NO_ENTRY; i = (i + 1) & index_mask_)
+    {
+        if (entries_[index_[i]].block_num == block_num)
+            return index_[i];
+    }
+
+    return BLOCK_CACHE_NO_ENTRY;
+}
+
+pstate::Cache::block_cache_entry_t& pstate::Cache::get_entry(unsigned int block_num, const char* msg)
+{
+    uint32_t e = find_entry(block_num);
+    pdo::error::ThrowIf<pdo::error::RuntimeError>(e == BLOCK_CACHE_NO_ENTRY, msg);
+    return entries_[e];
+}
+
+void pstate::Cache::index_insert(unsigned int block_num, uint32_t e)
+{
+    uint32_t i = index_home(block_num);
+    while (index_[i] != BLOCK_CACHE_NO_ENTRY)
+        i = (i + 1) & index_mask_;
+
+    index_[i] = e;
+}
+
+void pstate::Cache::index_remove(unsigned int block_num)
+{
+    uint32_t i = index_home(block_num);
+    while (entries_[index_[i]].block_num != block_num)
+        i = (i + 1) & index_mask_;
+
+    // shift back the following entries that would no longer be reachable
+    for (uint32_t j = (i + 1) & index_mask_; index_[j] != BLOCK_CACHE_NO_ENTRY; j = (j + 1) & index_mask_)
+    {
+        uint32_t k = index_home(entries_[index_[j]].block_num);
+        if (((j - k) & index_mask_) >= ((j - i) & index_mask_))
+        {
+            index_[i] = index_[j];
+            i = j;
+        }
+    }
+
+    index_[i] = BLOCK_CACHE_NO_ENTRY;
+}
+
+// XXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXX
+// replacement queues
+// XXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXX
+void pstate::Cache::queue_push_back(uint8_t queue, uint32_t e)
+{
+    cache_queue_t& q = queues_[queue];
+    block_cache_entry_t& bce = entries_[e];
+    bce.queue = queue;
+    bce.prev = q.tail;
+    bce.next = BLOCK_CACHE_NO_ENTRY;
+    if (q.tail == BLOCK_CACHE_NO_ENTRY)
+        q.head = e;
+    else
+        entries_[q.tail].next = e;
+    q.tail = e;
+    q.size ++;
+}
+
+void pstate::Cache::queue_push_front(uint8_t queue, uint32_t e)
+{
+    cache_queue_t& q = queues_[queue];
+    block_cache_entry_t& bce = entries_[e];
+    bce.queue = queue;
+    bce.prev = BLOCK_CACHE_NO_ENTRY;
+    bce.next = q.head;
+    if (q.head == BLOCK_CACHE_NO_ENTRY)
+        q.tail = e;
+    else
+        entries_[q.head].prev = e;
+    q.head = e;
+    q.size ++;
 }
 
-void pstate::Cache::replacement_policy_MRU()
+void pstate::Cache::queue_remove(uint32_t e)
 {
-    int index_to_remove = -1;
-    uint64_t clock = 0;
+    block_cache_entry_t& bce = entries_[e];
+    cache_queue_t& q = queues_[bce.queue];
+    if (bce.prev == BLOCK_CACHE_NO_ENTRY)
+        q.head = bce.next;
+    else
+        entries_[bce.prev].next = bce.next;
+    if (bce.next == BLOCK_CACHE_NO_ENTRY)
+        q.tail = bce.prev;
+    else
+        entries_[bce.next].prev = bce.prev;
+    q.size --;
+}
 
-    for (auto it = block_cache_.begin(); it != block_cache_.end(); ++it)
+void pstate::Cache::touch(uint32_t e)
+{
+    block_cache_entry_t& bce = entries_[e];
+    switch (policy_)
     {
-        block_cache_entry_t& bce = it->second;
-        if (!bce.pinned && bce.references == 0)
-        {  // candidate for replacement
-            if (index_to_remove == -1 || bce.clock > clock)
+        case STATE_CACHE_POLICY_CLOCK:
+            bce.referenced = true;
+            break;
+
+        case STATE_CACHE_POLICY_2Q:
+            // the recent queue is FIFO, hits do not reorder it
+            if (bce.queue == BLOCK_CACHE_QUEUE_RECENT)
+                break;
+            // fall through
+
+        default:
+            queue_remove(e);
+            queue_push_back(bce.queue, e);
+            break;
+    }
+}
+
+uint32_t pstate::Cache::select_victim()
+{
+    uint8_t queue = BLOCK_CACHE_QUEUE_RECENT;
+    if (policy_ == STATE_CACHE_POLICY_2Q)
+    {
+        // the recent queue gets a quarter of the slots allocated so far
+        if (queues_[BLOCK_CACHE_QUEUE_RECENT].size <= slots_.allocated_slots() / 4
+            && queues_[BLOCK_CACHE_QUEUE_FREQUENT].size > 0)
+            queue = BLOCK_CACHE_QUEUE_FREQUENT;
+    }
+
+    // entries in use are moved out of the way; CLOCK may need a second
+    // round once the reference bits are cleared
+    for (int round = 0; round < 2; round++)
+    {
+        for (unsigned int n = queues_[queue].size; n > 0; n--)
+        {
+            if (policy_ == STATE_CACHE_POLICY_MRU)
             {
-                index_to_remove = it->first;
-                clock = bce.clock;
+                uint32_t e = queues_[queue].tail;
+                block_cache_entry_t& bce = entries_[e];
+                if (!bce.pinned && bce.references == 0)
+                    return e;
+                queue_remove(e);
+                queue_push_front(queue, e);
+            }
+            else
+            {
+                uint32_t e = queues_[queue].head;
+                block_cache_entry_t& bce = entries_[e];
+                bool skip = bce.pinned || bce.references > 0;
+                if (policy_ == STATE_CACHE_POLICY_CLOCK)
+                {
+                    skip = skip || bce.referenced;
+                    bce.referenced = false;
+                }
+                if (!skip)
+                    return e;
+                queue_remove(e);
+                queue_push_back(queue, e);
             }
         }
+
+        // 2Q falls back to the other queue if everything in this one is in use
+        if (policy_ == STATE_CACHE_POLICY_2Q)
+            queue = (queue == BLOCK_CACHE_QUEUE_RECENT ? BLOCK_CACHE_QUEUE_FREQUENT : BLOCK_CACHE_QUEUE_RECENT);
     }
-    pdo::error::ThrowIf<pdo::error::RuntimeError>(
-        index_to_remove == -1, "cache replacement MRU, no item to replace");
-    flush_entry(index_to_remove);
+
+    return BLOCK_CACHE_NO_ENTRY;
 }
 
+void pstate::Cache::set_policy(state_cache_policy_e policy)
+{
+    policy_ = policy;
+
+    // policies other than 2Q only use the recent queue
+    while (queues_[BLOCK_CACHE_QUEUE_FREQUENT].size > 0)
+    {
+        uint32_t e = queues_[BLOCK_CACHE_QUEUE_FREQUENT].head;
+        queue_remove(e);
+        queue_push_back(BLOCK_CACHE_QUEUE_RECENT, e);
+    }
+}
+
+// XXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXX
 void pstate::Cache::replacement_policy()
 {
     pdo::error::ThrowIf<pdo::error::RuntimeError>(
-            block_cache_.size() + slots_.available_slots() != BLOCK_CACHE_MAX_ITEMS, "cache replacement, invariant not satisfied");
+            size() + slots_.free_slots() != slots_.allocated_slots(), "cache replacement, invariant not satisfied");
 
-    while (block_cache_.size() >= BLOCK_CACHE_MAX_ITEMS)
+    // evict only when no slot is free and none can be allocated
+    while (slots_.available_slots() == 0)
     {
-        replacement_policy_MRU();
+        uint32_t e = select_victim();
+        pdo::error::ThrowIf<pdo::error::RuntimeError>(
+            e == BLOCK_CACHE_NO_ENTRY, "cache replacement, no item to replace");
+
+        unsigned int block_num = entries_[e].block_num;
+        if (policy_ == STATE_CACHE_POLICY_2Q && entries_[e].queue == BLOCK_CACHE_QUEUE_RECENT)
+        {
+            if (ghost_.size() <= block_num)
+                ghost_.resize(block_num + 1, 0);
+            ghost_[block_num] = ++ghost_clock_;
+        }
+
+        evictions_ ++;
+        flush_entry(block_num);
     }
 }
 
 void pstate::Cache::drop_entry(unsigned int block_num)
 {
-    auto it = block_cache_.find(block_num);
-    block_cache_entry_t& bce = it->second;
+    uint32_t e = find_entry(block_num);
+    pdo::error::ThrowIf<pdo::error::RuntimeError>(
+        e == BLOCK_CACHE_NO_ENTRY, "cache drop entry, entry not found");
+
+    block_cache_entry_t& bce = entries_[e];
+    if (bce.prefetched)
+        prefetch_wasted_ ++;
     slots_.release(&(bce.dn));
-    block_cache_.erase(it);
+    queue_remove(e);
+    index_remove(block_num);
+    free_entries_.push_back(e);
 }
 
 void pstate::Cache::drop()
 {
-    while (!block_cache_.empty())
+    for (uint32_t e = 0; e < entries_.size(); e++)
     {
-        auto it = block_cache_.begin();
-        drop_entry(it->first);
+        if (entries_[e].dn != NULL)
+            drop_entry(entries_[e].block_num);
     }
 }
 
@@ -131,26 +401,29 @@ void pstate::Cache::flush_entry(unsigned int block_num)
 
 void pstate::Cache::flush()
 {
-    while (!block_cache_.empty())
-    {
-        auto it = block_cache_.begin();
-        flush_entry(it->first);
-    }
+    // write all modified entries in one batch, then drop everything
+    sync();
+    drop();
 }
 
 void pstate::Cache::sync_entry(unsigned int block_num)
 {
-    auto it = block_cache_.find(block_num);
-    pdo::error::ThrowIf<pdo::error::RuntimeError>(
-        it == block_cache_.end(), "cache sync entry, entry not found");
-
-    block_cache_entry_t& bce = it->second;
+    block_cache_entry_t& bce = get_entry(block_num, "cache sync entry, entry not found");
 
     if (bce.modified)
     {
         StateBlockId new_data_node_id;
-        bce.dn->unload(block_warehouse_.state_encryption_key_, new_data_node_id);
+        ByteArray encrypted_block = bce.dn->serialize_and_encrypt(
+            block_warehouse_.state_encryption_key_, compress_data_nodes_ ? &compressor_ : NULL);
+        state_status_t ret = sebio_evict(encrypted_block, SEBIO_NO_CRYPTO, new_data_node_id);
+        pdo::error::ThrowIf<pdo::error::ValueError>(
+            ret != STATE_SUCCESS, "cache sync entry, sebio returned an error");
+        bce.dn->unloaded(new_data_node_id);
+        written_nodes_ ++;
+        written_bytes_ += encrypted_block.size();
         block_warehouse_.update_datablock_id(block_num, new_data_node_id);
+        if (node_cache() != NULL)
+            node_cache()->put(new_data_node_id, block_warehouse_.state_encryption_key_, bce.dn->decrypted_data());
 
         // sync done
         bce.modified = false;
@@ -161,63 +434,225 @@ void pstate::Cache::sync_entry(unsigned int block_num)
 
 void pstate::Cache::sync()
 {
-    for (auto it = block_cache_.begin(); it != block_cache_.end(); ++it)
+    std::vector<uint32_t> modified_entries;
+    std::vector<StateBlock> encrypted_blocks;
+
+    for (uint32_t e = 0; e < entries_.size(); e++)
+    {
+        block_cache_entry_t& bce = entries_[e];
+        if (bce.dn != NULL && bce.modified)
+        {
+            modified_entries.push_back(e);
+            encrypted_blocks.push_back(bce.dn->serialize_and_encrypt(
+                block_warehouse_.state_encryption_key_, compress_data_nodes_ ? &compressor_ : NULL));
+            written_nodes_ ++;
+            written_bytes_ += encrypted_blocks.back().size();
+        }
+    }
+
+    if (modified_entries.empty())
+        return;
+
+    // evict all the modified data nodes with a single block store request
+    std::vector<StateBlockId> new_data_node_ids;
+    state_status_t ret = sebio_evict_many(encrypted_blocks, SEBIO_NO_CRYPTO, new_data_node_ids);
+    pdo::error::ThrowIf<pdo::error::ValueError>(
+        ret != STATE_SUCCESS, "cache sync, sebio returned an error");
+    pdo::error::ThrowIf<pdo::error::RuntimeError>(
+        new_data_node_ids.size() != modified_entries.size(), "cache sync, unexpected number of block ids");
+
+    for (size_t i = 0; i < modified_entries.size(); i++)
     {
-        sync_entry(it->first);
+        block_cache_entry_t& bce = entries_[modified_entries[i]];
+        bce.dn->unloaded(new_data_node_ids[i]);
+        block_warehouse_.update_datablock_id(bce.block_num, new_data_node_ids[i]);
+
+        // the next request on this worker will likely open this version
+        if (node_cache() != NULL)
+            node_cache()->put(new_data_node_ids[i], block_warehouse_.state_encryption_key_, bce.dn->decrypted_data());
+
+        // sync done
+        bce.modified = false;
+
+        synced_entries_ ++;
     }
 }
 
 void pstate::Cache::put(unsigned int block_num, data_node* dn)
 {
     //drop the current cache entry (if present)
-    if (block_cache_.count(block_num) != 0)
+    if (find_entry(block_num) != BLOCK_CACHE_NO_ENTRY)
     {
         drop_entry(block_num);
     }
 
+    uint32_t e;
+    if (free_entries_.empty())
+    {
+        pdo::error::ThrowIf<pdo::error::RuntimeError>(entries_.size() >= max_items_, "cache put, no free entry");
+        e = entries_.size();
+        entries_.push_back(block_cache_entry_t());
+    }
+    else
+    {
+        e = free_entries_.back();
+        free_entries_.pop_back();
+    }
+
     //add new cache entry
-    block_cache_entry_t bce;
+    block_cache_entry_t& bce = entries_[e];
+    bce.block_num = block_num;
     bce.dn = dn;
     bce.references = 0;
     bce.modified = false;
     bce.pinned = false;
-    bce.clock = (cache_clock_++);
-    block_cache_[block_num] = bce;
+    bce.prefetched = false;
+    bce.referenced = false;
+    index_insert(block_num, e);
+
+    // 2Q admits blocks evicted recently from the recent queue straight
+    // into the frequent queue
+    uint8_t queue = BLOCK_CACHE_QUEUE_RECENT;
+    if (policy_ == STATE_CACHE_POLICY_2Q && block_num < ghost_.size() && ghost_[block_num] != 0
+        && ghost_clock_ - ghost_[block_num] < max_items_ / 2)
+    {
+        queue = BLOCK_CACHE_QUEUE_FREQUENT;
+        ghost_[block_num] = 0;
+    }
+    queue_push_back(queue, e);
 }
 
-pstate::data_node& pstate::Cache::retrieve(unsigned int block_num, bool pinned)
+void pstate::Cache::load_entries(const std::vector<unsigned int>& block_nums, unsigned int demanded_block_num)
 {
-    if (block_cache_.count(block_num) == 0)
-    {  // not in cache
-        replacement_policy();
+    const ByteArray& key = block_warehouse_.state_encryption_key_;
+    std::vector<StateBlockId> data_node_ids(block_nums.size());
+    for (unsigned int i = 0; i < block_nums.size(); i++)
+        block_warehouse_.get_datablock_id_from_datablock_num(block_nums[i], data_node_ids[i]);
+
+    // only the data nodes the worker does not have decrypted already
+    // are fetched, all of them with a single block store request
+    std::vector<ByteArray> decrypted_nodes(block_nums.size());
+    std::vector<unsigned int> missing;
+    std::vector<StateBlockId> missing_ids;
+    for (unsigned int i = 0; i < block_nums.size(); i++)
+    {
+        if (node_cache() == NULL || !node_cache()->get(data_node_ids[i], key, decrypted_nodes[i]))
+        {
+            missing.push_back(i);
+            missing_ids.push_back(data_node_ids[i]);
+        }
+    }
 
-        StateBlockId data_node_id;
-        block_warehouse_.get_datablock_id_from_datablock_num(block_num, data_node_id);
+    std::vector<StateBlock> encrypted_blocks;
+    if (! missing_ids.empty())
+    {
+        state_status_t ret = sebio_fetch_many(missing_ids, SEBIO_NO_CRYPTO, encrypted_blocks);
+        pdo::error::ThrowIf<pdo::error::ValueError>(ret != STATE_SUCCESS,
+            ("cache load, sebio returned an error-" + ByteArrayToHexEncodedString(missing_ids[0])).c_str());
+        pdo::error::ThrowIf<pdo::error::RuntimeError>(
+            encrypted_blocks.size() != missing_ids.size(), "cache load, unexpected number of blocks");
+    }
 
+    for (unsigned int i = 0, m = 0; i < block_nums.size(); i++)
+    {
         // allocate data node and load block into it
         data_node* dn = slots_.allocate();
         pdo::error::ThrowIf<pdo::error::RuntimeError>(!dn, "slot allocate, null pointer");
-        dn->deserialize_original_encrypted_data_id(data_node_id);
-        dn->load(block_warehouse_.state_encryption_key_);
+        dn->deserialize_original_encrypted_data_id(data_node_ids[i]);
+        if (m < missing.size() && missing[m] == i)
+        {
+            dn->load_encrypted(encrypted_blocks[m], key);
+            if (node_cache() != NULL)
+                node_cache()->put(data_node_ids[i], key, dn->decrypted_data());
+            m++;
+        }
+        else
+        {
+            dn->load_decrypted(std::move(decrypted_nodes[i]));
+        }
 
         // cache it
-        put(block_num, dn);
+        put(block_nums[i], dn);
+        if (block_nums[i] != demanded_block_num)
+        {
+            entries_[find_entry(block_nums[i])].prefetched = true;
+            prefetched_ ++;
+        }
+    }
+}
+
+void pstate::Cache::prefetch_candidates(
+    unsigned int block_num, unsigned int count, std::vector<unsigned int>& block_nums)
+{
+    // prefetching only uses free slots, it never evicts cached entries
+    StateBlockId empty_id(STATE_BLOCK_ID_LENGTH, 0);
+    unsigned int last_block_num = block_warehouse_.get_last_block_num();
+    for (unsigned int n = block_num; n < block_num + count && n <= last_block_num; n++)
+    {
+        if (block_nums.size() >= slots_.available_slots())
+            break;
+        if (find_entry(n) != BLOCK_CACHE_NO_ENTRY)
+            continue;
+
+        // data nodes appended in this session have no id yet
+        StateBlockId data_node_id;
+        block_warehouse_.get_datablock_id_from_datablock_num(n, data_node_id);
+        if (data_node_id == empty_id)
+            continue;
+
+        block_nums.push_back(n);
+    }
+}
+
+void pstate::Cache::prefetch(unsigned int block_num, unsigned int count)
+{
+    std::vector<unsigned int> block_nums;
+    prefetch_candidates(block_num, count, block_nums);
+
+    if (! block_nums.empty())
+        load_entries(block_nums, (unsigned int)-1);
+}
+
+pstate::data_node& pstate::Cache::retrieve(unsigned int block_num, bool pinned)
+{
+    uint32_t e = find_entry(block_num);
+    if (e == BLOCK_CACHE_NO_ENTRY)
+    {  // not in cache
+        misses_ ++;
+        replacement_policy();
 
+        // read ahead the data nodes that follow, as long as they fit in
+        // the free slots, and load them together with the missing one
+        std::vector<unsigned int> block_nums(1, block_num);
+        if (prefetch_policy_.window > 1)
+            prefetch_candidates(block_num + 1, prefetch_policy_.window - 1, block_nums);
+
+        load_entries(block_nums, block_num);
+
+        e = find_entry(block_num);
         if (pinned)
-            pin(block_num);
+            entries_[e].pinned = true;
+    }
+    else
+    {
+        hits_ ++;
+        touch(e);
     }
 
     // now it is in cache, grab it
-    block_cache_entry_t& bce = block_cache_[block_num];
+    block_cache_entry_t& bce = entries_[e];
+    if (bce.prefetched)
+    {
+        prefetch_hits_ ++;
+        bce.prefetched = false;
+    }
     bce.references++;
     return *bce.dn;
 }
 
 void pstate::Cache::done(unsigned int block_num, bool modified)
 {
-    pdo::error::ThrowIf<pdo::error::RuntimeError>(
-        block_cache_.count(block_num) == 0, "cache done, item not in cache");
-    block_cache_entry_t& bce = block_cache_[block_num];
+    block_cache_entry_t& bce = get_entry(block_num, "cache done, item not in cache");
     bce.references--;
     if (modified)
     {
@@ -227,25 +662,19 @@ void pstate::Cache::done(unsigned int block_num, bool modified)
 
 void pstate::Cache::pin(unsigned int block_num)
 {
-    pdo::error::ThrowIf<pdo::error::RuntimeError>(
-        block_cache_.count(block_num) == 0, "cache done, item not in cache");
-    block_cache_entry_t& bce = block_cache_[block_num];
+    block_cache_entry_t& bce = get_entry(block_num, "cache pin, item not in cache");
     bce.pinned = true;
 }
 
 void pstate::Cache::unpin(unsigned int block_num)
 {
-    pdo::error::ThrowIf<pdo::error::RuntimeError>(
-        block_cache_.count(block_num) == 0, "cache done, item not in cache");
-    block_cache_entry_t& bce = block_cache_[block_num];
+    block_cache_entry_t& bce = get_entry(block_num, "cache unpin, item not in cache");
     bce.pinned = false;
 }
 
 void pstate::Cache::modified(unsigned int block_num)
 {
-    pdo::error::ThrowIf<pdo::error::RuntimeError>(
-        block_cache_.count(block_num) == 0, "cache done, item not in cache");
-    block_cache_entry_t& bce = block_cache_[block_num];
+    block_cache_entry_t& bce = get_entry(block_num, "cache modified, item not in cache");
     bce.modified = true;
 }
 
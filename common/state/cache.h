@@ -15,55 +15,216 @@
 
 #pragma once
 
-#include <map>
+#include <deque>
 #include <queue>
+#include <stddef.h>
+#include <stdint.h>
+#include <vector>
 
+// Default maximum size of the cache of one state; the slots of the cache
+// are allocated as they are needed, up to this size
+#ifndef CACHE_SIZE
 #define CACHE_SIZE (1 << 22)                 // 4 MB
+#endif
+
+// Default memory budget shared by the caches of all the states a worker
+// has open at the same time
+#ifndef STATE_CACHE_WORKER_BUDGET
+#define STATE_CACHE_WORKER_BUDGET (1 << 22)  // 4 MB
+#endif
+
+// Number of data nodes a cache can allocate even when the budget is
+// exhausted, enough for the pinned nodes and a path through the trie
+#ifndef STATE_CACHE_MIN_ITEMS
+#define STATE_CACHE_MIN_ITEMS 8
+#endif
+
+// Default replacement policy of the data node cache, one of the
+// state_cache_policy_e values below
+#ifndef STATE_CACHE_POLICY
+#define STATE_CACHE_POLICY STATE_CACHE_POLICY_LRU
+#endif
+
+// On a miss, the cache reads ahead this many data nodes (including the
+// missing one) in one batched fetch, as long as there are free slots
+#ifndef STATE_PREFETCH_WINDOW
+#define STATE_PREFETCH_WINDOW 8
+#endif
+
+// States with at most this many data nodes are fetched entirely on open
+#ifndef STATE_PREFETCH_ON_OPEN
+#define STATE_PREFETCH_ON_OPEN 16
+#endif
 
 namespace pdo
 {
 namespace state
 {
+    typedef enum
+    {
+        STATE_CACHE_POLICY_LRU,
+        STATE_CACHE_POLICY_MRU,
+        STATE_CACHE_POLICY_CLOCK,
+        STATE_CACHE_POLICY_2Q
+    } state_cache_policy_e;
+
+    // Memory available to the caches of a worker; the caches reserve
+    // memory from it as they allocate slots and return it when the
+    // state is closed. Not thread safe, each worker has its own.
+    class cache_budget
+    {
+    public:
+        size_t limit_;
+        size_t used_ = 0;
+
+        // decrypted data nodes the worker keeps across requests, if any;
+        // consulted by the caches before fetching from the block store
+        data_node_cache* node_cache_ = NULL;
+
+        cache_budget(size_t limit = STATE_CACHE_WORKER_BUDGET) : limit_(limit) {}
+
+        // reserve the bytes if they fit in the budget, or regardless
+        // of the budget if forced; returns false if nothing was reserved
+        bool reserve(size_t bytes, bool force = false);
+        void release(size_t bytes);
+        size_t available(void) const { return used_ < limit_ ? limit_ - used_ : 0; }
+    };
+
     class cache_slots
     {
     public:
-        cache_slots();
+        cache_slots(unsigned int max_slots, cache_budget* budget);
+        ~cache_slots();
         data_node* allocate();
         void release(data_node** dn);
         unsigned int available_slots();
+        unsigned int free_slots() const { return dn_queue_.size(); }
+        unsigned int allocated_slots() const { return data_nodes_.size(); }
+        unsigned int max_slots() const { return max_slots_; }
 
     private:
-        // the data nodes constitute the cache slots
-        // pointers to these slots are initially pushed in the queue,
-        // and then popped/pushed as they are allocated/released
-        std::vector<data_node> data_nodes_;
+        unsigned int max_slots_;
+        cache_budget* budget_;
+        size_t reserved_;
+
+        bool grow();
+
+        // the data nodes constitute the cache slots, they are created on
+        // demand (the deque keeps them in place as it grows); pointers to
+        // these slots are pushed in the queue when they are created, and
+        // then popped/pushed as they are allocated/released
+        std::deque<data_node> data_nodes_;
         std::queue<data_node*> dn_queue_;
     };
 
+    // The cache keeps its entries in a fixed table of slots indexed by an
+    // open addressing hash of the block number. Every entry is linked in
+    // one of two intrusive queues ordered by the replacement policy:
+    //   LRU/MRU: the recent queue, in order of last use
+    //   CLOCK:   the recent queue is the clock, the head is the hand
+    //   2Q:      new entries go in the recent (A1in, FIFO) queue, entries
+    //            reloaded shortly after being evicted from it go in the
+    //            frequent (Am, LRU) queue
+    // Pinned and referenced entries stay in their queue and are skipped
+    // (moved aside) when they come up for eviction, so a replacement
+    // costs O(1) plus the few entries in use.
     class Cache
     {
-    private:
-        // the block_warehouse_ reference is related to the block_warehouse member of dn_io
-        block_warehouse& block_warehouse_;
-        unsigned int synced_entries_;
-
-        void replacement_policy_MRU();
-
     public:
         struct block_cache_entry_t
         {
+            unsigned int block_num;
             bool pinned;
             unsigned int references;
             bool modified;
-            uint64_t clock;
+            bool prefetched;  // loaded speculatively and not used yet
+            bool referenced;  // CLOCK reference bit
+            uint8_t queue;
+            uint32_t prev;
+            uint32_t next;
             data_node* dn;
         };
 
-        Cache(block_warehouse& bw): block_warehouse_(bw), synced_entries_(0) {}
+        struct prefetch_policy_t
+        {
+            unsigned int window;
+            unsigned int on_open;
+        };
+
+    private:
+        struct cache_queue_t
+        {
+            uint32_t head;
+            uint32_t tail;
+            unsigned int size;
+        };
+
+        // the block_warehouse_ reference is related to the block_warehouse member of dn_io
+        block_warehouse& block_warehouse_;
+        unsigned int synced_entries_;
+
+        state_cache_policy_e policy_;
+        cache_budget* budget_;
+        unsigned int max_items_;
+        std::vector<block_cache_entry_t> entries_;
+        std::vector<uint32_t> free_entries_;
+        std::vector<uint32_t> index_;
+        uint32_t index_mask_;
+        cache_queue_t queues_[2];
+
+        // 2Q ghost queue: sequence number of the last eviction of each
+        // block from the recent queue, indexed by block number
+        std::vector<uint64_t> ghost_;
+        uint64_t ghost_clock_ = 0;
+
+        data_node_cache* node_cache(void) const { return budget_ != NULL ? budget_->node_cache_ : NULL; }
+
+        uint32_t index_home(unsigned int block_num) const;
+        uint32_t find_entry(unsigned int block_num) const;
+        block_cache_entry_t& get_entry(unsigned int block_num, const char* msg);
+        void index_insert(unsigned int block_num, uint32_t e);
+        void index_remove(unsigned int block_num);
+
+        void queue_push_back(uint8_t queue, uint32_t e);
+        void queue_push_front(uint8_t queue, uint32_t e);
+        void queue_remove(uint32_t e);
+        void touch(uint32_t e);
+        uint32_t select_victim();
+
+        void load_entries(const std::vector<unsigned int>& block_nums, unsigned int demanded_block_num);
+        void prefetch_candidates(unsigned int block_num, unsigned int count, std::vector<unsigned int>& block_nums);
+
+    public:
+        // cache_size is the maximum size of this cache, budget (if not
+        // NULL) is the memory shared with the other caches of the worker
+        Cache(block_warehouse& bw,
+            size_t cache_size = CACHE_SIZE,
+            cache_budget* budget = NULL,
+            state_cache_policy_e policy = STATE_CACHE_POLICY);
 
-        std::map<unsigned int, block_cache_entry_t> block_cache_;
         cache_slots slots_;
-        uint64_t cache_clock_ = 0;
+
+        prefetch_policy_t prefetch_policy_ = { STATE_PREFETCH_WINDOW, STATE_PREFETCH_ON_OPEN };
+        uint64_t prefetched_ = 0;
+        uint64_t prefetch_hits_ = 0;
+        uint64_t prefetch_wasted_ = 0;
+
+        uint64_t hits_ = 0;
+        uint64_t misses_ = 0;
+        uint64_t evictions_ = 0;
+
+        // data nodes are compressed before they are encrypted if the state
+        // opts in, see State_KV::SetDataNodeCompression; the bytes written
+        // for the nodes give the compression ratio of the state
+        bool compress_data_nodes_ = false;
+        block_compressor compressor_;
+        uint64_t written_nodes_ = 0;
+        uint64_t written_bytes_ = 0;
+
+        void set_policy(state_cache_policy_e policy);
+        state_cache_policy_e policy(void) const { return policy_; }
+        unsigned int size(void) const { return entries_.size() - free_entries_.size(); }
+        cache_budget* budget(void) const { return budget_; }
 
         void replacement_policy();
         void drop_entry(unsigned int block_num);
@@ -74,6 +235,7 @@ namespace state
         void sync();
         void put(unsigned int block_num, data_node* dn);
         data_node& retrieve(unsigned int block_num, bool pinned);
+        void prefetch(unsigned int block_num, unsigned int count);
         void done(unsigned int block_num, bool modified);
         void pin(unsigned int block_num);
         void unpin(unsigned int block_num);
@@ -13,6 +13,8 @@
  * limitations under the License.
  */
 
+#include <string.h>
+
 #include "state.h"
 
 namespace pstate = pdo::state;
@@ -72,6 +74,26 @@ void pstate::data_node::decrypt_and_deserialize_data(
     const ByteArray& inEncryptedData, const ByteArray& state_encryption_key)
 {
     data_ = pdo::crypto::skenc::DecryptMessage(state_encryption_key, inEncryptedData);
+
+    // an uncompressed node has the fixed size, a compressed one is shorter
+    if (data_.size() != FIXED_DATA_NODE_BYTE_SIZE)
+    {
+        const size_t magic_size = sizeof(STATE_COMPRESSED_NODE_MAGIC) - 1;
+        uint32_t raw_size;
+        pdo::error::ThrowIf<pdo::error::ValueError>(
+            data_.size() < magic_size + sizeof(raw_size) ||
+            memcmp(data_.data(), STATE_COMPRESSED_NODE_MAGIC, magic_size) != 0,
+            "data node, invalid size");
+        memcpy(&raw_size, data_.data() + magic_size, sizeof(raw_size));
+        pdo::error::ThrowIf<pdo::error::ValueError>(
+            raw_size != FIXED_DATA_NODE_BYTE_SIZE, "data node, invalid compressed size");
+
+        ByteArray raw_data;
+        size_t header_size = magic_size + sizeof(raw_size);
+        decompress_block(data_.data() + header_size, data_.size() - header_size, raw_size, raw_data);
+        data_ = std::move(raw_data);
+    }
+
     block_num_ = block_offset::serialized_offset_to_block_num(data_);
     free_bytes_ = block_offset::serialized_offset_to_bytes(data_);
 }
@@ -158,8 +180,29 @@ unsigned int pstate::data_node::read_at(const block_offset_t& bo_at, unsigned in
     return bytes_to_read;
 }
 
-void pstate::data_node::load(const ByteArray& state_encryption_key)
+unsigned int pstate::data_node::read_at(const block_offset_t& bo_at, unsigned int bytes, uint8_t* outBuffer)
 {
+    pdo::error::ThrowIf<pdo::error::RuntimeError>(
+        block_num_ != bo_at.block_num, "read, bad block num");
+
+    unsigned int bytes_to_endof_data = data_end_index() - bo_at.bytes;
+    unsigned int bytes_to_read =
+        (bytes <= bytes_to_endof_data ? bytes : bytes_to_endof_data);
+
+    memcpy(outBuffer, data_.data() + bo_at.bytes, bytes_to_read);
+    return bytes_to_read;
+}
+
+void pstate::data_node::load(const ByteArray& state_encryption_key, data_node_cache* node_cache)
+{
+    // the worker may still hold the node decrypted from an earlier request
+    ByteArray data;
+    if (node_cache != NULL && node_cache->get(originalEncryptedDataNodeId_, state_encryption_key, data))
+    {
+        load_decrypted(std::move(data));
+        return;
+    }
+
     state_status_t ret;
     ByteArray encrypted_buffer;
     ret = sebio_fetch(originalEncryptedDataNodeId_, SEBIO_NO_CRYPTO, encrypted_buffer);
@@ -168,13 +211,36 @@ void pstate::data_node::load(const ByteArray& state_encryption_key)
             ByteArrayToHexEncodedString(originalEncryptedDataNodeId_))
             .c_str());
     decrypt_and_deserialize_data(encrypted_buffer, state_encryption_key);
+
+    if (node_cache != NULL)
+        node_cache->put(originalEncryptedDataNodeId_, state_encryption_key, data_);
+}
+
+void pstate::data_node::load_encrypted(
+    const ByteArray& encrypted_buffer, const ByteArray& state_encryption_key)
+{
+    // the buffer was fetched (and authenticated) by the caller, typically
+    // as part of a batch with sebio_fetch_many
+    decrypt_and_deserialize_data(encrypted_buffer, state_encryption_key);
+}
+
+void pstate::data_node::load_decrypted(ByteArray data)
+{
+    data_ = std::move(data);
+    block_num_ = block_offset::serialized_offset_to_block_num(data_);
+    free_bytes_ = block_offset::serialized_offset_to_bytes(data_);
+}
+
+const ByteArray& pstate::data_node::decrypted_data()
+{
+    // the header is current once the node has been loaded or encrypted
+    return data_;
 }
 
 void pstate::data_node::unload(
-    const ByteArray& state_encryption_key, StateBlockId& outEncryptedDataNodeId)
+    const ByteArray& state_encryption_key, StateBlockId& outEncryptedDataNodeId, block_compressor* compressor)
 {
-    serialize_data_header();
-    ByteArray baEncryptedData = pdo::crypto::skenc::EncryptMessage(state_encryption_key, data_);
+    ByteArray baEncryptedData = serialize_and_encrypt(state_encryption_key, compressor);
     state_status_t ret =
         sebio_evict(baEncryptedData, SEBIO_NO_CRYPTO, originalEncryptedDataNodeId_);
     pdo::error::ThrowIf<pdo::error::ValueError>(
@@ -182,3 +248,33 @@ void pstate::data_node::unload(
     // return new id
     outEncryptedDataNodeId = originalEncryptedDataNodeId_;
 }
+
+/*
+    The two functions below split unload, so that the encrypted data of
+    several nodes can be evicted together with sebio_evict_many
+*/
+ByteArray pstate::data_node::serialize_and_encrypt(const ByteArray& state_encryption_key, block_compressor* compressor)
+{
+    serialize_data_header();
+
+    // the compressed node is written only if it saves space, with its header
+    ByteArray compressed;
+    const size_t magic_size = sizeof(STATE_COMPRESSED_NODE_MAGIC) - 1;
+    uint32_t raw_size = data_.size();
+    if (compressor != NULL && compressor->compress(data_.data(), data_.size(), compressed) &&
+        compressed.size() + magic_size + sizeof(raw_size) < data_.size())
+    {
+        ByteArray block(STATE_COMPRESSED_NODE_MAGIC, STATE_COMPRESSED_NODE_MAGIC + magic_size);
+        block.reserve(magic_size + sizeof(raw_size) + compressed.size());
+        block.insert(block.end(), (uint8_t*)&raw_size, (uint8_t*)&raw_size + sizeof(raw_size));
+        block.insert(block.end(), compressed.begin(), compressed.end());
+        return pdo::crypto::skenc::EncryptMessage(state_encryption_key, block);
+    }
+
+    return pdo::crypto::skenc::EncryptMessage(state_encryption_key, data_);
+}
+
+void pstate::data_node::unloaded(const StateBlockId& encryptedDataNodeId)
+{
+    originalEncryptedDataNodeId_ = encryptedDataNodeId;
+}
@@ -17,10 +17,17 @@
 
 #define FIXED_DATA_NODE_BYTE_SIZE (1 << 13)  // 8 KB
 
+// A data node that is written with a compressor is compressed before it
+// is encrypted, unless it does not compress; a compressed node starts
+// with this magic and its size
+#define STATE_COMPRESSED_NODE_MAGIC "PDOZ"
+
 namespace pdo
 {
 namespace state
 {
+    class data_node_cache;
+
     class data_node
     {
     private:
@@ -46,8 +53,16 @@ namespace state
         static void advance_block_offset(block_offset_t& bo, unsigned int length);
         unsigned int write_at(const ByteArray& buffer, unsigned int write_from, const block_offset_t& bo_at);
         unsigned int read_at(const block_offset_t& bo_at, unsigned int bytes, ByteArray& outBuffer);
-        void load(const ByteArray& state_encryption_key);
-        void unload(const ByteArray& state_encryption_key, StateBlockId& outEncryptedDataNodeId);
+        unsigned int read_at(const block_offset_t& bo_at, unsigned int bytes, uint8_t* outBuffer);
+        void load(const ByteArray& state_encryption_key, data_node_cache* node_cache = NULL);
+        void load_encrypted(const ByteArray& encrypted_buffer, const ByteArray& state_encryption_key);
+        void load_decrypted(ByteArray data);
+        const ByteArray& decrypted_data();
+        void unload(const ByteArray& state_encryption_key, StateBlockId& outEncryptedDataNodeId,
+            block_compressor* compressor = NULL);
+        ByteArray serialize_and_encrypt(const ByteArray& state_encryption_key,
+            block_compressor* compressor = NULL);
+        void unloaded(const StateBlockId& encryptedDataNodeId);
     };
 }
 }
@@ -0,0 +1,75 @@
+/* Copyright 2024 Intel Corporation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "state.h"
+
+namespace pstate = pdo::state;
+
+// XXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXX
+pstate::data_node_cache::data_node_cache(size_t cache_size)
+    : max_entries_(cache_size / FIXED_DATA_NODE_BYTE_SIZE)
+{
+}
+
+// XXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXX
+bool pstate::data_node_cache::get(const StateBlockId& id, const ByteArray& key, ByteArray& data)
+{
+    auto it = entries_.find(id);
+    if (it == entries_.end() || it->second.key != key)
+    {
+        misses_ ++;
+        return false;
+    }
+
+    lru_.splice(lru_.end(), lru_, it->second.lru);
+    data = it->second.data;
+    hits_ ++;
+    return true;
+}
+
+// XXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXX
+void pstate::data_node_cache::put(const StateBlockId& id, const ByteArray& key, const ByteArray& data)
+{
+    if (max_entries_ == 0)
+        return;
+
+    auto it = entries_.find(id);
+    if (it != entries_.end())
+    {
+        lru_.splice(lru_.end(), lru_, it->second.lru);
+        it->second.key = key;
+        it->second.data = data;
+        return;
+    }
+
+    while (entries_.size() >= max_entries_)
+    {
+        entries_.erase(lru_.front());
+        lru_.pop_front();
+        evictions_ ++;
+    }
+
+    node_cache_entry_t& entry = entries_[id];
+    entry.key = key;
+    entry.data = data;
+    entry.lru = lru_.insert(lru_.end(), id);
+}
+
+// XXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXX
+void pstate::data_node_cache::clear(void)
+{
+    entries_.clear();
+    lru_.clear();
+}
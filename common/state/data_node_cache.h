@@ -0,0 +1,73 @@
+/* Copyright 2024 Intel Corporation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <list>
+#include <map>
+
+// Default size of the decrypted data nodes kept by a worker across requests
+#ifndef STATE_NODE_CACHE_SIZE
+#define STATE_NODE_CACHE_SIZE (1 << 21)      // 2 MB
+#endif
+
+namespace pdo
+{
+namespace state
+{
+    // XXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXX
+    // data_node_cache
+    //
+    // Decrypted data nodes keyed by the id of their encrypted block. The
+    // cache outlives the states that fill it, so a request that opens the
+    // state written by the previous request on the same worker does not
+    // fetch, verify and decrypt the same blocks again. The id is the hash
+    // of the block, so entries never become stale and are only dropped
+    // to make room, least recently used first.
+    //
+    // The state encryption key is kept with each entry, and a node is
+    // returned only to a state using the same key.
+    // XXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXX
+    class data_node_cache
+    {
+    private:
+        struct node_cache_entry_t
+        {
+            ByteArray key;
+            ByteArray data;
+            std::list<StateBlockId>::iterator lru;
+        };
+
+        std::map<StateBlockId, node_cache_entry_t> entries_;
+        std::list<StateBlockId> lru_;
+        size_t max_entries_;
+
+    public:
+        uint64_t hits_ = 0;
+        uint64_t misses_ = 0;
+        uint64_t evictions_ = 0;
+
+        data_node_cache(size_t cache_size = STATE_NODE_CACHE_SIZE);
+
+        // copy the decrypted data node into data; returns false if the
+        // block is not cached for this key
+        bool get(const StateBlockId& id, const ByteArray& key, ByteArray& data);
+        void put(const StateBlockId& id, const ByteArray& key, const ByteArray& data);
+        void clear(void);
+
+        size_t size(void) const { return entries_.size(); }
+    };
+}
+}
@@ -27,22 +27,66 @@ void pstate::data_node_io::initialize(pdo::state::StateNode& node)
     // deserialize blocks ids in root block
     block_warehouse_.deserialize_block_ids(node);
 
-    //deserialize free space allocator, and remove last data node
+    // small states are fetched entirely with one batched request
+    unsigned int block_count = block_warehouse_.get_last_block_num() + 1;
+    if (block_count <= cache_.prefetch_policy_.on_open)
+        cache_.prefetch(0, block_count);
+
+    load_free_space_collection();
+
+    init_append_data_node();
+}
+
+void pstate::data_node_io::load_free_space_collection()
+{
+    //deserialize free space collection, and remove its data nodes from the end of the list;
+    //the last data node tells how many there are
+    unsigned int data_nodes = 1;
+    for(unsigned int n = 0; n < data_nodes; n++)
     {
         //get the data node of the free space collection
         unsigned int free_space_collection_block_num = block_warehouse_.get_last_block_num();
+        pdo::error::ThrowIf<pdo::error::RuntimeError>(free_space_collection_block_num == 0,
+            "free space collection, too many data nodes");
         data_node& fsc_dn = cache_.retrieve(free_space_collection_block_num, false);
         //save the identity of the data node containing it
-        block_warehouse_.get_datablock_id_from_datablock_num(
-            free_space_collection_block_num, free_space_collector_.original_block_id_of_collection);
+        StateBlockId fsc_dn_id;
+        block_warehouse_.get_datablock_id_from_datablock_num(free_space_collection_block_num, fsc_dn_id);
+        free_space_collector_.original_block_ids_of_collection.insert(
+            free_space_collector_.original_block_ids_of_collection.begin(), fsc_dn_id);
         //deserialize the collection
-        free_space_collector_.deserialize_from_data_node(fsc_dn);
-        //rmeove last data node
-        cache_.done(block_warehouse_.get_last_block_num(), false);
+        unsigned int fsc_data_nodes = free_space_collector_.deserialize_from_data_node(fsc_dn);
+        if(n == 0)
+        {
+            data_nodes = fsc_data_nodes;
+        }
+        //remove data node
+        cache_.done(free_space_collection_block_num, false);
         block_warehouse_.remove_block_id_from_datablock_num(free_space_collection_block_num);
     }
+}
 
-    init_append_data_node();
+void pstate::data_node_io::save_free_space_collection(bool modified)
+{
+    if(! modified)
+    {
+        // collection not modified, simply put its original block ids in the list
+        for(StateBlockId& fsc_dn_id : free_space_collector_.original_block_ids_of_collection)
+        {
+            block_warehouse_.add_block_id(fsc_dn_id);
+        }
+        return;
+    }
+
+    //serialize free space collection and store it in dedicated data nodes
+    std::vector<ByteArray> fsc_data_nodes;
+    free_space_collector_.serialize(fsc_data_nodes);
+    for(const ByteArray& fsc_data : fsc_data_nodes)
+    {
+        add_and_init_append_data_node();
+        block_offset_t bo = {append_dn_->get_block_num(), data_node::data_begin_index()};
+        append_dn_->write_at(fsc_data, 0, bo);
+    }
 }
 
 void pstate::data_node_io::init_append_data_node()
@@ -143,6 +187,7 @@ void pstate::data_node_io::read_across_data_nodes(const block_offset_t& bo_at, u
     {
 
         data_node& dn = cache_.retrieve(bo.block_num, false);
+        data_node_reads_ ++;
         try
         {
         bytes_read = dn.read_at(bo, length - total_bytes_read, out_buffer);
@@ -159,3 +204,30 @@ void pstate::data_node_io::read_across_data_nodes(const block_offset_t& bo_at, u
         data_node::advance_block_offset(bo, bytes_read);
     }
 }
+
+// read into a buffer of length bytes, straight from the cached data nodes
+void pstate::data_node_io::read_across_data_nodes(const block_offset_t& bo_at, unsigned int length, uint8_t* out_buffer)
+{
+    block_offset_t bo = bo_at;
+
+    unsigned int bytes_read, total_bytes_read = 0;
+
+    while(total_bytes_read < length)
+    {
+        data_node& dn = cache_.retrieve(bo.block_num, false);
+        data_node_reads_ ++;
+        try
+        {
+            bytes_read = dn.read_at(bo, length - total_bytes_read, out_buffer + total_bytes_read);
+        }
+        catch (const std::exception& e)
+        {
+            SAFE_LOG_EXCEPTION("read_at call failed");
+            throw;
+        }
+        cache_.done(bo.block_num, false);
+
+        total_bytes_read += bytes_read;
+        data_node::advance_block_offset(bo, bytes_read);
+    }
+}
@@ -15,6 +15,18 @@
 
 #pragma once
 
+// Levels of the trie with more than one node are written as branch nodes
+// (see trie.h); with 0, they are written as lists of sibling nodes
+#ifndef STATE_TRIE_BRANCH_NODES
+#define STATE_TRIE_BRANCH_NODES 1
+#endif
+
+// Small values are written in the trie node that refers to them (see
+// trie.h); with 0, all values are written after the trie nodes
+#ifndef STATE_TRIE_INLINE_VALUES
+#define STATE_TRIE_INLINE_VALUES 1
+#endif
+
 namespace pdo
 {
 namespace state
@@ -28,9 +40,18 @@ namespace state
         data_node* append_dn_;
         Cache cache_;
 
-        data_node_io(const ByteArray& key) : block_warehouse_(key), cache_(block_warehouse_) {}
+        bool trie_branch_nodes_ = STATE_TRIE_BRANCH_NODES;
+        bool trie_inline_values_ = STATE_TRIE_INLINE_VALUES;
+        uint64_t trie_node_reads_ = 0;
+        uint64_t data_node_reads_ = 0;
+
+        data_node_io(const ByteArray& key, size_t cache_size = CACHE_SIZE, cache_budget* budget = NULL)
+            : block_warehouse_(key), cache_(block_warehouse_, cache_size, budget) {}
         void initialize(pdo::state::StateNode& node);
 
+        void load_free_space_collection();
+        void save_free_space_collection(bool modified);
+
         void init_append_data_node();
         void add_and_init_append_data_node();
         void add_and_init_append_data_node_cond(bool cond);
@@ -40,6 +61,7 @@ namespace state
 
         void write_across_data_nodes(const ByteArray& buffer, unsigned int write_from, const block_offset_t& bo_at);
         void read_across_data_nodes(const block_offset_t& bo_at, unsigned int length, ByteArray& outBuffer);
+        void read_across_data_nodes(const block_offset_t& bo_at, unsigned int length, uint8_t* outBuffer);
     };
 }
 }
@@ -17,6 +17,23 @@
 
 namespace pstate = pdo::state;
 
+unsigned int pstate::free_space_collector::size_class(unsigned int length)
+{
+    if(length < FREE_SPACE_EXACT_SIZE_CLASSES)
+    {
+        return length;
+    }
+
+    unsigned int log2_length = 8 * sizeof(unsigned int) - 1 - __builtin_clz(length);
+    unsigned int log2_exact = 8 * sizeof(unsigned int) - 1 - __builtin_clz(FREE_SPACE_EXACT_SIZE_CLASSES);
+    return FREE_SPACE_EXACT_SIZE_CLASSES + log2_length - log2_exact;
+}
+
+unsigned int pstate::free_space_collector::items_per_data_node()
+{
+    return (data_node::data_end_index() - data_node::data_begin_index()) / sizeof(free_space_item_t);
+}
+
 bool pstate::free_space_collector::are_adjacent(const block_offset_t& bo1, const unsigned& length1, const block_offset_t& bo2)
 {
     pdo::error::ThrowIf<pdo::error::RuntimeError>(bo1.block_num > bo2.block_num ||
@@ -24,53 +41,52 @@ bool pstate::free_space_collector::are_adjacent(const block_offset_t& bo1, const
         "free space collector, adjancency error");
     block_offset_t bo = bo1;
     data_node::advance_block_offset(bo, length1);
+    pdo::error::ThrowIf<pdo::error::RuntimeError>(offset_less()(bo2, bo),
+        "free space collector, overlapping items");
     return (bo == bo2);
 }
 
-void pstate::free_space_collector::insert_free_space_item(std::vector<free_space_item_t>::iterator& it, free_space_item_t& fsi)
+void pstate::free_space_collector::insert_free_space_item(const free_space_item_t& fsi)
 {
+    free_space_by_offset_[fsi.bo] = fsi.length;
+    size_classes_[size_class(fsi.length)].insert(fsi);
+    free_bytes_ += fsi.length;
+}
+
+void pstate::free_space_collector::remove_free_space_item(const free_space_item_t& fsi)
+{
+    free_space_by_offset_.erase(fsi.bo);
+    size_classes_[size_class(fsi.length)].erase(fsi);
+    free_bytes_ -= fsi.length;
+}
+
+void pstate::free_space_collector::do_collect(free_space_item_t& fsi)
+{
+    auto next_it = free_space_by_offset_.lower_bound(fsi.bo);
+
     //first check if it can merge with previous
-    if(it != free_space_collection.begin())
+    if(next_it != free_space_by_offset_.begin())
     {
-        auto prev_it = std::prev(it);
-        if(are_adjacent(prev_it->bo, prev_it->length, fsi.bo))
+        auto prev_it = std::prev(next_it);
+        if(are_adjacent(prev_it->first, prev_it->second, fsi.bo))
         {
+            free_space_item_t prev_fsi = {prev_it->first, prev_it->second};
+            remove_free_space_item(prev_fsi);
             //update item to be inserted
-            fsi.bo = prev_it->bo;
-            fsi.length += prev_it->length;
-            //remove previous item
-            it = free_space_collection.erase(prev_it);
+            fsi.bo = prev_fsi.bo;
+            fsi.length += prev_fsi.length;
         }
     }
-    //also, check if it can merge with current
-    if(it != free_space_collection.end() && are_adjacent(fsi.bo, fsi.length, it->bo))
+    //also, check if it can merge with next
+    if(next_it != free_space_by_offset_.end() && are_adjacent(fsi.bo, fsi.length, next_it->first))
     {
+        free_space_item_t next_fsi = {next_it->first, next_it->second};
+        remove_free_space_item(next_fsi);
         //item to be inserted is the same, just increase length
-        fsi.length += it->length;
-        it = free_space_collection.erase(it);
+        fsi.length += next_fsi.length;
     }
     //any merge done, now insert
-    free_space_collection.insert(it, fsi);
-}
-
-void pstate::free_space_collector::do_collect(free_space_item_t& fsi)
-{
-    std::vector<free_space_item_t>::iterator it;
-
-    for(it = free_space_collection.begin(); it != free_space_collection.end(); it++)
-    {
-        if(fsi.bo.block_num < it->bo.block_num || //if the item location preceeds the current one, insert!
-            (fsi.bo.block_num == it->bo.block_num && fsi.bo.bytes < it->bo.bytes))
-        {
-            insert_free_space_item(it, fsi);
-            return;
-        }
-
-        //no insert, go to next
-    }
-
-    // no merge in loop, then insert/merge at end of vector
-    insert_free_space_item(it, fsi);
+    insert_free_space_item(fsi);
 
     is_collection_modified = true;
 }
@@ -90,12 +106,14 @@ void pstate::free_space_collector::collect(const block_offset_t& bo, const unsig
 
     deferred_fsi = {bo, length};
     is_fsi_deferred= true;
+
+    //an offset at the end of a block (e.g., the cursor of a full data node)
+    //refers to the beginning of the next one, so normalize it before merging
+    data_node::advance_block_offset(deferred_fsi.bo, 0);
 }
 
 bool pstate::free_space_collector::allocate(const unsigned int& length, block_offset_t& out_bo)
 {
-    bool space_found = false;
-
     if(is_fsi_deferred)
     {
         is_fsi_deferred=false;
@@ -110,41 +128,64 @@ bool pstate::free_space_collector::allocate(const unsigned int& length, block_of
         do_collect(deferred_fsi);
     }
 
-    for(auto it = free_space_collection.begin(); it != free_space_collection.end(); it++)
+    //the smallest item that fits is in the class of the length, or it is
+    //the smallest item of the next non-empty class
+    free_space_item_t lowest = {empty_block_offset, length};
+    for(unsigned int c = size_class(length); c < FREE_SPACE_SIZE_CLASSES; c++)
     {
-        if(it->length >= length)
+        auto it = size_classes_[c].lower_bound(lowest);
+        if(it == size_classes_[c].end())
+        {
+            continue;
+        }
+
+        free_space_item_t fsi = *it;
+        remove_free_space_item(fsi);
+        //return the block offset
+        out_bo = fsi.bo;
+
+        if(fsi.length > length)
         {
-            space_found = true;
-            //return the block offset
-            out_bo = it->bo;
-
-            if(it->length == length)
-            {
-                //the requested length match, so remove item
-                free_space_collection.erase(it);
-            }
-            else
-            {
-                //item has more space than necessary, so update it
-                data_node::advance_block_offset(it->bo, length);
-                it->length -= length;
-            }
-
-            is_collection_modified = true;
-
-            break;
+            //item has more space than necessary, so put back the rest
+            data_node::advance_block_offset(fsi.bo, length);
+            fsi.length -= length;
+            insert_free_space_item(fsi);
         }
+
+        is_collection_modified = true;
+        return true;
     }
 
-    return space_found;
+    return false;
 }
 
 bool pstate::free_space_collector::collection_modified()
 {
-    return is_collection_modified;
+    return is_collection_modified || is_fsi_deferred;
 }
 
-void pstate::free_space_collector::serialize_in_data_node(data_node &out_dn)
+unsigned int pstate::free_space_collector::largest_free_item() const
+{
+    for(unsigned int c = FREE_SPACE_SIZE_CLASSES; c > 0; c--)
+    {
+        if(! size_classes_[c - 1].empty())
+        {
+            return size_classes_[c - 1].rbegin()->length;
+        }
+    }
+    return 0;
+}
+
+double pstate::free_space_collector::fragmentation() const
+{
+    if(free_bytes_ == 0)
+    {
+        return 0;
+    }
+    return 1.0 - (double)largest_free_item() / free_bytes_;
+}
+
+void pstate::free_space_collector::serialize(std::vector<ByteArray>& out_data_nodes)
 {
     if(is_fsi_deferred)
     {
@@ -152,43 +193,61 @@ void pstate::free_space_collector::serialize_in_data_node(data_node &out_dn)
         is_fsi_deferred = false;
     }
 
-    //out_dn must be a dedicated data node, so let us check it is completely free
-    pdo::error::ThrowIf<pdo::error::RuntimeError>(
-        out_dn.free_bytes() != data_node::data_end_index() - data_node::data_begin_index(),
-    "serialize free space collector, data node not dedicated");
+    //the last data node starts with the header item
+    unsigned int items = free_space_by_offset_.size() + 1;
+    unsigned int data_nodes = (items + items_per_data_node() - 1) / items_per_data_node();
+    free_space_item_t header = {{data_nodes, 0}, 0};
 
-    unsigned int items=0;
-    block_offset_t bo = {out_dn.get_block_num(), data_node::data_begin_index()};
-    for(auto it = free_space_collection.begin(); it != free_space_collection.end(); it++)
+    out_data_nodes.clear();
+    out_data_nodes.resize(data_nodes);
+    auto it = free_space_by_offset_.begin();
+    for(unsigned int n = 0; n < data_nodes; n++)
     {
-        if(out_dn.free_bytes() < sizeof(free_space_item_t))
+        ByteArray& out_dn = out_data_nodes[n];
+        if(n == data_nodes - 1)
         {
-            //WARNING: items that do not fit into the data node are discarded
-            break;
+            out_dn.insert(out_dn.end(), (uint8_t*)&header, (uint8_t*)&header + sizeof(free_space_item_t));
+        }
+        while(it != free_space_by_offset_.end() &&
+            out_dn.size() < items_per_data_node() * sizeof(free_space_item_t))
+        {
+            free_space_item_t fsi = {it->first, it->second};
+            out_dn.insert(out_dn.end(), (uint8_t*)&fsi, (uint8_t*)&fsi + sizeof(free_space_item_t));
+            it++;
         }
-        ByteArray ba_free_space_item((uint8_t*)&(*it), (uint8_t*)&(*it) + sizeof(free_space_item_t));
-        out_dn.write_at(ba_free_space_item, 0, bo);
-        data_node::advance_block_offset(bo, sizeof(free_space_item_t));
-        items++;
     }
 }
 
-void pstate::free_space_collector::deserialize_from_data_node(data_node &in_dn)
+unsigned int pstate::free_space_collector::deserialize_from_data_node(data_node &in_dn)
 {
-    //ASSUMPTION: the data node is dedicated to contain the free space collection vector
+    //ASSUMPTION: the data node is dedicated to contain the free space collection
     unsigned int bytes_to_read = data_node::data_end_index() - data_node::data_begin_index() - in_dn.free_bytes();
     pdo::error::ThrowIf<pdo::error::RuntimeError>(
         bytes_to_read % sizeof(free_space_item_t) != 0,
         "deserialize free space collector, readable bytes not a multiple of item size");
     block_offset_t bo = {in_dn.get_block_num(), data_node::data_begin_index()};
-    ByteArray ba_free_space_item;
+    unsigned int data_nodes = 1;
+    bool modified = is_collection_modified;
+    free_space_item_t fsi;
     while(bytes_to_read)
     {
-        in_dn.read_at(bo, sizeof(free_space_item_t), ba_free_space_item);
+        in_dn.read_at(bo, sizeof(free_space_item_t), (uint8_t*)&fsi);
         data_node::advance_block_offset(bo, sizeof(free_space_item_t));
         bytes_to_read -= sizeof(free_space_item_t);
 
-        free_space_collection.push_back(*((free_space_item_t*)ba_free_space_item.data()));
-        ba_free_space_item.clear();
+        if(fsi.length == 0)
+        {
+            //header item
+            pdo::error::ThrowIf<pdo::error::RuntimeError>(fsi.bo.block_num == 0,
+                "deserialize free space collector, bad header");
+            data_nodes = fsi.bo.block_num;
+            continue;
+        }
+
+        //collections of earlier versions may have offsets at the end of a block
+        data_node::advance_block_offset(fsi.bo, 0);
+        do_collect(fsi);
     }
+    is_collection_modified = modified;
+    return data_nodes;
 }
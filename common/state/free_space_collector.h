@@ -15,10 +15,32 @@
 
 #pragma once
 
+#include <map>
+#include <set>
+
+// Free space items shorter than this length have one size class per
+// length; longer items are grouped in classes of doubling length
+#define FREE_SPACE_EXACT_SIZE_CLASSES 64
+#define FREE_SPACE_SIZE_CLASSES (FREE_SPACE_EXACT_SIZE_CLASSES + 32)
+
 namespace pdo
 {
 namespace state
 {
+    // XXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXX
+    // free_space_collector
+    //
+    // Keeps track of the free space in the data nodes of a state. Each
+    // free item is indexed twice: by offset, to merge it with adjacent
+    // items when space is collected, and by size class, to allocate the
+    // smallest item that fits without scanning the collection.
+    //
+    // The collection is stored in dedicated data nodes at the end of the
+    // state. The last of them starts with a header item (an item with
+    // zero length whose block number is the number of nodes), so the
+    // collection can take as many data nodes as it needs. A data node
+    // without header is a collection of earlier versions.
+    // XXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXX
     class free_space_collector
     {
         typedef struct {
@@ -26,25 +48,61 @@ namespace state
             unsigned int length;
         } free_space_item_t;
 
+        struct offset_less
+        {
+            bool operator()(const block_offset_t& lhs, const block_offset_t& rhs) const
+            {
+                return lhs.block_num < rhs.block_num ||
+                    (lhs.block_num == rhs.block_num && lhs.bytes < rhs.bytes);
+            }
+        };
+
+        // items in a size class are ordered by length, then by offset
+        struct length_less
+        {
+            bool operator()(const free_space_item_t& lhs, const free_space_item_t& rhs) const
+            {
+                return lhs.length < rhs.length ||
+                    (lhs.length == rhs.length && offset_less()(lhs.bo, rhs.bo));
+            }
+        };
+
     private:
         bool is_collection_modified = false;
         bool is_fsi_deferred = false;
         free_space_item_t deferred_fsi;
 
-        std::vector<free_space_item_t> free_space_collection;
+        std::map<block_offset_t, unsigned int, offset_less> free_space_by_offset_;
+        std::set<free_space_item_t, length_less> size_classes_[FREE_SPACE_SIZE_CLASSES];
+        uint64_t free_bytes_ = 0;
 
+        static unsigned int size_class(unsigned int length);
+        static unsigned int items_per_data_node();
         bool are_adjacent(const block_offset_t& bo1, const unsigned& length1, const block_offset_t& bo2);
-        void insert_free_space_item(std::vector<free_space_item_t>::iterator& it, free_space_item_t& fsi);
+        void insert_free_space_item(const free_space_item_t& fsi);
+        void remove_free_space_item(const free_space_item_t& fsi);
         void do_collect(free_space_item_t& fsi);
 
     public:
-        StateBlockId original_block_id_of_collection;
+        // ids of the data nodes the collection was read from, in order
+        std::vector<StateBlockId> original_block_ids_of_collection;
 
         void collect(const block_offset_t& bo, const unsigned int& length);
         bool allocate(const unsigned int& length, block_offset_t& out_bo);
         bool collection_modified();
-        void serialize_in_data_node(data_node &out_dn);
-        void deserialize_from_data_node(data_node &in_dn);
+
+        // contents of the data nodes that store the collection, in order
+        void serialize(std::vector<ByteArray>& out_data_nodes);
+        // returns the number of data nodes of the collection when in_dn
+        // is the last one, 1 for the collections of earlier versions
+        unsigned int deserialize_from_data_node(data_node &in_dn);
+
+        uint64_t free_bytes() const { return free_bytes_; }
+        size_t free_items() const { return free_space_by_offset_.size(); }
+        unsigned int largest_free_item() const;
+        // share of the free space outside of the largest item, from 0
+        // (no fragmentation) to 1
+        double fragmentation() const;
     };
 }
 }
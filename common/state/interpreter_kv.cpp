@@ -21,32 +21,49 @@
 // XXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXX
 // Local Functions
 // XXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXX
+// the access right byte is written first, so that the key is copied once
+static ByteArray to_access_key(uint8_t access_right, const ByteArray& key)
+{
+    ByteArray access_key;
+    access_key.reserve(key.size() + 1);
+    access_key.push_back(access_right);
+    access_key.insert(access_key.end(), key.begin(), key.end());
+    return access_key;
+}
+
 static ByteArray to_privileged_key(const ByteArray& key)
 {
-    uint8_t access_right = 'P';
-    ByteArray privileged_key = key;
-    privileged_key.insert(privileged_key.begin(), access_right);
-    return privileged_key;
+    return to_access_key('P', key);
 }
 
 static ByteArray to_unprivileged_key(const ByteArray& key)
 {
-    uint8_t access_right = 'p';
-    ByteArray unprivileged_key = key;
-    unprivileged_key.insert(unprivileged_key.begin(), access_right);
-    return unprivileged_key;
+    return to_access_key('p', key);
+}
+
+static std::vector<ByteArray> to_unprivileged_keys(const std::vector<ByteArray>& keys)
+{
+    std::vector<ByteArray> unprivileged_keys;
+    unprivileged_keys.reserve(keys.size());
+    for (const ByteArray& key : keys)
+    {
+        unprivileged_keys.push_back(to_unprivileged_key(key));
+    }
+    return unprivileged_keys;
 }
 
 // XXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXX
 // Class: Interpreter_KV
 // XXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXX
-pdo::state::Interpreter_KV::Interpreter_KV(const ByteArray& id, const ByteArray& encryption_key)
-    : kv_(id, encryption_key)
+pdo::state::Interpreter_KV::Interpreter_KV(
+    const ByteArray& id, const ByteArray& encryption_key, size_t cache_size, cache_budget* budget)
+    : kv_(id, encryption_key, cache_size, budget)
 {
 }
 
-pdo::state::Interpreter_KV::Interpreter_KV(const ByteArray& encryption_key)
-    : kv_(encryption_key)
+pdo::state::Interpreter_KV::Interpreter_KV(
+    const ByteArray& encryption_key, size_t cache_size, cache_budget* budget)
+    : kv_(encryption_key, cache_size, budget)
 {
 }
 
@@ -55,6 +72,16 @@ void pdo::state::Interpreter_KV::Finalize(ByteArray& id)
     kv_.Finalize(id);
 }
 
+void pdo::state::Interpreter_KV::Compact(ByteArray& id)
+{
+    kv_.Compact(id);
+}
+
+pdo::state::cache_budget* pdo::state::Interpreter_KV::GetCacheBudget(void) const
+{
+    return kv_.GetCacheBudget();
+}
+
 ByteArray pdo::state::Interpreter_KV::Get(const ByteArray& key) const
 {
     return kv_.Get(key);
@@ -108,3 +135,61 @@ void pdo::state::Interpreter_KV::UnprivilegedDelete(const ByteArray& key)
     ByteArray unprivileged_key = to_unprivileged_key(key);
     Delete(unprivileged_key);
 }
+
+// the scanned keys are returned without the access right byte
+static void strip_access_right(pdo::state::KeyValueArray& out, size_t first)
+{
+    for (size_t i = first; i < out.size(); i++)
+    {
+        out[i].first.erase(out[i].first.begin());
+    }
+}
+
+void pdo::state::Interpreter_KV::PrivilegedScan(const ByteArray& prefix, const ByteArray& start,
+    bool inclusive, size_t limit, KeyValueArray& out) const
+{
+    size_t first = out.size();
+    kv_.Scan(to_privileged_key(prefix), to_privileged_key(start), inclusive, limit, out);
+    strip_access_right(out, first);
+}
+
+void pdo::state::Interpreter_KV::UnprivilegedScan(const ByteArray& prefix, const ByteArray& start,
+    bool inclusive, size_t limit, KeyValueArray& out) const
+{
+    size_t first = out.size();
+    kv_.Scan(to_unprivileged_key(prefix), to_unprivileged_key(start), inclusive, limit, out);
+    strip_access_right(out, first);
+}
+
+size_t pdo::state::Interpreter_KV::UnprivilegedGetSize(const ByteArray& key) const
+{
+    return kv_.GetSize(to_unprivileged_key(key));
+}
+
+size_t pdo::state::Interpreter_KV::UnprivilegedGetInto(
+    const ByteArray& key, uint8_t* buffer, size_t size, size_t offset) const
+{
+    return kv_.GetInto(to_unprivileged_key(key), buffer, size, offset);
+}
+
+void pdo::state::Interpreter_KV::UnprivilegedGetMany(
+    const std::vector<ByteArray>& keys, std::vector<ByteArray>& values) const
+{
+    kv_.GetMany(to_unprivileged_keys(keys), values);
+}
+
+void pdo::state::Interpreter_KV::UnprivilegedPutMany(const KeyValueArray& pairs)
+{
+    KeyValueArray unprivileged_pairs;
+    unprivileged_pairs.reserve(pairs.size());
+    for (const auto& pair : pairs)
+    {
+        unprivileged_pairs.emplace_back(to_unprivileged_key(pair.first), pair.second);
+    }
+    kv_.PutMany(unprivileged_pairs);
+}
+
+void pdo::state::Interpreter_KV::UnprivilegedDeleteMany(const std::vector<ByteArray>& keys)
+{
+    kv_.DeleteMany(to_unprivileged_keys(keys));
+}
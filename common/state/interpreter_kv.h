@@ -32,10 +32,13 @@ namespace state
         void Delete(const ByteArray& key);
 
     public:
-        Interpreter_KV(const StateBlockId& id, const ByteArray& encryption_key);
-        Interpreter_KV(const ByteArray& encryption_key);
+        Interpreter_KV(const StateBlockId& id, const ByteArray& encryption_key,
+            size_t cache_size = CACHE_SIZE, cache_budget* budget = NULL);
+        Interpreter_KV(const ByteArray& encryption_key,
+            size_t cache_size = CACHE_SIZE, cache_budget* budget = NULL);
 
         void Finalize(ByteArray& id);
+        void Compact(ByteArray& id);
 
         void PrivilegedPut(const ByteArray& key, const ByteArray& value);
         ByteArray PrivilegedGet(const ByteArray& key) const;
@@ -44,6 +47,20 @@ namespace state
         void UnprivilegedPut(const ByteArray& key, const ByteArray& value);
         ByteArray UnprivilegedGet(const ByteArray& key);
         void UnprivilegedDelete(const ByteArray& key);
+
+        size_t UnprivilegedGetSize(const ByteArray& key) const;
+        size_t UnprivilegedGetInto(const ByteArray& key, uint8_t* buffer, size_t size, size_t offset) const;
+
+        void UnprivilegedGetMany(const std::vector<ByteArray>& keys, std::vector<ByteArray>& values) const;
+        void UnprivilegedPutMany(const KeyValueArray& pairs);
+        void UnprivilegedDeleteMany(const std::vector<ByteArray>& keys);
+
+        void PrivilegedScan(const ByteArray& prefix, const ByteArray& start,
+            bool inclusive, size_t limit, KeyValueArray& out) const;
+        void UnprivilegedScan(const ByteArray& prefix, const ByteArray& start,
+            bool inclusive, size_t limit, KeyValueArray& out) const;
+
+        cache_budget* GetCacheBudget(void) const;
     };
 }
 }
@@ -30,6 +30,12 @@ state_status_t sebio_fetch_from_block_store(const pstate::StateBlockId& block_id
     pstate::StateBlock& block);
 state_status_t sebio_evict_to_block_store(
     const pstate::StateBlock& block, sebio_crypto_algo_e crypto_algo, ByteArray& idOnEviction);
+state_status_t sebio_evict_many_to_block_store(const std::vector<pstate::StateBlock>& blocks,
+    sebio_crypto_algo_e crypto_algo,
+    std::vector<ByteArray>& idsOnEviction);
+state_status_t sebio_fetch_many_from_block_store(const std::vector<pstate::StateBlockId>& block_ids,
+    sebio_crypto_algo_e crypto_algo,
+    std::vector<pstate::StateBlock>& blocks);
 
 //########### internal sebio (Secure Block IO) context ####################
 /*
@@ -39,7 +45,8 @@ state_status_t sebio_evict_to_block_store(
     when fetching or eviting a block.
 */
 static sebio_ctx_t sebio_ctx = {
-    {}, SEBIO_NO_CRYPTO, &sebio_fetch_from_block_store, &sebio_evict_to_block_store};
+    {}, SEBIO_NO_CRYPTO, &sebio_fetch_from_block_store, &sebio_evict_to_block_store,
+    &sebio_evict_many_to_block_store, &sebio_fetch_many_from_block_store};
 //########################################################################
 
 /*
@@ -53,6 +60,16 @@ state_status_t sebio_set(sebio_ctx_t ctx)
         sebio_ctx.f_sebio_fetch = &sebio_fetch_from_block_store;
         sebio_ctx.f_sebio_evict = sebio_evict_to_block_store;
     }
+    // batching bypasses f_sebio_evict and f_sebio_fetch, so it is only
+    // used by default together with the default functions
+    if (sebio_ctx.f_sebio_evict_many == NULL && sebio_ctx.f_sebio_evict == &sebio_evict_to_block_store)
+    {
+        sebio_ctx.f_sebio_evict_many = &sebio_evict_many_to_block_store;
+    }
+    if (sebio_ctx.f_sebio_fetch_many == NULL && sebio_ctx.f_sebio_fetch == &sebio_fetch_from_block_store)
+    {
+        sebio_ctx.f_sebio_fetch_many = &sebio_fetch_many_from_block_store;
+    }
     return STATE_SUCCESS;
 }
 
@@ -69,6 +86,40 @@ state_status_t sebio_evict(
     return sebio_ctx.f_sebio_evict(block, crypto_algo, idOnEviction);
 }
 
+state_status_t sebio_fetch_many(const std::vector<pstate::StateBlockId>& block_ids,
+    sebio_crypto_algo_e crypto_algo,
+    std::vector<pstate::StateBlock>& blocks)
+{
+    if (sebio_ctx.f_sebio_fetch_many != NULL)
+        return sebio_ctx.f_sebio_fetch_many(block_ids, crypto_algo, blocks);
+
+    blocks.resize(block_ids.size());
+    for (size_t i = 0; i < block_ids.size(); i++)
+    {
+        state_status_t ret = sebio_ctx.f_sebio_fetch(block_ids[i], crypto_algo, blocks[i]);
+        if (ret != STATE_SUCCESS)
+            return ret;
+    }
+    return STATE_SUCCESS;
+}
+
+state_status_t sebio_evict_many(const std::vector<pstate::StateBlock>& blocks,
+    sebio_crypto_algo_e crypto_algo,
+    std::vector<ByteArray>& idsOnEviction)
+{
+    if (sebio_ctx.f_sebio_evict_many != NULL)
+        return sebio_ctx.f_sebio_evict_many(blocks, crypto_algo, idsOnEviction);
+
+    idsOnEviction.resize(blocks.size());
+    for (size_t i = 0; i < blocks.size(); i++)
+    {
+        state_status_t ret = sebio_ctx.f_sebio_evict(blocks[i], crypto_algo, idsOnEviction[i]);
+        if (ret != STATE_SUCCESS)
+            return ret;
+    }
+    return STATE_SUCCESS;
+}
+
 /*
     The fetch function gets a block from the block store.
     It requests first the size of a block,
@@ -118,6 +169,55 @@ state_status_t sebio_fetch_from_block_store(const pstate::StateBlockId& block_id
     return STATE_SUCCESS;
 }
 
+/*
+    The batched fetch function gets all the blocks from the block store
+    at once, then it checks and decrypts each of them as the fetch function does.
+*/
+state_status_t sebio_fetch_many_from_block_store(const std::vector<pstate::StateBlockId>& block_ids,
+    sebio_crypto_algo_e crypto_algo,
+    std::vector<pstate::StateBlock>& blocks)
+{
+    // load the data
+    pdo_err_t ret;
+    ret = pdo::block_store::BlockStoreGetMany(block_ids, blocks);
+    if (ret != PDO_SUCCESS)
+    {
+        SAFE_LOG(PDO_LOG_ERROR, "sebio error, BlockStoreGetMany returned %d\n", ret);
+        return STATE_ERR_NOT_FOUND;
+    }
+
+    for (size_t i = 0; i < block_ids.size(); i++)
+    {
+        // check block hash == block id
+        ByteArray computedId = pdo::crypto::ComputeMessageHash(blocks[i]);
+        if (block_ids[i] != computedId)
+        {
+            return STATE_ERR_BLOCK_AUTHENTICATION;
+        }
+
+        // decrypt if necessary
+        switch (crypto_algo)
+        {
+            case SEBIO_NO_CRYPTO:
+            {
+                // nothing to do
+                break;
+            }
+            case SEBIO_AES_GCM:
+            {
+                pdo::error::ThrowIf<pdo::error::RuntimeError>(
+                    sebio_ctx.crypto_algo != crypto_algo, "sebio_fetch, crypto-algo does not match");
+                blocks[i] = pdo::crypto::skenc::DecryptMessage(sebio_ctx.key, blocks[i]);
+                break;
+            }
+            default:
+                return STATE_ERR_UNIMPLEMENTED;
+        }
+    }
+
+    return STATE_SUCCESS;
+}
+
 /*
     The evict function puts a block into the block store.
     If the caller specifies an encryption algorithm and a context has been set,
@@ -159,3 +259,49 @@ state_status_t sebio_evict_to_block_store(
     }
     return STATE_SUCCESS;
 }
+
+/*
+    The batched evict function encrypts (if requested) and hashes all
+    the blocks and then puts them into the block store at once.
+*/
+state_status_t sebio_evict_many_to_block_store(const std::vector<pstate::StateBlock>& blocks,
+    sebio_crypto_algo_e crypto_algo,
+    std::vector<ByteArray>& idsOnEviction)
+{
+    std::vector<ByteArray> encryptedBlocks;
+    const std::vector<ByteArray>* blocksToPut = &blocks;
+
+    switch (crypto_algo)
+    {
+        case SEBIO_NO_CRYPTO:
+        {
+            break;
+        }
+        case SEBIO_AES_GCM:
+        {
+            // check initialization
+            pdo::error::ThrowIf<pdo::error::RuntimeError>(
+                sebio_ctx.crypto_algo != crypto_algo, "sebio_evict, crypto-algo does not match");
+            encryptedBlocks.reserve(blocks.size());
+            for (auto block = blocks.begin(); block != blocks.end(); block++)
+                encryptedBlocks.push_back(pdo::crypto::skenc::EncryptMessage(sebio_ctx.key, *block));
+            blocksToPut = &encryptedBlocks;
+            break;
+        }
+        default:
+            return STATE_ERR_UNIMPLEMENTED;
+    }
+
+    // compute block ids before they are evicted, and propagate them to the upper layers
+    idsOnEviction.resize(blocksToPut->size());
+    for (size_t i = 0; i < blocksToPut->size(); i++)
+        idsOnEviction[i] = pdo::crypto::ComputeMessageHash((*blocksToPut)[i]);
+
+    pdo_err_t ret = pdo::block_store::BlockStorePutMany(idsOnEviction, *blocksToPut);
+    if (ret != PDO_SUCCESS)
+    {
+        SAFE_LOG(PDO_LOG_ERROR, "sebio error, block store put many returned %d\n", ret);
+        return STATE_ERR_UNKNOWN;
+    }
+    return STATE_SUCCESS;
+}
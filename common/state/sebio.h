@@ -34,6 +34,16 @@ typedef struct
     state_status_t (*f_sebio_evict)(const pdo::state::StateBlockId& block_id,
         sebio_crypto_algo_e crypto_algo,
         ByteArray& idOnEviction);
+    // Optional batched version of the evict function; when it is not
+    // set, blocks are evicted one at a time with f_sebio_evict
+    state_status_t (*f_sebio_evict_many)(const std::vector<pdo::state::StateBlock>& blocks,
+        sebio_crypto_algo_e crypto_algo,
+        std::vector<ByteArray>& idsOnEviction);
+    // Optional batched version of the fetch function; when it is not
+    // set, blocks are fetched one at a time with f_sebio_fetch
+    state_status_t (*f_sebio_fetch_many)(const std::vector<pdo::state::StateBlockId>& block_ids,
+        sebio_crypto_algo_e crypto_algo,
+        std::vector<pdo::state::StateBlock>& blocks);
 } sebio_ctx_t;
 
 state_status_t sebio_set(sebio_ctx_t ctx);
@@ -44,3 +54,11 @@ state_status_t sebio_fetch(const pdo::state::StateBlockId& block_id,
 
 state_status_t sebio_evict(
     const pdo::state::StateBlock& block, sebio_crypto_algo_e crypto_algo, ByteArray& idOnEviction);
+
+state_status_t sebio_evict_many(const std::vector<pdo::state::StateBlock>& blocks,
+    sebio_crypto_algo_e crypto_algo,
+    std::vector<ByteArray>& idsOnEviction);
+
+state_status_t sebio_fetch_many(const std::vector<pdo::state::StateBlockId>& block_ids,
+    sebio_crypto_algo_e crypto_algo,
+    std::vector<pdo::state::StateBlock>& blocks);
@@ -30,7 +30,9 @@
 #include "basic_kv.h"
 #include "block_offset.h"
 #include "block_warehouse.h"
+#include "block_compression.h"
 #include "data_node.h"
+#include "data_node_cache.h"
 #include "free_space_collector.h"
 #include "cache.h"
 #include "data_node_io.h"
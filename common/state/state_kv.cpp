@@ -13,12 +13,14 @@
  * limitations under the License.
  */
 
+#include <algorithm>
+
 #include "state.h"
 
 namespace pstate = pdo::state;
 
-pdo::state::State_KV::State_KV(const ByteArray& key)
-    : state_encryption_key_(key), dn_io_(data_node_io(key))
+pdo::state::State_KV::State_KV(const ByteArray& key, size_t cache_size, cache_budget* budget)
+    : state_encryption_key_(key), dn_io_(data_node_io(key, cache_size, budget))
 {
     try
     {
@@ -46,9 +48,24 @@ pdo::state::State_KV::State_KV(const ByteArray& key)
     kv_start_mode = KV_CREATE;
 }
 
-pdo::state::State_KV::State_KV(const StateBlockId& id, const ByteArray& key)
-    : state_encryption_key_(key), dn_io_(data_node_io(key))
+pdo::state::State_KV::State_KV(
+    const StateBlockId& id, const ByteArray& key, size_t cache_size, cache_budget* budget)
+    : State_KV(id, key, { STATE_PREFETCH_WINDOW, STATE_PREFETCH_ON_OPEN }, STATE_CACHE_POLICY, cache_size, budget)
+{
+}
+
+pdo::state::State_KV::State_KV(
+    const StateBlockId& id,
+    const ByteArray& key,
+    const Cache::prefetch_policy_t& prefetch_policy,
+    state_cache_policy_e cache_policy,
+    size_t cache_size,
+    cache_budget* budget)
+    : state_encryption_key_(key), dn_io_(data_node_io(key, cache_size, budget))
 {
+    dn_io_.cache_.prefetch_policy_ = prefetch_policy;
+    dn_io_.cache_.set_policy(cache_policy);
+
     try
     {
         // retrieve main state block, root node and last data node
@@ -77,21 +94,24 @@ void pdo::state::State_KV::Finalize(ByteArray& outId)
     try
     {
         //store the free space collection table IF the kv has been create OR the table has been modified
-        if(kv_start_mode == KV_CREATE || dn_io_.free_space_collector_.collection_modified())
-        {
-            //serialize free space collection table and store it in one data node
-            dn_io_.add_and_init_append_data_node();
-            dn_io_.free_space_collector_.serialize_in_data_node(*dn_io_.append_dn_);
-        }
-        else
-        {
-            // collection table not modified, simply put its original block id in the list
-            dn_io_.block_warehouse_.add_block_id(dn_io_.free_space_collector_.original_block_id_of_collection);
-        }
+        dn_io_.save_free_space_collection(
+            kv_start_mode == KV_CREATE || dn_io_.free_space_collector_.collection_modified());
 
         // flush cache first
         dn_io_.cache_.flush();
 
+        SAFE_LOG(PDO_LOG_DEBUG, "state prefetch: %lu prefetched, %lu hits, %lu wasted",
+            dn_io_.cache_.prefetched_, dn_io_.cache_.prefetch_hits_, dn_io_.cache_.prefetch_wasted_);
+        SAFE_LOG(PDO_LOG_DEBUG, "state cache: %lu hits, %lu misses, %lu evictions",
+            dn_io_.cache_.hits_, dn_io_.cache_.misses_, dn_io_.cache_.evictions_);
+        SAFE_LOG(PDO_LOG_DEBUG, "state free space: %lu bytes in %zu items, fragmentation %.2f",
+            dn_io_.free_space_collector_.free_bytes(), dn_io_.free_space_collector_.free_items(),
+            dn_io_.free_space_collector_.fragmentation());
+        if (dn_io_.cache_.written_nodes_ > 0)
+            SAFE_LOG(PDO_LOG_DEBUG, "state compression: %lu data nodes written in %lu bytes, ratio %.2f",
+                dn_io_.cache_.written_nodes_, dn_io_.cache_.written_bytes_,
+                (double)dn_io_.cache_.written_bytes_ / (dn_io_.cache_.written_nodes_ * FIXED_DATA_NODE_BYTE_SIZE));
+
         // if the cache synced modified entries, recompute root block id
         if(dn_io_.cache_.synced_entries() > 0)
         {
@@ -115,6 +135,56 @@ void pdo::state::State_KV::Finalize(ByteArray& outId)
     }
 }
 
+void pdo::state::State_KV::Compact(ByteArray& outId)
+{
+    pdo::error::ThrowIf<pdo::error::RuntimeError>(
+        kv_start_mode == KV_UNINITIALIZED, "attempt to compact uninitialized state");
+
+    try
+    {
+        // the pairs are put in key order in a new state, so trie nodes and
+        // values are appended to its data nodes in traversal order
+        State_KV compacted(state_encryption_key_,
+            (size_t)dn_io_.cache_.slots_.max_slots() * FIXED_DATA_NODE_BYTE_SIZE, dn_io_.cache_.budget());
+        data_node_io& compacted_dn_io = compacted.GetDataNodeIO();
+        compacted_dn_io.trie_branch_nodes_ = dn_io_.trie_branch_nodes_;
+        compacted_dn_io.trie_inline_values_ = dn_io_.trie_inline_values_;
+        compacted.SetDataNodeCompression(dn_io_.cache_.compress_data_nodes_);
+
+        const ByteArray prefix;
+        ByteArray start;
+        bool inclusive = true;
+        while(1)
+        {
+            KeyValueArray page;
+            Scan(prefix, start, inclusive, STATE_COMPACTION_PAGE_SIZE, page);
+            for(auto it = page.begin(); it != page.end(); it++)
+            {
+                compacted.Put(it->first, it->second);
+            }
+            if(page.size() < STATE_COMPACTION_PAGE_SIZE)
+                break;
+            start = page.back().first;
+            inclusive = false;
+        }
+
+        compacted.Finalize(outId);
+
+        SAFE_LOG(PDO_LOG_INFO, "state compaction: %zu data blocks before, %u after",
+            dn_io_.block_warehouse_.get_last_block_num() + 1 +
+            dn_io_.free_space_collector_.original_block_ids_of_collection.size(),
+            compacted_dn_io.block_warehouse_.get_last_block_num() + 1);
+    }
+    catch(const std::exception& e)
+    {
+        SAFE_LOG_EXCEPTION("compact kv error");
+        throw;
+    }
+
+    // the pairs live in the compacted state now
+    kv_start_mode = KV_UNINITIALIZED;
+}
+
 ByteArray pstate::State_KV::Get(const ByteArray& key) const
 {
     // perform operation
@@ -165,3 +235,111 @@ void pstate::State_KV::Delete(const ByteArray& key)
         throw;
     }
 }
+
+size_t pstate::State_KV::GetSize(const ByteArray& key) const
+{
+    trie_node node;
+    try
+    {
+        if (! trie_node::lookup_trie_value(dn_io_, key, node))
+            return 0;
+        return trie_node::do_read_value_size(dn_io_, node);
+    }
+    catch(const std::exception& e)
+    {
+        SAFE_LOG_EXCEPTION("kv get size error");
+        throw;
+    }
+}
+
+size_t pstate::State_KV::GetInto(const ByteArray& key, uint8_t* buffer, size_t size, size_t offset) const
+{
+    trie_node node;
+    try
+    {
+        if (! trie_node::lookup_trie_value(dn_io_, key, node))
+            return 0;
+        return trie_node::do_read_value_into(dn_io_, node, offset, buffer, size);
+    }
+    catch(const std::exception& e)
+    {
+        SAFE_LOG_EXCEPTION("kv get into error");
+        throw;
+    }
+}
+
+// positions of the keys in key order, equal keys keep their order
+template<typename T, typename K>
+static std::vector<size_t> sorted_order(const std::vector<T>& items, K key_of)
+{
+    std::vector<size_t> order(items.size());
+    for (size_t i = 0; i < order.size(); i++)
+    {
+        order[i] = i;
+    }
+    std::stable_sort(order.begin(), order.end(),
+        [&](size_t a, size_t b) { return key_of(items[a]) < key_of(items[b]); });
+    return order;
+}
+
+void pstate::State_KV::GetMany(const std::vector<ByteArray>& keys, std::vector<ByteArray>& values) const
+{
+    std::vector<size_t> order = sorted_order(keys, [](const ByteArray& k) -> const ByteArray& { return k; });
+    std::vector<ByteArray> sorted_keys;
+    sorted_keys.reserve(keys.size());
+    for (size_t i : order)
+    {
+        sorted_keys.push_back(keys[i]);
+    }
+
+    std::vector<ByteArray> sorted_values;
+    try
+    {
+        trie_node::get_trie_many(dn_io_, sorted_keys, sorted_values);
+    }
+    catch(const std::exception& e)
+    {
+        SAFE_LOG_EXCEPTION("kv get many error");
+        throw;
+    }
+
+    values.resize(keys.size());
+    for (size_t i = 0; i < order.size(); i++)
+    {
+        values[order[i]].swap(sorted_values[i]);
+    }
+}
+
+void pstate::State_KV::PutMany(const KeyValueArray& pairs)
+{
+    // equal keys are put in their order, so the last value is kept
+    std::vector<size_t> order = sorted_order(pairs,
+        [](const std::pair<ByteArray, ByteArray>& p) -> const ByteArray& { return p.first; });
+    for (size_t i : order)
+    {
+        Put(pairs[i].first, pairs[i].second);
+    }
+}
+
+void pstate::State_KV::DeleteMany(const std::vector<ByteArray>& keys)
+{
+    std::vector<size_t> order = sorted_order(keys, [](const ByteArray& k) -> const ByteArray& { return k; });
+    for (size_t i : order)
+    {
+        Delete(keys[i]);
+    }
+}
+
+void pstate::State_KV::Scan(const ByteArray& prefix, const ByteArray& start,
+    bool inclusive, size_t limit, KeyValueArray& out) const
+{
+    try
+    {
+        trie_node::scan_trie(dn_io_, prefix, start, inclusive, limit, out);
+    }
+    catch(const std::exception& e)
+    {
+        SAFE_LOG_EXCEPTION("kv scan error");
+        throw;
+    }
+}
@@ -15,6 +15,11 @@
 
 #pragma once
 
+// Number of pairs read at a time from the state being compacted
+#ifndef STATE_COMPACTION_PAGE_SIZE
+#define STATE_COMPACTION_PAGE_SIZE 256
+#endif
+
 namespace pdo
 {
 namespace state
@@ -37,14 +42,57 @@ namespace state
         kv_start_mode_e kv_start_mode = KV_UNINITIALIZED;
 
     public:
-        State_KV(const ByteArray& key);
-        State_KV(const StateBlockId& id, const ByteArray& key);
+        // cache_size bounds the cache of this state, the cache takes its
+        // memory from budget if one is given
+        State_KV(const ByteArray& key, size_t cache_size = CACHE_SIZE, cache_budget* budget = NULL);
+        State_KV(const StateBlockId& id, const ByteArray& key,
+            size_t cache_size = CACHE_SIZE, cache_budget* budget = NULL);
+        State_KV(const StateBlockId& id, const ByteArray& key, const Cache::prefetch_policy_t& prefetch_policy,
+            state_cache_policy_e cache_policy = STATE_CACHE_POLICY,
+            size_t cache_size = CACHE_SIZE, cache_budget* budget = NULL);
 
         void Finalize(ByteArray& id);
 
+        // write the pairs of the state, in key order, into a new state of
+        // densely packed data nodes and finalize it; like Finalize, this
+        // ends the use of the state
+        void Compact(ByteArray& id);
+
+        // compress the data nodes written from now on before they are
+        // encrypted; off by default. Compression reveals to the block
+        // store, through the size of the encrypted nodes, how well the
+        // contents of the state compress, so a state should opt in only
+        // if that is acceptable for its contract. Nodes are readable
+        // whether they were written compressed or not
+        void SetDataNodeCompression(bool compress) { dn_io_.cache_.compress_data_nodes_ = compress; }
+
+        const Cache& GetCache(void) const { return dn_io_.cache_; }
+        cache_budget* GetCacheBudget(void) const { return dn_io_.cache_.budget(); }
+        block_warehouse& GetBlockWarehouse(void) { return dn_io_.block_warehouse_; }
+        data_node_io& GetDataNodeIO(void) { return dn_io_; }
+
         ByteArray Get(const ByteArray& key) const;
         void Put(const ByteArray& key, const ByteArray& value);
         void Delete(const ByteArray& key);
+
+        // size of the value of key, 0 if there is none
+        size_t GetSize(const ByteArray& key) const;
+
+        // copy up to size bytes of the value of key, from offset on, into
+        // buffer straight from the data nodes; returns the bytes copied
+        size_t GetInto(const ByteArray& key, uint8_t* buffer, size_t size, size_t offset = 0) const;
+
+        // batched operations, the keys are processed in key order; a get
+        // reads the trie levels shared by the keys once, and returns the
+        // values in the order of the keys (empty for missing keys)
+        void GetMany(const std::vector<ByteArray>& keys, std::vector<ByteArray>& values) const;
+        void PutMany(const KeyValueArray& pairs);
+        void DeleteMany(const std::vector<ByteArray>& keys);
+
+        // return, in key order, up to limit pairs whose key starts with
+        // prefix and follows start (or is equal to start if inclusive)
+        void Scan(const ByteArray& prefix, const ByteArray& start,
+            bool inclusive, size_t limit, KeyValueArray& out) const;
     };
 }
 }
@@ -13,6 +13,9 @@
  * limitations under the License.
  */
 
+#include <string.h>
+#include <algorithm>
+
 #include "state.h"
 
 namespace pstate = pdo::state;
@@ -31,8 +34,7 @@ unsigned int pstate::trie_node::shared_prefix_length(
 void pstate::trie_node::delete_trie_node_childless(data_node_io& dn_io,
     trie_node& node)
 {
-    block_offset bo_child(node.node.child_offset);
-    if(bo_child.is_empty())
+    if(! node.has_value())
     {
         //release space of trie node
         dn_io.free_space_collector_.collect(node.location.block_offset_, trie_node::new_trie_node_size());
@@ -54,13 +56,23 @@ void pstate::trie_node::do_write_value(data_node_io& dn_io,
 {
     {
         //if overwriting, delete the current value
-        block_offset current_child_bo(node.node.child_offset);
-        if (! current_child_bo.is_empty())
+        if (node.has_value())
         {
             do_delete_value(dn_io, node);
         }
     }
 
+    //a small value is written in the node, in place of the child offset
+    if (dn_io.trie_inline_values_ && value.size() > 0 && value.size() <= TRIE_INLINE_VALUE_MAX_SIZE)
+    {
+        trie_node_h_with_inline_value_t& iv = node.inline_value();
+        iv.hdr.isValue = 1;
+        iv.value_size = value.size();
+        memcpy(iv.value, value.data(), value.size());
+        node.modified = true;
+        return;
+    }
+
     unsigned int space_required = sizeof(trie_node_header_t) + sizeof(size_t) + value.size();
 
     //grab the offset where data is going to be written
@@ -121,6 +133,13 @@ void pstate::trie_node::do_read_value_info(data_node_io& dn_io,
 void pstate::trie_node::do_read_value(
     data_node_io& dn_io, const trie_node& node, ByteArray& value)
 {
+    if (node.has_inline_value())
+    {
+        const trie_node_h_with_inline_value_t& iv = node.inline_value();
+        value.assign(iv.value, iv.value + iv.value_size);
+        return;
+    }
+
     block_offset current_child_bo(node.node.child_offset);
     pdo::error::ThrowIf<pdo::error::RuntimeError>(
         current_child_bo.is_empty(), "read value, value is absent");
@@ -146,8 +165,57 @@ void pstate::trie_node::do_read_value(
     dn_io.read_across_data_nodes(bo, vs, value);
 }
 
+size_t pstate::trie_node::do_read_value_size(data_node_io& dn_io, const trie_node& node)
+{
+    if (node.has_inline_value())
+        return node.inline_value().value_size;
+
+    block_offset_t bo = node.node.child_offset;
+    ByteArray ba_header;
+    size_t value_size;
+    do_read_value_info(dn_io, bo, ba_header, value_size);
+    return value_size;
+}
+
+size_t pstate::trie_node::do_read_value_into(
+    data_node_io& dn_io, const trie_node& node, size_t offset, uint8_t* buffer, size_t size)
+{
+    if (node.has_inline_value())
+    {
+        const trie_node_h_with_inline_value_t& iv = node.inline_value();
+        if (offset >= iv.value_size)
+            return 0;
+        size_t length = std::min(size, iv.value_size - offset);
+        memcpy(buffer, iv.value + offset, length);
+        return length;
+    }
+
+    block_offset_t bo = node.node.child_offset;
+    ByteArray ba_header;
+    size_t value_size;
+    do_read_value_info(dn_io, bo, ba_header, value_size);
+    if (offset >= value_size)
+        return 0;
+
+    size_t length = std::min(size, value_size - offset);
+    data_node::advance_block_offset(bo, offset);
+    dn_io.read_across_data_nodes(bo, length, buffer);
+    return length;
+}
+
 void pstate::trie_node::do_delete_value(data_node_io& dn_io, trie_node& node)
 {
+    if (node.has_inline_value())
+    {
+        // clear the value, so that the child offset reads as empty
+        trie_node_h_with_inline_value_t& iv = node.inline_value();
+        iv.value_size = 0;
+        memset(iv.value, 0, TRIE_INLINE_VALUE_MAX_SIZE);
+        iv.hdr.isValue = 0;
+        node.modified = true;
+        return;
+    }
+
     block_offset_t bo = node.node.child_offset;
     ByteArray ba_header;
     size_t value_size;
@@ -231,6 +299,8 @@ void pstate::trie_node::read_trie_node(data_node_io& dn_io, block_offset_t& in_b
     pdo::error::ThrowIf<pdo::error::RuntimeError>(
         ba_node.size() != sizeof(trie_node_h_with_ncc_t), "unable to read trie node");
 
+    dn_io.trie_node_reads_ ++;
+
     //copy the node in the structure
     out_trie_node.node = *((trie_node_h_with_ncc_t*)ba_node.data());
     out_trie_node.location.block_offset_ = in_block_offset;
@@ -273,6 +343,220 @@ void pstate::trie_node::init_trie_root(data_node_io& dn_io)
     write_trie_node(dn_io, root);
 }
 
+// XXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXX
+// trie_branch_node
+// XXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXX
+
+// serialized branch: header, count (2 bytes), eos offset, then by type
+//   4, 16: sorted key bytes and their offsets
+//   48:    an index from each key byte to its offset (0 for none, or position + 1), and the offsets
+//   256:   the offsets of all key bytes
+#define TRIE_BRANCH_HEADER_SIZE (sizeof(trie_node_header_t) + sizeof(uint16_t) + sizeof(block_offset_t))
+
+static bool is_branch_header(const pstate::trie_node_header_t& hdr)
+{
+    return !hdr.isDeleted && !hdr.hasNext && hdr.hasChild && !hdr.isValue;
+}
+
+static bool is_empty_offset(const pstate::block_offset_t& bo)
+{
+    return bo == pstate::empty_block_offset;
+}
+
+static void append_raw(ByteArray& out, const void* data, size_t size)
+{
+    out.insert(out.end(), (const uint8_t*)data, (const uint8_t*)data + size);
+}
+
+pstate::trie_branch_node::trie_branch_node() : location(block_offset(empty_block_offset))
+{
+    for (unsigned int i = 0; i < TRIE_BRANCH_BYTE_SLOTS; i++)
+        children[i] = empty_block_offset;
+}
+
+unsigned int pstate::trie_branch_node::capacity(uint8_t type)
+{
+    static const unsigned int capacities[] = {4, 16, 48, 256};
+    return capacities[type];
+}
+
+size_t pstate::trie_branch_node::serialized_size(uint8_t type)
+{
+    size_t index_size = (type == TRIE_BRANCH_256 ? 0 : (type == TRIE_BRANCH_48 ? TRIE_BRANCH_BYTE_SLOTS : capacity(type)));
+    return TRIE_BRANCH_HEADER_SIZE + index_size + capacity(type) * sizeof(block_offset_t);
+}
+
+uint8_t pstate::trie_branch_node::type_for(unsigned int count)
+{
+    uint8_t type = TRIE_BRANCH_4;
+    while (capacity(type) < count)
+        type++;
+    return type;
+}
+
+void pstate::trie_branch_node::set_slot(unsigned int s, const block_offset_t& bo)
+{
+    block_offset_t& current = slot(s);
+    if (s != TRIE_BRANCH_EOS_SLOT)
+    {
+        if (is_empty_offset(current) && ! is_empty_offset(bo))
+            count++;
+        else if (! is_empty_offset(current) && is_empty_offset(bo))
+            count--;
+    }
+    current = bo;
+    modified = true;
+}
+
+void pstate::trie_branch_node::grow(data_node_io& dn_io)
+{
+    pdo::error::ThrowIf<pdo::error::RuntimeError>(type == TRIE_BRANCH_256, "trie branch cannot grow");
+
+    // the larger branch is written in a new location
+    if (! location.is_empty())
+        dn_io.free_space_collector_.collect(location.block_offset_, serialized_size(type));
+    location.block_offset_ = empty_block_offset;
+    type++;
+    modified = true;
+}
+
+void pstate::trie_branch_node::serialize(ByteArray& out) const
+{
+    pdo::error::ThrowIf<pdo::error::RuntimeError>(count > capacity(type), "trie branch overflow");
+    out.clear();
+    out.reserve(serialized_size(type));
+
+    trie_node_header_t hdr = branch_trie_header;
+    hdr.keyChunkSize = type;
+    uint16_t c = count;
+    append_raw(out, &hdr, sizeof(hdr));
+    append_raw(out, &c, sizeof(c));
+    append_raw(out, &eos_offset, sizeof(eos_offset));
+
+    if (type == TRIE_BRANCH_256)
+    {
+        append_raw(out, children, sizeof(children));
+        return;
+    }
+
+    unsigned int cap = capacity(type);
+    ByteArray index(type == TRIE_BRANCH_48 ? TRIE_BRANCH_BYTE_SLOTS : cap, 0);
+    std::vector<block_offset_t> offsets(cap, empty_block_offset);
+    unsigned int n = 0;
+    for (unsigned int b = 0; b < TRIE_BRANCH_BYTE_SLOTS; b++)
+    {
+        if (is_empty_offset(children[b]))
+            continue;
+
+        if (type == TRIE_BRANCH_48)
+            index[b] = n + 1;
+        else
+            index[n] = b;
+        offsets[n++] = children[b];
+    }
+    out.insert(out.end(), index.begin(), index.end());
+    append_raw(out, offsets.data(), offsets.size() * sizeof(block_offset_t));
+}
+
+void pstate::trie_branch_node::deserialize(const ByteArray& in)
+{
+    pdo::error::ThrowIf<pdo::error::RuntimeError>(
+        in.size() < TRIE_BRANCH_HEADER_SIZE, "invalid trie branch");
+    const trie_node_header_t* hdr = (const trie_node_header_t*)in.data();
+    pdo::error::ThrowIf<pdo::error::RuntimeError>(
+        !is_branch_header(*hdr) || hdr->keyChunkSize > TRIE_BRANCH_256, "invalid trie branch header");
+    type = hdr->keyChunkSize;
+    pdo::error::ThrowIf<pdo::error::RuntimeError>(
+        in.size() != serialized_size(type), "invalid trie branch size");
+
+    const uint8_t* p = in.data() + sizeof(trie_node_header_t);
+    uint16_t c;
+    memcpy(&c, p, sizeof(c));
+    p += sizeof(c);
+    memcpy(&eos_offset, p, sizeof(eos_offset));
+    p += sizeof(eos_offset);
+
+    for (unsigned int b = 0; b < TRIE_BRANCH_BYTE_SLOTS; b++)
+        children[b] = empty_block_offset;
+
+    unsigned int cap = capacity(type);
+    if (type == TRIE_BRANCH_256)
+    {
+        memcpy(children, p, sizeof(children));
+    }
+    else if (type == TRIE_BRANCH_48)
+    {
+        const uint8_t* index = p;
+        const uint8_t* offsets = p + TRIE_BRANCH_BYTE_SLOTS;
+        for (unsigned int b = 0; b < TRIE_BRANCH_BYTE_SLOTS; b++)
+        {
+            if (index[b] == 0)
+                continue;
+            pdo::error::ThrowIf<pdo::error::RuntimeError>(index[b] > cap, "invalid trie branch index");
+            memcpy(&children[b], offsets + (index[b] - 1) * sizeof(block_offset_t), sizeof(block_offset_t));
+        }
+    }
+    else
+    {
+        const uint8_t* keys = p;
+        const uint8_t* offsets = p + cap;
+        for (unsigned int i = 0; i < c && i < cap; i++)
+            memcpy(&children[keys[i]], offsets + i * sizeof(block_offset_t), sizeof(block_offset_t));
+    }
+
+    count = 0;
+    for (unsigned int b = 0; b < TRIE_BRANCH_BYTE_SLOTS; b++)
+    {
+        if (! is_empty_offset(children[b]))
+            count++;
+    }
+    pdo::error::ThrowIf<pdo::error::RuntimeError>(count != c, "invalid trie branch count");
+    modified = false;
+}
+
+void pstate::trie_branch_node::read_trie_branch(
+    data_node_io& dn_io, const block_offset_t& in_block_offset, trie_branch_node& out_branch)
+{
+    ByteArray ba_header;
+    dn_io.read_across_data_nodes(in_block_offset, sizeof(trie_node_header_t), ba_header);
+    const trie_node_header_t* hdr = (const trie_node_header_t*)ba_header.data();
+    pdo::error::ThrowIf<pdo::error::RuntimeError>(
+        !is_branch_header(*hdr) || hdr->keyChunkSize > TRIE_BRANCH_256, "invalid trie branch header");
+
+    ByteArray ba_branch;
+    dn_io.read_across_data_nodes(in_block_offset, serialized_size(hdr->keyChunkSize), ba_branch);
+    out_branch.deserialize(ba_branch);
+    out_branch.location.block_offset_ = in_block_offset;
+}
+
+void pstate::trie_branch_node::write_trie_branch(data_node_io& dn_io, trie_branch_node& in_branch)
+{
+    // same conventions as write_trie_node, the branch keeps its location until it grows
+    if (in_branch.location.is_empty())
+    {
+        if (! dn_io.free_space_collector_.allocate(serialized_size(in_branch.type), in_branch.location.block_offset_))
+        {
+            dn_io.block_offset_for_appending(in_branch.location.block_offset_);
+        }
+    }
+
+    ByteArray ba_branch;
+    in_branch.serialize(ba_branch);
+    dn_io.write_across_data_nodes(ba_branch, 0, in_branch.location.block_offset_);
+    in_branch.modified = false;
+}
+
+void pstate::trie_branch_node::delete_trie_branch_childless(data_node_io& dn_io, trie_branch_node& branch)
+{
+    if (branch.count > 0 || ! is_empty_offset(branch.eos_offset) || branch.location.is_empty())
+        return;
+
+    //release space of the branch, the upper node then drops its child offset
+    dn_io.free_space_collector_.collect(branch.location.block_offset_, serialized_size(branch.type));
+    branch.location.block_offset_ = empty_block_offset;
+    branch.modified = false;
+}
+
 namespace pdo
 {
 namespace state
@@ -281,11 +565,68 @@ namespace state
     {
     public:
         trie_node node;
+        trie_branch_node branch;
+        bool is_branch = false;
         bool go_next; // true: proceed with next offset; false: proceed with child offset
+        unsigned int slot; // for branches, the slot of the child
     };
 }
 }
 
+static void read_trie_item(pstate::data_node_io& dn_io, pstate::recursive_item& ri)
+{
+    pstate::trie_node::read_trie_node(dn_io, ri.node.location.block_offset_, ri.node);
+    if (is_branch_header(ri.node.node.hdr))
+    {
+        pstate::trie_branch_node::read_trie_branch(dn_io, ri.node.location.block_offset_, ri.branch);
+        ri.is_branch = true;
+    }
+}
+
+// replace the level of sibling nodes at the top of the stack with a branch
+// that has room for one more child; returns false if the level cannot be
+// converted
+static bool convert_level_to_branch(pstate::data_node_io& dn_io, std::list<pstate::recursive_item>& stack)
+{
+    // the level starts after the root, after a node followed through its
+    // child offset or after a branch
+    std::list<pstate::recursive_item>::iterator first = std::prev(stack.end());
+    std::list<pstate::recursive_item>::iterator parent = std::prev(first);
+    while (parent != stack.begin() && ! parent->is_branch && parent->go_next)
+    {
+        first = parent;
+        parent = std::prev(first);
+    }
+    if (parent->is_branch)
+        return false;
+
+    pstate::trie_branch_node branch;
+    branch.type = pstate::trie_branch_node::type_for(std::distance(first, stack.end()) + 1);
+    for (std::list<pstate::recursive_item>::iterator it = first; it != stack.end(); it++)
+    {
+        pstate::trie_node& node = it->node;
+        unsigned int s = (node.node.hdr.keyChunkSize == 0 ? TRIE_BRANCH_EOS_SLOT : node.node.key_chunk[0]);
+        pdo::error::ThrowIf<pdo::error::RuntimeError>(
+            ! is_empty_offset(branch.slot(s)), "trie level has two nodes for the same key byte");
+        branch.set_slot(s, node.location.block_offset_);
+
+        // nodes under a branch have no next offset
+        if (! is_empty_offset(node.node.next_offset))
+        {
+            node.node.next_offset = pstate::empty_block_offset;
+            node.modified = true;
+        }
+        if (node.modified)
+            pstate::trie_node::write_trie_node(dn_io, node);
+    }
+
+    stack.erase(first, stack.end());
+    stack.emplace_back();
+    stack.back().branch = branch;
+    stack.back().is_branch = true;
+    return true;
+}
+
 void pstate::trie_node::operate_trie_non_recursive(
     data_node_io& dn_io, const kv_operation_e operation, const ByteArray& kvkey, const ByteArray& in_value, ByteArray& out_value)
 {
@@ -312,6 +653,30 @@ void pstate::trie_node::operate_trie_non_recursive(
         // notice: the referenced node may not be initialized, it must be created if location is null,or read otherwise
         recursive_item& ri = trie_recursion_stack.back();
 
+        // a branch leads directly to the node for the next key byte
+        if(ri.is_branch)
+        {
+            unsigned int s = (depth < kvkey.size() ? kvkey[depth] : TRIE_BRANCH_EOS_SLOT);
+            if(is_empty_offset(ri.branch.slot(s)))
+            {
+                if (operation != PUT_OP)
+                {
+                    return;
+                }
+                if (s != TRIE_BRANCH_EOS_SLOT && ri.branch.count == trie_branch_node::capacity(ri.branch.type))
+                {
+                    ri.branch.grow(dn_io);
+                }
+            }
+            ri.slot = s;
+            //push the child node with the location set
+            trie_recursion_stack.emplace_back();
+            recursive_item& ri_child = trie_recursion_stack.back();
+            ri_child.node.location.block_offset_ = ri.branch.slot(s);
+            //notice: depth value is not changed, the child key chunk starts with the key byte
+            continue;
+        }
+
         // first, create/read the node if necessary, or return
         if(! ri.node.initialized)
         {
@@ -330,8 +695,12 @@ void pstate::trie_node::operate_trie_non_recursive(
             }
             else
             {
-                //load the node
-                read_trie_node(dn_io, ri.node.location.block_offset_, ri.node);
+                //load the node, or the branch at its location
+                read_trie_item(dn_io, ri);
+                if(ri.is_branch)
+                {
+                    continue;
+                }
             }
         }
 
@@ -349,6 +718,15 @@ void pstate::trie_node::operate_trie_non_recursive(
             //if right depth has not been reached OR (it has been reached but) the current trie is not EOS, go next
             if (depth < kvkey.size() || ri.node.node.hdr.keyChunkSize > 0)
             {  // no match, go next
+                //a put at the end of the level adds a sibling, so the level becomes a branch
+                if (operation == PUT_OP && dn_io.trie_branch_nodes_ && is_empty_offset(ri.node.node.next_offset))
+                {
+                    if (convert_level_to_branch(dn_io, trie_recursion_stack))
+                    {
+                        continue;
+                    }
+                }
+
                 //update field in referenced working recursive item
                 ri.go_next = true;
                 //push the next node with the location set (to avoid copy, append item and modify it)
@@ -421,38 +799,62 @@ void pstate::trie_node::operate_trie_non_recursive(
 
     while(!trie_recursion_stack.empty())
     {
-        // pop last item in stack
-        recursive_item ri_popped = trie_recursion_stack.back();
-        trie_recursion_stack.pop_back();
+        // last item in stack, popped once the previous item is updated
+        recursive_item& ri_popped = trie_recursion_stack.back();
 
-        if (operation == DEL_OP && trie_recursion_stack.size() > 1)
+        if (operation == DEL_OP && trie_recursion_stack.size() > 2)
         {
             // check whether we should delete this trie node, while removing items from stack
             // as nodes have been deleted, childless nodes can be removed (except the root node)
-            delete_trie_node_childless(dn_io, ri_popped.node);
+            if (ri_popped.is_branch)
+            {
+                trie_branch_node::delete_trie_branch_childless(dn_io, ri_popped.branch);
+            }
+            else
+            {
+                delete_trie_node_childless(dn_io, ri_popped.node);
+            }
         }
 
-        if(ri_popped.node.modified)
+        if (ri_popped.is_branch)
+        {
+            if (ri_popped.branch.modified)
+            {
+                trie_branch_node::write_trie_branch(dn_io, ri_popped.branch);
+            }
+        }
+        else if(ri_popped.node.modified)
         {
             write_trie_node(dn_io, ri_popped.node);
         }
 
-        if(trie_recursion_stack.empty())
+        if(trie_recursion_stack.size() == 1)
         {
             //no previous node to update
+            trie_recursion_stack.pop_back();
             continue;
         }
 
         // update offsets as necessary
-        recursive_item& ri_prev = trie_recursion_stack.back();
+        recursive_item& ri_prev = *std::prev(trie_recursion_stack.end(), 2);
+        const block_offset_t& popped_location = (ri_popped.is_branch ?
+            ri_popped.branch.location.block_offset_ : ri_popped.node.location.block_offset_);
 
-        if(ri_prev.go_next)
+        if(ri_prev.is_branch)
+        {
+            //ri_popped is the child of ri_prev in the slot that was followed
+            if(ri_prev.branch.slot(ri_prev.slot) != popped_location)
+            {
+                ri_prev.branch.set_slot(ri_prev.slot, popped_location);
+            }
+        }
+        else if(ri_prev.go_next)
         {
             //ri_popped is "next" of ri_prev
             //if next node location has changed, updated it
-            if(ri_prev.node.node.next_offset != ri_popped.node.location.block_offset_)
+            if(ri_prev.node.node.next_offset != popped_location)
             {
-                ri_prev.node.node.next_offset = ri_popped.node.location.block_offset_;
+                ri_prev.node.node.next_offset = popped_location;
                 ri_prev.node.modified = true;
             }
         }
@@ -460,13 +862,355 @@ void pstate::trie_node::operate_trie_non_recursive(
         {
             //ri_popped is "child" of ri_prev
             //if child node location has changed, updated it
-            if(ri_prev.node.node.child_offset != ri_popped.node.location.block_offset_)
+            if(ri_prev.node.node.child_offset != popped_location)
             {
-                ri_prev.node.node.child_offset = ri_popped.node.location.block_offset_;
+                ri_prev.node.node.child_offset = popped_location;
                 ri_prev.node.modified = true;
             }
         }
 
-        continue;
+        trie_recursion_stack.pop_back();
     }
 }
+
+// XXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXX
+// ordered scan
+// XXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXX
+
+namespace pdo
+{
+namespace state
+{
+    class scan_item
+    {
+    public:
+        unsigned int slot; // first byte of the key chunk, or the EOS slot
+        trie_node node;    // the nodes under a branch are read when they are visited
+    };
+
+    class scan_level
+    {
+    public:
+        ByteArray key; // key up to the level
+        std::vector<scan_item> items;
+        size_t next = 0;
+    };
+}
+}
+
+// the end of the key comes before any key byte
+static unsigned int scan_order(unsigned int slot)
+{
+    return (slot == TRIE_BRANCH_EOS_SLOT ? 0 : slot + 1);
+}
+
+// read the nodes of a level in key order; the top level is the root
+// followed by its sibling list or branch
+static void read_scan_level(pstate::data_node_io& dn_io, pstate::block_offset_t bo, pstate::scan_level& level)
+{
+    while (! is_empty_offset(bo))
+    {
+        pstate::recursive_item ri;
+        ri.node.location.block_offset_ = bo;
+        read_trie_item(dn_io, ri);
+        if (ri.is_branch)
+        {
+            for (unsigned int s = 0; s <= TRIE_BRANCH_BYTE_SLOTS; s++)
+            {
+                unsigned int slot = (s == 0 ? TRIE_BRANCH_EOS_SLOT : s - 1);
+                if (is_empty_offset(ri.branch.slot(slot)))
+                    continue;
+                level.items.emplace_back();
+                level.items.back().slot = slot;
+                level.items.back().node.location.block_offset_ = ri.branch.slot(slot);
+            }
+            break;
+        }
+
+        level.items.emplace_back();
+        level.items.back().node = ri.node;
+        level.items.back().slot = (ri.node.node.hdr.keyChunkSize == 0 ?
+            TRIE_BRANCH_EOS_SLOT : ri.node.node.key_chunk[0]);
+        bo = ri.node.node.next_offset;
+    }
+
+    std::stable_sort(level.items.begin(), level.items.end(),
+        [](const pstate::scan_item& a, const pstate::scan_item& b) {
+            return scan_order(a.slot) < scan_order(b.slot);
+        });
+}
+
+// compare the first bytes of a and b, up to the length of the shorter one
+static int compare_common_prefix(const ByteArray& a, const ByteArray& b)
+{
+    size_t length = std::min(a.size(), b.size());
+    return (length == 0 ? 0 : memcmp(a.data(), b.data(), length));
+}
+
+void pstate::trie_node::scan_trie(
+    data_node_io& dn_io,
+    const ByteArray& prefix,
+    const ByteArray& start,
+    bool inclusive,
+    size_t limit,
+    KeyValueArray& out)
+{
+    size_t found = 0;
+    std::list<scan_level> scan_stack;
+    scan_stack.emplace_back();
+    read_scan_level(dn_io,
+        {dn_io.block_warehouse_.get_root_block_num(), data_node::data_begin_index()}, scan_stack.back());
+
+    // depth first, in key order; every key under a node starts with the
+    // key up to the node, which allows to skip the nodes out of range
+    while (! scan_stack.empty() && found < limit)
+    {
+        scan_level& level = scan_stack.back();
+        if (level.next == level.items.size())
+        {
+            scan_stack.pop_back();
+            continue;
+        }
+        scan_item& item = level.items[level.next++];
+
+        ByteArray key = level.key;
+        if (item.slot != TRIE_BRANCH_EOS_SLOT)
+        {
+            // the first byte is enough to skip the nodes under a branch without reading them
+            key.push_back(item.slot);
+            int c = compare_common_prefix(key, prefix);
+            if (c > 0)
+                return;     // past the prefix, no more keys
+            if (c < 0 || compare_common_prefix(key, start) < 0)
+                continue;   // before the prefix or before start
+
+            if (! item.node.initialized)
+            {
+                read_trie_node(dn_io, item.node.location.block_offset_, item.node);
+            }
+            key.insert(key.end(), item.node.node.key_chunk + 1,
+                item.node.node.key_chunk + item.node.node.hdr.keyChunkSize);
+
+            c = compare_common_prefix(key, prefix);
+            if (c > 0)
+                return;
+            if (c < 0 || compare_common_prefix(key, start) < 0)
+                continue;
+            if (is_empty_offset(item.node.node.child_offset))
+                continue;
+
+            scan_stack.emplace_back();
+            scan_stack.back().key = key;
+            read_scan_level(dn_io, item.node.node.child_offset, scan_stack.back());
+            continue;
+        }
+
+        // end of the key, the node refers to the value if there is one
+        if (! item.node.initialized)
+        {
+            read_trie_node(dn_io, item.node.location.block_offset_, item.node);
+        }
+        if (! item.node.has_value())
+            continue;
+        if (key.size() < prefix.size() || key < start || (key == start && ! inclusive))
+            continue;
+
+        out.emplace_back();
+        out.back().first = key;
+        do_read_value(dn_io, item.node, out.back().second);
+        found++;
+    }
+}
+
+// XXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXX
+// batched get
+// XXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXX
+
+namespace pdo
+{
+namespace state
+{
+    // a level of the trie and the keys to look up in it; the keys are a
+    // range of the sorted keys that match the trie up to depth
+    class lookup_item
+    {
+    public:
+        block_offset_t level_offset;
+        size_t depth;
+        size_t begin;
+        size_t end;
+    };
+
+    // the keys of a lookup item with the same byte at depth (or no byte)
+    class lookup_group
+    {
+    public:
+        unsigned int slot;
+        size_t begin;
+        size_t end;
+        bool done;
+    };
+}
+}
+
+// follow a node with the keys of its group, the keys that match its key
+// chunk continue with its child level
+static void lookup_trie_node(pstate::data_node_io& dn_io,
+    const pstate::trie_node& node,
+    const std::vector<ByteArray>& keys,
+    const pstate::lookup_item& item,
+    const pstate::lookup_group& group,
+    std::vector<ByteArray>& values,
+    std::list<pstate::lookup_item>& lookup_stack)
+{
+    if (group.slot == TRIE_BRANCH_EOS_SLOT)
+    {
+        if (! node.has_value())
+            return;
+
+        ByteArray value;
+        pstate::trie_node::do_read_value(dn_io, node, value);
+        for (size_t k = group.begin; k < group.end; k++)
+        {
+            values[k] = value;
+        }
+        return;
+    }
+
+    // the keys that share the chunk are contiguous in the group
+    size_t chunk_size = node.node.hdr.keyChunkSize;
+    size_t k = group.begin;
+    while (k < group.end && (keys[k].size() < item.depth + chunk_size ||
+            memcmp(keys[k].data() + item.depth, node.node.key_chunk, chunk_size) < 0))
+    {
+        k++;
+    }
+    size_t begin = k;
+    while (k < group.end && keys[k].size() >= item.depth + chunk_size &&
+            memcmp(keys[k].data() + item.depth, node.node.key_chunk, chunk_size) == 0)
+    {
+        k++;
+    }
+    if (begin == k || is_empty_offset(node.node.child_offset))
+        return;
+
+    lookup_stack.push_back({node.node.child_offset, item.depth + chunk_size, begin, k});
+}
+
+void pstate::trie_node::get_trie_many(
+    data_node_io& dn_io,
+    const std::vector<ByteArray>& sorted_keys,
+    std::vector<ByteArray>& out_values)
+{
+    out_values.assign(sorted_keys.size(), ByteArray());
+    if (sorted_keys.empty())
+        return;
+
+    // each level on the way to the keys is read once for all of them
+    std::list<lookup_item> lookup_stack;
+    lookup_stack.push_back({{dn_io.block_warehouse_.get_root_block_num(), data_node::data_begin_index()},
+        0, 0, sorted_keys.size()});
+
+    while (! lookup_stack.empty())
+    {
+        lookup_item item = lookup_stack.back();
+        lookup_stack.pop_back();
+
+        // split the keys by their byte at depth, the keys that end at depth come first
+        std::vector<lookup_group> groups;
+        std::vector<int> group_of_slot(TRIE_BRANCH_BYTE_SLOTS + 1, -1);
+        for (size_t k = item.begin; k < item.end; k++)
+        {
+            const ByteArray& key = sorted_keys[k];
+            unsigned int s = (key.size() == item.depth ? TRIE_BRANCH_EOS_SLOT : key[item.depth]);
+            if (groups.empty() || groups.back().slot != s)
+            {
+                group_of_slot[s] = groups.size();
+                groups.push_back({s, k, k, false});
+            }
+            groups.back().end = k + 1;
+        }
+
+        size_t pending = groups.size();
+        block_offset_t bo = item.level_offset;
+        while (pending > 0 && ! is_empty_offset(bo))
+        {
+            recursive_item ri;
+            ri.node.location.block_offset_ = bo;
+            read_trie_item(dn_io, ri);
+            if (ri.is_branch)
+            {
+                for (lookup_group& group : groups)
+                {
+                    if (group.done || is_empty_offset(ri.branch.slot(group.slot)))
+                        continue;
+                    trie_node node;
+                    read_trie_node(dn_io, ri.branch.slot(group.slot), node);
+                    lookup_trie_node(dn_io, node, sorted_keys, item, group, out_values, lookup_stack);
+                }
+                break;
+            }
+
+            unsigned int s = (ri.node.node.hdr.keyChunkSize == 0 ? TRIE_BRANCH_EOS_SLOT : ri.node.node.key_chunk[0]);
+            int g = group_of_slot[s];
+            if (g >= 0 && ! groups[g].done)
+            {
+                lookup_trie_node(dn_io, ri.node, sorted_keys, item, groups[g], out_values, lookup_stack);
+                groups[g].done = true;
+                pending--;
+            }
+            bo = ri.node.node.next_offset;
+        }
+    }
+}
+
+// XXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXX
+// value lookup
+// XXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXX
+
+// find the node that refers to the value of a key, without reading the
+// value; returns false if the key has no value
+bool pstate::trie_node::lookup_trie_value(
+    data_node_io& dn_io,
+    const ByteArray& kvkey,
+    trie_node& out_node)
+{
+    block_offset_t bo = {dn_io.block_warehouse_.get_root_block_num(), data_node::data_begin_index()};
+    size_t depth = 0;
+
+    while (! is_empty_offset(bo))
+    {
+        recursive_item ri;
+        ri.node.location.block_offset_ = bo;
+        read_trie_item(dn_io, ri);
+        if (ri.is_branch)
+        {
+            bo = ri.branch.slot(depth < kvkey.size() ? kvkey[depth] : TRIE_BRANCH_EOS_SLOT);
+            continue;
+        }
+
+        const trie_node_h_with_ncc_t& node = ri.node.node;
+        unsigned int spl = shared_prefix_length(
+            node.key_chunk, node.hdr.keyChunkSize, kvkey.data() + depth, kvkey.size() - depth);
+        if (spl == 0)
+        {
+            if (depth == kvkey.size() && node.hdr.keyChunkSize == 0)
+            {
+                out_node = ri.node;
+                return out_node.has_value();
+            }
+            bo = node.next_offset;
+        }
+        else if (spl == node.hdr.keyChunkSize)
+        {
+            depth += spl;
+            bo = node.child_offset;
+        }
+        else
+        {
+            return false;
+        }
+    }
+
+    return false;
+}
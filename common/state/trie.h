@@ -52,12 +52,84 @@ namespace state
         uint8_t key_chunk[MAX_KEY_CHUNK_BYTE_SIZE];
     };
 
+// a value of up to this size is stored in the end-of-key node that refers
+// to it, in place of the child offset and the key chunk; the isValue flag
+// of the node header marks a node with an inline value
+#define TRIE_INLINE_VALUE_MAX_SIZE (sizeof(pdo::state::block_offset_t) + MAX_KEY_CHUNK_BYTE_SIZE - 1)
+
+    struct __attribute__((packed)) trie_node_h_with_inline_value_t
+    {
+        trie_node_header_t hdr;
+        block_offset_t next_offset;
+        uint8_t value_size;
+        uint8_t value[TRIE_INLINE_VALUE_MAX_SIZE];
+    };
+    static_assert(sizeof(trie_node_h_with_inline_value_t) == sizeof(trie_node_h_with_ncc_t),
+        "a node with an inline value must have the size of a trie node");
+
     const trie_node_header_t deleted_trie_header = {1, 0, 0, 0, 0};
     const trie_node_header_t empty_trie_header = {0, 0, 0, 0, 0};
     const trie_node_header_t empty_trie_header_with_nc = {0, 1, 1, 0, 0};
     const trie_node_h_with_nc_t empty_trie_node_h_with_nc = {
         empty_trie_header_with_nc, empty_block_offset};
 
+// a branch node has a child slot for each byte value, plus one for the end of the key
+#define TRIE_BRANCH_BYTE_SLOTS 256
+#define TRIE_BRANCH_EOS_SLOT TRIE_BRANCH_BYTE_SLOTS
+
+    // the keyChunkSize field of a branch header holds the branch type
+    const trie_node_header_t branch_trie_header = {0, 0, 1, 0, 0};
+
+    enum trie_branch_type_e
+    {
+        TRIE_BRANCH_4 = 0,
+        TRIE_BRANCH_16,
+        TRIE_BRANCH_48,
+        TRIE_BRANCH_256
+    };
+
+    // XXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXX
+    // trie_branch_node
+    //
+    // A level of the trie with more than one node is stored in a branch
+    // node that maps the first byte of the key chunk of each node in the
+    // level to the node offset, so that finding the node that matches a
+    // key takes one branch read instead of a walk through the sibling
+    // list. The nodes under a branch have no next offset.
+    //
+    // Like the nodes of an adaptive radix tree, a branch comes in four
+    // sizes: 4 and 16 children (sorted key bytes and offsets), 48 children
+    // (a 256 byte index into the offsets) and 256 children (offsets only).
+    // A full branch is moved to the next size when a child is added.
+    // XXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXX
+    class trie_branch_node
+    {
+    public:
+        uint8_t type = TRIE_BRANCH_4;
+        unsigned int count = 0;  // children in byte slots
+        block_offset_t eos_offset = empty_block_offset;
+        block_offset_t children[TRIE_BRANCH_BYTE_SLOTS];
+        bool modified = false;
+        block_offset location;
+
+        trie_branch_node();
+
+        static unsigned int capacity(uint8_t type);
+        static size_t serialized_size(uint8_t type);
+        static uint8_t type_for(unsigned int count);
+
+        block_offset_t& slot(unsigned int s) { return s == TRIE_BRANCH_EOS_SLOT ? eos_offset : children[s]; }
+        void set_slot(unsigned int s, const block_offset_t& bo);
+        void grow(data_node_io& dn_io);
+
+        void serialize(ByteArray& out) const;
+        void deserialize(const ByteArray& in);
+
+        static void read_trie_branch(data_node_io& dn_io, const block_offset_t& in_block_offset, trie_branch_node& out_branch);
+        static void write_trie_branch(data_node_io& dn_io, trie_branch_node& in_branch);
+        static void delete_trie_branch_childless(data_node_io& dn_io, trie_branch_node& branch);
+    };
+
     class trie_node
     {
     public:
@@ -76,6 +148,11 @@ namespace state
         static void delete_trie_node_childless(data_node_io& dn_io,
             trie_node& node);
 
+        trie_node_h_with_inline_value_t& inline_value() { return *(trie_node_h_with_inline_value_t*)&node; }
+        const trie_node_h_with_inline_value_t& inline_value() const { return *(const trie_node_h_with_inline_value_t*)&node; }
+        bool has_inline_value() const { return node.hdr.isValue; }
+        bool has_value() const { return node.hdr.isValue || node.child_offset != empty_block_offset; }
+
         static void do_write_value(data_node_io& dn_io,
             trie_node& node,
             const ByteArray& value);
@@ -83,6 +160,9 @@ namespace state
             data_node_io& dn_io, block_offset_t& bo_at, ByteArray& ba_header, size_t& value_size);
         static void do_read_value(
             data_node_io& dn_io, const trie_node& node, ByteArray& value);
+        static size_t do_read_value_size(data_node_io& dn_io, const trie_node& node);
+        static size_t do_read_value_into(
+            data_node_io& dn_io, const trie_node& node, size_t offset, uint8_t* buffer, size_t size);
         static void do_delete_value(data_node_io& dn_io, trie_node& node);
 
         static void do_split_trie_node(
@@ -100,6 +180,21 @@ namespace state
             const ByteArray& kvkey,
             const ByteArray& in_value,
             ByteArray& out_value);
+        static bool lookup_trie_value(
+            data_node_io& dn_io,
+            const ByteArray& kvkey,
+            trie_node& out_node);
+        static void get_trie_many(
+            data_node_io& dn_io,
+            const std::vector<ByteArray>& sorted_keys,
+            std::vector<ByteArray>& out_values);
+        static void scan_trie(
+            data_node_io& dn_io,
+            const ByteArray& prefix,
+            const ByteArray& start,
+            bool inclusive,
+            size_t limit,
+            KeyValueArray& out);
     };
 }
 }
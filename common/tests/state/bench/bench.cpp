@@ -0,0 +1,70 @@
+/* Copyright 2024 Intel Corporation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <stdio.h>
+#include <unistd.h>
+#include <string>
+
+#include "log.h"
+
+#include "packages/block_store/block_store.h"
+#include "packages/block_store/lmdb_block_store.h"
+
+#include "bench_block_store.h"
+#include "bench_flush.h"
+#include "bench_trie.h"
+
+#define BENCH_DATABASE_NAME "ubench.mdb"
+#define LOCK_EXTENSION "-lock"
+#define BENCH_DATABASE_LOCK_NAME BENCH_DATABASE_NAME LOCK_EXTENSION
+
+/* Shards that the block store benchmark spreads the blocks over */
+#define BENCH_DATABASE_SHARDS 4
+
+/* Application entry; the benchmarks are not part of the test run */
+int main(int argc, char* argv[])
+{
+    int ret = -1;
+    pdo::lmdb_block_store::BlockStoreOpen(BENCH_DATABASE_NAME);
+
+    SAFE_LOG(PDO_LOG_DEBUG, "State benchmarks: start\n");
+    try
+    {
+        bench_trie();
+        bench_compaction();
+        bench_flush();
+        bench_block_store(BENCH_DATABASE_NAME);
+        SAFE_LOG(PDO_LOG_DEBUG, "State benchmarks: SUCCESSFUL!\n");
+        ret = 0;
+    }
+    catch(...)
+    {
+        SAFE_LOG(PDO_LOG_ERROR, "State benchmarks: FAILED\n");
+        ret = -1;
+    }
+
+    pdo::lmdb_block_store::BlockStoreClose();
+
+    unlink(BENCH_DATABASE_NAME);
+    unlink(BENCH_DATABASE_LOCK_NAME);
+    for (int i = 1; i < BENCH_DATABASE_SHARDS; i++)
+    {
+        std::string shard_name = std::string(BENCH_DATABASE_NAME) + "." + std::to_string(i);
+        unlink(shard_name.c_str());
+        unlink((shard_name + LOCK_EXTENSION).c_str());
+    }
+
+    return ret;
+}
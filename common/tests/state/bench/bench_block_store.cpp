@@ -0,0 +1,258 @@
+/* Copyright 2024 Intel Corporation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <stdio.h>
+#include <atomic>
+#include <chrono>
+#include <random>
+#include <thread>
+
+#include "log.h"
+#include "error.h"
+#include "state.h"
+#include "types.h"
+
+#include "bench_block_store.h"
+#include "packages/block_store/block_store.h"
+#include "packages/block_store/lmdb_block_store.h"
+
+#define BENCH_BLOCK_STORE_BLOCK_COUNT 1024
+#define BENCH_BLOCK_STORE_BLOCK_SIZE 8192
+#define BENCH_BLOCK_STORE_READS_PER_THREAD 4096
+#define BENCH_BLOCK_STORE_MAX_THREADS 8
+#define BENCH_BLOCK_STORE_WRITES_PER_THREAD 256
+#define BENCH_BLOCK_STORE_SHARDS 4
+#define BENCH_BLOCK_STORE_REBALANCE_BATCH 256
+
+typedef std::chrono::steady_clock bench_clock;
+
+static ByteArray make_block(std::mt19937& rng)
+{
+    ByteArray block(BENCH_BLOCK_STORE_BLOCK_SIZE);
+    for(size_t i = 0; i < block.size(); i++)
+        block[i] = rng();
+    return block;
+}
+
+// read random blocks from the store, one get for each read as the
+// block cache of a contract enclave does
+static void bench_reader(const std::vector<ByteArray>& ids, unsigned int seed, std::atomic<bool>& failed)
+{
+    std::mt19937 rng(seed);
+    ByteArray block;
+    for(unsigned int i = 0; i < BENCH_BLOCK_STORE_READS_PER_THREAD; i++)
+    {
+        const ByteArray& id = ids[rng() % ids.size()];
+        if(pdo::block_store::BlockStoreGet(id, block) != PDO_SUCCESS ||
+            block.size() != BENCH_BLOCK_STORE_BLOCK_SIZE)
+        {
+            failed = true;
+            return;
+        }
+    }
+}
+
+// write new blocks until the readers are done
+static void bench_writer(unsigned int seed, std::atomic<bool>& done, std::atomic<bool>& failed, size_t& writes)
+{
+    std::mt19937 rng(seed);
+    while(! done)
+    {
+        ByteArray block = make_block(rng);
+        ByteArray id = pdo::crypto::ComputeMessageHash(block);
+        if(pdo::block_store::BlockStorePut(id, block) != PDO_SUCCESS)
+        {
+            failed = true;
+            return;
+        }
+        writes++;
+    }
+}
+
+static void bench_threads(const std::vector<ByteArray>& ids, unsigned int thread_count, bool with_writer)
+{
+    std::atomic<bool> done(false);
+    std::atomic<bool> failed(false);
+    size_t writes = 0;
+
+    bench_clock::time_point start = bench_clock::now();
+
+    std::thread writer;
+    if(with_writer)
+        writer = std::thread(bench_writer, thread_count, std::ref(done), std::ref(failed), std::ref(writes));
+
+    std::vector<std::thread> readers;
+    for(unsigned int t = 0; t < thread_count; t++)
+        readers.push_back(std::thread(bench_reader, std::cref(ids), t, std::ref(failed)));
+    for(unsigned int t = 0; t < thread_count; t++)
+        readers[t].join();
+
+    done = true;
+    if(with_writer)
+        writer.join();
+
+    std::chrono::duration<double> elapsed = bench_clock::now() - start;
+
+    if(failed)
+    {
+        SAFE_LOG(PDO_LOG_ERROR, "bench block store, failed to access block\n");
+        throw pdo::error::RuntimeError("error");
+    }
+
+    double reads = (double)thread_count * BENCH_BLOCK_STORE_READS_PER_THREAD;
+    printf("block store %u reader threads %-12s: %9.0f reads/s, %7.0f writes/s\n",
+        thread_count, with_writer ? "with writer" : "",
+        reads / elapsed.count(), writes / elapsed.count());
+}
+
+// put blocks from concurrent writers, one put for each block as the
+// enclave workers do when they flush their states; the puts of the
+// writers are committed in groups. The ids are computed up front so
+// that only the store is timed
+static void bench_writers(const std::vector<ByteArray>& blocks, unsigned int thread_count, const char* label)
+{
+    std::atomic<bool> failed(false);
+
+    std::vector<ByteArray> ids;
+    for(size_t i = 0; i < blocks.size(); i++)
+        ids.push_back(pdo::crypto::ComputeMessageHash(blocks[i]));
+
+    bench_clock::time_point start = bench_clock::now();
+
+    std::vector<std::thread> writers;
+    for(unsigned int t = 0; t < thread_count; t++)
+    {
+        writers.push_back(std::thread([&ids, &blocks, &failed, t, thread_count]() {
+            for(size_t i = t; i < blocks.size(); i += thread_count)
+            {
+                if(pdo::block_store::BlockStorePut(ids[i], blocks[i]) != PDO_SUCCESS)
+                {
+                    failed = true;
+                    return;
+                }
+            }
+        }));
+    }
+    for(unsigned int t = 0; t < thread_count; t++)
+        writers[t].join();
+
+    std::chrono::duration<double> elapsed = bench_clock::now() - start;
+
+    if(failed)
+    {
+        SAFE_LOG(PDO_LOG_ERROR, "bench block store, failed to write block\n");
+        throw pdo::error::RuntimeError("error");
+    }
+
+    printf("block store %u writer threads %-12s: %9.0f writes/s\n",
+        thread_count, label, blocks.size() / elapsed.count());
+}
+
+// change the number of shards and move the blocks that are stored to
+// the shards they are routed to
+static void bench_reshard(size_t shard_count)
+{
+    if(pdo::lmdb_block_store::BlockStoreShardCount() == shard_count)
+        return;
+
+    bench_clock::time_point start = bench_clock::now();
+
+    pdo::lmdb_block_store::BlockStoreReshard(shard_count);
+
+    size_t moved = 0, moved_count;
+    bool complete = false;
+    while(! complete)
+    {
+        if(pdo::lmdb_block_store::BlockStoreRebalance(BENCH_BLOCK_STORE_REBALANCE_BATCH, &moved_count, &complete) != PDO_SUCCESS)
+        {
+            SAFE_LOG(PDO_LOG_ERROR, "bench block store, failed to rebalance blocks\n");
+            throw pdo::error::RuntimeError("error");
+        }
+        moved += moved_count;
+    }
+
+    std::chrono::duration<double> elapsed = bench_clock::now() - start;
+    printf("block store moved %zu blocks to %zu shards : %9.0f blocks/s\n",
+        moved, shard_count, moved / elapsed.count());
+}
+
+void bench_block_store(const char* db_path)
+{
+    try
+    {
+        SAFE_LOG(PDO_LOG_INFO, "start block store benchmark\n");
+
+        std::mt19937 rng(5);
+        std::vector<ByteArray> ids, blocks;
+        for(unsigned int i = 0; i < BENCH_BLOCK_STORE_BLOCK_COUNT; i++)
+        {
+            blocks.push_back(make_block(rng));
+            ids.push_back(pdo::crypto::ComputeMessageHash(blocks.back()));
+        }
+        if(pdo::block_store::BlockStorePutMany(ids, blocks) != PDO_SUCCESS)
+        {
+            SAFE_LOG(PDO_LOG_ERROR, "bench block store, failed to store blocks\n");
+            throw pdo::error::RuntimeError("error");
+        }
+
+        for(unsigned int threads = 1; threads <= BENCH_BLOCK_STORE_MAX_THREADS; threads *= 2)
+        {
+            bench_threads(ids, threads, false);
+            bench_threads(ids, threads, true);
+        }
+
+        // new blocks, then the same blocks again which only extends
+        // their expiration time
+        for(unsigned int threads = 1; threads <= BENCH_BLOCK_STORE_MAX_THREADS; threads *= 2)
+        {
+            std::vector<ByteArray> new_blocks;
+            for(unsigned int i = 0; i < threads * BENCH_BLOCK_STORE_WRITES_PER_THREAD; i++)
+                new_blocks.push_back(make_block(rng));
+            bench_writers(new_blocks, threads, "new");
+            bench_writers(new_blocks, threads, "existing");
+        }
+
+        // new blocks from concurrent writers with a single shard and
+        // with the blocks spread over several shards. Each shard has its
+        // own writer and its own file; without sync on commit a commit
+        // only copies pages and the shards gain nothing over a single
+        // writer, so the store is reopened to sync every commit, where
+        // the shards wait for the disk at the same time
+        pdo::lmdb_block_store::BlockStoreClose();
+        pdo::lmdb_block_store::BlockStoreOpen(db_path, true);
+
+        const size_t shard_counts[] = {1, BENCH_BLOCK_STORE_SHARDS};
+        for(unsigned int c = 0; c < 2; c++)
+        {
+            bench_reshard(shard_counts[c]);
+
+            std::vector<ByteArray> new_blocks;
+            for(unsigned int i = 0; i < BENCH_BLOCK_STORE_MAX_THREADS * BENCH_BLOCK_STORE_WRITES_PER_THREAD; i++)
+                new_blocks.push_back(make_block(rng));
+
+            std::string label = std::to_string(shard_counts[c]) + (shard_counts[c] == 1 ? " shard" : " shards");
+            bench_writers(new_blocks, BENCH_BLOCK_STORE_MAX_THREADS, label.c_str());
+        }
+        bench_reshard(1);
+
+        pdo::lmdb_block_store::BlockStoreClose();
+        pdo::lmdb_block_store::BlockStoreOpen(db_path);
+    }
+    catch (...)
+    {
+        SAFE_LOG(PDO_LOG_ERROR, "error in block store benchmark\n");
+        throw;
+    }
+}
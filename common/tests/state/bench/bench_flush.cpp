@@ -0,0 +1,88 @@
+/* Copyright 2024 Intel Corporation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <stdio.h>
+#include <chrono>
+#include <random>
+
+#include "log.h"
+#include "error.h"
+#include "state.h"
+#include "types.h"
+
+#include "bench_flush.h"
+
+namespace pstate = pdo::state;
+
+#define BENCH_FLUSH_NODE_COUNT 256
+#define BENCH_FLUSH_ROUNDS 4
+
+typedef std::chrono::steady_clock bench_clock;
+
+static double mb_per_sec(bench_clock::time_point start, size_t bytes)
+{
+    std::chrono::duration<double> elapsed = bench_clock::now() - start;
+    return bytes / elapsed.count() / (1 << 20);
+}
+
+// encrypt and hash the data nodes one at a time, as a cache sync does
+static void bench_flush_nodes(std::vector<pstate::data_node>& nodes, bool compress)
+{
+    const ByteArray state_encryption_key_(16, 1);
+    pstate::block_compressor compressor;
+    size_t bytes = BENCH_FLUSH_ROUNDS * nodes.size() * FIXED_DATA_NODE_BYTE_SIZE;
+
+    bench_clock::time_point start = bench_clock::now();
+    for(unsigned int round = 0; round < BENCH_FLUSH_ROUNDS; round++)
+    {
+        for(unsigned int i = 0; i < nodes.size(); i++)
+        {
+            ByteArray block = nodes[i].serialize_and_encrypt(state_encryption_key_, compress ? &compressor : NULL);
+            ByteArray id = pdo::crypto::ComputeMessageHash(block);
+        }
+    }
+    double throughput = mb_per_sec(start, bytes);
+
+    printf("flush %u data nodes %-12s: %7.1f MB/s\n",
+        (unsigned int)nodes.size(), compress ? "compressed" : "uncompressed", throughput);
+}
+
+void bench_flush()
+{
+    try
+    {
+        SAFE_LOG(PDO_LOG_INFO, "start flush benchmark\n");
+        // full data nodes, half of them with random bytes and half with text
+        std::mt19937 rng(3);
+        std::vector<pstate::data_node> nodes;
+        for(unsigned int n = 0; n < BENCH_FLUSH_NODE_COUNT; n++)
+        {
+            ByteArray data(pstate::data_node::data_end_index() - pstate::data_node::data_begin_index());
+            for(size_t i = 0; i < data.size(); i++)
+                data[i] = (n % 2 ? rng() : 'a' + rng() % 16);
+            nodes.push_back(pstate::data_node(n));
+            pstate::block_offset_t bo = {n, pstate::data_node::data_begin_index()};
+            nodes.back().write_at(data, 0, bo);
+        }
+
+        bench_flush_nodes(nodes, false);
+        bench_flush_nodes(nodes, true);
+    }
+    catch (...)
+    {
+        SAFE_LOG(PDO_LOG_ERROR, "error in flush benchmark\n");
+        throw;
+    }
+}
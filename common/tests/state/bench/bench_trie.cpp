@@ -0,0 +1,230 @@
+/* Copyright 2024 Intel Corporation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <stdio.h>
+#include <chrono>
+#include <random>
+
+#include "log.h"
+#include "error.h"
+#include "state.h"
+#include "types.h"
+
+#include "bench_trie.h"
+
+namespace pstate = pdo::state;
+
+#define BENCH_TRIE_KEY_COUNT 4096
+#define BENCH_TRIE_KEY_SIZE 32
+
+typedef std::chrono::steady_clock bench_clock;
+
+static double usec_per_key(bench_clock::time_point start, size_t key_count)
+{
+    std::chrono::duration<double, std::micro> elapsed = bench_clock::now() - start;
+    return elapsed.count() / key_count;
+}
+
+// put, get and delete the keys in a state whose trie levels are either
+// sibling lists or branch nodes, and whose values are either inline or
+// not; sets the trie node and data node reads per get
+static void bench_trie_format(bool branch_nodes, bool inline_values, const std::vector<ByteArray>& keys,
+    double& reads_per_get, double& data_reads_per_get)
+{
+    const ByteArray state_encryption_key_(16, 0);
+    const ByteArray value(16, 'v');
+    ByteArray id;
+
+    bench_clock::time_point start = bench_clock::now();
+    {
+        pstate::State_KV skv(state_encryption_key_);
+        skv.GetDataNodeIO().trie_branch_nodes_ = branch_nodes;
+        skv.GetDataNodeIO().trie_inline_values_ = inline_values;
+        for(unsigned int i = 0; i < keys.size(); i++)
+        {
+            skv.Put(keys[i], value);
+        }
+        skv.Finalize(id);
+    }
+    double put_time = usec_per_key(start, keys.size());
+
+    {
+        pstate::State_KV skv(id, state_encryption_key_);
+        pstate::data_node_io& dn_io = skv.GetDataNodeIO();
+        dn_io.trie_branch_nodes_ = branch_nodes;
+        dn_io.trie_inline_values_ = inline_values;
+
+        uint64_t old_reads = dn_io.trie_node_reads_;
+        uint64_t old_data_reads = dn_io.data_node_reads_;
+        start = bench_clock::now();
+        for(unsigned int i = 0; i < keys.size(); i++)
+        {
+            if(skv.Get(keys[i]) != value)
+            {
+                SAFE_LOG(PDO_LOG_ERROR, "bench trie, wrong value\n");
+                throw pdo::error::RuntimeError("error");
+            }
+        }
+        double get_time = usec_per_key(start, keys.size());
+        reads_per_get = (double)(dn_io.trie_node_reads_ - old_reads) / keys.size();
+        data_reads_per_get = (double)(dn_io.data_node_reads_ - old_data_reads) / keys.size();
+
+        start = bench_clock::now();
+        for(unsigned int i = 0; i < keys.size(); i += 2)
+        {
+            skv.Delete(keys[i]);
+        }
+        double delete_time = usec_per_key(start, keys.size() / 2);
+        for(unsigned int i = 0; i < keys.size(); i++)
+        {
+            ByteArray expected = (i % 2 ? value : ByteArray());
+            if(skv.Get(keys[i]) != expected)
+            {
+                SAFE_LOG(PDO_LOG_ERROR, "bench trie, wrong value after delete\n");
+                throw pdo::error::RuntimeError("error");
+            }
+        }
+        skv.Finalize(id);
+
+        printf("trie %-6s %-7s %lu keys: put %6.1f us, get %6.1f us, delete %6.1f us, "
+            "%6.1f node reads and %6.1f data node reads per get\n",
+            branch_nodes ? "branch" : "chain", inline_values ? "inline" : "", keys.size(),
+            put_time, get_time, delete_time, reads_per_get, data_reads_per_get);
+    }
+}
+
+// open the state without warm cache and get the keys; sets the data
+// blocks of the state and the blocks loaded from the block store
+static double bench_cold_open(const ByteArray& id, const std::vector<ByteArray>& keys,
+    unsigned int& blocks, uint64_t& loaded)
+{
+    const ByteArray state_encryption_key_(16, 0);
+    bench_clock::time_point start = bench_clock::now();
+    pstate::State_KV skv(id, state_encryption_key_);
+    for(unsigned int i = 0; i < keys.size(); i++)
+    {
+        skv.Get(keys[i]);
+    }
+    double open_time = usec_per_key(start, 1);
+    blocks = skv.GetBlockWarehouse().get_last_block_num() + 1;
+    loaded = skv.GetCache().misses_ + skv.GetCache().prefetched_;
+    return open_time;
+}
+
+// a state whose keys were put, overwritten and deleted at random, with
+// more deletes in each round, is opened and read before and after
+// compaction
+void bench_compaction()
+{
+    try
+    {
+        SAFE_LOG(PDO_LOG_INFO, "start compaction benchmark\n");
+        const ByteArray state_encryption_key_(16, 0);
+        std::mt19937 rng(2);
+        std::vector<ByteArray> keys;
+        for(unsigned int i = 0; i < BENCH_TRIE_KEY_COUNT; i++)
+        {
+            std::string key = "bench." + std::to_string(rng());
+            keys.push_back(ByteArray(key.begin(), key.end()));
+        }
+
+        ByteArray id;
+        {
+            pstate::State_KV skv(state_encryption_key_);
+            skv.Finalize(id);
+        }
+        for(unsigned int round = 0; round < 4; round++)
+        {
+            pstate::State_KV skv(id, state_encryption_key_);
+            for(unsigned int i = 0; i < keys.size(); i++)
+            {
+                if(rng() % 5 <= round)
+                    skv.Delete(keys[i]);
+                else
+                    skv.Put(keys[i], ByteArray(1 + rng() % 200, 'v'));
+            }
+            skv.Finalize(id);
+        }
+
+        unsigned int blocks_before, blocks_after;
+        uint64_t loaded_before, loaded_after;
+        double open_before = bench_cold_open(id, keys, blocks_before, loaded_before);
+
+        bench_clock::time_point start = bench_clock::now();
+        {
+            pstate::State_KV skv(id, state_encryption_key_);
+            skv.Compact(id);
+        }
+        double compact_time = usec_per_key(start, 1);
+
+        double open_after = bench_cold_open(id, keys, blocks_after, loaded_after);
+
+        printf("compaction %lu keys: %u data blocks before, %u after, in %.1f ms; "
+            "cold open and get %.1f ms (%lu blocks loaded) before, %.1f ms (%lu blocks loaded) after\n",
+            keys.size(), blocks_before, blocks_after, compact_time / 1000,
+            open_before / 1000, loaded_before, open_after / 1000, loaded_after);
+
+        if(blocks_after >= blocks_before || loaded_after >= loaded_before)
+        {
+            SAFE_LOG(PDO_LOG_ERROR, "compaction does not reduce the blocks of the state\n");
+            throw pdo::error::RuntimeError("error");
+        }
+    }
+    catch (...)
+    {
+        SAFE_LOG(PDO_LOG_ERROR, "error in compaction benchmark\n");
+        throw;
+    }
+}
+
+void bench_trie()
+{
+    try
+    {
+        SAFE_LOG(PDO_LOG_INFO, "start trie benchmark\n");
+        std::mt19937 rng(1);
+        std::uniform_int_distribution<int> byte_distribution(0, 255);
+        std::vector<ByteArray> keys(BENCH_TRIE_KEY_COUNT, ByteArray(BENCH_TRIE_KEY_SIZE));
+        for(unsigned int i = 0; i < keys.size(); i++)
+        {
+            for(unsigned int j = 0; j < BENCH_TRIE_KEY_SIZE; j++)
+            {
+                keys[i][j] = byte_distribution(rng);
+            }
+        }
+
+        double chain_reads, chain_data_reads;
+        double branch_reads, branch_data_reads;
+        double inline_reads, inline_data_reads;
+        bench_trie_format(false, false, keys, chain_reads, chain_data_reads);
+        bench_trie_format(true, false, keys, branch_reads, branch_data_reads);
+        bench_trie_format(true, true, keys, inline_reads, inline_data_reads);
+        if(branch_reads >= chain_reads)
+        {
+            SAFE_LOG(PDO_LOG_ERROR, "branch nodes do not reduce trie node reads\n");
+            throw pdo::error::RuntimeError("error");
+        }
+        if(inline_data_reads >= branch_data_reads)
+        {
+            SAFE_LOG(PDO_LOG_ERROR, "inline values do not reduce data node reads\n");
+            throw pdo::error::RuntimeError("error");
+        }
+    }
+    catch (...)
+    {
+        SAFE_LOG(PDO_LOG_ERROR, "error in trie benchmark\n");
+        throw;
+    }
+}
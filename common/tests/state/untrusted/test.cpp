@@ -14,6 +14,7 @@
  */
 #include <stdio.h>
 #include <unistd.h>
+#include <string>
 
 #include "log.h"
 
@@ -25,6 +26,9 @@
 #define LOCK_EXTENSION "-lock"
 #define TEST_DATABASE_LOCK_NAME TEST_DATABASE_NAME LOCK_EXTENSION
 
+/* Shards that the tests spread the blocks over, shard i is stored in TEST_DATABASE_NAME.i */
+#define TEST_DATABASE_SHARDS 4
+
 /* Application entry */
 int main(int argc, char* argv[])
 {
@@ -34,7 +38,7 @@ int main(int argc, char* argv[])
     SAFE_LOG(PDO_LOG_DEBUG, "Test State KV: start\n");
     try
     {
-        test_state_kv();
+        test_state_kv(TEST_DATABASE_NAME);
         SAFE_LOG(PDO_LOG_DEBUG, "Test State KV: SUCCESSFUL!\n");
         ret = 0;
     }
@@ -49,6 +53,12 @@ int main(int argc, char* argv[])
     // Remove test db as docker builds will struggle with this huge sparse file ..
     unlink(TEST_DATABASE_NAME);
     unlink(TEST_DATABASE_LOCK_NAME);
+    for (int i = 1; i < TEST_DATABASE_SHARDS; i++)
+    {
+        std::string shard_name = std::string(TEST_DATABASE_NAME) + "." + std::to_string(i);
+        unlink(shard_name.c_str());
+        unlink((shard_name + LOCK_EXTENSION).c_str());
+    }
 
     return ret;
 }
@@ -46,6 +46,34 @@ state_status_t custom_evict(
     return sebio_evict_to_block_store(block, crypto_algo, idOnEviction);
 }
 
+// We intercept the batched evict call to count the number of batches
+extern state_status_t sebio_evict_many_to_block_store(const std::vector<pstate::StateBlock>& blocks,
+    sebio_crypto_algo_e crypto_algo,
+    std::vector<ByteArray>& idsOnEviction);
+
+unsigned int evict_many_calls = 0;
+state_status_t custom_evict_many(const std::vector<pstate::StateBlock>& blocks,
+    sebio_crypto_algo_e crypto_algo,
+    std::vector<ByteArray>& idsOnEviction)
+{
+    evict_many_calls ++;
+    return sebio_evict_many_to_block_store(blocks, crypto_algo, idsOnEviction);
+}
+
+// We intercept the batched fetch call to count the number of batches
+extern state_status_t sebio_fetch_many_from_block_store(const std::vector<pstate::StateBlockId>& block_ids,
+    sebio_crypto_algo_e crypto_algo,
+    std::vector<pstate::StateBlock>& blocks);
+
+unsigned int fetch_many_calls = 0;
+state_status_t custom_fetch_many(const std::vector<pstate::StateBlockId>& block_ids,
+    sebio_crypto_algo_e crypto_algo,
+    std::vector<pstate::StateBlock>& blocks)
+{
+    fetch_many_calls ++;
+    return sebio_fetch_many_from_block_store(block_ids, crypto_algo, blocks);
+}
+
 void init_test_cache()
 {
     sebio_set({{}, SEBIO_NO_CRYPTO, &custom_fetch, &custom_evict});
@@ -86,6 +114,294 @@ void test_cache()
     }
     sebio_set({{}, SEBIO_NO_CRYPTO, &sebio_fetch_from_block_store, &sebio_evict_to_block_store});
 
+//################## TEST BATCHED FLUSH ###############################################################################
+    try
+    {
+        SAFE_LOG(PDO_LOG_INFO, "start test batched flush\n");
+        sebio_set({{}, SEBIO_NO_CRYPTO, &custom_fetch, &custom_evict, &custom_evict_many});
+        pstate::State_KV skv(state_encryption_key_);
+        kv_ = &skv;
+        //each value takes a block, all of them fit in the cache
+        std::string value(FIXED_DATA_NODE_BYTE_SIZE, 'b');
+        for(char c = 'a'; c <= 'z'; c++)
+        {
+            _kv_put(std::string(1, c), value);
+        }
+        unsigned int old_evict_calls = evict_calls;
+        evict_many_calls = 0;
+        kv_->Finalize(id);
+        //all data nodes must be flushed in one batch, only the root block is evicted alone
+        if(evict_many_calls != 1 || evict_calls - old_evict_calls > 1)
+        {
+            SAFE_LOG(PDO_LOG_ERROR, "flush did not batch evictions (%u batches, %u single)\n",
+                evict_many_calls, evict_calls - old_evict_calls);
+            throw;
+        }
+    }
+    catch (...)
+    {
+        SAFE_LOG(PDO_LOG_ERROR, "error testing KVS batched flush\n");
+        throw;
+    }
+    sebio_set({{}, SEBIO_NO_CRYPTO, &sebio_fetch_from_block_store, &sebio_evict_to_block_store});
+
+//################## TEST PREFETCH ####################################################################################
+    try
+    {
+        SAFE_LOG(PDO_LOG_INFO, "start test prefetch\n");
+        std::string value(FIXED_DATA_NODE_BYTE_SIZE / 2, 'c');
+        {
+            pstate::State_KV skv(state_encryption_key_);
+            kv_ = &skv;
+            for(char c = 'a'; c <= 'h'; c++)
+            {
+                _kv_put(std::string(1, c), value);
+            }
+            kv_->Finalize(id);
+        }
+
+        sebio_set({{}, SEBIO_NO_CRYPTO, &custom_fetch, &custom_evict, &custom_evict_many, &custom_fetch_many});
+
+        //a small state is fetched entirely when it is opened
+        {
+            fetch_many_calls = 0;
+            pstate::State_KV skv(id, state_encryption_key_);
+            kv_ = &skv;
+            for(char c = 'a'; c <= 'h'; c++)
+            {
+                _kv_get(std::string(1, c), value);
+            }
+            if(fetch_many_calls != 1 || skv.GetCache().prefetch_hits_ == 0)
+            {
+                SAFE_LOG(PDO_LOG_ERROR, "state not prefetched on open (%u batches)\n", fetch_many_calls);
+                throw;
+            }
+            ByteArray new_id;
+            kv_->Finalize(new_id);
+        }
+
+        //without prefetch on open, misses read ahead the following data nodes
+        {
+            fetch_many_calls = 0;
+            pstate::State_KV skv(id, state_encryption_key_, {4, 0});
+            kv_ = &skv;
+            for(char c = 'a'; c <= 'h'; c++)
+            {
+                _kv_get(std::string(1, c), value);
+            }
+            const pstate::Cache& cache = skv.GetCache();
+            if(cache.prefetched_ == 0 || cache.prefetch_hits_ == 0)
+            {
+                SAFE_LOG(PDO_LOG_ERROR, "no read ahead (%u batches, %lu prefetched, %lu hits)\n",
+                    fetch_many_calls, cache.prefetched_, cache.prefetch_hits_);
+                throw;
+            }
+            ByteArray new_id;
+            kv_->Finalize(new_id);
+            if(cache.prefetch_hits_ + cache.prefetch_wasted_ != cache.prefetched_)
+            {
+                SAFE_LOG(PDO_LOG_ERROR, "prefetch counters do not add up\n");
+                throw;
+            }
+        }
+    }
+    catch (...)
+    {
+        SAFE_LOG(PDO_LOG_ERROR, "error testing KVS prefetch\n");
+        throw;
+    }
+    sebio_set({{}, SEBIO_NO_CRYPTO, &sebio_fetch_from_block_store, &sebio_evict_to_block_store});
+
+//################## TEST REPLACEMENT POLICIES ########################################################################
+    try
+    {
+        SAFE_LOG(PDO_LOG_INFO, "start test replacement policies\n");
+        //each value takes a block, the state does not fit in the cache
+        std::string value(FIXED_DATA_NODE_BYTE_SIZE, 'd');
+        unsigned int key_count = (CACHE_SIZE / FIXED_DATA_NODE_BYTE_SIZE) * 3 / 2;
+        unsigned int hot_key_count = (CACHE_SIZE / FIXED_DATA_NODE_BYTE_SIZE) / 4;
+        {
+            pstate::State_KV skv(state_encryption_key_);
+            kv_ = &skv;
+            for(unsigned int i = 0; i < key_count; i++)
+            {
+                _kv_put("p" + std::to_string(i), value);
+            }
+            kv_->Finalize(id);
+        }
+
+        //scan the whole state while reading a hot set every few keys
+        const pstate::state_cache_policy_e policies[] = { pstate::STATE_CACHE_POLICY_LRU,
+            pstate::STATE_CACHE_POLICY_MRU, pstate::STATE_CACHE_POLICY_CLOCK, pstate::STATE_CACHE_POLICY_2Q };
+        const char* policy_names[] = { "LRU", "MRU", "CLOCK", "2Q" };
+        double hit_ratio[4];
+        for(unsigned int p = 0; p < 4; p++)
+        {
+            pstate::State_KV skv(id, state_encryption_key_, {1, 0}, policies[p]);
+            kv_ = &skv;
+            for(unsigned int round = 0; round < 3; round++)
+            {
+                for(unsigned int i = 0; i < key_count; i++)
+                {
+                    _kv_get("p" + std::to_string(i), value);
+                    if(i % 4 == 0)
+                    {
+                        _kv_get("p" + std::to_string((i / 4) % hot_key_count), value);
+                    }
+                }
+            }
+            const pstate::Cache& cache = skv.GetCache();
+            hit_ratio[p] = (double)cache.hits_ / (double)(cache.hits_ + cache.misses_);
+            SAFE_LOG(PDO_LOG_INFO, "%s hit ratio %.3f (%lu hits, %lu misses, %lu evictions)\n",
+                policy_names[p], hit_ratio[p], cache.hits_, cache.misses_, cache.evictions_);
+            if(cache.evictions_ == 0 || cache.size() > CACHE_SIZE / FIXED_DATA_NODE_BYTE_SIZE)
+            {
+                SAFE_LOG(PDO_LOG_ERROR, "%s did not replace entries\n", policy_names[p]);
+                throw pdo::error::RuntimeError(std::string(policy_names[p]) + " did not replace entries");
+            }
+            ByteArray new_id;
+            kv_->Finalize(new_id);
+        }
+
+        //the trie nodes near the root and the hot set are re-read all the time, MRU evicts them first
+        for(unsigned int p = 0; p < 4; p++)
+        {
+            if(policies[p] != pstate::STATE_CACHE_POLICY_MRU && hit_ratio[p] <= hit_ratio[1])
+            {
+                SAFE_LOG(PDO_LOG_ERROR, "%s hit ratio not better than MRU\n", policy_names[p]);
+                throw pdo::error::RuntimeError(std::string(policy_names[p]) + " hit ratio not better than MRU");
+            }
+        }
+    }
+    catch (...)
+    {
+        SAFE_LOG(PDO_LOG_ERROR, "error testing KVS replacement policies\n");
+        throw;
+    }
+
+//################## TEST CACHE BUDGET ################################################################################
+    try
+    {
+        SAFE_LOG(PDO_LOG_INFO, "start test cache budget\n");
+        std::string value(FIXED_DATA_NODE_BYTE_SIZE, 'e');
+        unsigned int slot_count = (CACHE_SIZE / FIXED_DATA_NODE_BYTE_SIZE) / 4;
+        pstate::cache_budget budget(slot_count * FIXED_DATA_NODE_BYTE_SIZE);
+        {
+            //a small state only allocates the slots it uses
+            pstate::State_KV small_skv(state_encryption_key_, CACHE_SIZE, &budget);
+            kv_ = &small_skv;
+            _kv_put("a", "a");
+            unsigned int small_slots = small_skv.GetCache().slots_.allocated_slots();
+            if(small_slots > STATE_CACHE_MIN_ITEMS)
+            {
+                SAFE_LOG(PDO_LOG_ERROR, "small state allocated %u slots\n", small_slots);
+                throw;
+            }
+
+            //a large state takes the rest of the budget, and no more
+            pstate::State_KV large_skv(state_encryption_key_, CACHE_SIZE, &budget);
+            kv_ = &large_skv;
+            for(unsigned int i = 0; i < slot_count * 2; i++)
+            {
+                _kv_put("b" + std::to_string(i), value);
+            }
+            if(budget.used_ > budget.limit_ || large_skv.GetCache().slots_.allocated_slots() > slot_count)
+            {
+                SAFE_LOG(PDO_LOG_ERROR, "cache budget exceeded (%lu used)\n", budget.used_);
+                throw;
+            }
+            for(unsigned int i = 0; i < slot_count * 2; i++)
+            {
+                _kv_get("b" + std::to_string(i), value);
+            }
+
+            //a store opened when the budget is exhausted still works
+            kv_ = &small_skv;
+            _kv_put("c", value);
+            _kv_get("a", "a");
+            _kv_get("c", value);
+
+            kv_ = &large_skv;
+            kv_->Finalize(id);
+            kv_ = &small_skv;
+            kv_->Finalize(id);
+        }
+        if(budget.used_ != 0)
+        {
+            SAFE_LOG(PDO_LOG_ERROR, "cache budget not released (%lu used)\n", budget.used_);
+            throw;
+        }
+    }
+    catch (...)
+    {
+        SAFE_LOG(PDO_LOG_ERROR, "error testing KVS cache budget\n");
+        throw;
+    }
+
+//################## TEST NODE CACHE ##################################################################################
+    try
+    {
+        SAFE_LOG(PDO_LOG_INFO, "start test node cache\n");
+        std::string value(FIXED_DATA_NODE_BYTE_SIZE / 2, 'f');
+        pstate::data_node_cache node_cache;
+        pstate::cache_budget budget;
+        budget.node_cache_ = &node_cache;
+        sebio_set({{}, SEBIO_NO_CRYPTO, &custom_fetch, &custom_evict, &custom_evict_many, &custom_fetch_many});
+
+        //the nodes written by one request are decrypted for the next one
+        {
+            pstate::State_KV skv(state_encryption_key_, CACHE_SIZE, &budget);
+            kv_ = &skv;
+            for(char c = 'a'; c <= 'z'; c++)
+            {
+                _kv_put(std::string(1, c), value);
+            }
+            kv_->Finalize(id);
+        }
+        for(unsigned int request = 0; request < 2; request++)
+        {
+            unsigned int old_fetch_calls = fetch_calls;
+            fetch_many_calls = 0;
+            pstate::State_KV skv(id, state_encryption_key_, CACHE_SIZE, &budget);
+            kv_ = &skv;
+            for(char c = 'a'; c <= 'z'; c++)
+            {
+                _kv_get(std::string(1, c), value);
+            }
+            _kv_put("new" + std::to_string(request), value);
+            //only the root block is fetched
+            if(fetch_many_calls != 0 || fetch_calls - old_fetch_calls > 1)
+            {
+                SAFE_LOG(PDO_LOG_ERROR, "data nodes fetched (%u batches, %u single)\n",
+                    fetch_many_calls, fetch_calls - old_fetch_calls);
+                throw;
+            }
+            kv_->Finalize(id);
+        }
+
+        //without the node cache, the state is fetched from the block store
+        {
+            fetch_many_calls = 0;
+            pstate::State_KV skv(id, state_encryption_key_);
+            kv_ = &skv;
+            _kv_get("new1", value);
+            _kv_get("z", value);
+            if(fetch_many_calls == 0)
+            {
+                SAFE_LOG(PDO_LOG_ERROR, "data nodes not fetched\n");
+                throw;
+            }
+            ByteArray new_id;
+            kv_->Finalize(new_id);
+        }
+    }
+    catch (...)
+    {
+        SAFE_LOG(PDO_LOG_ERROR, "error testing KVS node cache\n");
+        throw;
+    }
+    sebio_set({{}, SEBIO_NO_CRYPTO, &sebio_fetch_from_block_store, &sebio_evict_to_block_store});
+
 //################## TEST CACHE EXAUSTION #############################################################################
     try
     {
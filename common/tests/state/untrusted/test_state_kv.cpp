@@ -13,8 +13,17 @@
  * limitations under the License.
  */
 
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <map>
+#include <mutex>
+#include <random>
 #include <string>
+#include <thread>
 #include "test_state_kv.h"
+#include "packages/block_store/block_store.h"
+#include "packages/block_store/lmdb_block_store.h"
 #include "_kv_gen.h"
 #include "test_cache.h"
 
@@ -29,7 +38,76 @@ extern unsigned int evict_calls;
 #define MIN_KEY_LENGTH ((1<<14) - (1<<8))
 #define MAX_KEY_LENGTH (1<<14)
 
-void test_state_kv() {
+//scan the state in pages of page_size pairs, and compare with the expected pairs
+static ByteArray to_byte_array(const std::string& s)
+{
+    return ByteArray(s.begin(), s.end());
+}
+
+static void check_scan(pstate::State_KV& skv, const std::map<std::string, std::string>& expected,
+    const std::string& prefix, const std::string& start, size_t page_size)
+{
+    ByteArray ba_prefix(prefix.begin(), prefix.end());
+    ByteArray ba_start(start.begin(), start.end());
+    pstate::KeyValueArray pairs;
+    bool inclusive = true;
+    while(1)
+    {
+        pstate::KeyValueArray page;
+        skv.Scan(ba_prefix, ba_start, inclusive, page_size, page);
+        pairs.insert(pairs.end(), page.begin(), page.end());
+        if(page.size() < page_size)
+            break;
+        ba_start = page.back().first;
+        inclusive = false;
+    }
+
+    std::map<std::string, std::string>::const_iterator it = expected.lower_bound(std::max(start, prefix));
+    for(size_t i = 0; i < pairs.size(); i++, it++)
+    {
+        std::string key(pairs[i].first.begin(), pairs[i].first.end());
+        std::string value(pairs[i].second.begin(), pairs[i].second.end());
+        if(it == expected.end() || key.compare(0, prefix.size(), prefix) != 0 || key != it->first || value != it->second)
+        {
+            SAFE_LOG(PDO_LOG_ERROR, "scan of prefix %s from %s, unexpected key %s\n",
+                prefix.c_str(), start.c_str(), key.c_str());
+            throw pdo::error::RuntimeError("error");
+        }
+    }
+    if(it != expected.end() && it->first.compare(0, prefix.size(), prefix) == 0)
+    {
+        SAFE_LOG(PDO_LOG_ERROR, "scan of prefix %s from %s, missing key %s\n",
+            prefix.c_str(), start.c_str(), it->first.c_str());
+        throw pdo::error::RuntimeError("error");
+    }
+}
+
+//move the blocks to the shards they are routed to in steps of batch_size blocks, and check that all the blocks can be read
+static size_t rebalance_and_check(const std::vector<ByteArray>& ids, const std::vector<ByteArray>& blocks, size_t batch_size)
+{
+    size_t moved = 0, moved_count;
+    bool complete = false;
+    while(! complete)
+    {
+        if(pdo::lmdb_block_store::BlockStoreRebalance(batch_size, &moved_count, &complete) != PDO_SUCCESS)
+        {
+            SAFE_LOG(PDO_LOG_ERROR, "failed to rebalance blocks\n");
+            throw pdo::error::RuntimeError("error");
+        }
+        moved += moved_count;
+    }
+
+    std::vector<ByteArray> values;
+    if(pdo::block_store::BlockStoreGetMany(ids, values) != PDO_SUCCESS || values != blocks)
+    {
+        SAFE_LOG(PDO_LOG_ERROR, "failed to get the moved blocks\n");
+        throw pdo::error::RuntimeError("error");
+    }
+
+    return moved;
+}
+
+void test_state_kv(const std::string& db_path) {
     init_test_cache();
 
     ByteArray emptyId;
@@ -436,6 +514,1233 @@ void test_state_kv() {
         throw;
     }
 
+//################## TEST BLOCK INDEX #################################################################################
+    try
+    {
+        SAFE_LOG(PDO_LOG_INFO, "start test block index\n");
+        //each value takes a block, so the block ids span a few index blocks
+        std::string value(FIXED_DATA_NODE_BYTE_SIZE, 'i');
+        std::string new_value(FIXED_DATA_NODE_BYTE_SIZE, 'j');
+        unsigned int key_count = 3 * STATE_BLOCK_INDEX_FANOUT;
+        {
+            pstate::State_KV skv(state_encryption_key_);
+            kv_ = &skv;
+            for(unsigned int i = 0; i < key_count; i++)
+            {
+                _kv_put("i" + std::to_string(i), value);
+            }
+            kv_->Finalize(id);
+            if(skv.GetBlockWarehouse().get_index_depth() == 0)
+            {
+                SAFE_LOG(PDO_LOG_ERROR, "large state has no index blocks\n");
+                throw pdo::error::RuntimeError("error");
+            }
+        }
+
+        //an update loads and writes only the index blocks it needs
+        {
+            pstate::State_KV skv(id, state_encryption_key_);
+            kv_ = &skv;
+            pstate::block_warehouse& bw = skv.GetBlockWarehouse();
+            unsigned int open_loads = bw.loaded_index_blocks_;
+            _kv_get("i0", value);
+            _kv_put("i0", new_value);
+            kv_->Finalize(id);
+            if(open_loads != 1 || bw.loaded_index_blocks_ > 2 || bw.written_index_blocks_ > 2)
+            {
+                SAFE_LOG(PDO_LOG_ERROR, "index blocks: %u loaded on open, %u loaded, %u written\n",
+                    open_loads, bw.loaded_index_blocks_, bw.written_index_blocks_);
+                throw pdo::error::RuntimeError("error");
+            }
+        }
+
+        //a version 1 root block is still readable, and it is converted on update
+        pstate::StateBlockIdArray ids;
+        {
+            ByteArray same_id;
+            pstate::State_KV skv(id, state_encryption_key_);
+            kv_ = &skv;
+            kv_->Finalize(same_id);
+            skv.GetBlockWarehouse().get_datablock_ids(ids);
+        }
+        pstate::StateNode legacy_root;
+        for(unsigned int i = 0; i < ids.size(); i++)
+        {
+            legacy_root.AppendChildId(ids[i]);
+        }
+        legacy_root.BlockifyChildren(state_encryption_key_);
+        ByteArray legacy_id;
+        if(sebio_evict(legacy_root.GetBlock(), SEBIO_NO_CRYPTO, legacy_id) != STATE_SUCCESS)
+        {
+            SAFE_LOG(PDO_LOG_ERROR, "failed to store legacy root block\n");
+            throw pdo::error::RuntimeError("error");
+        }
+        {
+            pstate::State_KV skv(legacy_id, state_encryption_key_);
+            kv_ = &skv;
+            _kv_get("i0", new_value);
+            _kv_get("i1", value);
+            _kv_put("legacy", "legacy");
+            kv_->Finalize(id);
+        }
+        pstate::StateBlock root_block;
+        if(sebio_fetch(id, SEBIO_NO_CRYPTO, root_block) != STATE_SUCCESS
+            || std::string(root_block.begin(), root_block.begin() + 4) != STATE_ROOT_BLOCK_MAGIC)
+        {
+            SAFE_LOG(PDO_LOG_ERROR, "legacy state not converted\n");
+            throw pdo::error::RuntimeError("error");
+        }
+        {
+            ByteArray same_id;
+            pstate::State_KV skv(id, state_encryption_key_);
+            kv_ = &skv;
+            _kv_get("legacy", "legacy");
+            _kv_get("i0", new_value);
+            for(unsigned int i = 1; i < key_count; i++)
+            {
+                _kv_get("i" + std::to_string(i), value);
+            }
+            kv_->Finalize(same_id);
+        }
+    }
+    catch (...)
+    {
+        SAFE_LOG(PDO_LOG_ERROR, "error testing KVS block index\n");
+        throw;
+    }
+
+//################## TEST TRIE SIBLING LISTS ##########################################################################
+    try
+    {
+        SAFE_LOG(PDO_LOG_INFO, "start test trie sibling lists\n");
+        //a state written with sibling lists is updated with branch nodes
+        {
+            pstate::State_KV skv(state_encryption_key_);
+            skv.GetDataNodeIO().trie_branch_nodes_ = false;
+            kv_ = &skv;
+            for(char c = 'a'; c <= 'z'; c++)
+            {
+                _kv_put(std::string(1, c), std::string(1, c));
+                _kv_put(std::string(2, c), std::string(2, c));
+            }
+            kv_->Finalize(id);
+        }
+        {
+            pstate::State_KV skv(id, state_encryption_key_);
+            kv_ = &skv;
+            for(char c = 'a'; c <= 'z'; c++)
+            {
+                _kv_put(std::string(1, c) + "_", "_");
+                _kv_put(std::string(1, c - 'a' + 'A'), "X");
+            }
+            for(char c = 'a'; c <= 'z'; c += 2)
+            {
+                _kv_delete(std::string(1, c));
+            }
+            kv_->Finalize(id);
+        }
+        {
+            pstate::State_KV skv(id, state_encryption_key_);
+            kv_ = &skv;
+            for(char c = 'a'; c <= 'z'; c++)
+            {
+                _kv_get(std::string(1, c), (c - 'a') % 2 ? std::string(1, c) : "");
+                _kv_get(std::string(2, c), std::string(2, c));
+                _kv_get(std::string(1, c) + "_", "_");
+                _kv_get(std::string(1, c - 'a' + 'A'), "X");
+            }
+            kv_->Finalize(id);
+        }
+    }
+    catch (...)
+    {
+        SAFE_LOG(PDO_LOG_ERROR, "error testing trie sibling lists\n");
+        throw;
+    }
+
+//################## TEST ORDERED SCAN ###############################################################################
+    try
+    {
+        SAFE_LOG(PDO_LOG_INFO, "start test ordered scan\n");
+        //same scans over sibling lists and branch nodes, before and after the state is reopened
+        for(int branch_nodes = 0; branch_nodes < 2; branch_nodes++)
+        {
+            std::map<std::string, std::string> expected;
+            {
+                pstate::State_KV skv(state_encryption_key_);
+                skv.GetDataNodeIO().trie_branch_nodes_ = branch_nodes;
+                kv_ = &skv;
+                for(unsigned int i = 0; i < 300; i += 3)
+                {
+                    std::string n = std::to_string(i);
+                    expected["s" + std::string(3 - n.size(), '0') + n] = n;
+                    expected["s" + n] = n;
+                    expected["t" + n + std::string(20, 't')] = n;
+                }
+                expected[""] = "empty";
+                expected["s"] = "s";
+                expected["r"] = "r";
+                for(auto& kv : expected)
+                {
+                    _kv_put(kv.first, kv.second);
+                }
+                check_scan(skv, expected, "", "", 1000);
+                check_scan(skv, expected, "s", "", 7);
+                check_scan(skv, expected, "s1", "", 1);
+                check_scan(skv, expected, "s", "s150", 10);
+                check_scan(skv, expected, "t", "t1", 4);
+                check_scan(skv, expected, "", "s2", 16);
+                check_scan(skv, expected, "u", "", 10);
+                kv_->Finalize(id);
+            }
+            {
+                pstate::State_KV skv(id, state_encryption_key_);
+                kv_ = &skv;
+                for(unsigned int i = 0; i < 300; i += 6)
+                {
+                    std::string n = std::to_string(i);
+                    _kv_delete("s" + n);
+                    expected.erase("s" + n);
+                }
+                _kv_delete("");
+                expected.erase("");
+                check_scan(skv, expected, "", "", 5);
+                check_scan(skv, expected, "s", "s1", 3);
+                kv_->Finalize(id);
+            }
+        }
+    }
+    catch (...)
+    {
+        SAFE_LOG(PDO_LOG_ERROR, "error testing ordered scan\n");
+        throw;
+    }
+
+//################## TEST INLINE VALUES ##############################################################################
+    try
+    {
+        SAFE_LOG(PDO_LOG_INFO, "start test inline values\n");
+        std::string small(TRIE_INLINE_VALUE_MAX_SIZE, 's');
+        std::string large(TRIE_INLINE_VALUE_MAX_SIZE + 1, 'l');
+        //a state written without inline values is updated with them
+        {
+            pstate::State_KV skv(state_encryption_key_);
+            skv.GetDataNodeIO().trie_inline_values_ = false;
+            kv_ = &skv;
+            for(unsigned int i = 0; i < 50; i++)
+            {
+                _kv_put("inline." + std::to_string(i), i % 2 ? small : large);
+            }
+            kv_->Finalize(id);
+        }
+        {
+            pstate::State_KV skv(id, state_encryption_key_);
+            kv_ = &skv;
+            for(unsigned int i = 0; i < 50; i++)
+            {
+                _kv_get("inline." + std::to_string(i), i % 2 ? small : large);
+                //small to large, large to small, and a few deleted
+                if(i % 5 == 0)
+                    _kv_delete("inline." + std::to_string(i));
+                else
+                    _kv_put("inline." + std::to_string(i), i % 2 ? large : small);
+            }
+            _kv_put("inline.x", "x");
+            _kv_put("inline.x", "");
+            kv_->Finalize(id);
+        }
+        {
+            pstate::State_KV skv(id, state_encryption_key_);
+            kv_ = &skv;
+            for(unsigned int i = 0; i < 50; i++)
+            {
+                std::string expected = (i % 5 == 0 ? "" : (i % 2 ? large : small));
+                std::string key = "inline." + std::to_string(i);
+                _kv_get(key, expected);
+                ByteArray ba_key(key.begin(), key.end());
+                ByteArray buffer(expected.size() + 1);
+                if(skv.GetSize(ba_key) != expected.size() ||
+                    skv.GetInto(ba_key, buffer.data(), buffer.size()) != expected.size() ||
+                    ! std::equal(expected.begin(), expected.end(), buffer.begin()))
+                {
+                    SAFE_LOG(PDO_LOG_ERROR, "wrong value %s read into buffer\n", key.c_str());
+                    throw pdo::error::RuntimeError("error");
+                }
+            }
+            _kv_get("inline.x", "");
+            kv_->Finalize(id);
+        }
+    }
+    catch (...)
+    {
+        SAFE_LOG(PDO_LOG_ERROR, "error testing inline values\n");
+        throw;
+    }
+
+//################## TEST READ INTO BUFFER ###########################################################################
+    try
+    {
+        SAFE_LOG(PDO_LOG_INFO, "start test read into buffer\n");
+        pstate::State_KV skv(state_encryption_key_);
+        kv_ = &skv;
+        std::vector<size_t> sizes = {1, 100, FIXED_DATA_NODE_BYTE_SIZE, 3 * FIXED_DATA_NODE_BYTE_SIZE + 17};
+        for(size_t size : sizes)
+        {
+            std::string key = "read." + std::to_string(size);
+            ByteArray value(size);
+            for(size_t i = 0; i < size; i++)
+            {
+                value[i] = (uint8_t)(i * 7 + size);
+            }
+            kv_->Put(ByteArray(key.begin(), key.end()), value);
+        }
+        for(size_t size : sizes)
+        {
+            std::string key = "read." + std::to_string(size);
+            ByteArray ba_key(key.begin(), key.end());
+            ByteArray value = kv_->Get(ba_key);
+            if(skv.GetSize(ba_key) != size || value.size() != size)
+            {
+                SAFE_LOG(PDO_LOG_ERROR, "wrong size of value %s\n", key.c_str());
+                throw pdo::error::RuntimeError("error");
+            }
+
+            //whole value, then in pieces that cross data nodes
+            ByteArray buffer(size + 10, 0);
+            if(skv.GetInto(ba_key, buffer.data(), buffer.size()) != size ||
+                ! std::equal(value.begin(), value.end(), buffer.begin()))
+            {
+                SAFE_LOG(PDO_LOG_ERROR, "wrong value %s read into buffer\n", key.c_str());
+                throw pdo::error::RuntimeError("error");
+            }
+            ByteArray pieces;
+            size_t offset = 0, copied;
+            ByteArray piece(1000);
+            while((copied = skv.GetInto(ba_key, piece.data(), piece.size(), offset)) > 0)
+            {
+                pieces.insert(pieces.end(), piece.begin(), piece.begin() + copied);
+                offset += copied;
+            }
+            if(pieces != value)
+            {
+                SAFE_LOG(PDO_LOG_ERROR, "wrong value %s read in pieces\n", key.c_str());
+                throw pdo::error::RuntimeError("error");
+            }
+        }
+        std::string missing = "read.missing";
+        ByteArray ba_missing(missing.begin(), missing.end());
+        uint8_t byte;
+        if(skv.GetSize(ba_missing) != 0 || skv.GetInto(ba_missing, &byte, 1) != 0)
+        {
+            SAFE_LOG(PDO_LOG_ERROR, "missing key has a value\n");
+            throw pdo::error::RuntimeError("error");
+        }
+        kv_->Finalize(id);
+    }
+    catch (...)
+    {
+        SAFE_LOG(PDO_LOG_ERROR, "error testing read into buffer\n");
+        throw;
+    }
+
+//################## TEST BATCHED OPERATIONS #########################################################################
+    try
+    {
+        SAFE_LOG(PDO_LOG_INFO, "start test batched operations\n");
+        for(int branch_nodes = 0; branch_nodes < 2; branch_nodes++)
+        {
+            pstate::State_KV skv(state_encryption_key_);
+            skv.GetDataNodeIO().trie_branch_nodes_ = branch_nodes;
+            kv_ = &skv;
+
+            //put in reverse order, with a repeated key whose last value is kept
+            pstate::KeyValueArray pairs;
+            for(int i = 199; i >= 0; i--)
+            {
+                std::string key = "batch." + std::to_string(i % 10) + "." + std::to_string(i);
+                pairs.emplace_back(ByteArray(key.begin(), key.end()), ByteArray(key.rbegin(), key.rend()));
+            }
+            pairs.emplace_back(pairs[0].first, ByteArray(1, 'x'));
+            skv.PutMany(pairs);
+            pairs.pop_back();
+            pairs[0].second = ByteArray(1, 'x');
+
+            //get with missing and repeated keys, each trie level is read once for all the keys
+            std::vector<ByteArray> keys;
+            for(size_t i = 0; i < pairs.size(); i += 3)
+            {
+                keys.push_back(pairs[i].first);
+                ByteArray missing = pairs[i].first;
+                missing.push_back('m');
+                keys.push_back(missing);
+            }
+            keys.push_back(pairs[3].first);
+            keys.push_back(ByteArray());
+
+            unsigned int reads = skv.GetDataNodeIO().trie_node_reads_;
+            std::vector<ByteArray> values;
+            skv.GetMany(keys, values);
+            unsigned int batch_reads = skv.GetDataNodeIO().trie_node_reads_ - reads;
+
+            reads = skv.GetDataNodeIO().trie_node_reads_;
+            for(size_t i = 0; i < keys.size(); i++)
+            {
+                if(values[i] != kv_->Get(keys[i]))
+                {
+                    SAFE_LOG(PDO_LOG_ERROR, "batched get returns a different value for key %zu\n", i);
+                    throw pdo::error::RuntimeError("error");
+                }
+            }
+            unsigned int single_reads = skv.GetDataNodeIO().trie_node_reads_ - reads;
+            if(values[0] != pairs[0].second || batch_reads >= single_reads)
+            {
+                SAFE_LOG(PDO_LOG_ERROR, "batched get, %u node reads, %u node reads for single gets\n",
+                    batch_reads, single_reads);
+                throw pdo::error::RuntimeError("error");
+            }
+
+            //delete half of the keys
+            std::vector<ByteArray> deleted;
+            for(size_t i = 0; i < pairs.size(); i += 2)
+            {
+                deleted.push_back(pairs[i].first);
+            }
+            skv.DeleteMany(deleted);
+            for(size_t i = 0; i < pairs.size(); i++)
+            {
+                std::string key(pairs[i].first.begin(), pairs[i].first.end());
+                std::string value(pairs[i].second.begin(), pairs[i].second.end());
+                _kv_get(key, i % 2 ? value : "");
+            }
+            kv_->Finalize(id);
+        }
+    }
+    catch (...)
+    {
+        SAFE_LOG(PDO_LOG_ERROR, "error testing batched operations\n");
+        throw;
+    }
+
+//################## TEST FREE SPACE CHURN ######################################################################
+    try
+    {
+        SAFE_LOG(PDO_LOG_INFO, "start test free space churn\n");
+        //a collection of separate items takes several data nodes, and it is read back as it was
+        {
+            pstate::free_space_collector fsc;
+            pstate::block_offset_t bo = {1, pstate::data_node::data_begin_index()};
+            for(unsigned int i = 0; i < 3000; i++)
+            {
+                fsc.collect(bo, 12);
+                pstate::data_node::advance_block_offset(bo, 24);
+            }
+            std::vector<ByteArray> fsc_data_nodes;
+            fsc.serialize(fsc_data_nodes);
+
+            pstate::free_space_collector loaded_fsc;
+            unsigned int data_nodes = 0;
+            for(unsigned int n = fsc_data_nodes.size(); n > 0; n--)
+            {
+                pstate::data_node dn(n);
+                pstate::block_offset_t dn_bo = {n, pstate::data_node::data_begin_index()};
+                dn.write_at(fsc_data_nodes[n - 1], 0, dn_bo);
+                unsigned int dn_data_nodes = loaded_fsc.deserialize_from_data_node(dn);
+                if(n == fsc_data_nodes.size())
+                    data_nodes = dn_data_nodes;
+            }
+            if(fsc_data_nodes.size() < 2 || data_nodes != fsc_data_nodes.size() ||
+                fsc.free_items() != 3000 || loaded_fsc.free_items() != 3000 ||
+                loaded_fsc.free_bytes() != 3000 * 12 || loaded_fsc.largest_free_item() != 12)
+            {
+                SAFE_LOG(PDO_LOG_ERROR, "free space collection not read back, %zu items in %zu data nodes\n",
+                    loaded_fsc.free_items(), fsc_data_nodes.size());
+                throw pdo::error::RuntimeError("error");
+            }
+
+            //adjacent items are merged, and the smallest item that fits is allocated
+            bo = {1, pstate::data_node::data_begin_index() + 12};
+            loaded_fsc.collect(bo, 12);
+            pstate::block_offset_t out_bo;
+            if(! loaded_fsc.allocate(20, out_bo) ||
+                out_bo.bytes != pstate::data_node::data_begin_index() ||
+                loaded_fsc.free_items() != 2999 ||
+                loaded_fsc.largest_free_item() != 16 ||
+                ! loaded_fsc.allocate(12, out_bo) ||
+                out_bo.bytes != pstate::data_node::data_begin_index() + 48 ||
+                loaded_fsc.allocate(17, out_bo) ||
+                loaded_fsc.fragmentation() <= 0.99)
+            {
+                SAFE_LOG(PDO_LOG_ERROR, "free space allocation error\n");
+                throw pdo::error::RuntimeError("error");
+            }
+        }
+
+        //a state with many holes keeps all of them across finalize and reopen
+        {
+            pstate::State_KV skv(state_encryption_key_);
+            for(unsigned int i = 0; i < 3000; i++)
+                skv.Put(to_byte_array("hole." + std::to_string(i)), ByteArray(100, 'h'));
+            for(unsigned int i = 0; i < 3000; i += 2)
+                skv.Delete(to_byte_array("hole." + std::to_string(i)));
+            skv.Finalize(id);
+        }
+
+        //random puts and deletes of values of random size, the state is checked and
+        //reopened after each round
+        std::mt19937 rng(11);
+        std::map<std::string, std::string> expected;
+        unsigned int rounds = 20, keys = 400, operations = 500;
+        unsigned int blocks_after_warmup = 0, blocks = 0;
+        for(unsigned int round = 0; round < rounds; round++)
+        {
+            uint64_t free_bytes;
+            {
+                pstate::State_KV skv(id, state_encryption_key_);
+                if(round == 0 && skv.GetDataNodeIO().free_space_collector_.original_block_ids_of_collection.size() < 2)
+                {
+                    SAFE_LOG(PDO_LOG_ERROR, "free space collection expected in several data nodes\n");
+                    throw pdo::error::RuntimeError("error");
+                }
+                for(unsigned int i = 0; i < operations; i++)
+                {
+                    std::string key = "churn." + std::to_string(rng() % keys);
+                    if(rng() % 5 < 3)
+                    {
+                        std::string value(1 + rng() % 700, 'a' + rng() % 26);
+                        skv.Put(to_byte_array(key), to_byte_array(value));
+                        expected[key] = value;
+                    }
+                    else
+                    {
+                        skv.Delete(to_byte_array(key));
+                        expected.erase(key);
+                    }
+                }
+                skv.Finalize(id);
+                free_bytes = skv.GetDataNodeIO().free_space_collector_.free_bytes();
+            }
+            {
+                pstate::State_KV skv(id, state_encryption_key_);
+                pstate::data_node_io& dn_io = skv.GetDataNodeIO();
+                for(unsigned int k = 0; k < keys; k++)
+                {
+                    std::string key = "churn." + std::to_string(k);
+                    ByteArray value = skv.Get(to_byte_array(key));
+                    auto it = expected.find(key);
+                    if(value != (it == expected.end() ? ByteArray() : to_byte_array(it->second)))
+                    {
+                        SAFE_LOG(PDO_LOG_ERROR, "wrong value of %s after round %u\n", key.c_str(), round);
+                        throw pdo::error::RuntimeError("error");
+                    }
+                }
+                if(dn_io.free_space_collector_.free_bytes() != free_bytes)
+                {
+                    SAFE_LOG(PDO_LOG_ERROR, "free space lost across reopen, %lu bytes, %lu expected\n",
+                        dn_io.free_space_collector_.free_bytes(), free_bytes);
+                    throw pdo::error::RuntimeError("error");
+                }
+                blocks = dn_io.block_warehouse_.get_last_block_num() + 1;
+                if(round == rounds / 2)
+                    blocks_after_warmup = blocks;
+                SAFE_LOG(PDO_LOG_INFO, "churn round %u: %u data blocks, %lu free bytes in %zu items, fragmentation %.2f\n",
+                    round, blocks, free_bytes, dn_io.free_space_collector_.free_items(),
+                    dn_io.free_space_collector_.fragmentation());
+                skv.Finalize(id);
+            }
+        }
+        //once the holes are in use, the state stops growing
+        if(blocks > blocks_after_warmup + 2)
+        {
+            SAFE_LOG(PDO_LOG_ERROR, "state grows under churn, %u data blocks, %u after warmup\n",
+                blocks, blocks_after_warmup);
+            throw pdo::error::RuntimeError("error");
+        }
+    }
+    catch (...)
+    {
+        SAFE_LOG(PDO_LOG_ERROR, "error testing free space churn\n");
+        throw;
+    }
+
+//################## TEST COMPACTION ######################################################################
+    try
+    {
+        SAFE_LOG(PDO_LOG_INFO, "start test compaction\n");
+        //a state full of holes, with values of many sizes
+        std::mt19937 rng(13);
+        std::map<std::string, std::string> expected;
+        ByteArray fragmented_id;
+        {
+            pstate::State_KV skv(state_encryption_key_);
+            for(unsigned int i = 0; i < 2000; i++)
+            {
+                std::string key = "compact." + std::to_string(i);
+                expected[key] = std::string(1 + rng() % 300, 'a' + i % 26);
+                skv.Put(to_byte_array(key), to_byte_array(expected[key]));
+            }
+            for(unsigned int i = 0; i < 2000; i++)
+            {
+                std::string key = "compact." + std::to_string(i);
+                if(i % 3 != 0)
+                {
+                    skv.Delete(to_byte_array(key));
+                    expected.erase(key);
+                }
+            }
+            skv.Finalize(fragmented_id);
+        }
+
+        ByteArray compacted_id;
+        unsigned int fragmented_blocks, compacted_blocks;
+        {
+            pstate::State_KV skv(fragmented_id, state_encryption_key_);
+            fragmented_blocks = skv.GetBlockWarehouse().get_last_block_num() + 1;
+            skv.Compact(compacted_id);
+        }
+        for(unsigned int pass = 0; pass < 2; pass++)
+        {
+            //the compacted state has the same pairs, and it can be updated
+            pstate::State_KV skv(compacted_id, state_encryption_key_);
+            compacted_blocks = skv.GetBlockWarehouse().get_last_block_num() + 1;
+            check_scan(skv, expected, "", "", 100);
+            std::string key = "compact.new." + std::to_string(pass);
+            expected[key] = key;
+            skv.Put(to_byte_array(key), to_byte_array(key));
+            skv.Finalize(compacted_id);
+        }
+        {
+            pstate::State_KV skv(fragmented_id, state_encryption_key_);
+            expected.erase("compact.new.0");
+            expected.erase("compact.new.1");
+            check_scan(skv, expected, "", "", 100);
+        }
+        if(compacted_blocks * 2 > fragmented_blocks)
+        {
+            SAFE_LOG(PDO_LOG_ERROR, "compaction from %u to %u data blocks\n", fragmented_blocks, compacted_blocks);
+            throw pdo::error::RuntimeError("error");
+        }
+
+        //an empty state is compacted too
+        {
+            pstate::State_KV skv(state_encryption_key_);
+            skv.Compact(compacted_id);
+        }
+        {
+            pstate::State_KV skv(compacted_id, state_encryption_key_);
+            check_scan(skv, std::map<std::string, std::string>(), "", "", 100);
+        }
+    }
+    catch (...)
+    {
+        SAFE_LOG(PDO_LOG_ERROR, "error testing compaction\n");
+        throw;
+    }
+
+//################## TEST DATA NODE COMPRESSION ######################################################################
+    try
+    {
+        SAFE_LOG(PDO_LOG_INFO, "start test data node compression\n");
+        //round trip of random, repetitive and short buffers
+        std::mt19937 rng(7);
+        std::vector<ByteArray> buffers;
+        ByteArray random_buffer(FIXED_DATA_NODE_BYTE_SIZE);
+        for(auto& b : random_buffer)
+            b = rng();
+        buffers.push_back(random_buffer);
+        buffers.push_back(ByteArray(FIXED_DATA_NODE_BYTE_SIZE, 0));
+        std::string json;
+        while(json.size() < FIXED_DATA_NODE_BYTE_SIZE)
+            json += "{\"account\":\"" + std::to_string(rng() % 1000) + "\",\"balance\":" + std::to_string(rng() % 100) + "},";
+        buffers.push_back(ByteArray(json.begin(), json.end()));
+        for(size_t size = 0; size < 40; size++)
+            buffers.push_back(ByteArray(json.begin(), json.begin() + size));
+        //one compressor for all the buffers, its table is reused
+        pstate::block_compressor compressor;
+        for(const ByteArray& buffer : buffers)
+        {
+            ByteArray compressed, decompressed;
+            if(! compressor.compress(buffer.data(), buffer.size(), compressed))
+                continue;
+            pstate::decompress_block(compressed.data(), compressed.size(), buffer.size(), decompressed);
+            if(decompressed != buffer || compressed.size() >= buffer.size())
+            {
+                SAFE_LOG(PDO_LOG_ERROR, "compression round trip failed, size %zu\n", buffer.size());
+                throw pdo::error::RuntimeError("error");
+            }
+        }
+        {
+            ByteArray compressed, decompressed;
+            if(compressor.compress(random_buffer.data(), random_buffer.size(), compressed) ||
+                ! compressor.compress(buffers[1].data(), buffers[1].size(), compressed))
+            {
+                SAFE_LOG(PDO_LOG_ERROR, "unexpected compression result\n");
+                throw pdo::error::RuntimeError("error");
+            }
+            bool invalid_detected = false;
+            try
+            {
+                pstate::decompress_block(compressed.data(), compressed.size() - 1, buffers[1].size(), decompressed);
+            }
+            catch(const pdo::error::ValueError& e)
+            {
+                invalid_detected = true;
+            }
+            if(! invalid_detected)
+            {
+                SAFE_LOG(PDO_LOG_ERROR, "truncated compressed block not detected\n");
+                throw pdo::error::RuntimeError("error");
+            }
+        }
+
+        //a state with uncompressed nodes (the default) is updated with compressed ones by a state
+        //that opts in, values are JSON like
+        std::string value = json.substr(0, 200);
+        double uncompressed_bytes_per_node;
+        {
+            pstate::State_KV skv(state_encryption_key_);
+            kv_ = &skv;
+            for(unsigned int i = 0; i < 200; i++)
+                _kv_put("zip." + std::to_string(i), value);
+            kv_->Finalize(id);
+            const pstate::Cache& cache = skv.GetCache();
+            uncompressed_bytes_per_node = (double)cache.written_bytes_ / cache.written_nodes_;
+        }
+        double compressed_bytes_per_node;
+        {
+            pstate::State_KV skv(id, state_encryption_key_);
+            skv.SetDataNodeCompression(true);
+            kv_ = &skv;
+            for(unsigned int i = 0; i < 200; i += 2)
+                _kv_put("zip." + std::to_string(i), value + "+");
+            kv_->Finalize(id);
+            const pstate::Cache& cache = skv.GetCache();
+            compressed_bytes_per_node = (double)cache.written_bytes_ / cache.written_nodes_;
+        }
+        {
+            pstate::State_KV skv(id, state_encryption_key_);
+            kv_ = &skv;
+            for(unsigned int i = 0; i < 200; i++)
+                _kv_get("zip." + std::to_string(i), i % 2 ? value : value + "+");
+            kv_->Finalize(id);
+        }
+        if(uncompressed_bytes_per_node < FIXED_DATA_NODE_BYTE_SIZE ||
+            compressed_bytes_per_node >= uncompressed_bytes_per_node / 2)
+        {
+            SAFE_LOG(PDO_LOG_ERROR, "data nodes written in %f bytes, %f bytes compressed\n",
+                uncompressed_bytes_per_node, compressed_bytes_per_node);
+            throw pdo::error::RuntimeError("error");
+        }
+    }
+    catch (...)
+    {
+        SAFE_LOG(PDO_LOG_ERROR, "error testing data node compression\n");
+        throw;
+    }
+
+//################## TEST BLOCK STORE GROUP COMMIT ###################################################################
+    try
+    {
+        SAFE_LOG(PDO_LOG_INFO, "start test block store group commit\n");
+        //concurrent puts of single blocks and of lists of blocks, half of the blocks are shared by all threads
+        const unsigned int thread_count = 4;
+        const unsigned int block_count = 64;
+        std::vector<std::vector<ByteArray>> ids(thread_count), blocks(thread_count);
+        for(unsigned int t = 0; t < thread_count; t++)
+        {
+            for(unsigned int i = 0; i < block_count; i++)
+            {
+                std::string s = "group commit block " + std::to_string(i % 2 ? t : thread_count) + " " + std::to_string(i);
+                blocks[t].push_back(to_byte_array(s));
+                ids[t].push_back(pdo::crypto::ComputeMessageHash(blocks[t].back()));
+            }
+        }
+        std::vector<pdo_err_t> results(thread_count, PDO_SUCCESS);
+        std::vector<std::thread> threads;
+        for(unsigned int t = 0; t < thread_count; t++)
+        {
+            threads.push_back(std::thread([&, t]() {
+                for(unsigned int i = 0; i < block_count / 2 && results[t] == PDO_SUCCESS; i++)
+                    results[t] = pdo::block_store::BlockStorePut(ids[t][i], blocks[t][i]);
+                std::vector<ByteArray> many_ids(ids[t].begin() + block_count / 2, ids[t].end());
+                std::vector<ByteArray> many_blocks(blocks[t].begin() + block_count / 2, blocks[t].end());
+                if(results[t] == PDO_SUCCESS)
+                    results[t] = pdo::block_store::BlockStorePutMany(many_ids, many_blocks);
+            }));
+        }
+        for(auto& thread : threads)
+            thread.join();
+        for(unsigned int t = 0; t < thread_count; t++)
+        {
+            if(results[t] != PDO_SUCCESS)
+            {
+                SAFE_LOG(PDO_LOG_ERROR, "concurrent put failed; %d\n", results[t]);
+                throw pdo::error::RuntimeError("error");
+            }
+            for(unsigned int i = 0; i < block_count; i++)
+            {
+                ByteArray block;
+                if(pdo::block_store::BlockStoreGet(ids[t][i], block) != PDO_SUCCESS || block != blocks[t][i])
+                {
+                    SAFE_LOG(PDO_LOG_ERROR, "block %u of thread %u not committed\n", i, t);
+                    throw pdo::error::RuntimeError("error");
+                }
+            }
+        }
+
+        //a put of a block that is already present keeps the stored data and metadata
+        pdo::block_store::BlockMetaData before, after;
+        bool present;
+        ByteArray block;
+        ByteArray other_block(blocks[0][0].size(), 'x');
+        pdo::block_store::BlockStoreHead(ids[0][0], &present, &before);
+        if(pdo::block_store::BlockStorePut(ids[0][0], other_block) != PDO_SUCCESS ||
+            pdo::block_store::BlockStoreGet(ids[0][0], block) != PDO_SUCCESS || block != blocks[0][0])
+        {
+            SAFE_LOG(PDO_LOG_ERROR, "put of an existing block rewrote its data\n");
+            throw pdo::error::RuntimeError("error");
+        }
+        pdo::block_store::BlockStoreHead(ids[0][0], &present, &after);
+        if(!present || after.create_time_ != before.create_time_ ||
+            after.expiration_time_ < before.expiration_time_ || after.block_size_ != before.block_size_)
+        {
+            SAFE_LOG(PDO_LOG_ERROR, "put of an existing block changed its metadata\n");
+            throw pdo::error::RuntimeError("error");
+        }
+    }
+    catch (...)
+    {
+        SAFE_LOG(PDO_LOG_ERROR, "error testing block store group commit\n");
+        throw;
+    }
+
+//################## TEST BLOCK STORE READ VIEWS ######################################################################
+    try
+    {
+        SAFE_LOG(PDO_LOG_INFO, "start test block store read views\n");
+        //views of blocks, including from nested transactions, match the blocks that were put
+        std::vector<ByteArray> ids, blocks;
+        for(unsigned int i = 0; i < 8; i++)
+        {
+            blocks.push_back(ByteArray(1 << (i + 8), 'a' + i));
+            ids.push_back(pdo::crypto::ComputeMessageHash(blocks.back()));
+        }
+        if(pdo::block_store::BlockStorePutMany(ids, blocks) != PDO_SUCCESS)
+        {
+            SAFE_LOG(PDO_LOG_ERROR, "failed to put blocks\n");
+            throw pdo::error::RuntimeError("error");
+        }
+
+        pdo::lmdb_block_store::ReadTransaction transaction;
+        std::vector<pdo::lmdb_block_store::BlockView> views(ids.size());
+        for(unsigned int i = 0; i < ids.size(); i++)
+        {
+            pdo::lmdb_block_store::ReadTransaction nested_transaction;
+            pdo::lmdb_block_store::BlockView nested_view;
+            if(transaction.Get(ids[i], views[i]) != PDO_SUCCESS ||
+                nested_transaction.Get(ids[i], nested_view) != PDO_SUCCESS ||
+                nested_view.size_ != blocks[i].size() ||
+                ! std::equal(blocks[i].begin(), blocks[i].end(), nested_view.data_))
+            {
+                SAFE_LOG(PDO_LOG_ERROR, "failed to get view of block %u\n", i);
+                throw pdo::error::RuntimeError("error");
+            }
+        }
+        for(unsigned int i = 0; i < ids.size(); i++)
+        {
+            if(views[i].size_ != blocks[i].size() || ! std::equal(blocks[i].begin(), blocks[i].end(), views[i].data_))
+            {
+                SAFE_LOG(PDO_LOG_ERROR, "view of block %u changed during the transaction\n", i);
+                throw pdo::error::RuntimeError("error");
+            }
+        }
+
+        //a missing block is reported as not found by the view and as a value error by the copying get
+        ByteArray missing_id = pdo::crypto::ComputeMessageHash(to_byte_array("missing block"));
+        pdo::lmdb_block_store::BlockView missing_view;
+        ByteArray missing_block;
+        if(transaction.Get(missing_id, missing_view) != PDO_ERR_NOTFOUND ||
+            pdo::block_store::BlockStoreGet(missing_id, missing_block) != PDO_ERR_VALUE)
+        {
+            SAFE_LOG(PDO_LOG_ERROR, "missing block not reported\n");
+            throw pdo::error::RuntimeError("error");
+        }
+    }
+    catch (...)
+    {
+        SAFE_LOG(PDO_LOG_ERROR, "error testing block store read views\n");
+        throw;
+    }
+
+//################## TEST BLOCK STORE EXPIRATION ######################################################################
+    try
+    {
+        SAFE_LOG(PDO_LOG_INFO, "start test block store expiration\n");
+        //expire all the blocks of the store in bounded batches, keeping the blocks with the live tag
+        std::vector<ByteArray> ids, blocks, live_ids;
+        for(unsigned int i = 0; i < 100; i++)
+        {
+            blocks.push_back(to_byte_array("expiring block " + std::to_string(i)));
+            ids.push_back(pdo::crypto::ComputeMessageHash(blocks.back()));
+            if(i % 2)
+                live_ids.push_back(ids.back());
+        }
+        size_t tagged;
+        const uint64_t live_tag = 7;
+        if(pdo::block_store::BlockStorePutMany(ids, blocks) != PDO_SUCCESS ||
+            pdo::lmdb_block_store::BlockStoreTagBlocks(live_ids, live_tag, &tagged) != PDO_SUCCESS ||
+            tagged != live_ids.size())
+        {
+            SAFE_LOG(PDO_LOG_ERROR, "failed to put and tag blocks\n");
+            throw pdo::error::RuntimeError("error");
+        }
+
+        const uint64_t later = time(NULL) + 3600;
+        const size_t batch_size = 16;
+        size_t expired = 0, expired_count, batches = 0;
+        bool complete = false;
+        while(! complete)
+        {
+            if(pdo::lmdb_block_store::BlockStoreExpireBlocks(later, batch_size, live_tag, &expired_count, &complete) != PDO_SUCCESS ||
+                expired_count > batch_size)
+            {
+                SAFE_LOG(PDO_LOG_ERROR, "failed to expire blocks\n");
+                throw pdo::error::RuntimeError("error");
+            }
+            expired += expired_count;
+            batches++;
+        }
+        SAFE_LOG(PDO_LOG_INFO, "expired %zu blocks in %zu batches\n", expired, batches);
+        for(unsigned int i = 0; i < ids.size(); i++)
+        {
+            bool present;
+            pdo::block_store::BlockMetaData metadata;
+            pdo::block_store::BlockStoreHead(ids[i], &present, &metadata);
+            if(present != (i % 2 == 1) || (present && metadata.expiration_time_ < later))
+            {
+                SAFE_LOG(PDO_LOG_ERROR, "unexpected expiration of block %u\n", i);
+                throw pdo::error::RuntimeError("error");
+            }
+        }
+        if(expired < ids.size() - live_ids.size() || batches < 2)
+        {
+            SAFE_LOG(PDO_LOG_ERROR, "expired %zu blocks in %zu batches\n", expired, batches);
+            throw pdo::error::RuntimeError("error");
+        }
+
+        //without the live tag the extended blocks expire too
+        const uint64_t much_later = later + 2 * MINIMUM_EXPIRATION_TIME;
+        complete = false;
+        while(! complete)
+            pdo::lmdb_block_store::BlockStoreExpireBlocks(much_later, batch_size, 0, &expired_count, &complete);
+        for(unsigned int i = 0; i < live_ids.size(); i++)
+        {
+            bool present;
+            size_t size;
+            pdo::block_store::BlockStoreHead(live_ids[i].data(), live_ids[i].size(), &present, &size);
+            if(present)
+            {
+                SAFE_LOG(PDO_LOG_ERROR, "live block %u did not expire\n", i);
+                throw pdo::error::RuntimeError("error");
+            }
+        }
+    }
+    catch (...)
+    {
+        SAFE_LOG(PDO_LOG_ERROR, "error testing block store expiration\n");
+        throw;
+    }
+
+//################## TEST BLOCK STORE SHARDS ##########################################################################
+    try
+    {
+        SAFE_LOG(PDO_LOG_INFO, "start test block store shards\n");
+        //spread the blocks over several shards and back while they are read from another thread
+        std::vector<ByteArray> ids, blocks;
+        for(unsigned int i = 0; i < 200; i++)
+        {
+            blocks.push_back(to_byte_array("sharded block " + std::to_string(i)));
+            ids.push_back(pdo::crypto::ComputeMessageHash(blocks.back()));
+        }
+        if(pdo::block_store::BlockStorePutMany(ids, blocks) != PDO_SUCCESS)
+        {
+            SAFE_LOG(PDO_LOG_ERROR, "failed to put blocks\n");
+            throw pdo::error::RuntimeError("error");
+        }
+
+        const std::vector<ByteArray> read_ids(ids), read_blocks(blocks);
+        std::atomic<bool> done(false);
+        std::atomic<size_t> missing(0);
+        std::thread reader([&]() {
+            while(! done)
+            {
+                for(unsigned int i = 0; i < read_ids.size(); i++)
+                {
+                    ByteArray value;
+                    if(pdo::block_store::BlockStoreGet(read_ids[i], value) != PDO_SUCCESS || value != read_blocks[i])
+                        missing++;
+                }
+            }
+        });
+
+        const size_t shard_counts[] = {4, 1};
+        for(unsigned int c = 0; c < 2; c++)
+        {
+            pdo::lmdb_block_store::BlockStoreReshard(shard_counts[c]);
+            if(pdo::lmdb_block_store::BlockStoreShardCount() != shard_counts[c])
+            {
+                SAFE_LOG(PDO_LOG_ERROR, "unexpected shard count\n");
+                throw pdo::error::RuntimeError("error");
+            }
+
+            //blocks written during the move go to the new routing
+            blocks.push_back(to_byte_array("sharded block written while moving " + std::to_string(c)));
+            ids.push_back(pdo::crypto::ComputeMessageHash(blocks.back()));
+            pdo::block_store::BlockStorePut(ids.back(), blocks.back());
+
+            size_t moved = 0, moved_count, steps = 0;
+            bool complete = false;
+            while(! complete)
+            {
+                if(pdo::lmdb_block_store::BlockStoreRebalance(16, &moved_count, &complete) != PDO_SUCCESS)
+                {
+                    SAFE_LOG(PDO_LOG_ERROR, "failed to rebalance blocks\n");
+                    throw pdo::error::RuntimeError("error");
+                }
+                moved += moved_count;
+                steps++;
+
+                bool resharded = false;
+                try
+                {
+                    if(! complete)
+                    {
+                        pdo::lmdb_block_store::BlockStoreReshard(2);
+                        resharded = true;
+                    }
+                }
+                catch(pdo::error::RuntimeError& e) {}
+                if(resharded)
+                {
+                    SAFE_LOG(PDO_LOG_ERROR, "reshard allowed while moving blocks\n");
+                    throw pdo::error::RuntimeError("error");
+                }
+            }
+            SAFE_LOG(PDO_LOG_INFO, "moved %zu blocks to %zu shards in %zu steps\n", moved, shard_counts[c], steps);
+            if(moved == 0 || steps < 2)
+            {
+                SAFE_LOG(PDO_LOG_ERROR, "blocks were not moved\n");
+                throw pdo::error::RuntimeError("error");
+            }
+
+            std::vector<ByteArray> values;
+            if(pdo::block_store::BlockStoreGetMany(ids, values) != PDO_SUCCESS || values != blocks)
+            {
+                SAFE_LOG(PDO_LOG_ERROR, "failed to get the moved blocks\n");
+                throw pdo::error::RuntimeError("error");
+            }
+        }
+
+        done = true;
+        reader.join();
+        if(missing != 0)
+        {
+            SAFE_LOG(PDO_LOG_ERROR, "%zu blocks were missing while they were moved\n", missing.load());
+            throw pdo::error::RuntimeError("error");
+        }
+    }
+    catch (...)
+    {
+        SAFE_LOG(PDO_LOG_ERROR, "error testing block store shards\n");
+        throw;
+    }
+
+//################## TEST BLOCK STORE REOPEN WITH SHARDS ##############################################################
+    try
+    {
+        SAFE_LOG(PDO_LOG_INFO, "start test block store reopen with shards\n");
+        //blocks written across shards are committed together, and are kept when the store is reopened with another shard count
+        std::vector<ByteArray> ids, blocks;
+        for(unsigned int i = 0; i < 100; i++)
+        {
+            blocks.push_back(to_byte_array("reopened block " + std::to_string(i)));
+            ids.push_back(pdo::crypto::ComputeMessageHash(blocks.back()));
+        }
+        if(pdo::block_store::BlockStorePutMany(ids, blocks) != PDO_SUCCESS)
+        {
+            SAFE_LOG(PDO_LOG_ERROR, "failed to put blocks\n");
+            throw pdo::error::RuntimeError("error");
+        }
+
+        pdo::lmdb_block_store::BlockStoreClose();
+        pdo::lmdb_block_store::BlockStoreOpen(db_path, false, 4);
+        if(pdo::lmdb_block_store::BlockStoreShardCount() != 4)
+        {
+            SAFE_LOG(PDO_LOG_ERROR, "store not reopened with 4 shards\n");
+            throw pdo::error::RuntimeError("error");
+        }
+
+        //the blocks are read from the shard they were written to until they are moved
+        std::vector<ByteArray> values;
+        size_t moved_count;
+        bool complete;
+        if(pdo::block_store::BlockStoreGetMany(ids, values) != PDO_SUCCESS || values != blocks ||
+            pdo::lmdb_block_store::BlockStoreRebalance(16, &moved_count, &complete) != PDO_SUCCESS || complete)
+        {
+            SAFE_LOG(PDO_LOG_ERROR, "failed to read blocks before they were moved\n");
+            throw pdo::error::RuntimeError("error");
+        }
+
+        //the move continues after the store is reopened, and the shard count cannot change until it is done
+        bool reopened = false;
+        pdo::lmdb_block_store::BlockStoreClose();
+        try
+        {
+            pdo::lmdb_block_store::BlockStoreOpen(db_path, false, 2);
+            reopened = true;
+        }
+        catch(pdo::error::RuntimeError& e) {}
+        if(reopened)
+        {
+            SAFE_LOG(PDO_LOG_ERROR, "shard count changed while moving blocks\n");
+            throw pdo::error::RuntimeError("error");
+        }
+
+        pdo::lmdb_block_store::BlockStoreOpen(db_path);
+        if(pdo::lmdb_block_store::BlockStoreShardCount() != 4)
+        {
+            SAFE_LOG(PDO_LOG_ERROR, "store not reopened with the shard count it was last used with\n");
+            throw pdo::error::RuntimeError("error");
+        }
+        if(rebalance_and_check(ids, blocks, 16) == 0)
+        {
+            SAFE_LOG(PDO_LOG_ERROR, "blocks were not moved after the store was reopened\n");
+            throw pdo::error::RuntimeError("error");
+        }
+
+        //blocks that are routed to several shards are written together
+        for(unsigned int i = 0; i < 100; i++)
+        {
+            blocks.push_back(to_byte_array("block across shards " + std::to_string(i)));
+            ids.push_back(pdo::crypto::ComputeMessageHash(blocks.back()));
+        }
+        if(pdo::block_store::BlockStorePutMany(ids, blocks) != PDO_SUCCESS)
+        {
+            SAFE_LOG(PDO_LOG_ERROR, "failed to put blocks across shards\n");
+            throw pdo::error::RuntimeError("error");
+        }
+
+        pdo::lmdb_block_store::BlockStoreClose();
+        pdo::lmdb_block_store::BlockStoreOpen(db_path, false, 1);
+        if(pdo::lmdb_block_store::BlockStoreShardCount() != 1 || rebalance_and_check(ids, blocks, 64) == 0)
+        {
+            SAFE_LOG(PDO_LOG_ERROR, "blocks were not moved back to a single shard\n");
+            throw pdo::error::RuntimeError("error");
+        }
+    }
+    catch (...)
+    {
+        SAFE_LOG(PDO_LOG_ERROR, "error testing block store reopen with shards\n");
+        throw;
+    }
+
+//################## TEST BLOCK STORE MOVE OF A COPIED BLOCK ##########################################################
+    try
+    {
+        SAFE_LOG(PDO_LOG_INFO, "start test block store move of a copied block\n");
+        //a block that is written again after the shard count changes is in both shards until it is moved; the
+        //moved block keeps the tag and the later expiration time of the two
+        ByteArray block, id;
+        for(unsigned int i = 0; id.empty() || ((id[0] << 8) | id[1]) % 4 == 0; i++)
+        {
+            block = to_byte_array("copied block " + std::to_string(i));
+            id = pdo::crypto::ComputeMessageHash(block);
+        }
+
+        const uint64_t live_tag = 11;
+        const uint64_t later = time(NULL) + 3600;
+        size_t tagged, expired_count;
+        bool complete = false;
+        std::vector<ByteArray> ids(1, id);
+        if(pdo::block_store::BlockStorePut(id, block) != PDO_SUCCESS ||
+            pdo::lmdb_block_store::BlockStoreTagBlocks(ids, live_tag, &tagged) != PDO_SUCCESS)
+        {
+            SAFE_LOG(PDO_LOG_ERROR, "failed to put and tag the block\n");
+            throw pdo::error::RuntimeError("error");
+        }
+        while(! complete)
+            pdo::lmdb_block_store::BlockStoreExpireBlocks(later, 16, live_tag, &expired_count, &complete);
+
+        pdo::lmdb_block_store::BlockStoreReshard(4);
+        if(pdo::block_store::BlockStorePut(id, block) != PDO_SUCCESS)
+        {
+            SAFE_LOG(PDO_LOG_ERROR, "failed to put the block again\n");
+            throw pdo::error::RuntimeError("error");
+        }
+        rebalance_and_check(ids, std::vector<ByteArray>(1, block), 16);
+
+        bool present;
+        pdo::block_store::BlockMetaData metadata;
+        pdo::block_store::BlockStoreHead(id, &present, &metadata);
+        if(! present || metadata.tag_ != live_tag || metadata.expiration_time_ < later)
+        {
+            SAFE_LOG(PDO_LOG_ERROR, "moved block lost its tag or expiration time\n");
+            throw pdo::error::RuntimeError("error");
+        }
+
+        pdo::lmdb_block_store::BlockStoreReshard(1);
+        rebalance_and_check(ids, std::vector<ByteArray>(1, block), 16);
+    }
+    catch (...)
+    {
+        SAFE_LOG(PDO_LOG_ERROR, "error testing block store move of a copied block\n");
+        throw;
+    }
+
+//################## TEST BLOCK STORE READERS #########################################################################
+    try
+    {
+        SAFE_LOG(PDO_LOG_INFO, "start test block store readers\n");
+        //more threads read from the store at once than a shard has reader slots, each thread keeps its read transaction
+        //until all the threads have read
+        const ByteArray block = to_byte_array("block read by many threads");
+        const ByteArray id = pdo::crypto::ComputeMessageHash(block);
+        pdo::block_store::BlockStorePut(id, block);
+
+        const unsigned int thread_count = 600;
+        std::mutex lock;
+        std::condition_variable all_read;
+        unsigned int read_count = 0;
+        std::atomic<unsigned int> failed(0);
+        std::vector<std::thread> readers;
+        for(unsigned int i = 0; i < thread_count; i++)
+        {
+            readers.push_back(std::thread([&]() {
+                ByteArray value;
+                if(pdo::block_store::BlockStoreGet(id, value) != PDO_SUCCESS || value != block)
+                    failed++;
+
+                std::unique_lock<std::mutex> ulock(lock);
+                if(++read_count == thread_count)
+                    all_read.notify_all();
+                while(read_count < thread_count)
+                    all_read.wait(ulock);
+            }));
+        }
+        for(unsigned int i = 0; i < thread_count; i++)
+            readers[i].join();
+
+        if(failed != 0)
+        {
+            SAFE_LOG(PDO_LOG_ERROR, "%u of %u threads failed to read\n", failed.load(), thread_count);
+            throw pdo::error::RuntimeError("error");
+        }
+    }
+    catch (...)
+    {
+        SAFE_LOG(PDO_LOG_ERROR, "error testing block store readers\n");
+        throw;
+    }
+
 //################## TEST CACHE #######################################################################################
     test_cache();
 
@@ -20,4 +20,4 @@
 #include "state.h"
 #include "types.h"
 
-void test_state_kv();
+void test_state_kv(const std::string& db_path);
@@ -23,6 +23,40 @@
 #include "Util.h"
 #include "WasmExtensions.h"
 
+// XXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXX
+// batched operations pass arrays of byte arrays in a single buffer,
+// each item is its length (4 bytes) followed by its bytes
+// XXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXX
+static void pack_byte_array(ww::types::ByteArray& packed, const ww::types::ByteArray& item)
+{
+    uint32_t length = item.size();
+    packed.insert(packed.end(), (uint8_t*)&length, (uint8_t*)&length + sizeof(length));
+    packed.insert(packed.end(), item.begin(), item.end());
+}
+
+static bool unpack_byte_arrays(
+    const uint8_t* buffer,
+    size_t buffer_length,
+    std::vector<ww::types::ByteArray>& items)
+{
+    size_t offset = 0;
+    while (offset < buffer_length)
+    {
+        uint32_t length;
+        if (buffer_length - offset < sizeof(length))
+            return false;
+        memcpy(&length, buffer + offset, sizeof(length));
+        offset += sizeof(length);
+
+        if (buffer_length - offset < length)
+            return false;
+        items.emplace_back(buffer + offset, buffer + offset + length);
+        offset += length;
+    }
+
+    return true;
+}
+
 // XXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXX
 // CLASS: KeyValueStore
 // XXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXX
@@ -185,3 +219,229 @@ bool KeyValueStore::privileged_get(const ww::types::ByteArray& key, uint32_t& va
     val = *(uint32_t*)_value.data();
     return true;
 }
+
+// XXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXX
+bool KeyValueStore::get_size(const ww::types::ByteArray& key, size_t& size) const
+{
+    ww::types::ByteArray prefixed_key;
+    if (! make_key(key, prefixed_key))
+        return false;
+
+    int result = key_value_get_size(handle_, prefixed_key.data(), prefixed_key.size());
+    if (result < 0)
+        return false;
+
+    size = result;
+    return true;
+}
+
+// XXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXX
+bool KeyValueStore::read_into(
+    const ww::types::ByteArray& key,
+    uint8_t* buffer,
+    size_t size,
+    size_t offset,
+    size_t& copied) const
+{
+    ww::types::ByteArray prefixed_key;
+    if (! make_key(key, prefixed_key))
+        return false;
+
+    int result = key_value_read_into(handle_, prefixed_key.data(), prefixed_key.size(), buffer, size, offset);
+    if (result < 0)
+        return false;
+
+    copied = result;
+    return true;
+}
+
+// XXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXX
+bool KeyValueStore::get_into(const ww::types::ByteArray& key, ww::types::ByteArray& val) const
+{
+    size_t size;
+    if (! get_size(key, size))
+        return false;
+
+    // same as get, a missing key has no value
+    if (size == 0)
+        return false;
+
+    val.resize(size);
+
+    size_t copied;
+    if (! read_into(key, val.data(), size, 0, copied) || copied != size)
+    {
+        val.clear();
+        return false;
+    }
+
+    return true;
+}
+
+// XXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXX
+bool KeyValueStore::get_many(
+    const std::vector<ww::types::ByteArray>& keys,
+    std::vector<ww::types::ByteArray>& vals) const
+{
+    vals.clear();
+    if (keys.size() == 0)
+        return true;
+
+    ww::types::ByteArray packed_keys;
+    ww::types::ByteArray prefixed_key;
+    for (const auto& key : keys)
+    {
+        if (! make_key(key, prefixed_key))
+            return false;
+        pack_byte_array(packed_keys, prefixed_key);
+    }
+
+    uint8_t* datap = NULL;
+    size_t size = 0;
+
+    if (key_value_get_many(handle_, packed_keys.data(), packed_keys.size(), &datap, &size) < 0)
+        return false;
+
+    if (datap == NULL)
+    {
+        CONTRACT_SAFE_LOG(3, "invalid pointer from extension function key_value_get_many");
+        return false;
+    }
+
+    bool valid = unpack_byte_arrays(datap, size, vals) && vals.size() == keys.size();
+    free(datap);
+
+    if (! valid)
+    {
+        CONTRACT_SAFE_LOG(3, "invalid result from extension function key_value_get_many");
+        vals.clear();
+        return false;
+    }
+
+    return true;
+}
+
+// XXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXX
+bool KeyValueStore::set_many(const KeyValueArray& pairs) const
+{
+    ww::types::ByteArray packed_pairs;
+    ww::types::ByteArray prefixed_key;
+    for (const auto& pair : pairs)
+    {
+        if (! make_key(pair.first, prefixed_key))
+            return false;
+        pack_byte_array(packed_pairs, prefixed_key);
+        pack_byte_array(packed_pairs, pair.second);
+    }
+
+    return key_value_set_many(handle_, packed_pairs.data(), packed_pairs.size());
+}
+
+// XXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXX
+bool KeyValueStore::remove_many(const std::vector<ww::types::ByteArray>& keys) const
+{
+    ww::types::ByteArray packed_keys;
+    ww::types::ByteArray prefixed_key;
+    for (const auto& key : keys)
+    {
+        if (! make_key(key, prefixed_key))
+            return false;
+        pack_byte_array(packed_keys, prefixed_key);
+    }
+
+    return key_value_delete_many(handle_, packed_keys.data(), packed_keys.size());
+}
+
+// XXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXX
+bool KeyValueStore::scan(
+    const ww::types::ByteArray& prefix,
+    const ww::types::ByteArray& start,
+    bool inclusive,
+    size_t limit,
+    KeyValueArray& pairs) const
+{
+    pairs.clear();
+
+    ww::types::ByteArray prefixed_prefix;
+    if (! make_key(prefix, prefixed_prefix))
+        return false;
+
+    ww::types::ByteArray prefixed_start;
+    if (! make_key(start, prefixed_start))
+        return false;
+
+    uint8_t* datap = NULL;
+    size_t size = 0;
+
+    int count = key_value_iterate(handle_,
+                                  prefixed_prefix.data(), prefixed_prefix.size(),
+                                  prefixed_start.data(), prefixed_start.size(),
+                                  inclusive, limit, &datap, &size);
+    if (count < 0)
+        return false;
+
+    if (count == 0)
+        return true;
+
+    if (datap == NULL)
+    {
+        CONTRACT_SAFE_LOG(3, "invalid pointer from extension function key_value_iterate");
+        return false;
+    }
+
+    std::vector<ww::types::ByteArray> items;
+    bool valid = unpack_byte_arrays(datap, size, items) && items.size() == 2 * (size_t)count;
+    free(datap);
+
+    if (! valid)
+    {
+        CONTRACT_SAFE_LOG(3, "invalid result from extension function key_value_iterate");
+        return false;
+    }
+
+    // the store prefix is removed from the keys
+    size_t prefix_size = prefixed_prefix.size() - prefix.size();
+    pairs.reserve(count);
+    for (size_t i = 0; i < items.size(); i += 2)
+    {
+        pairs.emplace_back();
+        pairs.back().first.assign(items[i].begin() + prefix_size, items[i].end());
+        pairs.back().second.swap(items[i + 1]);
+    }
+
+    return true;
+}
+
+// XXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXX
+// CLASS: KeyValueIterator
+// XXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXX
+
+// XXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXX
+void KeyValueIterator::seek(const ww::types::ByteArray& key)
+{
+    position_ = key;
+    inclusive_ = true;
+    done_ = false;
+}
+
+// XXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXX
+bool KeyValueIterator::next(size_t limit, KeyValueArray& pairs)
+{
+    pairs.clear();
+    if (done_ || limit == 0)
+        return true;
+
+    if (! store_.scan(prefix_, position_, inclusive_, limit, pairs))
+        return false;
+
+    if (pairs.size() < limit)
+        done_ = true;
+
+    if (pairs.size() > 0)
+    {
+        position_ = pairs.back().first;
+        inclusive_ = false;
+    }
+
+    return true;
+}
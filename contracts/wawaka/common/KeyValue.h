@@ -16,10 +16,14 @@
 #pragma once
 
 #include <stdint.h>
+#include <utility>
 
 // pick up types from pdo common
 #include "Types.h"
 
+// key/value pairs in key order, as returned by a scan
+typedef std::vector<std::pair<ww::types::ByteArray, ww::types::ByteArray>> KeyValueArray;
+
 class KeyValueStore
 {
     size_t handle_;
@@ -104,4 +108,60 @@ public:
 
         return set(bkey, bval);
     };
+
+    // read a value into contract memory with a single copy: get_size
+    // returns 0 for a missing key, read_into copies up to size bytes of
+    // the value from offset on and sets the number of bytes copied
+    bool get_size(const ww::types::ByteArray& key, size_t& size) const;
+    bool read_into(const ww::types::ByteArray& key, uint8_t* buffer, size_t size,
+                   size_t offset, size_t& copied) const;
+    bool get_into(const ww::types::ByteArray& key, ww::types::ByteArray& val) const;
+
+    // batched operations, with one call to the interpreter for all the
+    // keys; get_many returns the values in the order of the keys, with an
+    // empty value for a missing key
+    bool get_many(const std::vector<ww::types::ByteArray>& keys,
+                  std::vector<ww::types::ByteArray>& vals) const;
+    bool set_many(const KeyValueArray& pairs) const;
+    bool remove_many(const std::vector<ww::types::ByteArray>& keys) const;
+
+    // return, in key order, up to limit pairs whose key starts with prefix
+    // and follows start (or is equal to start if inclusive); fewer than
+    // limit pairs means that the scan reached the end
+    bool scan(const ww::types::ByteArray& prefix, const ww::types::ByteArray& start,
+              bool inclusive, size_t limit, KeyValueArray& pairs) const;
+};
+
+// XXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXX
+// KeyValueIterator
+//
+// Iterates over the keys of a store that start with a prefix, in key
+// order and a batch at a time, so that the pairs do not have to be all
+// in contract memory at once.
+// XXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXX
+class KeyValueIterator
+{
+    const KeyValueStore& store_;
+    const ww::types::ByteArray prefix_;
+    ww::types::ByteArray position_;
+    bool inclusive_ = true;
+    bool done_ = false;
+
+public:
+    KeyValueIterator(const KeyValueStore& store, const ww::types::ByteArray& prefix)
+        : store_(store), prefix_(prefix) {};
+    KeyValueIterator(const KeyValueStore& store, const std::string& prefix)
+        : store_(store), prefix_(prefix.begin(), prefix.end()) {};
+
+    // the next batch starts with the first key equal to or after key
+    void seek(const ww::types::ByteArray& key);
+    void seek(const std::string& key)
+    {
+        ww::types::ByteArray bkey(key.begin(), key.end());
+        seek(bkey);
+    };
+
+    // get up to limit pairs that follow the last batch, no pairs once
+    // the iteration is complete; false on failure
+    bool next(size_t limit, KeyValueArray& pairs);
 };
@@ -413,6 +413,55 @@ bool kv_test_get(const Message& msg, const Environment& env, Response& rsp)
     return rsp.value(v, false);
 }
 
+// XXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXX
+// instance reset test
+//
+// The interpreter may run an invocation in an instance that was reset
+// after an earlier invocation rather than in a new one. Every call
+// checks that it sees exactly the state of a fresh instance (initialized
+// and zeroed data, and the same first heap allocation as the first call
+// recorded) and then dirties all of it, so any state that survives a
+// reset makes the next call fail.
+// XXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXX
+const std::string reset_heap_key("reset-heap-address");
+
+static uint32_t reset_initialized = 0x5eed;
+static uint32_t reset_zeroed[1024];
+
+bool instance_reset_test(const Message& msg, const Environment& env, Response& rsp)
+{
+    if (reset_initialized != 0x5eed)
+        return rsp.error("initialized data survived from a previous invocation");
+
+    for (size_t i = 0; i < sizeof(reset_zeroed) / sizeof(reset_zeroed[0]); i++)
+        if (reset_zeroed[i] != 0)
+            return rsp.error("zeroed data survived from a previous invocation");
+
+    // the allocation is deliberately never freed, an instance whose heap
+    // was not reset returns a different address on the next invocation
+    uint8_t* allocation = new uint8_t[256];
+    uint32_t heap_address = (uint32_t)(uintptr_t)allocation;
+
+    uint32_t expected_address;
+    if (meta_store.get(reset_heap_key, expected_address))
+    {
+        if (heap_address != expected_address)
+            return rsp.error("heap state survived from a previous invocation");
+    }
+    else if (! meta_store.set(reset_heap_key, heap_address))
+    {
+        return rsp.error("failed to save the heap address");
+    }
+
+    reset_initialized++;
+    for (size_t i = 0; i < sizeof(reset_zeroed) / sizeof(reset_zeroed[0]); i++)
+        reset_zeroed[i] = i + 1;
+    for (size_t i = 0; i < 256; i++)
+        allocation[i] = (uint8_t)i;
+
+    return rsp.success(true);
+}
+
 // XXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXX
 // kv store test
 // XXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXX
@@ -456,5 +505,6 @@ contract_method_reference_t contract_method_dispatch_table[] = {
     CONTRACT_METHOD(kv_test_set),
     CONTRACT_METHOD(kv_test_get),
     CONTRACT_METHOD(privileged_test_get),
+    CONTRACT_METHOD(instance_reset_test),
     { NULL, NULL }
 };
@@ -19,6 +19,8 @@
  */
 
 #include <string.h>
+#include <algorithm>
+#include <vector>
 
 #include "error.h"
 #include "hex_string.h"
@@ -29,6 +31,14 @@
 
 #include "enclave_t.h"
 
+// The marshalled buffers of an ocall are allocated on the untrusted
+// stack, so batches are split to keep each ocall below this size
+#define BLOCK_STORE_BATCH_MAX_BYTES (1 << 19)
+
+// Initial guess of the size of a block when sizing the buffer for a
+// batched get, a little more than an encrypted 8KB data node
+#define BLOCK_STORE_BLOCK_SIZE_HINT ((1 << 13) + 256)
+
 // XXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXX
 pdo_err_t pdo::block_store::BlockStoreHead(
     const uint8_t* inId,
@@ -82,6 +92,54 @@ pdo_err_t pdo::block_store::BlockStorePut(
     return PDO_SUCCESS;
 }
 
+// XXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXX
+pdo_err_t pdo::block_store::BlockStoreGetMany(
+    const uint8_t* inIds,
+    const size_t inIdsSize,
+    const size_t* inIdSizes,
+    const size_t inCount,
+    uint8_t* outValue,
+    const size_t inValueSize,
+    size_t* outValueSizes,
+    size_t* outFetchedCount
+)
+{
+    pdo_err_t ret;
+    int sgx_ret = ocall_BlockStoreGetMany(&ret, inIds, inIdsSize, inIdSizes, inCount,
+        outValue, inValueSize, outValueSizes, outFetchedCount);
+    pdo::error::ThrowIf<pdo::error::RuntimeError>(
+        sgx_ret != 0, "sgx failed during batched get request on the block store");
+    pdo::error::ThrowIf<pdo::error::RuntimeError>(
+        ret != 0, "batched get request failed on the block store");
+
+    // the counts come from outside the enclave
+    pdo::error::ThrowIf<pdo::error::RuntimeError>(
+        *outFetchedCount > inCount, "invalid response from the block store");
+
+    return PDO_SUCCESS;
+}
+
+// XXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXX
+pdo_err_t pdo::block_store::BlockStorePutMany(
+    const uint8_t* inIds,
+    const size_t inIdsSize,
+    const size_t* inIdSizes,
+    const size_t inCount,
+    const uint8_t* inValue,
+    const size_t inValueSize,
+    const size_t* inValueSizes
+)
+{
+    pdo_err_t ret;
+    int sgx_ret = ocall_BlockStorePutMany(&ret, inIds, inIdsSize, inIdSizes, inCount,
+        inValue, inValueSize, inValueSizes);
+    pdo::error::ThrowIf<pdo::error::RuntimeError>(
+        sgx_ret != 0, "sgx failed during batched put to the block store");
+    pdo::error::ThrowIf<pdo::error::RuntimeError>(ret != 0, "failed to put batch to the block store");
+
+    return PDO_SUCCESS;
+}
+
 // XXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXX
 pdo_err_t pdo::block_store::BlockStoreHead(
     const ByteArray& inId,
@@ -134,3 +192,108 @@ pdo_err_t pdo::block_store::BlockStorePut(
 {
     return (pdo_err_t)BlockStorePut(inId.data(), inId.size(), inValue.data(), inValue.size());
 }
+
+// XXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXX
+pdo_err_t pdo::block_store::BlockStoreGetMany(
+    const std::vector<ByteArray>& inIds,
+    std::vector<ByteArray>& outValues
+)
+{
+    pdo_err_t result = PDO_SUCCESS;
+
+    outValues.resize(inIds.size());
+
+    ByteArray ids;
+    std::vector<size_t> id_sizes;
+    for (auto id = inIds.begin(); id != inIds.end(); id++)
+    {
+        ids.insert(ids.end(), id->begin(), id->end());
+        id_sizes.push_back(id->size());
+    }
+
+    std::vector<size_t> value_sizes(inIds.size());
+    ByteArray buffer;
+
+    size_t next = 0;
+    size_t id_offset = 0;
+    size_t required = 0;
+    while (next < inIds.size())
+    {
+        size_t remaining = inIds.size() - next;
+        size_t capacity = std::min(remaining * BLOCK_STORE_BLOCK_SIZE_HINT, (size_t)BLOCK_STORE_BATCH_MAX_BYTES);
+        capacity = std::max(capacity, required);
+        buffer.resize(capacity);
+
+        size_t fetched = 0;
+        result = BlockStoreGetMany(ids.data() + id_offset, ids.size() - id_offset,
+            &id_sizes[next], remaining, buffer.data(), buffer.size(), &value_sizes[next], &fetched);
+        if (result != PDO_SUCCESS)
+            return result;
+
+        // the next block did not fit, make room for it and try again
+        if (fetched == 0)
+        {
+            pdo::error::ThrowIf<pdo::error::RuntimeError>(
+                value_sizes[next] <= required, "invalid block size from the block store");
+            required = value_sizes[next];
+            continue;
+        }
+
+        size_t value_offset = 0;
+        for (size_t i = next; i < next + fetched; i++)
+        {
+            pdo::error::ThrowIf<pdo::error::RuntimeError>(
+                buffer.size() - value_offset < value_sizes[i], "invalid block size from the block store");
+            outValues[i].assign(buffer.begin() + value_offset, buffer.begin() + value_offset + value_sizes[i]);
+            value_offset += value_sizes[i];
+            id_offset += id_sizes[i];
+        }
+
+        next += fetched;
+        required = 0;
+    }
+
+    return result;
+}
+
+// XXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXX
+pdo_err_t pdo::block_store::BlockStorePutMany(
+    const std::vector<ByteArray>& inIds,
+    const std::vector<ByteArray>& inValues
+)
+{
+    pdo_err_t result = PDO_SUCCESS;
+
+    if (inIds.size() != inValues.size())
+        return PDO_ERR_VALUE;
+
+    size_t next = 0;
+    while (next < inIds.size())
+    {
+        ByteArray ids;
+        ByteArray values;
+        std::vector<size_t> id_sizes;
+        std::vector<size_t> value_sizes;
+
+        // always send at least one block, even a large one
+        size_t i = next;
+        do
+        {
+            ids.insert(ids.end(), inIds[i].begin(), inIds[i].end());
+            id_sizes.push_back(inIds[i].size());
+            values.insert(values.end(), inValues[i].begin(), inValues[i].end());
+            value_sizes.push_back(inValues[i].size());
+            i++;
+        } while (i < inIds.size() &&
+                 ids.size() + values.size() + inIds[i].size() + inValues[i].size() <= BLOCK_STORE_BATCH_MAX_BYTES);
+
+        result = BlockStorePutMany(ids.data(), ids.size(), id_sizes.data(), id_sizes.size(),
+            values.data(), values.size(), value_sizes.data());
+        if (result != PDO_SUCCESS)
+            return result;
+
+        next = i;
+    }
+
+    return result;
+}
@@ -15,6 +15,8 @@
 
 #include "enclave_t.h"
 
+#include <map>
+#include <memory>
 #include <string>
 #include <vector>
 
@@ -36,17 +38,109 @@
 #include "contract_enclave.h"
 #include "contract_worker.h"
 #include "enclave_data.h"
+#include "session_keys.h"
 #include "signup_enclave.h"
 
 #include "contract_request.h"
 #include "contract_response.h"
 #include "contract_secrets.h"
 
-ByteArray last_result;
 ContractWorker *worker = NULL;
 static bool worker_initialized = false;
 static bool shutdown_worker = false;
 
+// XXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXX
+// Responses that did not fit in the buffer provided by the caller are
+// held here until they are retrieved with ecall_GetSerializedResponse.
+// The caller asks for the response immediately after the request and
+// requests to an enclave are serialized, so normally at most one
+// response is waiting; the table is bounded only in case the caller
+// never comes back, and then the oldest response is dropped first
+// XXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXX
+#define PENDING_RESPONSE_TABLE_SIZE 8
+
+typedef struct {
+    ByteArray response;
+    uint64_t created;
+} pending_response_t;
+
+static sgx_thread_mutex_t pending_response_mutex = SGX_THREAD_MUTEX_INITIALIZER;
+static std::map<uint32_t, pending_response_t> pending_responses;
+static uint32_t next_response_identifier = 1;
+static uint64_t pending_response_clock = 0;
+
+class SafePendingResponseLock
+{
+public:
+    SafePendingResponseLock(void) { sgx_thread_mutex_lock(&pending_response_mutex); }
+    ~SafePendingResponseLock(void) { sgx_thread_mutex_unlock(&pending_response_mutex); }
+};
+
+// XXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXX
+static void return_response(
+    const ByteArray& response,
+    uint8_t* outSerializedResponse,
+    size_t inSerializedResponseCapacity,
+    size_t* outSerializedResponseSize,
+    uint32_t* outResponseIdentifier)
+{
+    (*outSerializedResponseSize) = response.size();
+    (*outResponseIdentifier) = 0;
+
+    // the buffer is untrusted memory (user_check in the EDL), only the
+    // bytes of the response are written to it
+    if (response.size() <= inSerializedResponseCapacity)
+    {
+        memcpy_s(outSerializedResponse, inSerializedResponseCapacity, response.data(), response.size());
+        return;
+    }
+
+    // the caller must come back for the response with a larger buffer
+    SafePendingResponseLock lock;
+
+    // identifiers wrap around so the oldest response is found by age
+    while (pending_responses.size() >= PENDING_RESPONSE_TABLE_SIZE)
+    {
+        auto oldest = pending_responses.begin();
+        for (auto pending = pending_responses.begin(); pending != pending_responses.end(); pending++)
+        {
+            if (pending->second.created < oldest->second.created)
+                oldest = pending;
+        }
+
+        SAFE_LOG(PDO_LOG_WARNING, "response %u was never retrieved, dropping it", oldest->first);
+        pending_responses.erase(oldest);
+    }
+
+    // identifier 0 means the response was returned in place
+    if (next_response_identifier == 0)
+        next_response_identifier++;
+
+    (*outResponseIdentifier) = next_response_identifier++;
+
+    pending_response_t& pending = pending_responses[*outResponseIdentifier];
+    pending.response = response;
+    pending.created = pending_response_clock++;
+}
+
+// XXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXX
+// The response buffer is declared user_check so that edger8r does not
+// allocate, clear and copy out the whole capacity on every call; the
+// enclave checks that it really lies outside of the enclave instead
+// XXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXX
+static void check_response_buffer(
+    const uint8_t* outSerializedResponse,
+    size_t inSerializedResponseCapacity)
+{
+    pdo::error::ThrowIf<pdo::error::ValueError>(
+        outSerializedResponse == NULL && inSerializedResponseCapacity > 0,
+        "Serialized response pointer is NULL");
+    pdo::error::ThrowIf<pdo::error::ValueError>(
+        inSerializedResponseCapacity > 0 &&
+        ! sgx_is_outside_enclave(outSerializedResponse, inSerializedResponseCapacity),
+        "Serialized response buffer must be outside the enclave");
+}
+
 // XXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXX
 pdo_err_t ecall_CreateContractWorker(size_t inThreadId) {
     pdo_err_t result = PDO_SUCCESS;
@@ -157,8 +251,9 @@ pdo_err_t ecall_VerifySecrets(const uint8_t* inSealedSignupData,
 
         pdo_err_t presult;
 
-        // Unseal the enclave persistent data
-        EnclaveData enclaveData(inSealedSignupData);
+        // Fetch the unsealed enclave persistent data
+        std::shared_ptr<EnclaveData> enclaveData(
+            GetEnclaveData(inSealedSignupData, inSealedSignupDataSize));
 
         // Create the contract state encryption key
         ByteArray message;
@@ -168,7 +263,7 @@ pdo_err_t ecall_VerifySecrets(const uint8_t* inSealedSignupData,
         ByteArray contractStateEncryptionKey;
 
         presult = CreateEnclaveStateEncryptionKey(
-            enclaveData, contractId, creatorId, secretList, contractStateEncryptionKey, message);
+            *enclaveData, contractId, creatorId, secretList, contractStateEncryptionKey, message);
         if (presult != PDO_SUCCESS)
             return presult;
 
@@ -192,7 +287,7 @@ pdo_err_t ecall_VerifySecrets(const uint8_t* inSealedSignupData,
         std::copy(encrypted_state_encryption_key.begin(), encrypted_state_encryption_key.end(),
             std::back_inserter(message));
 
-        const ByteArray signature = enclaveData.sign_message(message);
+        const ByteArray signature = enclaveData->sign_message(message);
         pdo::error::ThrowIf<pdo::error::ValueError>(
             inEncryptedContractKeySignatureMaxLength < signature.size(),
             "Contract key signature is too short");
@@ -226,7 +321,10 @@ pdo_err_t ecall_HandleContractRequest(
     size_t inEncryptedSessionKeySize,
     const uint8_t* inSerializedRequest,
     size_t inSerializedRequestSize,
-    size_t* outSerializedResponseSize)
+    uint8_t* outSerializedResponse,
+    size_t inSerializedResponseCapacity,
+    size_t* outSerializedResponseSize,
+    uint32_t* outResponseIdentifier)
 {
     pdo_err_t result = PDO_SUCCESS;
 
@@ -236,32 +334,44 @@ pdo_err_t ecall_HandleContractRequest(
         pdo::error::ThrowIfNull(inEncryptedSessionKey, "Session key pointer is NULL");
         pdo::error::ThrowIfNull(inSerializedRequest, "Serialized request pointer is NULL");
         pdo::error::ThrowIfNull(outSerializedResponseSize, "Response size pointer is NULL");
+        pdo::error::ThrowIfNull(outResponseIdentifier, "Response identifier pointer is NULL");
+        check_response_buffer(outSerializedResponse, inSerializedResponseCapacity);
         pdo::error::ThrowIfNull(worker, "worker pointer is NULL");
 
-        // Unseal the enclave persistent data
-        EnclaveData enclaveData(inSealedSignupData);
+        // Fetch the unsealed enclave persistent data
+        std::shared_ptr<EnclaveData> enclaveData(
+            GetEnclaveData(inSealedSignupData, inSealedSignupDataSize));
 
+        // the encrypted key may also be the id of an established session
         ByteArray encrypted_key(
             inEncryptedSessionKey, inEncryptedSessionKey + inEncryptedSessionKeySize);
-        ByteArray session_key = enclaveData.decrypt_message(encrypted_key);
+        ByteArray session_key = GetSessionKey(*enclaveData, encrypted_key);
 
         ByteArray encrypted_request(
             inSerializedRequest, inSerializedRequest + inSerializedRequestSize);
         UpdateStateRequest request(session_key, encrypted_request, worker);
+        if (request.establish_session_)
+            EstablishSession(encrypted_key, session_key);
 
         ContractState contract_state(
             request.state_encryption_key_,
             request.input_state_hash_,
-            request.contract_id_hash_);
+            request.contract_id_hash_,
+            &worker->cache_budget_);
 
         // IN PROGRESS: this is the one change
         request.contract_code_.FetchFromState(contract_state, request.code_hash_);
 
         std::shared_ptr<ContractResponse> response(request.process_request(contract_state));
-        last_result = response->SerializeAndEncrypt(session_key, enclaveData);
-
-        // save the response and return the size of the buffer required for it
-        (*outSerializedResponseSize) = last_result.size();
+        ByteArray serialized_response = response->SerializeAndEncrypt(session_key, *enclaveData);
+
+        // return the response in place if it fits, otherwise hold on to it
+        return_response(
+            serialized_response,
+            outSerializedResponse,
+            inSerializedResponseCapacity,
+            outSerializedResponseSize,
+            outResponseIdentifier);
     }
     catch (pdo::error::Error& e)
     {
@@ -288,7 +398,10 @@ pdo_err_t ecall_InitializeContractState(
     size_t inEncryptedSessionKeySize,
     const uint8_t* inSerializedRequest,
     size_t inSerializedRequestSize,
-    size_t* outSerializedResponseSize)
+    uint8_t* outSerializedResponse,
+    size_t inSerializedResponseCapacity,
+    size_t* outSerializedResponseSize,
+    uint32_t* outResponseIdentifier)
 {
     pdo_err_t result = PDO_SUCCESS;
 
@@ -298,31 +411,43 @@ pdo_err_t ecall_InitializeContractState(
         pdo::error::ThrowIfNull(inEncryptedSessionKey, "Session key pointer is NULL");
         pdo::error::ThrowIfNull(inSerializedRequest, "Serialized request pointer is NULL");
         pdo::error::ThrowIfNull(outSerializedResponseSize, "Response size pointer is NULL");
+        pdo::error::ThrowIfNull(outResponseIdentifier, "Response identifier pointer is NULL");
+        check_response_buffer(outSerializedResponse, inSerializedResponseCapacity);
         pdo::error::ThrowIfNull(worker, "worker pointer is NULL");
 
-        // Unseal the enclave persistent data
-        EnclaveData enclaveData(inSealedSignupData);
+        // Fetch the unsealed enclave persistent data
+        std::shared_ptr<EnclaveData> enclaveData(
+            GetEnclaveData(inSealedSignupData, inSealedSignupDataSize));
 
+        // the encrypted key may also be the id of an established session
         ByteArray encrypted_key(
             inEncryptedSessionKey, inEncryptedSessionKey + inEncryptedSessionKeySize);
-        ByteArray session_key = enclaveData.decrypt_message(encrypted_key);
+        ByteArray session_key = GetSessionKey(*enclaveData, encrypted_key);
 
         ByteArray encrypted_request(
             inSerializedRequest, inSerializedRequest + inSerializedRequestSize);
         InitializeStateRequest request(session_key, encrypted_request, worker);
+        if (request.establish_session_)
+            EstablishSession(encrypted_key, session_key);
 
         ContractState contract_state(
             request.state_encryption_key_,
-            request.contract_id_hash_);
+            request.contract_id_hash_,
+            &worker->cache_budget_);
 
         // IN PROGRESS: this is the one change
         request.contract_code_.SaveToState(contract_state);
 
         std::shared_ptr<ContractResponse> response(request.process_request(contract_state));
-        last_result = response->SerializeAndEncrypt(session_key, enclaveData);
-
-        // save the response and return the size of the buffer required for it
-        (*outSerializedResponseSize) = last_result.size();
+        ByteArray serialized_response = response->SerializeAndEncrypt(session_key, *enclaveData);
+
+        // return the response in place if it fits, otherwise hold on to it
+        return_response(
+            serialized_response,
+            outSerializedResponse,
+            inSerializedResponseCapacity,
+            outSerializedResponseSize,
+            outResponseIdentifier);
     }
     catch (pdo::error::Error& e)
     {
@@ -342,8 +467,8 @@ pdo_err_t ecall_InitializeContractState(
 }
 
 // XXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXX
-pdo_err_t ecall_GetSerializedResponse(const uint8_t* inSealedSignupData,
-    size_t inSealedSignupDataSize,
+pdo_err_t ecall_GetSerializedResponse(
+    uint32_t inResponseIdentifier,
     uint8_t* outSerializedResponse,
     size_t inSerializedResponseSize)
 {
@@ -351,16 +476,23 @@ pdo_err_t ecall_GetSerializedResponse(const uint8_t* inSealedSignupData,
 
     try
     {
-        pdo::error::ThrowIfNull(inSealedSignupData, "Sealed signup data pointer is NULL");
         pdo::error::ThrowIfNull(outSerializedResponse, "Serialized response pointer is NULL");
+
+        SafePendingResponseLock lock;
+
+        auto pending = pending_responses.find(inResponseIdentifier);
+        pdo::error::ThrowIf<pdo::error::ValueError>(
+            inResponseIdentifier == 0, "Unknown response identifier");
         pdo::error::ThrowIf<pdo::error::ValueError>(
-            inSerializedResponseSize < last_result.size(), "Not enough space for the response");
+            pending == pending_responses.end(),
+            "Response is no longer available; it was already retrieved or expired");
 
-        // Unseal the enclave persistent data
-        EnclaveData enclaveData(inSealedSignupData);
+        const ByteArray& response = pending->second.response;
+        pdo::error::ThrowIf<pdo::error::ValueError>(
+            inSerializedResponseSize < response.size(), "Not enough space for the response");
 
-        memcpy_s(outSerializedResponse, inSerializedResponseSize, last_result.data(),
-            last_result.size());
+        memcpy_s(outSerializedResponse, inSerializedResponseSize, response.data(), response.size());
+        pending_responses.erase(pending);
     }
     catch (pdo::error::Error& e)
     {
@@ -378,3 +510,35 @@ pdo_err_t ecall_GetSerializedResponse(const uint8_t* inSealedSignupData,
 
     return result;
 }
+
+// XXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXX
+pdo_err_t ecall_RefreshEnclaveData(
+    const uint8_t* inSealedSignupData,
+    size_t inSealedSignupDataSize)
+{
+    pdo_err_t result = PDO_SUCCESS;
+
+    try
+    {
+        // sessions were established with the old keys
+        ClearSessionTable();
+
+        // a NULL blob simply invalidates the cached keys
+        RefreshEnclaveData(inSealedSignupData, inSealedSignupDataSize);
+    }
+    catch (pdo::error::Error& e)
+    {
+        SAFE_LOG(PDO_LOG_ERROR,
+            "Error in contract enclave (ecall_RefreshEnclaveData): %04X -- %s", e.error_code(),
+            e.what());
+        ocall_SetErrorMessage(e.what());
+        result = e.error_code();
+    }
+    catch (...)
+    {
+        SAFE_LOG(PDO_LOG_ERROR, "Unknown error in contract enclave (ecall_RefreshEnclaveData)");
+        result = PDO_ERR_UNKNOWN;
+    }
+
+    return result;
+}
@@ -44,21 +44,34 @@ extern pdo_err_t ecall_VerifySecrets(const uint8_t* inSealedSignupData,
     size_t* outEncryptedContractKeySignatureActualLength);
 
 // XXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXX
-extern pdo_err_t ecall_InitializeContract(const uint8_t* inSealedSignupData,
+extern pdo_err_t ecall_InitializeContractState(const uint8_t* inSealedSignupData,
     size_t inSealedSignupDataSize,
-    const char* inEncryptedSessionKey,
-    const char* inSerializedRequest,
-    size_t* outSerializedResponseSize);
+    const uint8_t* inEncryptedSessionKey,
+    size_t inEncryptedSessionKeySize,
+    const uint8_t* inSerializedRequest,
+    size_t inSerializedRequestSize,
+    uint8_t* outSerializedResponse,
+    size_t inSerializedResponseCapacity,
+    size_t* outSerializedResponseSize,
+    uint32_t* outResponseIdentifier);
 
 // XXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXX
-extern pdo_err_t ecall_UpdateContract(const uint8_t* inSealedSignupData,
+extern pdo_err_t ecall_HandleContractRequest(const uint8_t* inSealedSignupData,
     size_t inSealedSignupDataSize,
-    const char* inEncryptedSessionKey,
-    const char* inSerializedRequest,
-    size_t* outSerializedResponseSize);
+    const uint8_t* inEncryptedSessionKey,
+    size_t inEncryptedSessionKeySize,
+    const uint8_t* inSerializedRequest,
+    size_t inSerializedRequestSize,
+    uint8_t* outSerializedResponse,
+    size_t inSerializedResponseCapacity,
+    size_t* outSerializedResponseSize,
+    uint32_t* outResponseIdentifier);
 
 // XXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXX
-extern pdo_err_t ecall_GetSerializedResponse(const uint8_t* inSealedSignupData,
-    size_t inSealedSignupDataSize,
-    char* outSerializedResponse,
+extern pdo_err_t ecall_GetSerializedResponse(uint32_t inResponseIdentifier,
+    uint8_t* outSerializedResponse,
     size_t inSerializedResponseSize);
+
+// XXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXX
+extern pdo_err_t ecall_RefreshEnclaveData(const uint8_t* inSealedSignupData,
+    size_t inSealedSignupDataSize);
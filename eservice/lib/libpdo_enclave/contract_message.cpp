@@ -36,7 +36,9 @@ bool ContractMessage::VerifySignature(const ByteArray& signature) const
     // verify the signature in the message came from the originator
     pdo::crypto::sig::PublicKey verifying_key(originator_verifying_key_);
 
-    std::string serialized = expression_ + channel_verifying_key_ + nonce_;
+    // the maintenance operation is only serialized when present so
+    // that signatures of ordinary messages are unchanged
+    std::string serialized = expression_ + channel_verifying_key_ + nonce_ + maintenance_operation_;
     ByteArray message(serialized.begin(), serialized.end());
     return verifying_key.VerifySignature(message, signature) > 0;
 }
@@ -69,6 +71,10 @@ void ContractMessage::Unpack(const JSON_Object* object)
         !pvalue, "invalid request; failed to retrieve Nonce");
     nonce_.assign(pvalue);
 
+    // optional
+    pvalue = json_object_dotget_string(object, "MaintenanceOperation");
+    maintenance_operation_.assign(pvalue ? pvalue : "");
+
     pvalue = json_object_dotget_string(object, "Signature");
     pdo::error::ThrowIf<pdo::error::ValueError>(
         !pvalue, "invalid request; failed to retrieve Signature");
@@ -83,7 +89,7 @@ void ContractMessage::Unpack(const JSON_Object* object)
 // XXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXX
 void ContractMessage::ComputeHash(ByteArray& message_hash) const
 {
-    std::string serialized = expression_ + nonce_;
+    std::string serialized = expression_ + nonce_ + maintenance_operation_;
     ByteArray message(serialized.begin(), serialized.end());
     message_hash = pdo::crypto::ComputeMessageHash(message);
 }
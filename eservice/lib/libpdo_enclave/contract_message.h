@@ -35,6 +35,10 @@ public:
     std::string nonce_;
     ByteArray message_hash_;
 
+    // optional maintenance operation requested instead of invoking the
+    // contract, covered by the signature like the rest of the message
+    std::string maintenance_operation_;
+
     ContractMessage(void){};
     void Unpack(const JSON_Object* object);
 };
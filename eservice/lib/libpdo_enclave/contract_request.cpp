@@ -73,6 +73,9 @@ void ContractRequest::parse_common_properties(const JSON_Object* request_object)
 
     state_encryption_key_ = DecodeAndDecryptStateEncryptionKey(contract_id_, pvalue);
 
+    // optional, a session is only established when the client asks for one
+    establish_session_ = (json_object_dotget_boolean(request_object, "EstablishSession") == 1);
+
     // contract message
     const JSON_Object* ovalue = json_object_dotget_object(request_object, "ContractMessage");
     pdo::error::ThrowIf<pdo::error::ValueError>(
@@ -95,6 +98,25 @@ std::shared_ptr<ContractResponse> UpdateStateRequest::process_request(ContractSt
     // the only reason for the try/catch here is to provide some logging for the error
     try
     {
+        // compaction rewrites the state without changing its content, the
+        // contract code is not involved
+        if (compact_state_)
+        {
+            pdo::error::ThrowIf<pdo::error::ValueError>(
+                contract_message_.originator_verifying_key_ != creator_id_,
+                "state compaction is restricted to the contract creator");
+
+            contract_state.Compact();
+
+            std::map<std::string, std::string> dependencies;
+            return std::make_shared<UpdateStateResponse>(
+                *this,
+                contract_state.input_block_id_,
+                contract_state.output_block_id_,
+                dependencies,
+                "true");
+        }
+
         pdo::contracts::ContractCode code;
         code.Code = contract_code_.code_;
         code.Name = contract_code_.name_;
@@ -221,6 +243,14 @@ UpdateStateRequest::UpdateStateRequest(
     pdo::error::ThrowIf<pdo::error::ValueError>(
         input_state_hash_.size() != SHA256_DIGEST_LENGTH,
         "invalid contract state hash");
+
+    // maintenance operations are part of the signed contract message so
+    // they cannot be added to a message relayed from the creator
+    const std::string& operation = contract_message_.maintenance_operation_;
+    pdo::error::ThrowIf<pdo::error::ValueError>(
+        ! operation.empty() && operation != "compact-state",
+        "invalid request; unknown maintenance operation");
+    compact_state_ = (operation == "compact-state");
 }
 
 // XXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXX
@@ -44,6 +44,10 @@ public:
     ContractCode contract_code_; /*  */
     ContractMessage contract_message_;
 
+    // the client asks to reuse the session key of this request in later
+    // requests, see session_table.h
+    bool establish_session_ = false;
+
     ContractWorker *worker_ = NULL;
 
     ContractRequest(ContractWorker* worker);
@@ -68,6 +72,10 @@ public:
     ByteArray code_hash_ = {};
     ByteArray input_state_hash_ = {};
 
+    // signed maintenance request from the contract creator: the state
+    // is compacted instead of sending the message to the contract
+    bool compact_state_ = false;
+
     UpdateStateRequest(
         const ByteArray& session_key,
         const ByteArray& encrypted_request,
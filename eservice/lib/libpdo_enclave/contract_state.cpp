@@ -58,11 +58,12 @@
 ContractState::ContractState(
     const ByteArray& state_encryption_key,
     const ByteArray& input_block_id,
-    const ByteArray& id_hash)
+    const ByteArray& id_hash,
+    pstate::cache_budget* cache_budget)
     :
     input_block_id_(STATE_BLOCK_ID_LENGTH, 0),
     output_block_id_(STATE_BLOCK_ID_LENGTH, 0),
-    state_(pdo::state::Interpreter_KV(input_block_id, state_encryption_key))
+    state_(pdo::state::Interpreter_KV(input_block_id, state_encryption_key, CACHE_SIZE, cache_budget))
 {
     Unpack(state_encryption_key, input_block_id, id_hash);
 }
@@ -70,11 +71,12 @@ ContractState::ContractState(
 // XXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXX
 ContractState::ContractState(
     const ByteArray& state_encryption_key,
-    const ByteArray& id_hash)
+    const ByteArray& id_hash,
+    pstate::cache_budget* cache_budget)
     :
     input_block_id_(STATE_BLOCK_ID_LENGTH, 0),
     output_block_id_(STATE_BLOCK_ID_LENGTH, 0),
-    state_(pdo::state::Interpreter_KV(state_encryption_key))
+    state_(pdo::state::Interpreter_KV(state_encryption_key, CACHE_SIZE, cache_budget))
 {
     Initialize(state_encryption_key, id_hash);
 }
@@ -85,6 +87,12 @@ void ContractState::Finalize(void)
     state_.Finalize(output_block_id_);
 }
 
+// XXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXX
+void ContractState::Compact(void)
+{
+    state_.Compact(output_block_id_);
+}
+
 // XXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXX
 void ContractState::Unpack(
     const ByteArray& state_encryption_key,
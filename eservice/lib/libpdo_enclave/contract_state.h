@@ -39,13 +39,16 @@ public:
     ContractState(
         const ByteArray& state_encryption_key,
         const ByteArray& input_block_id,
-        const ByteArray& id_hash);
+        const ByteArray& id_hash,
+        pstate::cache_budget* cache_budget = NULL);
 
     ContractState(
         const ByteArray& state_encryption_key,
-        const ByteArray& id_hash);
+        const ByteArray& id_hash,
+        pstate::cache_budget* cache_budget = NULL);
 
     void Finalize(void);
+    void Compact(void);
 
     void Unpack(
         const ByteArray& state_encryption_key,
@@ -28,6 +28,7 @@ ContractWorker::ContractWorker(long thread_id)
 {
     thread_id_ = thread_id;
     current_state_ = INTERPRETER_DONE;
+    cache_budget_.node_cache_ = &node_cache_;
 }
 
 // XXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXX
@@ -21,6 +21,7 @@
 #include "enclave_utils.h"
 
 #include "interpreter/ContractInterpreter.h"
+#include "state.h"
 
 class ContractWorker
 {
@@ -43,6 +44,12 @@ protected:
 public:
 
     long thread_id_;
+
+    // memory for the caches of the states opened by requests on this
+    // worker, and the decrypted data nodes kept across requests
+    pdo::state::cache_budget cache_budget_;
+    pdo::state::data_node_cache node_cache_;
+
     ContractWorker(long thread_id);
     ~ContractWorker(void)
     {
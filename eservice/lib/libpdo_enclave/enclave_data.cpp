@@ -15,9 +15,13 @@
 
 #include "enclave_t.h"
 #include "sgx_tseal.h"
+#include "sgx_thread.h"
 
 #include <stdlib.h>
+#include <string.h>
+#include <memory>
 #include <string>
+#include <utility>
 #include <vector>
 
 #include "crypto.h"
@@ -243,3 +247,65 @@ void EnclaveData::SerializePublicData(void)
 
     serialized_public_data_.assign(&serialized_buffer[0]);
 }
+
+// XXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXX
+// XXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXX
+static sgx_thread_mutex_t enclave_data_cache_mutex = SGX_THREAD_MUTEX_INITIALIZER;
+static std::vector<std::pair<ByteArray, std::shared_ptr<EnclaveData>>> enclave_data_cache;
+
+class SafeEnclaveDataCacheLock
+{
+public:
+    SafeEnclaveDataCacheLock(void) { sgx_thread_mutex_lock(&enclave_data_cache_mutex); }
+    ~SafeEnclaveDataCacheLock(void) { sgx_thread_mutex_unlock(&enclave_data_cache_mutex); }
+};
+
+// XXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXX
+// XXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXX
+std::shared_ptr<EnclaveData> GetEnclaveData(
+    const uint8_t* inSealedData,
+    size_t inSealedDataSize)
+{
+    pdo::error::ThrowIfNull(inSealedData, "Sealed sign up data pointer is NULL");
+
+    SafeEnclaveDataCacheLock lock;
+
+    // a sealed blob is a few kilobytes at most, comparing the bytes
+    // is much cheaper than hashing or unsealing them
+    for (auto entry = enclave_data_cache.begin(); entry != enclave_data_cache.end(); entry++)
+    {
+        const ByteArray& sealed = entry->first;
+        if (sealed.size() == inSealedDataSize &&
+            memcmp(sealed.data(), inSealedData, inSealedDataSize) == 0)
+            return entry->second;
+    }
+
+    std::shared_ptr<EnclaveData> enclave_data = std::make_shared<EnclaveData>(inSealedData);
+
+    // normally an enclave only ever sees one sealed blob, so
+    // dropping the oldest entry is good enough for eviction
+    if (enclave_data_cache.size() >= ENCLAVE_DATA_CACHE_SIZE)
+        enclave_data_cache.erase(enclave_data_cache.begin());
+
+    enclave_data_cache.push_back(
+        std::make_pair(ByteArray(inSealedData, inSealedData + inSealedDataSize), enclave_data));
+
+    return enclave_data;
+}
+
+// XXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXX
+// XXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXX
+void RefreshEnclaveData(
+    const uint8_t* inSealedData,
+    size_t inSealedDataSize)
+{
+    {
+        SafeEnclaveDataCacheLock lock;
+
+        // requests in progress hold their own reference to the data
+        enclave_data_cache.clear();
+    }
+
+    if (inSealedData != NULL && inSealedDataSize > 0)
+        GetEnclaveData(inSealedData, inSealedDataSize);
+}
@@ -19,6 +19,7 @@
 
 #include <stdint.h>
 #include <cassert>
+#include <memory>
 #include <string>
 
 #include "crypto.h"
@@ -122,3 +123,23 @@ public:
         return sdsize;
     };
 };
+
+// XXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXX
+// Unsealing the enclave data and parsing the keys it contains is
+// expensive relative to a small contract invocation. The unsealed data
+// is kept in the enclave, keyed by the sealed blob, so that only the
+// first request for a given blob pays for sgx_unseal_data.
+// XXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXX
+#define ENCLAVE_DATA_CACHE_SIZE 4
+
+// Return the unsealed enclave data for the sealed blob, unsealing and
+// caching it if it has not been seen before
+std::shared_ptr<EnclaveData> GetEnclaveData(
+    const uint8_t* inSealedData,
+    size_t inSealedDataSize);
+
+// Drop all cached enclave data; if a sealed blob is provided it is
+// unsealed and cached again immediately
+void RefreshEnclaveData(
+    const uint8_t* inSealedData,
+    size_t inSealedDataSize);
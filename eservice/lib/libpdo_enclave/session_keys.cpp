@@ -0,0 +1,77 @@
+/* Copyright 2024 Intel Corporation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "enclave_t.h"
+#include "sgx_thread.h"
+
+#include "crypto.h"
+#include "error.h"
+#include "types.h"
+
+#include "enclave_utils.h"
+
+#include "session_keys.h"
+#include "session_table.h"
+
+// XXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXX
+// XXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXX
+static sgx_thread_mutex_t session_table_mutex = SGX_THREAD_MUTEX_INITIALIZER;
+static SessionTable session_table;
+
+class SafeSessionTableLock
+{
+public:
+    SafeSessionTableLock(void) { sgx_thread_mutex_lock(&session_table_mutex); }
+    ~SafeSessionTableLock(void) { sgx_thread_mutex_unlock(&session_table_mutex); }
+};
+
+// XXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXX
+// XXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXX
+ByteArray GetSessionKey(
+    const EnclaveData& enclaveData,
+    const ByteArray& inEncryptedSessionKey)
+{
+    // an RSA encrypted key is always much larger than a session id
+    if (inEncryptedSessionKey.size() == SESSION_ID_SIZE)
+    {
+        SafeSessionTableLock lock;
+        return session_table.Lookup(inEncryptedSessionKey);
+    }
+
+    return enclaveData.decrypt_message(inEncryptedSessionKey);
+}
+
+// XXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXX
+// XXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXX
+void EstablishSession(
+    const ByteArray& inEncryptedSessionKey,
+    const ByteArray& inSessionKey)
+{
+    if (inEncryptedSessionKey.size() == SESSION_ID_SIZE)
+        return;
+
+    ByteArray session_id = pdo::crypto::ComputeMessageHash(inEncryptedSessionKey);
+
+    SafeSessionTableLock lock;
+    session_table.Add(session_id, inSessionKey);
+}
+
+// XXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXX
+// XXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXX
+void ClearSessionTable(void)
+{
+    SafeSessionTableLock lock;
+    session_table.Clear();
+}
@@ -0,0 +1,43 @@
+/* Copyright 2024 Intel Corporation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include "types.h"
+
+#include "enclave_data.h"
+
+// XXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXX
+// The session table of the enclave, shared by the workers; see
+// session_table.h for sessions
+// XXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXX
+
+// Return the session key for the request; inEncryptedSessionKey is
+// either a session key encrypted with the enclave encryption key or the
+// id of an established session. Throws a SessionError if the session is
+// unknown or has expired; this happens before any part of the request
+// is processed.
+ByteArray GetSessionKey(
+    const EnclaveData& enclaveData,
+    const ByteArray& inEncryptedSessionKey);
+
+// Establish a session for a request that asked for one; does nothing
+// if the request already referenced a session by its id
+void EstablishSession(
+    const ByteArray& inEncryptedSessionKey,
+    const ByteArray& inSessionKey);
+
+// Drop all sessions, for example when the enclave keys change
+void ClearSessionTable(void);
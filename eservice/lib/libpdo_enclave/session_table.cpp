@@ -0,0 +1,98 @@
+/* Copyright 2024 Intel Corporation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "error.h"
+#include "types.h"
+#include "zero.h"
+
+#include "session_table.h"
+
+// XXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXX
+// XXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXX
+SessionTable::SessionTable(size_t capacity, uint32_t max_uses, uint64_t max_age) :
+    capacity_(capacity),
+    max_uses_(max_uses),
+    max_age_(max_age)
+{
+}
+
+SessionTable::~SessionTable(void)
+{
+    Clear();
+}
+
+// XXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXX
+void SessionTable::drop_session(std::map<ByteArray, session_entry_t>::iterator session)
+{
+    ZeroV(session->second.session_key);
+    lru_.erase(session->second.lru);
+    sessions_.erase(session);
+}
+
+// XXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXX
+bool SessionTable::is_expired(const session_entry_t& session) const
+{
+    return (session.uses >= max_uses_ || clock_ - session.created >= max_age_);
+}
+
+// XXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXX
+ByteArray SessionTable::Lookup(const ByteArray& inSessionId)
+{
+    clock_++;
+
+    auto session = sessions_.find(inSessionId);
+    pdo::error::ThrowIf<pdo::error::SessionError>(
+        session == sessions_.end(), "unknown session");
+
+    if (is_expired(session->second))
+    {
+        drop_session(session);
+        throw pdo::error::SessionError("session expired");
+    }
+
+    // move the session to the front of the replacement order
+    lru_.splice(lru_.begin(), lru_, session->second.lru);
+    session->second.uses++;
+    return session->second.session_key;
+}
+
+// XXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXX
+void SessionTable::Add(const ByteArray& inSessionId, const ByteArray& inSessionKey)
+{
+    clock_++;
+
+    auto session = sessions_.find(inSessionId);
+    if (session != sessions_.end())
+        drop_session(session);
+
+    // the least recently used session is at the back
+    while (! sessions_.empty() && sessions_.size() >= capacity_)
+        drop_session(sessions_.find(lru_.back()));
+
+    lru_.push_front(inSessionId);
+
+    session_entry_t& entry = sessions_[inSessionId];
+    entry.session_key = inSessionKey;
+    entry.created = clock_;
+    entry.uses = 1;
+    entry.lru = lru_.begin();
+}
+
+// XXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXX
+void SessionTable::Clear(void)
+{
+    while (! sessions_.empty())
+        drop_session(sessions_.begin());
+}
@@ -0,0 +1,101 @@
+/* Copyright 2024 Intel Corporation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <list>
+#include <map>
+
+#include "crypto.h"
+#include "types.h"
+
+// XXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXX
+// Session keys are delivered encrypted with the enclave's RSA key and
+// decrypting them dominates the cost of small invocations. A client may
+// establish a session by asking for one in a request that carries the
+// encrypted session key, and then reference it in later requests by its
+// session id, the SHA256 hash of the encrypted session key, in place of
+// the encrypted key. Requests that do not ask for a session leave the
+// table alone, so they cannot push out the sessions of other clients.
+//
+// The enclave has no trusted clock so sessions expire after a number
+// of uses or after a number of lookups processed by the table; the
+// least recently used session is dropped when the table is full.
+//
+// The table does no locking, see session_keys.h for the table of the
+// enclave.
+// XXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXX
+#define SESSION_ID_SIZE SHA256_DIGEST_LENGTH
+
+#ifndef SESSION_TABLE_SIZE
+#define SESSION_TABLE_SIZE 64
+#endif
+
+#ifndef SESSION_MAX_USES
+#define SESSION_MAX_USES 1024
+#endif
+
+#ifndef SESSION_MAX_AGE
+#define SESSION_MAX_AGE (1 << 16)
+#endif
+
+class SessionTable
+{
+protected:
+    typedef std::list<ByteArray> lru_list_t;
+
+    typedef struct
+    {
+        ByteArray session_key;
+        uint64_t created;
+        uint32_t uses;
+        lru_list_t::iterator lru;
+    } session_entry_t;
+
+    // session ids, the most recently used first
+    lru_list_t lru_;
+    std::map<ByteArray, session_entry_t> sessions_;
+    uint64_t clock_ = 0;
+
+    size_t capacity_;
+    uint32_t max_uses_;
+    uint64_t max_age_;
+
+    void drop_session(std::map<ByteArray, session_entry_t>::iterator session);
+    bool is_expired(const session_entry_t& session) const;
+
+public:
+    SessionTable(
+        size_t capacity = SESSION_TABLE_SIZE,
+        uint32_t max_uses = SESSION_MAX_USES,
+        uint64_t max_age = SESSION_MAX_AGE);
+    ~SessionTable(void);
+
+    // return the key of the session; throws a SessionError if the
+    // session is unknown or has expired
+    ByteArray Lookup(const ByteArray& inSessionId);
+
+    // add a session, or restart it if it exists; the least recently
+    // used session is dropped if the table is full
+    void Add(const ByteArray& inSessionId, const ByteArray& inSessionKey);
+
+    // drop all sessions
+    void Clear(void);
+
+    size_t Size(void) const { return sessions_.size(); }
+};
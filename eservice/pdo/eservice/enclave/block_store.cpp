@@ -26,9 +26,9 @@
 #include "swig_utils.h"
 
 // XXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXX
-void block_store_open(const std::string& db_path)
+void block_store_open(const std::string& db_path, bool sync_on_commit)
 {
-    pdo::lmdb_block_store::BlockStoreOpen(db_path);
+    pdo::lmdb_block_store::BlockStoreOpen(db_path, sync_on_commit);
 }
 
 // XXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXX
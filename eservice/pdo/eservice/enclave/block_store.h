@@ -20,7 +20,7 @@
  *
  * @param db_path       path to the persistent block store database
  */
-void block_store_open(const std::string& db_path);
+void block_store_open(const std::string& db_path, bool sync_on_commit = false);
 
 /**
  * Close the block store - must be called when exiting
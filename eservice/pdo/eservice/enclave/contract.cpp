@@ -86,9 +86,6 @@ std::vector<uint8_t> contract_handle_contract_request(
 {
     pdo_err_t presult;
 
-    uint32_t response_identifier;
-    size_t response_size;
-
 #if PDO_DEBUG_BUILD
     uint64_t start_time = GetTimer();
     uint64_t request_identifier = GetRequestIdentifier();
@@ -97,20 +94,11 @@ std::vector<uint8_t> contract_handle_contract_request(
 
     pdo::enclave_queue::ReadyEnclave readyEnclave = pdo::enclave_api::base::GetReadyEnclave();
 
+    std::vector<uint8_t> response;
     presult = pdo::enclave_api::contract::HandleContractRequest(
         sealed_signup_data,
         encrypted_session_key,
         serialized_request,
-        response_identifier,
-        response_size,
-        readyEnclave.getIndex());
-    ThrowPDOError(presult);
-
-    std::vector<uint8_t> response(response_size);
-    presult = pdo::enclave_api::contract::GetSerializedResponse(
-        sealed_signup_data,
-        response_identifier,
-        response_size,
         response,
         readyEnclave.getIndex());
     ThrowPDOError(presult);
@@ -129,9 +117,6 @@ std::vector<uint8_t> initialize_contract_state(
 {
     pdo_err_t presult;
 
-    uint32_t response_identifier;
-    size_t response_size;
-
 #if PDO_DEBUG_BUILD
     uint64_t start_time = GetTimer();
     uint64_t request_identifier = GetRequestIdentifier();
@@ -140,20 +125,11 @@ std::vector<uint8_t> initialize_contract_state(
 
     pdo::enclave_queue::ReadyEnclave readyEnclave = pdo::enclave_api::base::GetReadyEnclave();
 
+    std::vector<uint8_t> response;
     presult = pdo::enclave_api::contract::InitializeContractState(
         sealed_signup_data,
         encrypted_session_key,
         serialized_request,
-        response_identifier,
-        response_size,
-        readyEnclave.getIndex());
-    ThrowPDOError(presult);
-
-    std::vector<uint8_t> response(response_size);
-    presult = pdo::enclave_api::contract::GetSerializedResponse(
-        sealed_signup_data,
-        response_identifier,
-        response_size,
         response,
         readyEnclave.getIndex());
     ThrowPDOError(presult);
@@ -162,3 +138,12 @@ std::vector<uint8_t> initialize_contract_state(
 
     return response;
 }
+
+// XXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXX
+void contract_refresh_enclave_data(
+    const std::string& sealed_signup_data
+    )
+{
+    pdo_err_t presult = pdo::enclave_api::contract::RefreshEnclaveData(sealed_signup_data);
+    ThrowPDOError(presult);
+}
@@ -44,3 +44,8 @@ std::vector<uint8_t> initialize_contract_state(
     const std::vector<uint8_t>& encryptedSessionKey,
     const std::vector<uint8_t>& serializedRequest
     );
+
+// XXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXX
+void contract_refresh_enclave_data(
+    const std::string& sealedSignupData /* base64 encoded string, empty to invalidate */
+    );
@@ -15,6 +15,10 @@
 
 #include "enclave_u.h"
 
+#include <algorithm>
+#include <atomic>
+#include <string>
+
 #include "pdo_error.h"
 #include "error.h"
 #include "log.h"
@@ -156,57 +160,130 @@ pdo_err_t pdo::enclave_api::contract::VerifySecrets(
 }
 
 // XXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXX
-pdo_err_t pdo::enclave_api::contract::HandleContractRequest(
+// The response buffer passed into the enclave starts at a size that
+// covers most responses and grows to the largest response seen so that
+// the second ecall to retrieve the response is rarely needed
+// XXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXX
+#define RESPONSE_BUFFER_INITIAL_SIZE (16 * 1024)
+#define RESPONSE_BUFFER_MAXIMUM_SIZE (1024 * 1024)
+
+static std::atomic<size_t> g_ResponseBufferSize(RESPONSE_BUFFER_INITIAL_SIZE);
+
+typedef sgx_status_t (*contract_request_ecall_t)(
+    sgx_enclave_id_t,
+    pdo_err_t*,
+    const uint8_t*, size_t,
+    const uint8_t*, size_t,
+    const uint8_t*, size_t,
+    uint8_t*, size_t,
+    size_t*,
+    uint32_t*);
+
+// XXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXX
+static void InvokeContractRequest(
+    contract_request_ecall_t ecall,
+    const char* ecall_name,
     const Base64EncodedString& inSealedEnclaveData,
     const ByteArray& inEncryptedSessionKey,
     const ByteArray& inSerializedRequest,
-    uint32_t& outResponseIdentifier,
-    size_t& outSerializedResponseSize,
+    ByteArray& outSerializedResponse,
     int enclaveIndex
     )
 {
-    pdo_err_t result = PDO_SUCCESS;
-
-    try
+    size_t response_size = 0;
+    uint32_t response_identifier = 0;
+    ByteArray sealed_enclave_data = Base64EncodedStringToByteArray(inSealedEnclaveData);
+
+    outSerializedResponse.resize(g_ResponseBufferSize.load());
+
+    /// get the enclave id for passing into the ecall
+    sgx_enclave_id_t enclaveid = g_Enclave[enclaveIndex].GetEnclaveId();
+    pdo::logger::LogV(PDO_LOG_DEBUG, "%s[%ld] %u ", ecall_name, (long)enclaveid, enclaveIndex);
+
+    pdo_err_t presult = PDO_SUCCESS;
+    sgx_status_t sresult =
+        g_Enclave[enclaveIndex].CallSgx(
+            [
+                ecall,
+                enclaveid,
+                &presult,
+                &sealed_enclave_data,
+                &inEncryptedSessionKey,
+                &inSerializedRequest,
+                &outSerializedResponse,
+                &response_size,
+                &response_identifier
+            ]
+            ()
+            {
+                sgx_status_t sresult_inner = ecall(
+                    enclaveid,
+                    &presult,
+                    sealed_enclave_data.data(),
+                    sealed_enclave_data.size(),
+                    inEncryptedSessionKey.data(),
+                    inEncryptedSessionKey.size(),
+                    inSerializedRequest.data(),
+                    inSerializedRequest.size(),
+                    outSerializedResponse.data(),
+                    outSerializedResponse.size(),
+                    &response_size,
+                    &response_identifier);
+                return pdo::error::ConvertErrorStatus(sresult_inner, presult);
+            }
+            );
+    std::string sgx_message = std::string("SGX enclave call failed (") + ecall_name + ")";
+    pdo::error::ThrowSgxError(sresult, sgx_message.c_str());
+    g_Enclave[enclaveIndex].ThrowPDOError(presult);
+
+    // the response was returned in place
+    if (response_identifier == 0)
     {
-        size_t response_size;
-        ByteArray sealed_enclave_data = Base64EncodedStringToByteArray(inSealedEnclaveData);
+        outSerializedResponse.resize(response_size);
+        return;
+    }
 
-        /// get the enclave id for passing into the ecall
-        sgx_enclave_id_t enclaveid = g_Enclave[enclaveIndex].GetEnclaveId();
-        pdo::logger::LogV(PDO_LOG_DEBUG, "HandleContractRequest[%ld] %u ", (long)enclaveid, enclaveIndex);
+    // grow the buffer for future requests, and fetch this response
+    // with a second call
+    size_t buffer_size = g_ResponseBufferSize.load();
+    while (buffer_size < response_size && buffer_size < RESPONSE_BUFFER_MAXIMUM_SIZE)
+    {
+        size_t new_size = std::min(
+            std::max(response_size, 2 * buffer_size), (size_t)RESPONSE_BUFFER_MAXIMUM_SIZE);
+        if (g_ResponseBufferSize.compare_exchange_weak(buffer_size, new_size))
+            break;
+    }
 
-        pdo_err_t presult = PDO_SUCCESS;
-        sgx_status_t sresult =
-            g_Enclave[enclaveIndex].CallSgx(
-                [
-                    enclaveid,
-                    &presult,
-                    sealed_enclave_data,
-                    inEncryptedSessionKey,
-                    inSerializedRequest,
-                    &response_size
-                ]
-                ()
-                {
-                    sgx_status_t sresult_inner = ecall_HandleContractRequest(
-                        enclaveid,
-                        &presult,
-                        sealed_enclave_data.data(),
-                        sealed_enclave_data.size(),
-                        inEncryptedSessionKey.data(),
-                        inEncryptedSessionKey.size(),
-                        inSerializedRequest.data(),
-                        inSerializedRequest.size(),
-                        &response_size);
-                    return pdo::error::ConvertErrorStatus(sresult_inner, presult);
-                }
-                );
-        pdo::error::ThrowSgxError(sresult, "SGX enclave call failed (InitializeContract)");
-        g_Enclave[enclaveIndex].ThrowPDOError(presult);
+    pdo_err_t gresult = pdo::enclave_api::contract::GetSerializedResponse(
+        response_identifier,
+        response_size,
+        outSerializedResponse,
+        enclaveIndex);
+    pdo::error::ThrowIf<pdo::error::RuntimeError>(
+        gresult != PDO_SUCCESS, pdo::enclave_api::base::GetLastError().c_str());
+}
 
-        outSerializedResponseSize = response_size;
+// XXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXX
+pdo_err_t pdo::enclave_api::contract::HandleContractRequest(
+    const Base64EncodedString& inSealedEnclaveData,
+    const ByteArray& inEncryptedSessionKey,
+    const ByteArray& inSerializedRequest,
+    ByteArray& outSerializedResponse,
+    int enclaveIndex
+    )
+{
+    pdo_err_t result = PDO_SUCCESS;
 
+    try
+    {
+        InvokeContractRequest(
+            ecall_HandleContractRequest,
+            "HandleContractRequest",
+            inSealedEnclaveData,
+            inEncryptedSessionKey,
+            inSerializedRequest,
+            outSerializedResponse,
+            enclaveIndex);
     }
     catch (pdo::error::Error& e)
     {
@@ -232,8 +309,7 @@ pdo_err_t pdo::enclave_api::contract::InitializeContractState(
     const Base64EncodedString& inSealedEnclaveData,
     const ByteArray& inEncryptedSessionKey,
     const ByteArray& inSerializedRequest,
-    uint32_t& outResponseIdentifier,
-    size_t& outSerializedResponseSize,
+    ByteArray& outSerializedResponse,
     int enclaveIndex
     )
 {
@@ -241,44 +317,14 @@ pdo_err_t pdo::enclave_api::contract::InitializeContractState(
 
     try
     {
-        size_t response_size;
-        ByteArray sealed_enclave_data = Base64EncodedStringToByteArray(inSealedEnclaveData);
-
-        /// get the enclave id for passing into the ecall
-        sgx_enclave_id_t enclaveid = g_Enclave[enclaveIndex].GetEnclaveId();
-        pdo::logger::LogV(PDO_LOG_DEBUG, "HandleContractRequest[%ld] %u ", (long)enclaveid, enclaveIndex);
-
-        pdo_err_t presult = PDO_SUCCESS;
-        sgx_status_t sresult =
-            g_Enclave[enclaveIndex].CallSgx(
-                [
-                    enclaveid,
-                    &presult,
-                    sealed_enclave_data,
-                    inEncryptedSessionKey,
-                    inSerializedRequest,
-                    &response_size
-                ]
-                ()
-                {
-                    sgx_status_t sresult_inner = ecall_InitializeContractState(
-                        enclaveid,
-                        &presult,
-                        sealed_enclave_data.data(),
-                        sealed_enclave_data.size(),
-                        inEncryptedSessionKey.data(),
-                        inEncryptedSessionKey.size(),
-                        inSerializedRequest.data(),
-                        inSerializedRequest.size(),
-                        &response_size);
-                    return pdo::error::ConvertErrorStatus(sresult_inner, presult);
-                }
-                );
-        pdo::error::ThrowSgxError(sresult, "SGX enclave call failed (InitializeContract)");
-        g_Enclave[enclaveIndex].ThrowPDOError(presult);
-
-        outSerializedResponseSize = response_size;
-
+        InvokeContractRequest(
+            ecall_InitializeContractState,
+            "InitializeContractState",
+            inSealedEnclaveData,
+            inEncryptedSessionKey,
+            inSerializedRequest,
+            outSerializedResponse,
+            enclaveIndex);
     }
     catch (pdo::error::Error& e)
     {
@@ -301,7 +347,6 @@ pdo_err_t pdo::enclave_api::contract::InitializeContractState(
 
 // XXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXX
 pdo_err_t pdo::enclave_api::contract::GetSerializedResponse(
-    const Base64EncodedString& inSealedEnclaveData,
     const uint32_t inResponseIdentifier,
     const size_t inSerializedResponseSize,
     ByteArray& outSerializedResponse,
@@ -312,12 +357,8 @@ pdo_err_t pdo::enclave_api::contract::GetSerializedResponse(
 
     try
     {
-        ByteArray sealed_enclave_data = Base64EncodedStringToByteArray(inSealedEnclaveData);
-
         outSerializedResponse.resize(inSerializedResponseSize);
 
-        // xxxxx call the enclave
-
         /// get the enclave id for passing into the ecall
         sgx_enclave_id_t enclaveid = g_Enclave[enclaveIndex].GetEnclaveId();
         pdo::logger::LogV(PDO_LOG_DEBUG, "GetSerializedResponse[%ld] %u ", (long)enclaveid, enclaveIndex);
@@ -329,7 +370,7 @@ pdo_err_t pdo::enclave_api::contract::GetSerializedResponse(
                 [
                     enclaveid,
                     &presult,
-                    sealed_enclave_data,
+                    inResponseIdentifier,
                     &outSerializedResponse
                 ]
                 ()
@@ -337,8 +378,7 @@ pdo_err_t pdo::enclave_api::contract::GetSerializedResponse(
                     sgx_status_t sresult_inner = ecall_GetSerializedResponse(
                         enclaveid,
                         &presult,
-                        sealed_enclave_data.data(),
-                        sealed_enclave_data.size(),
+                        inResponseIdentifier,
                         outSerializedResponse.data(),
                         outSerializedResponse.size());
                     return pdo::error::ConvertErrorStatus(sresult_inner, presult);
@@ -365,3 +405,62 @@ pdo_err_t pdo::enclave_api::contract::GetSerializedResponse(
 
     return result;
 }
+
+// XXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXX
+pdo_err_t pdo::enclave_api::contract::RefreshEnclaveData(
+    const Base64EncodedString& inSealedEnclaveData
+    )
+{
+    pdo_err_t result = PDO_SUCCESS;
+
+    try
+    {
+        ByteArray sealed_enclave_data = Base64EncodedStringToByteArray(inSealedEnclaveData);
+
+        for (pdo::enclave_api::Enclave& enc : g_Enclave)
+        {
+            /// get the enclave id for passing into the ecall
+            sgx_enclave_id_t enclaveid = enc.GetEnclaveId();
+            pdo::logger::LogV(PDO_LOG_DEBUG, "RefreshEnclaveData[%ld]", (long)enclaveid);
+
+            pdo_err_t presult = PDO_SUCCESS;
+            sgx_status_t sresult =
+                enc.CallSgx(
+                    [
+                        enclaveid,
+                        &presult,
+                        &sealed_enclave_data
+                    ]
+                    ()
+                    {
+                        // an empty blob is passed as NULL to invalidate the cache
+                        sgx_status_t sresult_inner = ecall_RefreshEnclaveData(
+                            enclaveid,
+                            &presult,
+                            sealed_enclave_data.size() > 0 ? sealed_enclave_data.data() : NULL,
+                            sealed_enclave_data.size());
+                        return pdo::error::ConvertErrorStatus(sresult_inner, presult);
+                    }
+                    );
+            pdo::error::ThrowSgxError(sresult, "SGX enclave call failed (RefreshEnclaveData)");
+            enc.ThrowPDOError(presult);
+        }
+    }
+    catch (pdo::error::Error& e)
+    {
+        pdo::enclave_api::base::SetLastError(e.what());
+        result = e.error_code();
+    }
+    catch (std::exception& e)
+    {
+        pdo::enclave_api::base::SetLastError(e.what());
+        result = PDO_ERR_UNKNOWN;
+    }
+    catch (...)
+    {
+        pdo::enclave_api::base::SetLastError("Unexpected exception");
+        result = PDO_ERR_UNKNOWN;
+    }
+
+    return result;
+}
@@ -50,8 +50,7 @@ namespace pdo
                 const Base64EncodedString& inSealedEnclaveData,
                 const ByteArray& inEncryptedSessionKey,
                 const ByteArray& inSerializedRequest,
-                uint32_t& outResponseIdentifier,
-                size_t& outSerializedResponseSize,
+                ByteArray& outSerializedResponse,
                 int enclaveIndex
                 );
 
@@ -60,20 +59,27 @@ namespace pdo
                 const Base64EncodedString& inSealedEnclaveData,
                 const ByteArray& inEncryptedSessionKey,
                 const ByteArray& inSerializedRequest,
-                uint32_t& outResponseIdentifier,
-                size_t& outSerializedResponseSize,
+                ByteArray& outSerializedResponse,
                 int enclaveIndex
                 );
 
             // XXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXX
+            // only needed when a response did not fit in the buffer
+            // passed to HandleContractRequest or InitializeContractState
             pdo_err_t GetSerializedResponse(
-                const Base64EncodedString& inSealedEnclaveData,
                 const uint32_t inResponseIdentifier,
                 const size_t inSerializedResponseSize,
                 ByteArray& outSerializedResponse,
                 int enclaveIndex
                 );
 
+            // XXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXX
+            // replace the unsealed enclave data cached in every enclave
+            // instance, an empty string only invalidates the caches
+            pdo_err_t RefreshEnclaveData(
+                const Base64EncodedString& inSealedEnclaveData
+                );
+
         } /* contract */
     }     /* enclave_api */
 }         /* pdo */
@@ -15,11 +15,13 @@
 
 #include <stdint.h>
 #include <stdio.h>
+#include <string.h>
 #include <iostream>
 #include <chrono>
 
 #include "log.h"
 #include "packages/block_store/block_store.h"
+#include "packages/block_store/lmdb_block_store.h"
 #include "timer.h"
 
 std::string g_enclaveError;
@@ -67,7 +69,27 @@ extern "C" {
         const size_t inValueSize
         )
     {
-        return pdo::block_store::BlockStoreGet(inKey, inKeySize, outValue, inValueSize);
+        // copy the block from the memory map of the store directly into
+        // the buffer that is marshalled into the enclave
+        try
+        {
+            pdo::lmdb_block_store::ReadTransaction transaction;
+            pdo::lmdb_block_store::BlockView view;
+
+            pdo_err_t result = transaction.Get(inKey, inKeySize, view);
+            if (result != PDO_SUCCESS)
+                return result;
+
+            if (inValueSize < view.size_)
+                return PDO_ERR_VALUE;
+
+            memcpy(outValue, view.data_, view.size_);
+            return PDO_SUCCESS;
+        }
+        catch (...)
+        {
+            return PDO_ERR_SYSTEM;
+        }
     } // ocall_BlockStoreGet
 
     pdo_err_t ocall_BlockStorePut(
@@ -79,4 +101,35 @@ extern "C" {
     {
         return pdo::block_store::BlockStorePut(inKey, inKeySize, inValue, inValueSize);
     } // ocall_BlockStorePut
+
+    pdo_err_t ocall_BlockStoreGetMany(
+        const uint8_t* inKeys,
+        const size_t inKeysSize,
+        const size_t* inKeySizes,
+        const size_t inKeyCount,
+        uint8_t* outValue,
+        const size_t inValueSize,
+        size_t* outValueSizes,
+        size_t* outFetchedCount
+        )
+    {
+        return pdo::block_store::BlockStoreGetMany(
+            inKeys, inKeysSize, inKeySizes, inKeyCount,
+            outValue, inValueSize, outValueSizes, outFetchedCount);
+    } // ocall_BlockStoreGetMany
+
+    pdo_err_t ocall_BlockStorePutMany(
+        const uint8_t* inKeys,
+        const size_t inKeysSize,
+        const size_t* inKeySizes,
+        const size_t inKeyCount,
+        const uint8_t* inValue,
+        const size_t inValueSize,
+        const size_t* inValueSizes
+        )
+    {
+        return pdo::block_store::BlockStorePutMany(
+            inKeys, inKeysSize, inKeySizes, inKeyCount,
+            inValue, inValueSize, inValueSizes);
+    } // ocall_BlockStorePutMany
 } // extern "C"
@@ -58,6 +58,12 @@
     {
         SWIG_exception(SWIG_SystemError, e.what());
     }
+    catch (pdo::error::SessionError& e)
+    {
+        /* raised as LookupError so the service can tell it apart */
+        PyErr_SetString(PyExc_LookupError, e.what());
+        SWIG_fail;
+    }
     catch (pdo::error::UnknownError& e) {
         SWIG_exception(SWIG_UnknownError, e.what());
     }
@@ -76,6 +76,9 @@ void ThrowPDOError(
     case PDO_ERR_SYSTEM_BUSY:
         throw pdo::error::SystemBusyError(message);
 
+    case PDO_ERR_SESSION:
+        throw pdo::error::SessionError(message);
+
     default:
         throw std::runtime_error(message);
     }
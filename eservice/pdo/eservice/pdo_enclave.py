@@ -45,10 +45,12 @@ __all__ = [
     'verify_secrets',
     'initialize_contract_state',
     'send_to_contract',
+    'refresh_enclave_data',
     'shutdown'
 ]
 
 verify_secrets = enclave.contract_verify_secrets
+refresh_enclave_data = enclave.contract_refresh_enclave_data
 get_enclave_public_info = enclave.unseal_enclave_data
 block_store_open = enclave.block_store_open
 block_store_close = enclave.block_store_close
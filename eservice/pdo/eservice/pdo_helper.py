@@ -53,7 +53,8 @@ def initialize_enclave(config) :
         if not os.path.isfile(block_store_file) :
             raise Exception('missing block store file {0}'.format(block_store_file))
 
-        pdo_enclave.block_store_open(block_store_file)
+        sync_on_commit = config['StorageService'].get('SyncOnCommit', False)
+        pdo_enclave.block_store_open(block_store_file, bool(sync_on_commit))
     except KeyError as ke :
         raise Exception('missing block store configuration key {0}'.format(str(ke)))
 
@@ -47,6 +47,11 @@ class InvokeApp(object) :
 
         try :
             result = self.enclave.send_to_contract(encrypted_session_key, encrypted_request)
+        except LookupError as e :
+            # the session id is unknown or expired, nothing was processed
+            # and the client may resend the request with the session key
+            logger.info('session rejected (Invoke); %s', str(e))
+            return ErrorResponse(start_response, 'unknown or expired session', HTTPStatus.GONE)
         except Exception as e :
             logger.error('unknown exception processing request (Invoke); %s', str(e))
             return ErrorResponse(start_response, 'unknown exception processing request')
@@ -0,0 +1,163 @@
+/* Copyright 2024 Intel Corporation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <stdio.h>
+#include <string>
+
+#include "error.h"
+#include "log.h"
+#include "types.h"
+
+#include "session_table.h"
+
+static ByteArray make_id(unsigned int i)
+{
+    std::string id = "session-" + std::to_string(i);
+    id.resize(SESSION_ID_SIZE, '.');
+    return ByteArray(id.begin(), id.end());
+}
+
+static ByteArray make_key(unsigned int i)
+{
+    return ByteArray(16, (uint8_t)i);
+}
+
+// true if the lookup of the session is rejected with a SessionError
+static bool rejected(SessionTable& table, const ByteArray& id)
+{
+    try
+    {
+        table.Lookup(id);
+    }
+    catch (pdo::error::SessionError& e)
+    {
+        return true;
+    }
+    return false;
+}
+
+static void check(bool condition, const char* message)
+{
+    if (! condition)
+    {
+        SAFE_LOG(PDO_LOG_ERROR, "session table test: %s\n", message);
+        throw pdo::error::RuntimeError(message);
+    }
+}
+
+static void test_lookup(void)
+{
+    SessionTable table(4, 16, 1024);
+    for (unsigned int i = 0; i < 4; i++)
+        table.Add(make_id(i), make_key(i));
+
+    for (unsigned int i = 0; i < 4; i++)
+        check(table.Lookup(make_id(i)) == make_key(i), "lookup returned the wrong key");
+    check(rejected(table, make_id(4)), "unknown session accepted");
+
+    // adding a session again restarts it with the new key
+    table.Add(make_id(0), make_key(9));
+    check(table.Size() == 4, "restarted session added twice");
+    check(table.Lookup(make_id(0)) == make_key(9), "restarted session kept the old key");
+}
+
+static void test_expiry(void)
+{
+    // a session expires after its uses
+    {
+        SessionTable table(4, 3, 1024);
+        table.Add(make_id(0), make_key(0));
+        table.Lookup(make_id(0));
+        table.Lookup(make_id(0));
+        check(rejected(table, make_id(0)), "session used too often accepted");
+        check(table.Size() == 0, "expired session not dropped");
+        check(rejected(table, make_id(0)), "dropped session accepted");
+    }
+
+    // and after a number of lookups of any session
+    {
+        SessionTable table(4, 1024, 8);
+        table.Add(make_id(0), make_key(0));
+        table.Add(make_id(1), make_key(1));
+        for (unsigned int i = 0; i < 6; i++)
+            table.Lookup(make_id(1));
+        check(rejected(table, make_id(0)), "old session accepted");
+        table.Add(make_id(2), make_key(2));
+        check(table.Lookup(make_id(2)) == make_key(2), "new session rejected");
+    }
+}
+
+static void test_eviction(void)
+{
+    SessionTable table(4, 1024, 1024);
+    for (unsigned int i = 0; i < 4; i++)
+        table.Add(make_id(i), make_key(i));
+
+    // session 0 is used, so session 1 is the least recently used
+    table.Lookup(make_id(0));
+    table.Add(make_id(4), make_key(4));
+    check(table.Size() == 4, "table grew beyond its capacity");
+    check(rejected(table, make_id(1)), "least recently used session kept");
+    check(table.Lookup(make_id(0)) == make_key(0), "recently used session dropped");
+
+    // sessions are dropped in the order they were last used
+    table.Lookup(make_id(2));
+    table.Add(make_id(5), make_key(5));
+    table.Add(make_id(6), make_key(6));
+    check(rejected(table, make_id(3)), "least recently used session kept");
+    check(rejected(table, make_id(4)), "least recently used session kept");
+    check(table.Lookup(make_id(2)) == make_key(2), "recently used session dropped");
+    check(table.Lookup(make_id(6)) == make_key(6), "new session dropped");
+}
+
+static void test_clear(void)
+{
+    SessionTable table(4, 1024, 1024);
+    for (unsigned int i = 0; i < 4; i++)
+        table.Add(make_id(i), make_key(i));
+
+    table.Clear();
+    check(table.Size() == 0, "sessions left after clear");
+    for (unsigned int i = 0; i < 4; i++)
+        check(rejected(table, make_id(i)), "session accepted after clear");
+
+    // the table is usable after it was cleared
+    table.Add(make_id(0), make_key(0));
+    check(table.Lookup(make_id(0)) == make_key(0), "session lost after clear");
+}
+
+/* Application entry */
+int main(int argc, char* argv[])
+{
+    int ret = -1;
+
+    SAFE_LOG(PDO_LOG_DEBUG, "Test session table: start\n");
+    try
+    {
+        test_lookup();
+        test_expiry();
+        test_eviction();
+        test_clear();
+        SAFE_LOG(PDO_LOG_DEBUG, "Test session table: SUCCESSFUL!\n");
+        ret = 0;
+    }
+    catch(...)
+    {
+        SAFE_LOG(PDO_LOG_ERROR, "Test session table: FAILED\n");
+        ret = -1;
+    }
+
+    return ret;
+}
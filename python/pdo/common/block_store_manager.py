@@ -82,6 +82,9 @@ class BlockStoreManager(object) :
 
     map_size = 1 << 40
 
+    # maximum number of blocks deleted in one write transaction
+    expiration_batch_size = 1024
+
     # --------------------------------------------------
     def __init__(self, block_store_file, create_block_store=False) :
         """Initialize storage service class instance
@@ -94,11 +97,35 @@ class BlockStoreManager(object) :
         self.block_store_env = lmdb.open(
             block_store_file,
             create=create_block_store,
-            max_dbs=2,
+            max_dbs=4,
             subdir=False,
             sync=False,
             map_size=self.map_size)
 
+        # the blocks of a sharded store are spread over several files
+        # that only the native block store routes to
+        self.__check_shard_count__()
+
+        # blocks stored before the expiration index existed are added
+        # to the index by the first garbage collection
+        self.__index_complete__ = False
+
+    # --------------------------------------------------
+    def __check_shard_count__(self) :
+        sdb = self.block_store_env.open_db(b'store_data')
+        with self.block_store_env.begin(db=sdb) as txn :
+            shard_count = txn.get(b'shard_count')
+            previous_shard_count = txn.get(b'previous_shard_count')
+
+        if shard_count is None :
+            return
+
+        shard_count = struct.unpack('<I', shard_count)[0]
+        previous_shard_count = struct.unpack('<I', previous_shard_count)[0] if previous_shard_count else 0
+        if shard_count != 1 or previous_shard_count != 0 :
+            self.block_store_env.close()
+            raise Exception('block store {0} has {1} shards'.format(self.block_store_file, shard_count))
+
     # --------------------------------------------------
     def close(self) :
         """Sync the database to disk and close the handles
@@ -212,6 +239,7 @@ class BlockStoreManager(object) :
 
         mdb = self.block_store_env.open_db(b'meta_data')
         bdb = self.block_store_env.open_db(b'block_data')
+        edb = self.block_store_env.open_db(b'expiration_data')
 
         block_hashes = []
 
@@ -228,9 +256,11 @@ class BlockStoreManager(object) :
                 if raw_metadata :
                     metadata = BlockMetadata.unpack(raw_metadata)
                     if expiration_time > metadata.expiration_time :
+                        txn.delete(expiration_key(metadata.expiration_time, block_hash), db=edb)
                         metadata.expiration_time = expiration_time
                         if not txn.put(block_hash, metadata.pack(), db=mdb, overwrite=True) :
                             raise StorageException("failed to update metadata")
+                        txn.put(expiration_key(expiration_time, block_hash), b'', db=edb)
 
                     continue
 
@@ -247,6 +277,8 @@ class BlockStoreManager(object) :
                 if not txn.put(block_hash, block_data, db=bdb) :
                     raise StorageException("failed to save block data")
 
+                txn.put(expiration_key(expiration_time, block_hash), b'', db=edb)
+
         return block_hashes
 
     # --------------------------------------------------
@@ -288,26 +320,78 @@ class BlockStoreManager(object) :
 
         return block_status_list
 
+    # --------------------------------------------------
+    def __index_unindexed_blocks__(self, mdb, edb) :
+        """Add the blocks that are missing from the expiration index, one
+        bounded write transaction at a time
+        """
+        position = None
+        while True :
+            with self.block_store_env.begin(write=True) as txn :
+                cursor = txn.cursor(db=mdb)
+                found = cursor.set_range(position) if position else cursor.first()
+                entries = []
+                while found and len(entries) < self.expiration_batch_size :
+                    entries.append((cursor.key(), BlockMetadata.unpack(cursor.value()).expiration_time))
+                    found = cursor.next()
+                position = cursor.key() if found else None
+
+                for (block_hash, expiration_time) in entries :
+                    txn.put(expiration_key(expiration_time, block_hash), b'', db=edb)
+
+            if position is None :
+                break
+
+        self.__index_complete__ = True
+
     # --------------------------------------------------
     def expire_blocks(self) :
-        """Delete data and metadata for blocks that have expired
+        """Delete data and metadata for blocks that have expired; expired
+        blocks are found through the expiration index and are deleted in
+        bounded batches, one write transaction per batch
         """
         try :
             mdb = self.block_store_env.open_db(b'meta_data')
             bdb = self.block_store_env.open_db(b'block_data')
+            edb = self.block_store_env.open_db(b'expiration_data')
+
+            if not self.__index_complete__ :
+                self.__index_unindexed_blocks__(mdb, edb)
 
             current_time = int(time.time())
 
             count = 0
-            with self.block_store_env.begin() as txn :
-                cursor = txn.cursor(db=mdb)
-                for key, value in cursor :
-                    metadata = BlockMetadata.unpack(value)
-                    if metadata.expiration_time < current_time :
+            while True :
+                with self.block_store_env.begin(write=True) as txn :
+                    cursor = txn.cursor(db=edb)
+                    keys = []
+                    found = cursor.first()
+                    while found and len(keys) < self.expiration_batch_size :
+                        if expiration_time_from_key(cursor.key()) >= current_time :
+                            break
+                        keys.append(cursor.key())
+                        found = cursor.next()
+
+                    for key in keys :
+                        txn.delete(key, db=edb)
+                        block_hash = key[EXPIRATION_TIME_SIZE:]
+                        raw_metadata = txn.get(block_hash, db=mdb)
+                        if raw_metadata is None :
+                            continue
+
+                        # the entry is stale if the block was extended by
+                        # a writer that does not maintain the index
+                        metadata = BlockMetadata.unpack(raw_metadata)
+                        if metadata.expiration_time != expiration_time_from_key(key) :
+                            txn.put(expiration_key(metadata.expiration_time, block_hash), b'', db=edb)
+                            continue
+
+                        txn.delete(block_hash, db=bdb)
+                        txn.delete(block_hash, db=mdb)
                         count += 1
-                        with self.block_store_env.begin(write=True) as dtxn :
-                            assert dtxn.delete(key, db=bdb)
-                            assert dtxn.delete(key, db=mdb)
+
+                if len(keys) < self.expiration_batch_size :
+                    break
 
             logger.info('expired %d blocks', count)
         except Exception as e :
@@ -317,13 +401,94 @@ class BlockStoreManager(object) :
         return count
 
 # --------------------------------------------------
-def decode_root_block(root_block) :
-    """decode the raw root block and parse the JSON
+# keys of the expiration index are the big-endian expiration time
+# followed by the block id, the same layout is used by the native
+# block store
+EXPIRATION_TIME_SIZE = 8
+
+def expiration_key(expiration_time, block_hash) :
+    return struct.pack('>Q', expiration_time) + bytes(block_hash)
+
+def expiration_time_from_key(key) :
+    return struct.unpack_from('>Q', key, 0)[0]
+
+# --------------------------------------------------
+STATE_ROOT_BLOCK_MAGIC = b'PDOS'
+STATE_INDEX_BLOCK_MAGIC = b'PDOI'
+STATE_FORMAT_VERSION = 2
+STATE_BLOCK_ID_LENGTH = 32
+
+def __decode_block_ids__(block, offset, count) :
+    """decode count raw block ids stored at offset into base64 ids
+    """
+    block_ids = []
+    for i in range(count) :
+        start = offset + i * STATE_BLOCK_ID_LENGTH
+        block_ids.append(base64.b64encode(block[start:start + STATE_BLOCK_ID_LENGTH]).decode('utf8'))
+
+    return block_ids
+
+def __decode_binary_root_block__(root_block, block_store) :
+    """decode a version 2 root block and walk its tree of index blocks
+    """
+    try :
+        (_, version, count, depth, id_count) = struct.unpack_from('<4sIIII', root_block, 0)
+    except struct.error :
+        raise StorageException("invalid root block")
+
+    if version != STATE_FORMAT_VERSION :
+        raise StorageException("unsupported state format version {}".format(version))
+
+    block_ids = __decode_block_ids__(root_block, struct.calcsize('<4sIIII'), id_count)
+    index_block_ids = []
+
+    # the index blocks are read one level at a time, the root holds the
+    # ids of the blocks at level depth-1 and the leaves hold data block ids
+    if depth > 0 and block_store is None :
+        block_store = local_block_manager()
+
+    for level in range(depth - 1, -1, -1) :
+        index_block_ids.extend(block_ids)
+        level_block_ids = []
+        for index_block in block_store.get_blocks(block_ids) :
+            try :
+                (magic, block_level, id_count) = struct.unpack_from('<4sII', index_block, 0)
+            except struct.error :
+                raise StorageException("invalid index block")
+            if magic != STATE_INDEX_BLOCK_MAGIC or block_level != level :
+                raise StorageException("invalid index block")
+            level_block_ids.extend(__decode_block_ids__(index_block, struct.calcsize('<4sII'), id_count))
+        block_ids = level_block_ids
+
+    if len(block_ids) != count :
+        raise StorageException("invalid root block")
+
+    root_data = dict()
+    root_data['Version'] = version
+    root_data['Depth'] = depth
+    root_data['IndexBlockIds'] = index_block_ids
+    root_data['DataBlockIds'] = block_ids
+    root_data['BlockIds'] = index_block_ids + block_ids
+    return root_data
+
+def decode_root_block(root_block, block_store = None) :
+    """decode the raw root block of a state
+
+    version 1 root blocks are a JSON object, version 2 root blocks are binary
+    and reference a tree of index blocks; in both cases the ids of all the
+    blocks of the state are returned in 'BlockIds'
+
+    :param root_block bytes: root block data
+    :param block_store object implementing get_blocks, used to read the index
+    blocks; the local block manager is used if it is not provided
     """
 
     if root_block is None :
         raise StorageException("invalid root block")
 
+    if isinstance(root_block, (bytes, bytearray)) and root_block[:4] == STATE_ROOT_BLOCK_MAGIC :
+        return __decode_binary_root_block__(root_block, block_store)
+
     # backward compatibility with json parser
     try :
         root_block = root_block.decode('utf8')
@@ -355,15 +520,7 @@ def sync_block_store(src_block_store, dst_block_store, root_block_id, root_block
         root_block = src_block_store.get_block(root_block_id)
 
     block_ids = [root_block_id]
-
-    try :
-        root_block = root_block.decode('utf8')
-    except AttributeError :
-        pass
-
-    root_block = root_block.rstrip('\0')
-    root_block_json = json.loads(root_block)
-    block_ids.extend(root_block_json['BlockIds'])
+    block_ids.extend(decode_root_block(root_block, src_block_store)['BlockIds'])
 
     default_minimum_duration = pconfig.shared_configuration(['Replication', 'MinimumDuration'], 5)
     minimum_duration = kwargs.get('minimum_duration', default_minimum_duration)
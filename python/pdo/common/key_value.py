@@ -12,15 +12,14 @@
 # See the License for the specific language governing permissions and
 # limitations under the License.
 
-from array import array
 import hashlib
-import json
 import time
 
 import pdo.common.crypto as pcrypto
 import pdo.common.utility as putils
 import pdo.common.key_value_swig.key_value_swig as kvs
 import pdo.common.config as pconfig
+import pdo.common.block_store_manager as pblocks
 
 import logging
 logger = logging.getLogger(__name__)
@@ -38,7 +37,9 @@ def KeyValueInitialize(block_store_file = None) :
         block_store_file = pconfig.shared_configuration(['StorageService', 'KeyValueStore'], "./keyvalue.mdb")
         kvs.SetLogger(logger)
 
-    kvs.block_store_open(block_store_file)
+    sync_on_commit = pconfig.shared_configuration(['StorageService', 'SyncOnCommit'], False)
+    shard_count = pconfig.shared_configuration(['StorageService', 'ShardCount'], 0)
+    kvs.block_store_open(block_store_file, bool(sync_on_commit), int(shard_count))
     __block_store_initialized__ = True
 
 # -----------------------------------------------------------------
@@ -60,6 +61,68 @@ def KeyValueGetBlock(hash_identity) :
     raw_hash_identity = pcrypto.base64_to_byte_array(hash_identity)
     return kvs.block_store_get(raw_hash_identity)
 
+# -----------------------------------------------------------------
+# -----------------------------------------------------------------
+class __LocalBlockReader__(object) :
+    """read the index blocks of a state from the local block store
+    """
+    def get_blocks(self, block_ids) :
+        for block_id in block_ids :
+            yield kvs.block_store_get(pcrypto.base64_to_byte_array(block_id))
+
+def KeyValueCollectGarbage(live_state_ids = [], batch_size = 1024) :
+    """delete the expired blocks of the local block store; the blocks of
+    the states in live_state_ids are kept and their expiration is extended
+
+    each step of the collection deletes at most batch_size blocks in a
+    single transaction so writers are not held up for long
+
+    :param live_state_ids list of string: base64 encoded root block ids
+    :param batch_size int: maximum number of blocks handled in one transaction
+    :return int: number of blocks deleted
+    """
+    live_tag = 0
+    if live_state_ids :
+        live_tag = int(time.time())
+        reader = __LocalBlockReader__()
+        for state_id in live_state_ids :
+            root_block = KeyValueGetBlock(state_id)
+            block_ids = [state_id] + pblocks.decode_root_block(root_block, reader)['BlockIds']
+            for i in range(0, len(block_ids), batch_size) :
+                kvs.block_store_tag_blocks(block_ids[i:i+batch_size], live_tag)
+
+    count = 0
+    while True :
+        result = kvs.block_store_expire_blocks(batch_size, live_tag)
+        count += result['expired_blocks']
+        if result['complete'] :
+            break
+
+    logger.info('expired %d blocks', count)
+    return count
+
+# -----------------------------------------------------------------
+# -----------------------------------------------------------------
+def KeyValueReshard(shard_count, batch_size = 1024) :
+    """spread the blocks of the local block store over shard_count
+    shards; blocks remain readable and writable while they are moved
+
+    :param shard_count int: number of shards
+    :param batch_size int: maximum number of blocks examined in one step
+    :return int: number of blocks moved
+    """
+    kvs.block_store_reshard(shard_count)
+
+    count = 0
+    while True :
+        result = kvs.block_store_rebalance(batch_size)
+        count += result['moved_blocks']
+        if result['complete'] :
+            break
+
+    logger.info('moved %d blocks to %d shards', count, shard_count)
+    return count
+
 # -----------------------------------------------------------------
 # -----------------------------------------------------------------
 class KeyValueStore(object) :
@@ -178,10 +241,7 @@ class KeyValueStore(object) :
 
         block_hash = self.input_encoding_conversion[input_encoding](block_id)
 
-        raw_block_data = kvs.block_store_get(block_hash)
-        block_data = array('B', raw_block_data).tobytes()
-
-        return block_data
+        return kvs.block_store_get(block_hash)
 
     # -----------------------------------------------------------------
     def __get_block_iterator__(self, block_ids, input_encoding='b64') :
@@ -198,6 +258,16 @@ class KeyValueStore(object) :
                 raise Exception('unable to locate required block; {}'.format(block_id))
             yield block_data
 
+    # -----------------------------------------------------------------
+    def get_blocks(self, block_ids) :
+        """Return the data for blocks given a list of base64 encoded block
+        identifiers, used to read the index blocks of a state
+
+        :param block_ids list of string: block identifiers
+        :return iterable: block data
+        """
+        return self.__get_block_iterator__(block_ids)
+
     # -----------------------------------------------------------------
     def __store_block__(self, block_data, duration=60, input_encoding='str') :
         """
@@ -226,15 +296,8 @@ class KeyValueStore(object) :
             logger.exception('failed to get root block from local kv store')
             raise
 
-        try :
-            root_block = root_block.decode('utf8')
-        except AttributeError :
-            pass
-
-        root_block = root_block.rstrip('\0')
-        root_block_json = json.loads(root_block)
-
-        block_ids = [self.hash_identity] + root_block_json['BlockIds']
+        root_block_data = pblocks.decode_root_block(root_block, self)
+        block_ids = [self.hash_identity] + root_block_data['BlockIds']
 
         # check to see which blocks need to be pushed
         blocks_to_extend = []
@@ -283,14 +346,8 @@ class KeyValueStore(object) :
             logger.exception('failed to get root block from remote kv store')
             raise
 
-        try :
-            root_block = root_block.decode('utf8')
-        except AttributeError :
-            pass
-
-        root_block = root_block.rstrip('\0')
-        root_block_json = json.loads(root_block)
-        block_ids = [root_block_id] + root_block_json['BlockIds']
+        root_block_data = pblocks.decode_root_block(root_block, src_block_store)
+        block_ids = [root_block_id] + root_block_data['BlockIds']
 
         # check to see which blocks need to be pushed
         blocks_to_extend = []
@@ -14,6 +14,7 @@
  */
 
 #include <stdlib.h>
+#include <time.h>
 #include <string>
 #include <vector>
 #include <map>
@@ -27,9 +28,9 @@
 #include "block_store.h"
 
 // XXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXX
-void block_store_open(const std::string& db_path)
+void block_store_open(const std::string& db_path, bool sync_on_commit, unsigned int shard_count)
 {
-    pdo::lmdb_block_store::BlockStoreOpen(db_path);
+    pdo::lmdb_block_store::BlockStoreOpen(db_path, sync_on_commit, shard_count);
 }
 
 // XXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXX
@@ -39,10 +40,12 @@ void block_store_close()
 }
 
 // XXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXX
-std::vector<uint8_t> block_store_get(const std::vector<uint8_t>& block_id)
+BlockStoreData block_store_get(const std::vector<uint8_t>& block_id)
 {
-    std::vector<uint8_t> block_data;
-    pdo_err_t status = pdo::block_store::BlockStoreGet(block_id, block_data);
+    BlockStoreData block_data;
+    block_data.transaction_.reset(new pdo::lmdb_block_store::ReadTransaction());
+
+    pdo_err_t status = block_data.transaction_->Get(block_id, block_data.view_);
     pdo::error::ThrowIf<pdo::error::IndexError>(status != PDO_SUCCESS, "failed to fetch block");
 
     return block_data;
@@ -75,3 +78,63 @@ std::map<std::string, metadata_value_type_t> block_store_head(const std::vector<
 
     return result;
 }
+
+// XXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXX
+std::map<std::string, metadata_value_type_t> block_store_expire_blocks(
+    metadata_value_type_t batch_size,
+    metadata_value_type_t live_tag)
+{
+    size_t expired_count;
+    bool complete;
+
+    pdo_err_t status = pdo::lmdb_block_store::BlockStoreExpireBlocks(
+        time(NULL), batch_size, live_tag, &expired_count, &complete);
+    pdo::error::ThrowIf<pdo::error::SystemError>(status != PDO_SUCCESS, "failed to expire blocks");
+
+    std::map<std::string, metadata_value_type_t> result;
+
+    result["expired_blocks"] = expired_count;
+    result["complete"] = complete ? 1 : 0;
+
+    return result;
+}
+
+// XXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXX
+metadata_value_type_t block_store_tag_blocks(
+    const std::vector<std::string>& block_ids,
+    metadata_value_type_t tag)
+{
+    std::vector<ByteArray> ids;
+    for (size_t i = 0; i < block_ids.size(); i++)
+        ids.push_back(Base64EncodedStringToByteArray(block_ids[i]));
+
+    size_t tagged_count;
+    pdo_err_t status = pdo::lmdb_block_store::BlockStoreTagBlocks(ids, tag, &tagged_count);
+    pdo::error::ThrowIf<pdo::error::SystemError>(status != PDO_SUCCESS, "failed to tag blocks");
+
+    return tagged_count;
+}
+
+// XXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXX
+void block_store_reshard(unsigned int shard_count)
+{
+    pdo::lmdb_block_store::BlockStoreReshard(shard_count);
+}
+
+// XXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXX
+std::map<std::string, metadata_value_type_t> block_store_rebalance(
+    metadata_value_type_t batch_size)
+{
+    size_t moved_count;
+    bool complete;
+
+    pdo_err_t status = pdo::lmdb_block_store::BlockStoreRebalance(batch_size, &moved_count, &complete);
+    pdo::error::ThrowIf<pdo::error::SystemError>(status != PDO_SUCCESS, "failed to rebalance blocks");
+
+    std::map<std::string, metadata_value_type_t> result;
+
+    result["moved_blocks"] = moved_count;
+    result["complete"] = complete ? 1 : 0;
+
+    return result;
+}
@@ -22,8 +22,9 @@
  * Initialize the block store - must be called before performing gets/puts
  *
  * @param db_path       path to the persistent block store database
+ * @param shard_count   number of shards, 0 keeps the current number
  */
-void block_store_open(const std::string& db_path);
+void block_store_open(const std::string& db_path, bool sync_on_commit = false, unsigned int shard_count = 0);
 
 /**
  * Close the block store - must be called when exiting
@@ -38,6 +39,41 @@ void block_store_close();
 // processing uint64_t. this is a known problem with SWIG
 typedef unsigned long int metadata_value_type_t;
 
-std::vector<uint8_t> block_store_get(const std::vector<uint8_t>& block_id);
+// A block borrowed from the memory map of the block store; the read
+// transaction is held until the block has been converted to a python
+// bytes object, so the block is copied once
+#ifndef SWIG
+#include <memory>
+#include "packages/block_store/lmdb_block_store.h"
+
+class BlockStoreData
+{
+public:
+    std::shared_ptr<pdo::lmdb_block_store::ReadTransaction> transaction_;
+    pdo::lmdb_block_store::BlockView view_;
+};
+#else
+class BlockStoreData;
+#endif
+
+BlockStoreData block_store_get(const std::vector<uint8_t>& block_id);
 void block_store_put(const std::vector<uint8_t>& block_id, const std::vector<uint8_t>& block_data);
 std::map<std::string,metadata_value_type_t> block_store_head(const std::vector<uint8_t>& block_id);
+
+/**
+ * Garbage collection, see BlockStoreExpireBlocks and BlockStoreTagBlocks;
+ * block ids are base64 encoded
+ */
+std::map<std::string,metadata_value_type_t> block_store_expire_blocks(
+    metadata_value_type_t batch_size,
+    metadata_value_type_t live_tag = 0);
+metadata_value_type_t block_store_tag_blocks(
+    const std::vector<std::string>& block_ids,
+    metadata_value_type_t tag);
+
+/**
+ * Sharding, see BlockStoreReshard and BlockStoreRebalance
+ */
+void block_store_reshard(unsigned int shard_count);
+std::map<std::string,metadata_value_type_t> block_store_rebalance(
+    metadata_value_type_t batch_size);
@@ -74,6 +74,12 @@
     $result = PyByteArray_FromStringAndSize((const char*)$1.data.data(),$1.data.size());
 }
 
+/* Copy a block from the block store into a python bytes object */
+%typemap(out) BlockStoreData {
+    const BlockStoreData* block_data = &$1;
+    $result = PyBytes_FromStringAndSize((const char*)block_data->view_.data_, block_data->view_.size_);
+}
+
 %include "std_string.i"
 %include "std_vector.i"
 %include "std_map.i"
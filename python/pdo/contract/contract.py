@@ -185,6 +185,22 @@ class Contract(object) :
             enclave_service=enclave_service,
             invocation_request = expression)
 
+    # -------------------------------------------------------
+    def create_compact_request(self, request_originator_keys, enclave_service='random') :
+        """create a request to compact the state of the contract, the
+        contract is not invoked; only the creator of the contract can
+        send this request
+
+        :param request_originator_keys: object of type ServiceKeys
+        :param enclave_service: object that implements the enclave service interface
+        """
+        return UpdateStateRequest(
+            'update',
+            request_originator_keys,
+            self,
+            enclave_service=enclave_service,
+            maintenance_operation = 'compact-state')
+
     # -------------------------------------------------------
     def save_to_file(self, basename, data_dir = None) :
         serialized = dict()
@@ -47,6 +47,10 @@ class ContractMessage(object) :
 
         self.nonce = crypto.byte_array_to_hex(crypto.random_bit_string(16))
 
+        # operation the enclave performs instead of invoking the contract,
+        # it is signed along with the rest of the message
+        self.maintenance_operation = kwargs.get('maintenance_operation', '')
+
     # -------------------------------------------------------
     @property
     @deprecated
@@ -59,11 +63,11 @@ class ContractMessage(object) :
         return self.__request_originator_keys.identity
 
     def serialize_for_signing(self) :
-        return self.invocation_request + self.channel_id + self.nonce
+        return self.invocation_request + self.channel_id + self.nonce + self.maintenance_operation
 
     # -------------------------------------------------------
     def serialize_for_hash(self) :
-        return self.invocation_request + self.nonce
+        return self.invocation_request + self.nonce + self.maintenance_operation
 
     # -------------------------------------------------------
     @property
@@ -81,6 +85,8 @@ class ContractMessage(object) :
         result['OriginatorVerifyingKey'] = self.originator_verifying_key
         result['ChannelVerifyingKey'] = self.channel_id
         result['Nonce'] = self.nonce
+        if self.maintenance_operation :
+            result['MaintenanceOperation'] = self.maintenance_operation
         result['Signature'] = self.signature
 
         return result
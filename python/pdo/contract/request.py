@@ -23,6 +23,7 @@ from pdo.contract.message import ContractMessage
 from pdo.contract.response import ContractResponse, UpdateStateResponse, InitializeStateResponse
 from pdo.contract.state import ContractState
 from pdo.submitter.create import create_submitter
+from pdo.service_client.enclave import SessionException
 from pdo.service_client.service_data.service_data import ServiceDatabaseManager as service_data
 
 import logging
@@ -45,12 +46,30 @@ class ContractRequest(object) :
     # request_number. the converse is not true (if the request failed)
     __request_number__ = 0
 
+    # session keys established with each enclave service, keyed by
+    # enclave id; a session lets the enclave skip decrypting the session
+    # key with its private key, see enable_sessions
+    __sessions__ = {}
+    __use_sessions__ = False
+
     # -------------------------------------------------------
     @classmethod
     def get_request_number(cls) :
         cls.__request_number__ += 1
         return cls.__request_number__
 
+    # -------------------------------------------------------
+    @classmethod
+    def enable_sessions(cls, enable = True) :
+        """reuse the session key for requests to the same enclave service,
+        later requests reference the session by its id rather than carry
+        the encrypted session key; individual requests may override this
+        with the use_session keyword
+        """
+        cls.__use_sessions__ = enable
+        if not enable :
+            cls.__sessions__ = {}
+
     # -------------------------------------------------------
     def __init__(self, request_originator_keys, contract, **kwargs) :
         self.contract_id = contract.contract_id
@@ -67,7 +86,14 @@ class ContractRequest(object) :
         self.encrypted_state_encryption_key = contract.get_state_encryption_key(self.enclave_service.enclave_id)
         self.originator_keys = request_originator_keys
         self.make_channel_keys()
-        self.session_key = crypto.SKENC_GenerateKey()
+
+        self.use_session = kwargs.get('use_session', ContractRequest.__use_sessions__)
+        self.session_id = None
+        session = ContractRequest.__sessions__.get(self.enclave_service.enclave_id) if self.use_session else None
+        if session :
+            (self.session_key, self.session_id) = session
+        else :
+            self.session_key = crypto.SKENC_GenerateKey()
 
         self.replication_params = contract.replication_params
         self.request_number = ContractRequest.get_request_number()
@@ -88,6 +114,51 @@ class ContractRequest(object) :
     def enclave_keys(self) :
         return self.enclave_service.enclave_keys
 
+    # -------------------------------------------------------
+    def __encrypt_session_key__(self) :
+        """return the session id of an established session or the session
+        key encrypted for the enclave; the latter establishes a session
+        when sessions are in use
+        """
+        if self.session_id :
+            return self.session_id
+
+        encrypted_key = bytes(self.enclave_keys.encrypt(self.session_key))
+        if self.use_session :
+            # the enclave identifies the session by the hash of the encrypted key
+            session_id = bytes(crypto.compute_message_hash(encrypted_key))
+            ContractRequest.__sessions__[self.enclave_service.enclave_id] = (self.session_key, session_id)
+
+        return encrypted_key
+
+    # -------------------------------------------------------
+    def _serialize_session_(self, result) :
+        """ask the enclave to keep the session key; the enclave only adds
+        sessions that are asked for, and ignores the request when the
+        session id is sent, the same request may be resent with a new
+        encrypted session key if the session was rejected
+        """
+        if self.use_session :
+            result['EstablishSession'] = True
+
+    # -------------------------------------------------------
+    def _send_request_(self, send, encrypted_request) :
+        """send the request, re-establishing the session if the enclave
+        no longer knows it (the enclave was restarted or the session expired);
+        the enclave rejects an unknown session before it processes any part
+        of the request so only that error is safe to retry
+        """
+        try :
+            return send(self.__encrypt_session_key__(), encrypted_request)
+        except SessionException as e :
+            if not self.session_id :
+                raise
+
+            logger.info('session request failed, retry with a new session; %s', str(e))
+            ContractRequest.__sessions__.pop(self.enclave_service.enclave_id, None)
+            self.session_id = None
+            return send(self.__encrypt_session_key__(), encrypted_request)
+
 # -----------------------------------------------------------------
 # -----------------------------------------------------------------
 class UpdateStateRequest(ContractRequest) :
@@ -114,6 +185,7 @@ class UpdateStateRequest(ContractRequest) :
         result['ContractStateHash'] = self.contract_state.get_state_hash(encoding='b64')
 
         result['ContractMessage'] = self.message.serialize()
+        self._serialize_session_(result)
 
         return json.dumps(result)
 
@@ -128,11 +200,10 @@ class UpdateStateRequest(ContractRequest) :
         # Encrypt the request
         serialized_byte_array = crypto.string_to_byte_array(self.__serialize_for_encryption())
         encrypted_request = bytes(crypto.SKENC_EncryptMessage(self.session_key, serialized_byte_array))
-        encrypted_key = bytes(self.enclave_keys.encrypt(self.session_key))
 
         try :
             self.contract_state.push_state_to_eservice(self.enclave_service)
-            encrypted_response = self.enclave_service.send_to_contract(encrypted_key, encrypted_request)
+            encrypted_response = self._send_request_(self.enclave_service.send_to_contract, encrypted_request)
 
         except Exception as e:
             logger.warning('contract invocation failed; %s', str(e))
@@ -200,6 +271,7 @@ class InitializeStateRequest(ContractRequest) :
 
         result['ContractMessage'] = self.message.serialize()
         result['ContractCode'] = self.contract_code.serialize()
+        self._serialize_session_(result)
 
         return json.dumps(result)
 
@@ -214,10 +286,9 @@ class InitializeStateRequest(ContractRequest) :
         # Encrypt the request
         serialized_byte_array = crypto.string_to_byte_array(self.__serialize_for_encryption())
         encrypted_request = bytes(crypto.SKENC_EncryptMessage(self.session_key, serialized_byte_array))
-        encrypted_key = bytes(self.enclave_keys.encrypt(self.session_key))
 
         try :
-            encrypted_response = self.enclave_service.initialize_contract_state(encrypted_key, encrypted_request)
+            encrypted_response = self._send_request_(self.enclave_service.initialize_contract_state, encrypted_request)
 
         except Exception as e:
             logger.warning('contract invocation failed; %s', str(e))
@@ -124,14 +124,30 @@ class ContractState(object) :
     def update_state(self, raw_state) :
         """update state information from the root block
 
-        :param raw_state string: root block of contract state, json string
+        :param raw_state bytes: root block of contract state
         """
         self.raw_state = raw_state
-        self.component_block_ids = []
+        self.__component_block_ids__ = None
 
-        if self.raw_state :
-            json_main_state_block = pblocks.decode_root_block(self.raw_state)
-            self.component_block_ids = json_main_state_block['BlockIds']
+    # --------------------------------------------------
+    @property
+    def component_block_ids(self) :
+        """ids of all the blocks of the state
+
+        the index blocks of a large state are read from the local block
+        store, so the state must be pulled before the ids are used
+        """
+        if self.__component_block_ids__ is None :
+            self.__component_block_ids__ = []
+            if self.raw_state :
+                main_state_block = pblocks.decode_root_block(self.raw_state)
+                self.__component_block_ids__ = main_state_block['BlockIds']
+
+        return self.__component_block_ids__
+
+    @component_block_ids.setter
+    def component_block_ids(self, block_ids) :
+        self.__component_block_ids__ = block_ids
 
     # --------------------------------------------------
     def compute_new_block_ids(self, old_block_ids):
@@ -14,6 +14,7 @@
 
 import json
 import requests
+from http import HTTPStatus
 import base64
 import time
 
@@ -34,6 +35,14 @@ class EnclaveException(Exception) :
     """
     pass
 
+class SessionException(MessageException) :
+    """
+    The enclave did not recognize the session id in the request, the
+    session expired or the enclave restarted; the request was not
+    processed and may be resent with the encrypted session key
+    """
+    pass
+
 class RetryException(Exception) :
     """
     A class for exceptions in the enclave service that
@@ -130,6 +139,10 @@ class EnclaveServiceClient(GenericServiceClient) :
             raise MessageException(str(e)) from e
 
         except requests.HTTPError as e :
+            if e.response is not None and e.response.status_code == HTTPStatus.GONE :
+                logger.info('[%d] session rejected by the enclave (invoke)', request_identifier)
+                raise SessionException(str(e)) from e
+
             logger.warning('[%d] network error connecting to service (invoke); %s', request_identifier, str(e))
             raise MessageException(str(e)) from e
 
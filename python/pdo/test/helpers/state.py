@@ -14,6 +14,7 @@
 
 import os
 import json
+import struct
 import pdo.common.crypto as crypto
 import pdo.common.block_store_manager as pblocks
 
@@ -27,6 +28,25 @@ def TamperWithStateBlockOrder(state_object) :
     if len(state_object.component_block_ids) < 2 :
         raise Exception('cannot tamper with state block order')
 
+    raw_state = state_object.raw_state
+    if raw_state[:4] == pblocks.STATE_ROOT_BLOCK_MAGIC :
+        # binary root block, swap the first two ids it holds
+        decoded_state = state_object.decode_state()
+        root_ids = decoded_state['IndexBlockIds'] if decoded_state['Depth'] > 0 else decoded_state['DataBlockIds']
+        if len(root_ids) < 2 :
+            raise Exception('cannot tamper with state block order')
+
+        offset = struct.calcsize('<4sIIII')
+        length = pblocks.STATE_BLOCK_ID_LENGTH
+        first_id = raw_state[offset:offset + length]
+        second_id = raw_state[offset + length:offset + 2 * length]
+        raw_state = raw_state[:offset] + second_id + first_id + raw_state[offset + 2 * length:]
+
+        #re-store the tampered main state block
+        state_object.update_state(raw_state)
+        pblocks.local_block_manager().store_blocks([state_object.raw_state])
+        return
+
     block_ids = state_object.component_block_ids
 
     temp_id = block_ids[0]